@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#include <dxgi1_6.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What an application needs and prefers in an adapter.
+struct AdapterPolicy
+{
+	// Order adapters are enumerated in. HIGH_PERFORMANCE ranks by dedicated
+	// memory first; MINIMUM_POWER keeps the order DXGI gives (integrated
+	// GPUs first).
+	DXGI_GPU_PREFERENCE Preference = DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE;
+
+	// == Requirements ==
+	D3D_FEATURE_LEVEL MinFeatureLevel = D3D_FEATURE_LEVEL_11_0;
+	D3D_SHADER_MODEL MinShaderModel = D3D_SHADER_MODEL_5_1;
+	D3D12_RESOURCE_BINDING_TIER MinResourceBindingTier = D3D12_RESOURCE_BINDING_TIER_1;
+	D3D12_RAYTRACING_TIER MinRaytracingTier = D3D12_RAYTRACING_TIER_NOT_SUPPORTED;
+	D3D12_MESH_SHADER_TIER MinMeshShaderTier = D3D12_MESH_SHADER_TIER_NOT_SUPPORTED;
+
+	// WARP (or another software adapter) when no hardware adapter qualifies.
+	bool AllowSoftware = true;
+
+	// From the application's config: "warp", "#<index>" (in enumeration
+	// order) or part of the adapter's description, e.g. "Intel". A usable
+	// match wins over the score; anything else is logged and ignored.
+	std::wstring Override;
+};
+
+// An adapter and what it supports. Enumerate() fills these from DXGI; tests
+// describe fake adapters with AddCandidate() and leave Adapter and Device
+// null.
+struct AdapterCandidate
+{
+	Microsoft::WRL::ComPtr<IDXGIAdapter1> Adapter;
+	Microsoft::WRL::ComPtr<ID3D12Device> Device; // created at MinFeatureLevel; null if that failed
+
+	std::wstring Description;
+	UINT VendorId = 0;
+	UINT DeviceId = 0;
+	LUID Luid = {};
+	UINT64 DedicatedVideoMemory = 0;
+	UINT64 SharedSystemMemory = 0;
+	bool Software = false;
+	UINT PreferenceOrder = 0; // position in the enumeration
+
+	// == Supported (all zero when no device could be created) ==
+	D3D_FEATURE_LEVEL MaxFeatureLevel = static_cast<D3D_FEATURE_LEVEL>(0);
+	D3D_SHADER_MODEL HighestShaderModel = static_cast<D3D_SHADER_MODEL>(0);
+	D3D12_RESOURCE_BINDING_TIER ResourceBindingTier = static_cast<D3D12_RESOURCE_BINDING_TIER>(0);
+	D3D12_RAYTRACING_TIER RaytracingTier = D3D12_RAYTRACING_TIER_NOT_SUPPORTED;
+	D3D12_MESH_SHADER_TIER MeshShaderTier = D3D12_MESH_SHADER_TIER_NOT_SUPPORTED;
+};
+
+// == Adapter selection ==
+//
+// Passing nullptr to D3D12CreateDevice takes the first adapter DXGI lists,
+// which on dual-GPU laptops is often the integrated one. AdapterSelector
+// picks deliberately:
+//
+//  1. Enumerate() lists the adapters with
+//     IDXGIFactory6::EnumAdapterByGpuPreference, creates a device on each at
+//     MinFeatureLevel and asks it what it supports (CD3DX12FeatureSupport).
+//     WARP is added if allowed and DXGI did not list it.
+//  2. Select() drops the adapters missing a requirement, honours the
+//     override if it names a usable one, and otherwise takes the highest
+//     Score(). The candidates and the choice go to the debugger output.
+//
+// The chosen candidate's Device is ready to use; D3D12 returns the same
+// device for an adapter anyway, so nothing is created twice.
+class AdapterSelector
+{
+public:
+	static const size_t NoAdapter = ~size_t(0);
+
+	struct Stats
+	{
+		double EnumerateMilliseconds = 0.0;
+		bool Overridden = false; // Select() followed the override
+	};
+
+	explicit AdapterSelector(const AdapterPolicy& policy);
+	AdapterSelector(const AdapterSelector& rhs) = delete;
+	AdapterSelector& operator=(const AdapterSelector& rhs) = delete;
+
+	void Enumerate(IDXGIFactory6* factory);
+	void AddCandidate(const AdapterCandidate& candidate);
+
+	// Index of the chosen candidate, or NoAdapter if none is usable.
+	size_t Select();
+
+	const std::vector<AdapterCandidate>& GetCandidates() const { return m_Candidates; }
+	const Stats& GetStats() const { return m_Stats; }
+
+	// Whether 'candidate' meets every requirement of 'policy'; if not,
+	// 'reason' says which one it misses.
+	static bool IsUsable(const AdapterCandidate& candidate, const AdapterPolicy& policy, std::wstring* reason = nullptr);
+
+	// Higher is better; only meaningful between usable candidates. Hardware
+	// always beats software. Then, for HIGH_PERFORMANCE, dedicated memory (in
+	// 256 MB steps, so near-equal cards fall through), feature level and
+	// enumeration order; for the other preferences, enumeration order and
+	// feature level.
+	static UINT64 Score(const AdapterCandidate& candidate, const AdapterPolicy& policy);
+
+private:
+	void Probe(AdapterCandidate& candidate) const;
+	size_t FindOverride() const;
+
+private:
+	AdapterPolicy m_Policy;
+	std::vector<AdapterCandidate> m_Candidates;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
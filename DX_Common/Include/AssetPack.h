@@ -0,0 +1,169 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <string>
+#include <vector>
+
+#include "StreamingUploader.h"
+
+// == Packed asset container ==
+//
+// A single file holding many assets, laid out so that textures can go from
+// disk to the GPU without being decoded or re-laid-out on load:
+//
+//   +-------------------------------+
+//   | AssetPackHeader               |
+//   +-------------------------------+
+//   | AssetPackEntry[EntryCount]    |  table of contents, sorted by NameHash
+//   +-------------------------------+
+//   | AssetPackSubresource[...]     |  placed footprints of texture payloads
+//   +-------------------------------+
+//   | name string table             |
+//   +-------------------------------+
+//   | payloads                      |  each aligned to 512 bytes
+//   +-------------------------------+
+//
+// Texture payloads are stored exactly as GetCopyableFootprints would lay them
+// out in an upload buffer (rows padded to 256 bytes, subresources aligned to
+// 512 bytes). The reader memory-maps the file and hands the mapped payload
+// straight to StreamingUploader, which can then copy it into the staging ring
+// with a single memcpy.
+
+namespace AssetPackFormat
+{
+	const UINT32 Magic = 0x50415844; // "DXAP"
+	const UINT32 Version = 1;
+	const UINT64 PayloadAlignment = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
+}
+
+enum class AssetType : UINT32
+{
+	Raw = 0,     // opaque bytes (meshes, shaders, ...)
+	Texture = 1, // pre-pitched texture subresources
+};
+
+struct AssetPackHeader
+{
+	UINT32 Magic;
+	UINT32 Version;
+	UINT32 EntryCount;
+	UINT32 SubresourceCount;
+	UINT64 TocOffset;
+	UINT64 SubresourceTableOffset;
+	UINT64 StringTableOffset;
+	UINT64 StringTableSize;
+	UINT64 PayloadOffset;
+	UINT64 FileSize;
+	UINT64 TocHash; // FNV-1a of the TOC, subresource table and string table
+};
+static_assert(sizeof(AssetPackHeader) == 72, "AssetPackHeader layout changed; bump AssetPackFormat::Version");
+
+struct AssetPackEntry
+{
+	UINT64 NameHash;
+	UINT32 NameOffset;       // into the string table
+	UINT32 NameLength;
+	UINT32 Type;             // AssetType
+	UINT32 Format;           // DXGI_FORMAT (textures)
+	UINT32 Dimension;        // D3D12_RESOURCE_DIMENSION (textures)
+	UINT32 Height;
+	UINT64 Width;
+	UINT16 DepthOrArraySize;
+	UINT16 MipLevels;
+	UINT32 FirstSubresource; // index into the subresource table
+	UINT32 SubresourceCount;
+	UINT32 Reserved;
+	UINT64 PayloadOffset;    // absolute file offset
+	UINT64 PayloadSize;
+};
+static_assert(sizeof(AssetPackEntry) == 72, "AssetPackEntry layout changed; bump AssetPackFormat::Version");
+
+struct AssetPackSubresource
+{
+	UINT64 Offset;           // relative to the entry's payload
+	UINT32 RowPitch;
+	UINT32 NumRows;
+	UINT64 RowSizeInBytes;
+	UINT32 Width;
+	UINT32 Height;
+	UINT32 Depth;
+	UINT32 Reserved;
+};
+static_assert(sizeof(AssetPackSubresource) == 40, "AssetPackSubresource layout changed; bump AssetPackFormat::Version");
+
+// Read-only view of a packed asset file. Open() maps the file and validates
+// every table before anything is handed out, so a truncated or corrupted
+// pack is rejected up front instead of crashing the upload path.
+class AssetPack
+{
+public:
+	AssetPack() = default;
+	AssetPack(const AssetPack& rhs) = delete;
+	AssetPack& operator=(const AssetPack& rhs) = delete;
+	~AssetPack();
+
+	bool Open(const std::wstring& filename);
+	void Close();
+	bool IsOpen() const { return m_Data != nullptr; }
+
+	UINT GetAssetCount() const;
+	const AssetPackEntry& GetEntry(UINT index) const;
+
+	// Looks an asset up by name (binary search on the hash). nullptr if missing.
+	const AssetPackEntry* FindAsset(const std::string& name) const;
+
+	std::string GetName(const AssetPackEntry& entry) const;
+
+	// Pointer into the mapped file. Valid until Close().
+	const BYTE* GetPayload(const AssetPackEntry& entry) const;
+
+	// Texture helpers
+	D3D12_RESOURCE_DESC GetTextureDesc(const AssetPackEntry& entry) const;
+	void GetTextureLayouts(const AssetPackEntry& entry, std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts) const;
+
+	// Queues the texture payload for upload straight from the mapped file.
+	// The bytes are copied into the uploader's staging ring before this
+	// returns, so the pack does not have to outlive the upload.
+	UploadTicket UploadTexture(StreamingUploader& uploader, ID3D12Resource* dest, const AssetPackEntry& entry) const;
+
+private:
+	bool Validate(UINT64 fileSize);
+	bool ValidateEntry(const AssetPackEntry& entry) const;
+
+private:
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+	HANDLE m_Mapping = nullptr;
+	const BYTE* m_Data = nullptr;
+
+	const AssetPackHeader* m_Header = nullptr;
+	const AssetPackEntry* m_Entries = nullptr;
+	const AssetPackSubresource* m_Subresources = nullptr;
+	const char* m_Strings = nullptr;
+};
+
+// Builds pack files. This is the "packer": tools (or a first-run bake step)
+// add assets and call Write(). Texture subresources are laid out with
+// ComputeCopyableFootprints so the result is upload-ready.
+class AssetPackWriter
+{
+public:
+	// 'subresources' holds one entry per subresource of 'desc'
+	// (MipLevels * ArraySize for 1D/2D textures, MipLevels for 3D).
+	bool AddTexture(const std::string& name, const D3D12_RESOURCE_DESC& desc, const D3D12_SUBRESOURCE_DATA* subresources);
+	bool AddRaw(const std::string& name, const void* data, UINT64 size);
+
+	bool Write(const std::wstring& filename) const;
+
+private:
+	struct PendingAsset
+	{
+		std::string Name;
+		AssetPackEntry Entry = {};
+		std::vector<AssetPackSubresource> Subresources;
+		std::vector<BYTE> Payload;
+	};
+
+	std::vector<PendingAsset> m_Assets;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Identifies a file opened through AsyncFileReader::OpenFile (0 = invalid).
+typedef UINT AsyncFileHandle;
+
+// Identifies one read request (0 = invalid).
+typedef UINT64 AsyncReadId;
+
+// Requests are issued strictly by priority class; within a class they are
+// issued in submission order.
+enum class IoPriority
+{
+	High = 0,   // needed this frame (e.g. a visible texture's top mip)
+	Normal = 1,
+	Low = 2,    // prefetch / background streaming
+	Count
+};
+
+enum class AsyncReadStatus
+{
+	Queued,     // waiting for a free slot in the device queue
+	InFlight,   // issued to the OS
+	Completed,
+	Failed,
+	Cancelled,
+	Unknown     // id was never issued, or its final status was already consumed
+};
+
+// Called on the reader's completion thread once a request reaches a final
+// status. Keep it short: it blocks further completions while it runs. It is
+// a good place to hand the buffer to StreamingUploader.
+typedef std::function<void(AsyncReadId id, AsyncReadStatus status, UINT bytesRead)> AsyncReadCallback;
+
+struct AsyncReadRequest
+{
+	AsyncFileHandle File = 0;
+	UINT64 Offset = 0;
+	UINT Size = 0;
+	void* Buffer = nullptr;        // caller-owned, must stay alive until the read is final
+	IoPriority Priority = IoPriority::Normal;
+	AsyncReadCallback OnComplete;  // optional; the request is forgotten once it runs
+};
+
+// Asynchronous file reader built on overlapped I/O and an I/O completion port.
+//
+// Callers submit reads into their own (aligned) buffers; the reader keeps at
+// most 'queueDepth' reads outstanding at the OS level and feeds it from three
+// priority queues. Nothing here blocks the submitting thread.
+//
+// Files opened with 'unbuffered = true' bypass the OS file cache
+// (FILE_FLAG_NO_BUFFERING). Then the offset, the size and the buffer address
+// of every read must be multiples of GetSectorAlignment(). Unbuffered reads
+// avoid an extra kernel copy, which matters when streaming gigabytes.
+class AsyncFileReader
+{
+public:
+	explicit AsyncFileReader(UINT queueDepth = 32);
+	AsyncFileReader(const AsyncFileReader& rhs) = delete;
+	AsyncFileReader& operator=(const AsyncFileReader& rhs) = delete;
+	~AsyncFileReader();
+
+	AsyncFileHandle OpenFile(const std::wstring& filename, bool unbuffered = true);
+	void CloseFile(AsyncFileHandle file); // the file must have no pending reads
+	UINT64 GetFileSize(AsyncFileHandle file) const;
+
+	// Alignment required by unbuffered reads. 4096 covers both 512e and 4Kn drives.
+	static UINT GetSectorAlignment() { return 4096; }
+
+	// Number of reads the reader keeps in flight at the OS level.
+	void SetQueueDepth(UINT queueDepth);
+	UINT GetQueueDepth() const;
+
+	AsyncReadId Submit(const AsyncReadRequest& request);
+	// Batched submission: takes the lock once and issues as many reads as the
+	// queue depth allows in one go. 'ids' receives one id per request.
+	void Submit(const AsyncReadRequest* requests, UINT count, AsyncReadId* ids);
+
+	// Cancels a queued or in-flight read. Returns false if it already finished.
+	// The final status (Cancelled, or Completed if the OS finished first) is
+	// still delivered through the callback / Poll().
+	bool Cancel(AsyncReadId id);
+
+	// Non-blocking status query. When a final status is returned the request
+	// is forgotten and later queries return Unknown. Requests with an
+	// OnComplete callback report through it instead and are forgotten as
+	// soon as they finish.
+	AsyncReadStatus Poll(AsyncReadId id, UINT* bytesRead = nullptr);
+
+	// Blocks until the request is final. Same bookkeeping rules as Poll().
+	AsyncReadStatus Wait(AsyncReadId id, UINT* bytesRead = nullptr);
+
+	// Blocks until nothing is queued or in flight.
+	void WaitIdle();
+
+private:
+	struct ReadOp
+	{
+		OVERLAPPED Overlapped = {}; // must be first: completions hand back this pointer
+		AsyncReadId Id = 0;
+		AsyncReadRequest Request;
+		AsyncReadStatus Status = AsyncReadStatus::Queued;
+		UINT BytesRead = 0;
+	};
+
+	// Snapshot of a finished read, so its callback can run after the lock is
+	// released (by then Poll() may already have freed the ReadOp).
+	struct FinishedRead
+	{
+		AsyncReadCallback Callback;
+		AsyncReadId Id;
+		AsyncReadStatus Status;
+		UINT BytesRead;
+	};
+
+	struct OpenFileInfo
+	{
+		HANDLE Handle = INVALID_HANDLE_VALUE;
+		UINT64 Size = 0;
+		bool Unbuffered = false;
+	};
+
+	AsyncReadId QueueLocked(const AsyncReadRequest& request);
+	void IssueReadsLocked(std::vector<FinishedRead>& finished);
+	void FinishLocked(ReadOp* op, AsyncReadStatus status, UINT bytesRead, std::vector<FinishedRead>& finished);
+	static void RunCallbacks(const std::vector<FinishedRead>& finished);
+	void CompletionThreadMain();
+
+private:
+	HANDLE m_CompletionPort = nullptr;
+	std::thread m_CompletionThread;
+
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_FinishedCv;
+
+	std::vector<OpenFileInfo> m_Files; // AsyncFileHandle - 1 indexes this
+	std::unordered_map<AsyncReadId, std::unique_ptr<ReadOp>> m_Ops;
+	std::deque<ReadOp*> m_Queued[(int)IoPriority::Count];
+	UINT m_InFlight = 0;
+	UINT m_QueueDepth = 0;
+	AsyncReadId m_NextId = 1;
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class PipelineCache;
+class ThreadPool;
+
+// Index of a pipeline requested from an AsyncPipelineCompiler.
+typedef UINT PipelineHandle;
+const PipelineHandle InvalidPipelineHandle = ~0u;
+
+enum class PipelinePriority
+{
+	Background, // prewarming, nothing is waiting for it
+	Normal,
+	Visible,    // something on screen is drawn with a fallback or not at all
+};
+
+enum class PipelineStatus
+{
+	Pending,
+	Compiling,
+	Ready,
+	Failed,
+};
+
+// == Asynchronous pipeline compilation ==
+//
+// Creating a pipeline state blocks for as long as the driver compiles it,
+// so creating one the first time a material is drawn stalls the frame.
+// Request() instead queues the creation on the thread pool and returns a
+// handle right away. The draw code asks GetPipeline() every frame: until the
+// pipeline is ready it gets the fallback set with SetFallback() (e.g. a
+// generic material), or nullptr, in which case it skips the draw.
+//
+// Workers take the highest priority request first, oldest first within a
+// priority. Asking GetPipeline() for a pipeline that is not ready boosts it
+// to PipelinePriority::Visible, so what is on screen overtakes prewarming.
+//
+// Pipelines are created through PipelineCache, so they are shared with
+// synchronous users and persisted with it. Identical requests return the
+// same handle; if that pipeline failed, the request queues it again.
+//
+// Request(), SetFallback(), Boost() and GetPipeline() are meant to be called
+// from one (render) thread. The shader bytecode, input layout and other
+// arrays a description points to must stay alive until the pipeline is no
+// longer Pending or Compiling.
+class AsyncPipelineCompiler
+{
+public:
+	// Creates the pipeline on a worker thread. The default calls
+	// PipelineCache::GetOrCreate(); replace it to simulate slow compiles.
+	typedef std::function<ID3D12PipelineState*(const D3D12_PIPELINE_STATE_STREAM_DESC&)> CompileFunc;
+
+	struct Stats
+	{
+		UINT Requests = 0;
+		UINT Deduplicated = 0; // requests answered with an existing handle
+		UINT Compiled = 0;
+		UINT Failed = 0;
+		UINT Retries = 0; // failed pipelines requested again
+		UINT Boosts = 0;
+
+		// Requested to ready
+		double TotalLatencyMilliseconds = 0.0;
+		double MaxLatencyMilliseconds = 0.0;
+
+		// GetPipeline() results
+		UINT DrawsReady = 0;
+		UINT DrawsWithFallback = 0;
+		UINT DrawsSkipped = 0;
+	};
+
+	// 'pool' may be null, in which case Request() compiles immediately.
+	AsyncPipelineCompiler(PipelineCache* cache, ThreadPool* pool);
+	AsyncPipelineCompiler(const AsyncPipelineCompiler& rhs) = delete;
+	AsyncPipelineCompiler& operator=(const AsyncPipelineCompiler& rhs) = delete;
+	// Drops what has not started and waits for what has.
+	~AsyncPipelineCompiler();
+
+	void SetCompileFunc(const CompileFunc& compile) { m_Compile = compile; }
+
+	PipelineHandle Request(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, PipelinePriority priority = PipelinePriority::Normal);
+	PipelineHandle Request(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, PipelinePriority priority = PipelinePriority::Normal);
+	PipelineHandle Request(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, PipelinePriority priority = PipelinePriority::Normal);
+
+	// GetPipeline(handle) returns GetPipeline(fallback)'s pipeline while
+	// 'handle' is not ready. Fallbacks are not followed further.
+	void SetFallback(PipelineHandle handle, PipelineHandle fallback);
+
+	void Boost(PipelineHandle handle, PipelinePriority priority = PipelinePriority::Visible);
+
+	PipelineStatus GetStatus(PipelineHandle handle) const;
+	bool IsReady(PipelineHandle handle) const { return GetStatus(handle) == PipelineStatus::Ready; }
+
+	// What to draw with this frame: the pipeline, its fallback, or nullptr
+	// (skip the draw). Boosts the pipeline if it is not ready.
+	ID3D12PipelineState* GetPipeline(PipelineHandle handle);
+
+	// Blocks until every request so far is compiled (loading screens).
+	void WaitIdle();
+
+	Stats GetStats() const;
+
+private:
+	struct Entry
+	{
+		std::vector<void*> Stream; // copy of the stream, pointer aligned
+		SIZE_T StreamSize = 0;
+		uint64_t Key = 0;
+		PipelineHandle Fallback = InvalidPipelineHandle;
+		PipelinePriority Priority = PipelinePriority::Normal; // m_Mutex
+		UINT64 Sequence = 0;
+		LARGE_INTEGER RequestTime = {};
+		std::atomic<PipelineStatus> Status{ PipelineStatus::Pending };
+		std::atomic<ID3D12PipelineState*> Pipeline{ nullptr };
+	};
+
+	void RunHighestPriority();
+	void Compile(Entry& entry);
+
+private:
+	PipelineCache* m_Cache = nullptr;
+	ThreadPool* m_Pool = nullptr;
+	CompileFunc m_Compile;
+
+	// Only grows; handles index into it. std::deque keeps references to
+	// existing entries valid while it grows.
+	std::deque<Entry> m_Entries;
+	std::unordered_map<uint64_t, PipelineHandle> m_ByKey;
+	UINT64 m_NextSequence = 0;
+
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_IdleCv;
+	std::vector<Entry*> m_Pending; // not yet picked up by a worker
+	UINT m_QueuedRunners = 0;      // pool tasks submitted and not finished
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;     // m_Mutex; the Draws* counters live in the atomics below
+
+	// Counted without the lock by GetPipeline(), copied into the Draws*
+	// counters by GetStats().
+	std::atomic<UINT> m_DrawsReady{ 0 };
+	std::atomic<UINT> m_DrawsWithFallback{ 0 };
+	std::atomic<UINT> m_DrawsSkipped{ 0 };
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+class ThreadPool;
+
+// Speed / quality trade-off of the block compressor.
+enum class BCQuality
+{
+	Fast,   // bounding-box endpoints, no refinement (previews, first-run bakes)
+	Normal, // principal-axis endpoints plus one least-squares refinement
+	High,   // more refinement, tries every mode / p-bit variant the encoder knows
+};
+
+// == Block-compression (BC) encoder ==
+//
+// Compresses R8G8B8A8 texels into 4x4 blocks. BC textures are 4x (BC3/BC5/
+// BC7) to 8x (BC1/BC4) smaller than RGBA8 and are sampled directly by the GPU,
+// so they save both VRAM and bandwidth.
+//
+//   BC1  RGB (+1-bit alpha)      8 bytes/block   colour maps without alpha
+//   BC3  RGBA                   16 bytes/block   colour maps with smooth alpha
+//   BC4  R                       8 bytes/block   height/roughness/AO masks (source R)
+//   BC5  RG                     16 bytes/block   tangent-space normal maps (source R, G)
+//   BC7  RGBA (mode 6)          16 bytes/block   high quality colour
+//
+// sRGB variants are compressed in their stored (gamma) space, which is what
+// the hardware decodes from, so the same code handles both.
+//
+// Blocks are independent. Block rows are spread across the thread pool when
+// one is given, and the nearest-palette-entry search runs four texels at a
+// time with SSE.
+//
+// Typical baking flow: load RGBA8 mip 0, run MipGenerator, then EncodeTexture
+// into a buffer laid out with ComputeCopyableFootprints for the BC format, and
+// hand that to AssetPackWriter or StreamingUploader.
+class BCEncoder
+{
+public:
+	explicit BCEncoder(ThreadPool* pool = nullptr);
+
+	static bool IsFormatSupported(DXGI_FORMAT format);
+	static UINT GetBlockSize(DXGI_FORMAT format); // bytes per 4x4 block, 0 if unsupported
+
+	// Compresses one width x height surface of R8G8B8A8 texels. Partial blocks
+	// at the right and bottom edges repeat the edge texels.
+	bool EncodeSurface(
+		DXGI_FORMAT format,
+		const BYTE* src, UINT srcRowPitch, UINT width, UINT height,
+		BYTE* dst, UINT dstRowPitch,
+		BCQuality quality = BCQuality::Normal) const;
+
+	// Compresses every subresource of an R8G8B8A8 texture. Both sides are
+	// laid out as GetCopyableFootprints describes (offsets relative to the
+	// data pointers). 'srcDesc' and the BC texture share everything except
+	// the format.
+	bool EncodeTexture(
+		const D3D12_RESOURCE_DESC& srcDesc,
+		const void* srcData, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* srcLayouts,
+		DXGI_FORMAT format,
+		void* dstData, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* dstLayouts,
+		BCQuality quality = BCQuality::Normal) const;
+
+	// Decodes one block back to 16 R8G8B8A8 texels (row-major). Meant for
+	// quality checks (e.g. PSNR against the source); BC7 supports mode 6 only.
+	static bool DecodeBlock(DXGI_FORMAT format, const BYTE* block, BYTE rgba[16 * 4]);
+
+private:
+	ThreadPool* m_Pool = nullptr;
+};
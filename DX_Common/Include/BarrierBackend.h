@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <vector>
+
+// Enhanced Barriers need a D3D12 SDK (or Agility SDK) that declares them.
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 608)
+#define ENHANCED_BARRIERS_AVAILABLE 1
+#endif
+
+// == Barrier backend ==
+//
+// Records D3D12_RESOURCE_BARRIER arrays on a command list, using the
+// Enhanced Barriers API (ID3D12GraphicsCommandList7::Barrier) when the
+// device supports it and ResourceBarrier otherwise.
+//
+// A legacy transition says nothing about *which* work has to finish, so the
+// driver usually waits for the whole pipeline. An enhanced barrier names the
+// synchronization scope (SYNC), the caches to flush/invalidate (ACCESS) and
+// the texture layout separately. Translating each legacy state into the
+// narrowest sync/access/layout that covers it lets, e.g., a
+// RENDER_TARGET -> PIXEL_SHADER_RESOURCE transition wait only for render
+// target writes and block only pixel shading:
+//
+//   state                       sync                    access                 layout
+//   RENDER_TARGET               RENDER_TARGET           RENDER_TARGET          RENDER_TARGET
+//   DEPTH_WRITE                 DEPTH_STENCIL           DEPTH_STENCIL_WRITE    DEPTH_STENCIL_WRITE
+//   PIXEL_SHADER_RESOURCE       PIXEL_SHADING           SHADER_RESOURCE        SHADER_RESOURCE
+//   COPY_DEST                   COPY                    COPY_DEST              COPY_DEST
+//   ...
+//
+// Both paths take the same input, so callers (ResourceStateTracker, the
+// samples) do not change. Anything without an enhanced equivalent (aliasing
+// barriers, states outside the table) is recorded with ResourceBarrier in
+// its original order; the two APIs may be mixed on one command list.
+class BarrierBackend
+{
+public:
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	struct EnhancedState
+	{
+		D3D12_BARRIER_SYNC Sync;
+		D3D12_BARRIER_ACCESS Access;
+		D3D12_BARRIER_LAYOUT Layout; // textures only
+	};
+
+	// What Record() does on a list with Enhanced Barriers, as data: a
+	// sequence of calls, each either one Barrier() with the global, buffer
+	// and texture barriers it names, or one legacy ResourceBarrier() for a
+	// barrier with no enhanced equivalent.
+	struct Translation
+	{
+		struct Call
+		{
+			const D3D12_RESOURCE_BARRIER* Legacy = nullptr;
+			UINT32 FirstGlobal = 0;
+			UINT32 GlobalCount = 0;
+			UINT32 FirstBuffer = 0;
+			UINT32 BufferCount = 0;
+			UINT32 FirstTexture = 0;
+			UINT32 TextureCount = 0;
+		};
+
+		std::vector<Call> Calls;
+		std::vector<D3D12_GLOBAL_BARRIER> GlobalBarriers;
+		std::vector<D3D12_BUFFER_BARRIER> BufferBarriers;
+		std::vector<D3D12_TEXTURE_BARRIER> TextureBarriers;
+
+		// Keeps the capacity, so a reused Translation stops allocating.
+		void Clear();
+
+	private:
+		friend class BarrierBackend;
+		std::vector<ID3D12Resource*> RunResources; // resources in the open Barrier() call
+	};
+#endif
+
+	BarrierBackend() = default;
+	BarrierBackend(const BarrierBackend& rhs) = delete;
+	BarrierBackend& operator=(const BarrierBackend& rhs) = delete;
+
+	// Queries D3D12_OPTIONS12. Until this is called (or with allowEnhanced =
+	// false) every barrier goes through ResourceBarrier.
+	void Initialize(ID3D12Device* device, bool allowEnhanced = true);
+
+	bool UsesEnhancedBarriers() const { return m_UseEnhanced; }
+
+	void Record(ID3D12GraphicsCommandList* commandList, UINT numBarriers, const D3D12_RESOURCE_BARRIER* barriers);
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	// Maps a legacy state (or a combination of read states) to the enhanced
+	// sync/access/layout triple. Returns false if some bit has no mapping.
+	static bool TranslateState(D3D12_RESOURCE_STATES state, EnhancedState& out);
+
+	// Appends the calls Record() would make with Enhanced Barriers. The
+	// Legacy pointers point into 'barriers'.
+	static void Translate(UINT numBarriers, const D3D12_RESOURCE_BARRIER* barriers, Translation& out);
+#endif
+
+private:
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	static bool TranslateBarrier(const D3D12_RESOURCE_BARRIER& barrier, Translation& out);
+	// Closes the open Barrier() call, if it has any barriers.
+	static void EndCall(Translation& out);
+#endif
+
+private:
+	bool m_UseEnhanced = false;
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	// Scratch storage for Record()
+	Translation m_Translation;
+#endif
+};
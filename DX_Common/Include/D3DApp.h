@@ -9,7 +9,24 @@
 #include <d3d12.h>
 #include <dxgi1_6.h> // DXGI 1.6
 #include "Timer.h"
-
+#include "AdapterSelector.h"
+#include "AsyncPipelineCompiler.h"
+#include "BarrierBackend.h"
+#include "DeviceCapabilities.h"
+#include "DynamicResolution.h"
+#include "FramePacer.h"
+#include "GpuFrameTimer.h"
+#include "MsaaTarget.h"
+#include "PipelineCache.h"
+#include "RenderPassRecorder.h"
+#include "ResourceStateTracker.h"
+#include "RootSignatureCache.h"
+#include "ShaderCache.h"
+#include "ShaderHotReload.h"
+#include "StartupGraph.h"
+#include "ThreadPool.h"
+
+#include <mutex>
 #include <string>
 
 class D3DApp
@@ -25,6 +42,21 @@ public:
 	bool Get4xMsaaState() const;
 	void Set4xMsaaState(bool value);
 
+	// 2 to 4 back buffers. More of them let the GPU run further ahead of the
+	// display, for throughput, at the cost of latency.
+	UINT GetSwapChainBufferCount() const;
+	void SetSwapChainBufferCount(UINT count);
+	// Frames the CPU may queue ahead of the display, at most one less than
+	// the back buffer count.
+	UINT GetMaxFrameLatency() const;
+	void SetMaxFrameLatency(UINT latency);
+
+	// Dynamic resolution scales the rendered region of the back buffer to
+	// hold the GPU frame time at m_DynamicResolutionSettings.TargetMilliseconds.
+	bool GetDynamicResolution() const;
+	void SetDynamicResolution(bool enabled);
+	float GetRenderScale() const;
+
 	int Run();
 
 	virtual bool Initialize();
@@ -48,20 +80,68 @@ protected:
 	virtual void OnMouseUp(WPARAM btnState, int x, int y) {}
 	virtual void OnMouseMove(WPARAM btnState, int x, int y) {}
 
+	// The stages of Initialize(), for tasks of the application to depend on.
+	struct StartupStages
+	{
+		StartupTask Window;         // m_hMainWnd
+		StartupTask Device;         // m_d3dDevice, caches, fence, descriptor sizes
+		StartupTask ShaderCache;    // m_ShaderCache ready for Add()/Build()
+		StartupTask CommandObjects; // queue, allocator, lists, RTV/DSV heaps
+		StartupTask SwapChain;      // swap chain and back buffers, sized
+	};
+	// Adds the application's startup work (shader builds, pipeline warmup,
+	// asset prefetch) to run alongside Initialize()'s own stages.
+	virtual void AddStartupTasks(StartupGraph& graph, const StartupStages& stages) {}
+
 protected:
 
 	bool InitMainWindow();
 	bool InitDirect3D();
 
+	// Startup stages may run on worker threads, which must not show any
+	// window. A failing stage records why here and returns false;
+	// Initialize() shows the first message recorded, on the main thread.
+	void SetStartupError(const std::wstring& message);
+
 	void CreateCommandObjects();
 	void CreateSwapChain();
+	// Hands the swap chain and the maximum frame latency to m_PresentQueue.
+	void ResetPresentQueue();
+	// Sets m_ScreenViewport and m_ScissorRect to 'scale' of the client area
+	// and has the swap chain stretch that region to the window.
+	void ApplyRenderScale(float scale);
 
 	void FlushCommandQueue();
+	// Blocks until the GPU has reached 'fenceValue' on m_Fence.
+	void WaitForFence(UINT64 fenceValue);
+
+	// Presents the current back buffer through m_FramePacer and moves on to
+	// the next one, once the GPU is done with the frame that last rendered
+	// into it, and resets that buffer's command allocator. Draw() ends with
+	// this.
+	void Present();
+
+	// Flushes the tracked barriers, closes m_CommandList and executes it,
+	// preceded by a fixup list that moves resources from their global states
+	// into the states the list expects at its start.
+	void ExecuteCommandList();
 
 	ID3D12Resource* CurrentBackBuffer() const;
+	ID3D12CommandAllocator* CurrentCommandAllocator() const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView() const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView() const;
 
+	// A render pass over the current back buffer and the depth buffer that
+	// clears both and keeps only the colour (depth is discarded at the end).
+	// With 4X MSAA it draws into the offscreen MSAA targets instead and
+	// resolves the colour into the back buffer. The MSAA colour target is
+	// recreated between frames to make 'clearColor' its optimized clear
+	// value, so keep it the same from frame to frame.
+	RenderPassDesc BackBufferRenderPass(const float clearColor[4]);
+	// Moves the back buffer and depth (or MSAA) targets into the states
+	// BackBufferRenderPass() needs and flushes the barriers.
+	void PrepareBackBufferRenderPass();
+
 	void CalculateFrameStats();
 
 	void LogAdapters();
@@ -91,21 +171,87 @@ protected:
 	// Direct3D objects
 	Microsoft::WRL::ComPtr<IDXGIFactory7> m_dxgiFactory;
 	Microsoft::WRL::ComPtr<ID3D12Device> m_d3dDevice;
-	Microsoft::WRL::ComPtr<IDXGISwapChain> m_SwapChain;
+	Microsoft::WRL::ComPtr<IDXGISwapChain3> m_SwapChain;
+	UINT m_SwapChainFlags = 0; // DXGI_SWAP_CHAIN_FLAG_*, also needed by ResizeBuffers
+
+	// Waits on the swap chain's frame-latency waitable object before each
+	// frame and presents with or without vsync/tearing
+	DxgiPresentQueue m_PresentQueue;
+	FramePacer m_FramePacer;
 
 	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
 	UINT64 m_CurrentFence = 0;
 
 	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CommandQueue;
-	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_DirectCmdListAlloc;
 	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_FixupCommandList;
+
+	// Records barriers with Enhanced Barriers when the device supports them
+	BarrierBackend m_BarrierBackend;
+
+	// Feature support, descriptor sizes and MSAA levels, persisted across runs
+	DeviceCapabilityCache m_DeviceCaps;
 
-	// Swap chain back buffers
-	static const int s_SwapChainBufferCount = 2;
+	// Tracks resource states for m_CommandList
+	ResourceStateTracker m_StateTracker;
+
+	// Records BeginRenderPass/EndRenderPass with load/store ops
+	RenderPassRecorder m_RenderPasses;
+
+	// Pipeline states, persisted across runs
+	PipelineCache m_PipelineCache;
+
+	// Root signatures shared by layout, serialized blobs persisted across runs
+	RootSignatureCache m_RootSignatureCache;
+
+	// Shader bytecode, compiled in parallel and cached on disk
+	ShaderCache m_ShaderCache;
+
+	// Worker threads for CPU work (pipeline compiles, ...)
+	ThreadPool m_ThreadPool;
+
+	std::mutex m_StartupErrorMutex;
+	std::wstring m_StartupError; // the first SetStartupError() message
+
+	// Creates pipelines from m_PipelineCache on m_ThreadPool, so first use of
+	// a material does not stall the frame
+	AsyncPipelineCompiler m_PipelineCompiler;
+
+	// Rebuilds shaders and their pipelines when the sources change. Samples
+	// register pipelines with AddPipeline() and call Start() with their
+	// shader directories.
+	ShaderHotReload m_ShaderHotReload;
+
+	// Swap chain back buffers; the first m_SwapChainBufferCount are in use
+	static const UINT s_MinSwapChainBufferCount = 2;
+	static const UINT s_MaxSwapChainBufferCount = 4;
 	int m_CurrentBackBuffer = 0;
-	Microsoft::WRL::ComPtr<ID3D12Resource> m_SwapChainBuffer[s_SwapChainBufferCount];
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_SwapChainBuffer[s_MaxSwapChainBufferCount];
+	// The frame ring: the fence value of the last frame rendered into each
+	// back buffer. Per-frame resources such as constant buffers can be kept
+	// in a ring of GetSwapChainBufferCount() and retired the same way.
+	UINT64 m_BackBufferFence[s_MaxSwapChainBufferCount] = {};
+	// One command allocator per back buffer, so recording a frame never
+	// touches memory a frame still on the GPU uses. Present() resets the
+	// next one once its fence has passed; reset m_CommandList with
+	// CurrentCommandAllocator().
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_DirectCmdListAlloc[s_MaxSwapChainBufferCount];
+
+	// Dynamic resolution. The frame's GPU time, measured by m_GpuTimer in
+	// the slot of its back buffer, is read when the buffer comes round again
+	// and fed to m_ResolutionController with the scale it was rendered at.
+	GpuFrameTimer m_GpuTimer;
+	DynamicResolutionController m_ResolutionController;
+	bool m_GpuFrameBegun = false; // the current frame's begin timestamp is recorded
+	float m_RenderScale = 1.0f;
+	float m_BackBufferScale[s_MaxSwapChainBufferCount] = {};
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_DepthStencilBuffer;
 
+	// Offscreen 4X MSAA colour and depth targets. Set4xMsaaState() only
+	// changes m_Msaa's settings; Run() reallocates the targets between frames.
+	D3D12MsaaTargetAllocator m_MsaaTargets;
+	MsaaTarget m_Msaa;
+
 	// Descriptor Heaps
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_RtvHeap;
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_DsvHeap;
@@ -121,6 +267,20 @@ protected:
 	// Derived class should set these in derived constructor to customize starting values.
 	std::wstring m_MainWndCaption = L"D3D App";
 	D3D_DRIVER_TYPE m_d3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
+	// Back buffers, 2 to 4 (change it at runtime with SetSwapChainBufferCount)
+	UINT m_SwapChainBufferCount = 2;
+	// Frames the CPU may queue ahead of the display; 1 is the lowest latency
+	// (change it at runtime with SetMaxFrameLatency)
+	UINT m_MaxFrameLatency = 1;
+	// false presents as soon as a frame is done, tearing if the display allows it
+	// (change it at runtime with m_FramePacer.SetVSync)
+	bool m_VSync = true;
+	// Scale the render resolution to hold the GPU frame time (change it at
+	// runtime with SetDynamicResolution)
+	bool m_DynamicResolution = false;
+	DynamicResolutionSettings m_DynamicResolutionSettings;
+	// GPU preference, required features and the config override (Override)
+	AdapterPolicy m_AdapterPolicy;
 	DXGI_FORMAT m_BackBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
 	DXGI_FORMAT m_DepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	int m_ClientWidth = 800;
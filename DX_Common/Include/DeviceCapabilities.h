@@ -0,0 +1,303 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace DeviceCapabilityFormat
+{
+	const UINT32 Magic = 0x50435844; // "DXCP"
+	// Bump when DeviceCapabilities changes in a way sizeof() does not show
+	// (fields reordered or swapped for others of the same size).
+	const UINT32 Version = 1;
+}
+
+// Multisample quality levels of one format, for 2, 4, 8 and 16 samples.
+struct MsaaQualityLevels
+{
+	static const UINT SampleCountCount = 4;
+
+	DXGI_FORMAT Format;
+	UINT QualityLevels[SampleCountCount]; // 0: that sample count is not supported
+};
+
+// == Device capabilities ==
+//
+// Everything the application asks the device about at startup, as plain
+// data so it can be written to disk as is: the results of every
+// CD3DX12FeatureSupport getter that takes no arguments (node 0 for the
+// per-node ones), the descriptor increment sizes and the MSAA quality levels
+// of the formats given to DeviceCapabilityCache::Initialize().
+//
+// Fields of newer D3D12_FEATURE_D3D12_OPTIONS are only there when the SDK
+// has them, as in CD3DX12FeatureSupport; the SDK version is part of the
+// file's identity.
+struct DeviceCapabilities
+{
+	static const UINT MaxMsaaFormats = 4;
+
+	// == D3D12_OPTIONS ==
+	BOOL DoublePrecisionFloatShaderOps;
+	BOOL OutputMergerLogicOp;
+	D3D12_SHADER_MIN_PRECISION_SUPPORT MinPrecisionSupport;
+	D3D12_TILED_RESOURCES_TIER TiledResourcesTier;
+	D3D12_RESOURCE_BINDING_TIER ResourceBindingTier;
+	BOOL PSSpecifiedStencilRefSupported;
+	BOOL TypedUAVLoadAdditionalFormats;
+	BOOL ROVsSupported;
+	D3D12_CONSERVATIVE_RASTERIZATION_TIER ConservativeRasterizationTier;
+	BOOL StandardSwizzle64KBSupported;
+	BOOL CrossAdapterRowMajorTextureSupported;
+	BOOL VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation;
+	D3D12_RESOURCE_HEAP_TIER ResourceHeapTier;
+	D3D12_CROSS_NODE_SHARING_TIER CrossNodeSharingTier;
+	UINT MaxGPUVirtualAddressBitsPerResource;
+
+	// == Feature level, GPU VA, shader model, root signature ==
+	D3D_FEATURE_LEVEL MaxSupportedFeatureLevel;
+	UINT MaxGPUVirtualAddressBitsPerProcess;
+	D3D_SHADER_MODEL HighestShaderModel;
+	D3D_ROOT_SIGNATURE_VERSION HighestRootSignatureVersion;
+
+	// == D3D12_OPTIONS1 ==
+	BOOL WaveOps;
+	UINT WaveLaneCountMin;
+	UINT WaveLaneCountMax;
+	UINT TotalLaneCount;
+	BOOL ExpandedComputeResourceStates;
+	BOOL Int64ShaderOps;
+
+	// == Per node (node 0) ==
+	D3D12_PROTECTED_RESOURCE_SESSION_SUPPORT_FLAGS ProtectedResourceSessionSupport;
+	BOOL TileBasedRenderer;
+	BOOL UMA;
+	BOOL CacheCoherentUMA;
+	BOOL IsolatedMMU;
+	D3D12_HEAP_SERIALIZATION_TIER HeapSerializationTier;
+	UINT ProtectedResourceSessionTypeCount;
+
+	// == D3D12_OPTIONS2 to OPTIONS7 ==
+	BOOL DepthBoundsTestSupported;
+	D3D12_PROGRAMMABLE_SAMPLE_POSITIONS_TIER ProgrammableSamplePositionsTier;
+	D3D12_SHADER_CACHE_SUPPORT_FLAGS ShaderCacheSupportFlags;
+	BOOL CopyQueueTimestampQueriesSupported;
+	BOOL CastingFullyTypedFormatSupported;
+	D3D12_COMMAND_LIST_SUPPORT_FLAGS WriteBufferImmediateSupportFlags;
+	D3D12_VIEW_INSTANCING_TIER ViewInstancingTier;
+	BOOL BarycentricsSupported;
+	BOOL ExistingHeapsSupported;
+	BOOL MSAA64KBAlignedTextureSupported;
+	D3D12_SHARED_RESOURCE_COMPATIBILITY_TIER SharedResourceCompatibilityTier;
+	BOOL Native16BitShaderOpsSupported;
+	BOOL CrossNodeAtomicShaderInstructions;
+	BOOL SRVOnlyTiledResourceTier3;
+	D3D12_RENDER_PASS_TIER RenderPassesTier;
+	D3D12_RAYTRACING_TIER RaytracingTier;
+	BOOL AdditionalShadingRatesSupported;
+	BOOL PerPrimitiveShadingRateSupportedWithViewportIndexing;
+	D3D12_VARIABLE_SHADING_RATE_TIER VariableShadingRateTier;
+	UINT ShadingRateImageTileSize;
+	BOOL BackgroundProcessingSupported;
+	D3D12_MESH_SHADER_TIER MeshShaderTier;
+	D3D12_SAMPLER_FEEDBACK_TIER SamplerFeedbackTier;
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 3)
+	// == D3D12_OPTIONS8, OPTIONS9 ==
+	BOOL UnalignedBlockTexturesSupported;
+	BOOL MeshShaderPipelineStatsSupported;
+	BOOL MeshShaderSupportsFullRangeRenderTargetArrayIndex;
+	BOOL AtomicInt64OnTypedResourceSupported;
+	BOOL AtomicInt64OnGroupSharedSupported;
+	BOOL DerivativesInMeshAndAmplificationShadersSupported;
+	D3D12_WAVE_MMA_TIER WaveMMATier;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 4)
+	// == DISPLAYABLE, D3D12_OPTIONS10, OPTIONS11 ==
+	BOOL DisplayableTexture;
+	BOOL VariableRateShadingSumCombinerSupported;
+	BOOL MeshShaderPerPrimitiveShadingRateSupported;
+	BOOL AtomicInt64OnDescriptorHeapResourceSupported;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 600)
+	// == D3D12_OPTIONS12 ==
+	D3D12_TRI_STATE MSPrimitivesPipelineStatisticIncludesCulledPrimitives;
+	BOOL EnhancedBarriersSupported;
+	BOOL RelaxedFormatCastingSupported;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 602)
+	// == D3D12_OPTIONS13 ==
+	BOOL UnrestrictedBufferTextureCopyPitchSupported;
+	BOOL UnrestrictedVertexElementAlignmentSupported;
+	BOOL InvertedViewportHeightFlipsYSupported;
+	BOOL InvertedViewportDepthFlipsZSupported;
+	BOOL TextureCopyBetweenDimensionsSupported;
+	BOOL AlphaBlendFactorSupported;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 606)
+	// == D3D12_OPTIONS14, OPTIONS15 ==
+	BOOL AdvancedTextureOpsSupported;
+	BOOL WriteableMSAATexturesSupported;
+	BOOL IndependentFrontAndBackStencilRefMaskSupported;
+	BOOL TriangleFanSupported;
+	BOOL DynamicIndexBufferStripCutSupported;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 608)
+	// == D3D12_OPTIONS16 ==
+	BOOL DynamicDepthBiasSupported;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 609)
+	// == D3D12_OPTIONS16 to OPTIONS18 ==
+	BOOL GPUUploadHeapSupported;
+	BOOL NonNormalizedCoordinateSamplersSupported;
+	BOOL ManualWriteTrackingResourceSupported;
+	BOOL RenderPassesValid;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 610)
+	// == D3D12_OPTIONS19 ==
+	BOOL MismatchingOutputDimensionsSupported;
+	UINT SupportedSampleCountsWithNoOutputs;
+	BOOL PointSamplingAddressesNeverRoundUp;
+	BOOL RasterizerDesc2Supported;
+	BOOL NarrowQuadrilateralLinesSupported;
+	BOOL AnisoFilterWithPointMipSupported;
+	UINT MaxSamplerDescriptorHeapSize;
+	UINT MaxSamplerDescriptorHeapSizeWithStaticSamplers;
+	UINT MaxViewDescriptorHeapSize;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 611)
+	// == D3D12_OPTIONS20 ==
+	BOOL ComputeOnlyWriteWatchSupported;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 612)
+	// == D3D12_OPTIONS21 ==
+	D3D12_EXECUTE_INDIRECT_TIER ExecuteIndirectTier;
+	D3D12_WORK_GRAPHS_TIER WorkGraphsTier;
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 617)
+	// == TIGHT_ALIGNMENT ==
+	D3D12_TIGHT_ALIGNMENT_TIER TightAlignmentSupportTier;
+#endif
+
+	// == Descriptor increment sizes, by D3D12_DESCRIPTOR_HEAP_TYPE ==
+	UINT DescriptorIncrementSize[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+
+	// == MSAA ==
+	UINT MsaaFormatCount;
+	MsaaQualityLevels Msaa[MaxMsaaFormats];
+
+	// Quality levels of 'format' at 'sampleCount' (2, 4, 8 or 16); 0 if not
+	// supported, or if the format was not asked for.
+	UINT GetMsaaQualityLevels(DXGI_FORMAT format, UINT sampleCount) const;
+};
+// Written to disk byte for byte, so it must stay plain data without padding.
+static_assert(std::is_trivially_copyable<DeviceCapabilities>::value, "DeviceCapabilities must be plain data");
+static_assert(sizeof(DeviceCapabilities) % sizeof(UINT) == 0, "DeviceCapabilities must not need padding");
+
+// The adapter and driver a snapshot was taken on. Like the pipeline cache,
+// this leaves out the LUID, which changes with every boot.
+struct DeviceIdentity
+{
+	UINT32 VendorId;
+	UINT32 DeviceId;
+	UINT32 SubSysId;
+	UINT32 Revision;
+	UINT64 DriverVersion; // user mode driver version reported by DXGI; 0 if unknown
+};
+
+// Fills DeviceCapabilities. The default, D3D12FeatureSource, asks a device
+// through CD3DX12FeatureSupport; tests and tools can plug in their own.
+class DeviceFeatureSource
+{
+public:
+	virtual ~DeviceFeatureSource() = default;
+
+	virtual DeviceIdentity GetIdentity() = 0;
+
+	// 'caps' arrives zeroed. 'msaaFormats' holds at most
+	// DeviceCapabilities::MaxMsaaFormats formats.
+	virtual void Query(const std::vector<DXGI_FORMAT>& msaaFormats, DeviceCapabilities& caps) = 0;
+};
+
+class D3D12FeatureSource : public DeviceFeatureSource
+{
+public:
+	explicit D3D12FeatureSource(ID3D12Device* device) : m_Device(device) {}
+
+	DeviceIdentity GetIdentity() override;
+	void Query(const std::vector<DXGI_FORMAT>& msaaFormats, DeviceCapabilities& caps) override;
+
+private:
+	ID3D12Device* m_Device = nullptr;
+};
+
+// == Device capability cache ==
+//
+// CD3DX12FeatureSupport::Init() makes some thirty CheckFeatureSupport calls,
+// one after the other, and every start asks for the same answers again.
+// DeviceCapabilityCache keeps them in a small file instead:
+//
+//  - Initialize() reads the snapshot with a single read. The file is only
+//    used if it was written by this format version, for the same adapter
+//    and driver, by a build with the same D3D12 SDK (which decides the
+//    fields) and for the same MSAA formats, and if its hash checks out.
+//  - Otherwise the source is asked, and the snapshot saved for next time.
+//
+// A driver update changes the driver version, so capabilities are asked for
+// again after one; an unknown driver version means the file is not used.
+class DeviceCapabilityCache
+{
+public:
+	struct Stats
+	{
+		bool FromDisk = false;
+		double LoadMilliseconds = 0.0;  // reading the file, hit or miss
+		double QueryMilliseconds = 0.0; // asking the source (on a miss)
+	};
+
+	DeviceCapabilityCache();
+	DeviceCapabilityCache(const DeviceCapabilityCache& rhs) = delete;
+	DeviceCapabilityCache& operator=(const DeviceCapabilityCache& rhs) = delete;
+
+	void Initialize(DeviceFeatureSource& source, const std::wstring& filename, const std::vector<DXGI_FORMAT>& msaaFormats);
+
+	const DeviceCapabilities& Get() const { return m_Caps; }
+	UINT GetDescriptorIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE type) const { return m_Caps.DescriptorIncrementSize[type]; }
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	struct FileHeader
+	{
+		UINT32 Magic;
+		UINT32 Version;
+		DeviceIdentity Identity;
+		UINT32 SdkVersion;    // D3D12_SDK_VERSION of the build
+		UINT32 SnapshotSize;  // sizeof(DeviceCapabilities)
+		UINT64 FormatsHash;   // of the MSAA formats asked for
+		UINT64 SnapshotHash;  // FNV-1a of the snapshot
+	};
+
+	bool Load(const FileHeader& expected);
+	bool Save(const FileHeader& header) const;
+
+private:
+	std::wstring m_Filename;
+	DeviceCapabilities m_Caps = {};
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Windows.h>
+
+struct DynamicResolutionSettings
+{
+	// The GPU frame time to hold, e.g. 16.6 for 60 Hz with no headroom.
+	double TargetMilliseconds = 14.0;
+
+	// Scale of the render width and height.
+	float MinScale = 0.5f;
+	float MaxScale = 1.0f;
+
+	// Gains on the relative error, ln(target / time). The integral gain is
+	// the share of the error corrected per frame. The proportional and
+	// derivative terms act on the change of the error, so they mostly add
+	// frame time noise; they are off by default.
+	double Kp = 0.0;
+	double Ki = 0.5;
+	double Kd = 0.0;
+
+	// Frame times under the target by less than this (relative, 0.05 is
+	// 5%) count as on target, so noise does not keep nudging the scale.
+	double Deadband = 0.05;
+	// Weight of a new frame in the smoothed frame time, when it is slower
+	// and when it is faster; 1 disables smoothing. Load spikes are followed
+	// at once, noise and drops in load slowly.
+	double RisingSmoothing = 0.5;
+	double FallingSmoothing = 0.1;
+	// The largest change of scale in one frame.
+	float MaxScaleStep = 0.1f;
+};
+
+// == Dynamic resolution ==
+//
+// Rendering at full resolution whatever the load misses the frame budget
+// in heavy scenes and wastes headroom in light ones. The scene is rendered
+// into a viewport scaled by GetScale() instead, and upscaled to the window
+// (D3DApp does it with the swap chain's source size), with the scale
+// driven by the GPU frame time.
+//
+// The controller is a PID loop in the log domain. GPU time is roughly
+// proportional to the pixel count, scale squared, so the error is
+// ln(target / time) and the output is ln(scale squared). A frame twice
+// over budget then asks for half the pixels however heavy the scene is,
+// and the gains mean the same thing for every load.
+//
+// GPU times arrive frames late: a frame's time is read once the GPU has
+// finished it, after the CPU has moved on. Update() takes the scale each
+// frame was rendered at and converts its time to the current scale, so the
+// controller does not keep correcting for changes already made (the cause
+// of overshoot and oscillation with delayed measurements).
+class DynamicResolutionController
+{
+public:
+	struct Stats
+	{
+		UINT64 Frames = 0;
+		UINT64 ScaleChanges = 0;
+		double SmoothedMilliseconds = 0.0; // at the current scale
+		double Error = 0.0;                // ln(target / smoothed time)
+	};
+
+	explicit DynamicResolutionController(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+	DynamicResolutionController(const DynamicResolutionController& rhs) = delete;
+	DynamicResolutionController& operator=(const DynamicResolutionController& rhs) = delete;
+
+	void SetSettings(const DynamicResolutionSettings& settings);
+	const DynamicResolutionSettings& GetSettings() const { return m_Settings; }
+
+	// Starts over at 'scale', forgetting the frame time history.
+	void Reset(float scale);
+
+	// Takes the GPU time of a finished frame and the scale it was rendered
+	// at, and returns the scale for the next frame.
+	float Update(double gpuMilliseconds, float renderedScale);
+
+	float GetScale() const { return m_Scale; }
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	DynamicResolutionSettings m_Settings;
+	float m_Scale = 1.0f;
+
+	bool m_HaveHistory = false;
+	double m_Smoothed = 0.0;      // milliseconds at m_Scale
+	double m_PreviousError = 0.0;
+	double m_PreviousDelta = 0.0; // error change of the previous frame
+
+	Stats m_Stats;
+};
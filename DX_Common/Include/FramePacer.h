@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <dxgi1_6.h>
+
+// The swap chain as FramePacer sees it. DxgiPresentQueue is the real one;
+// tests drive the pacing with their own.
+class PresentQueue
+{
+public:
+	virtual ~PresentQueue() = default;
+
+	// Blocks until the display can take another frame without going over
+	// the maximum frame latency. False if it timed out.
+	virtual bool WaitForFrame(DWORD timeoutMilliseconds) = 0;
+	virtual HRESULT Present(UINT syncInterval, UINT flags) = 0;
+	// Tearing is not allowed in exclusive fullscreen.
+	virtual bool IsExclusiveFullscreen() = 0;
+};
+
+// A flip-model swap chain created with
+// DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT.
+class DxgiPresentQueue : public PresentQueue
+{
+public:
+	DxgiPresentQueue() = default;
+	DxgiPresentQueue(const DxgiPresentQueue& rhs) = delete;
+	DxgiPresentQueue& operator=(const DxgiPresentQueue& rhs) = delete;
+	~DxgiPresentQueue();
+
+	// Sets the maximum frame latency and takes the waitable object.
+	// 'swapChain' may be null to let go of the current one.
+	void Reset(IDXGISwapChain2* swapChain, UINT maxFrameLatency);
+
+	bool WaitForFrame(DWORD timeoutMilliseconds) override;
+	HRESULT Present(UINT syncInterval, UINT flags) override;
+	bool IsExclusiveFullscreen() override;
+
+private:
+	Microsoft::WRL::ComPtr<IDXGISwapChain2> m_SwapChain;
+	HANDLE m_FrameLatencyWaitable = nullptr;
+};
+
+// == Frame pacing ==
+//
+// With the legacy swap chain the CPU ran up to three frames ahead of the
+// display, so input sampled at the start of a frame reached the screen
+// frames later. FramePacer paces a flip-model swap chain instead:
+//
+//  - WaitForFrame(), at the start of a frame, before input is read, waits
+//    on the frame-latency waitable object. It is signaled when the queue of
+//    presented frames drops below the maximum frame latency, so with a
+//    latency of 1 the frame starts just as the previous one is picked up
+//    by the display and is displayed as soon as it is done.
+//  - Present() presents with vsync, or without it. Without vsync, if the
+//    display and driver allow tearing (DXGI_FEATURE_PRESENT_ALLOW_TEARING),
+//    it passes DXGI_PRESENT_ALLOW_TEARING, which variable refresh rate
+//    displays need to show frames the moment they are done.
+//
+// The waitable object must be waited on once per Present(); a wait that
+// times out (minimized or occluded window) is counted and the frame goes
+// ahead anyway.
+class FramePacer
+{
+public:
+	// Long enough for a 10 Hz display; a hung wait means the window is gone.
+	static const DWORD WaitTimeoutMilliseconds = 100;
+
+	struct Stats
+	{
+		UINT64 Frames = 0;
+		UINT64 WaitTimeouts = 0;
+		UINT64 TearingPresents = 0;
+		UINT64 OccludedPresents = 0;   // DXGI_STATUS_OCCLUDED; the app may throttle
+		double LastWaitMilliseconds = 0.0;
+		double TotalWaitMilliseconds = 0.0;
+	};
+
+	FramePacer();
+	FramePacer(const FramePacer& rhs) = delete;
+	FramePacer& operator=(const FramePacer& rhs) = delete;
+
+	// 'tearingSupported' is what CheckTearingSupport() returned.
+	void SetPresentQueue(PresentQueue* queue, bool tearingSupported);
+	void SetVSync(bool vsync) { m_VSync = vsync; }
+	bool GetVSync() const { return m_VSync; }
+
+	void WaitForFrame();
+	HRESULT Present();
+
+	// The SyncInterval and flags Present() uses right now.
+	void GetPresentParameters(UINT& syncInterval, UINT& flags) const;
+
+	// Whether the factory, driver and display allow DXGI_PRESENT_ALLOW_TEARING.
+	static bool CheckTearingSupport(IDXGIFactory5* factory);
+
+	bool IsTearingSupported() const { return m_TearingSupported; }
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	PresentQueue* m_Queue = nullptr;
+	bool m_TearingSupported = false;
+	bool m_VSync = true;
+	bool m_Waited = false; // WaitForFrame() called since the last Present()
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <vector>
+
+// == GPU frame timer ==
+//
+// Measures how long the GPU spends on each frame with a pair of timestamp
+// queries. A frame's timestamps are resolved into a readback buffer and can
+// only be read once the GPU has finished the frame, so there is one slot per
+// frame in flight (D3DApp uses the back buffer index): Begin()/End() write
+// a slot, and Read() returns its time once the fence guarding it has
+// passed.
+class GpuFrameTimer
+{
+public:
+	GpuFrameTimer() = default;
+	GpuFrameTimer(const GpuFrameTimer& rhs) = delete;
+	GpuFrameTimer& operator=(const GpuFrameTimer& rhs) = delete;
+	~GpuFrameTimer();
+
+	// 'queue' is the queue the frames run on; its timestamp frequency
+	// converts ticks to milliseconds.
+	void Initialize(ID3D12Device* device, ID3D12CommandQueue* queue, UINT slotCount);
+
+	void Begin(ID3D12GraphicsCommandList* commandList, UINT slot);
+	// Writes the end timestamp and resolves both into the readback buffer.
+	void End(ID3D12GraphicsCommandList* commandList, UINT slot);
+
+	// The slot's last frame in milliseconds. False if the slot has no
+	// frame ended since the last Read(). The GPU must be done with it.
+	bool Read(UINT slot, double& milliseconds);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> m_QueryHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_Readback;
+	const UINT64* m_Timestamps = nullptr; // m_Readback, persistently mapped
+	std::vector<bool> m_Ended;
+	double m_MillisecondsPerTick = 0.0;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Small, stable (platform and run independent) hashing helpers.
+// std::hash is not guaranteed to produce the same value across runs or
+// compilers, so anything that is written to disk must use these instead.
+
+// 64-bit FNV-1a. Pass the previous result as 'seed' to hash data in pieces.
+inline uint64_t Fnv1a64(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline uint64_t Fnv1a64(const std::string& str, uint64_t seed = 14695981039346656037ull)
+{
+	return Fnv1a64(str.data(), str.size(), seed);
+}
+
+inline uint64_t Fnv1a64(const std::wstring& str, uint64_t seed = 14695981039346656037ull)
+{
+	return Fnv1a64(str.data(), str.size() * sizeof(wchar_t), seed);
+}
+
+// Mixes 'value' into 'seed' (boost::hash_combine style, widened to 64 bits).
+inline uint64_t HashCombine(uint64_t seed, uint64_t value)
+{
+	return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 12) + (seed >> 4));
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+class ThreadPool;
+
+enum class MipFilter
+{
+	Box,    // 2x2 average (area-weighted for odd sizes). Fast, slightly blurry.
+	Kaiser, // Kaiser-windowed sinc. Sharper, less aliasing, a bit of ringing.
+};
+
+// Instruction set used by the filter kernels. Detected at start-up; forcing
+// Scalar gives a reference result to compare the SIMD paths against.
+enum class MipSimdLevel
+{
+	Scalar,
+	SSE,
+	AVX,
+};
+
+// == CPU mip-chain generator ==
+//
+// Builds mips 1..N-1 of a texture from its mip 0. Works in place on memory
+// that is already laid out as GetCopyableFootprints describes, i.e. an upload
+// buffer, a mapped staging ring or a buffer that is later handed to
+// StreamingUploader::UploadTexture. Nothing is re-laid-out afterwards:
+//
+//   std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(subresourceCount);
+//   ComputeCopyableFootprints(desc, 0, subresourceCount, 0, layouts.data(), ..., &totalBytes);
+//   std::vector<BYTE> data(totalBytes);
+//   ... copy the rows of mip 0 of every array slice to data + layouts[...].Offset ...
+//   mipGenerator.Generate(desc, data.data(), layouts.data(), MipFilter::Kaiser);
+//   uploader.UploadTexture(texture, 0, subresourceCount, data.data(), layouts.data());
+//
+// Filtering happens in linear space in 32-bit float. sRGB formats are decoded
+// before filtering and re-encoded afterwards (alpha stays linear). Each mip is
+// built from the float result of the previous one, so quantization error does
+// not accumulate down the chain.
+//
+// Rows of a mip are distributed across the thread pool (when one is given).
+//
+// Supported formats: R8/R8G8/R8G8B8A8/B8G8R8A8/B8G8R8X8 UNORM (with their
+// _SRGB variants) and A8_UNORM, plus the 32-bit float formats R32, R32G32,
+// R32G32B32 and R32G32B32A32. Block-compressed textures must have their mips
+// generated before compression.
+class MipGenerator
+{
+public:
+	explicit MipGenerator(ThreadPool* pool = nullptr);
+
+	static bool IsFormatSupported(DXGI_FORMAT format);
+
+	// Highest instruction set the CPU and OS support.
+	static MipSimdLevel GetSupportedSimdLevel();
+
+	// Clamped to GetSupportedSimdLevel().
+	void SetSimdLevel(MipSimdLevel level);
+	MipSimdLevel GetSimdLevel() const { return m_SimdLevel; }
+
+	// 'desc' must be a 1D or 2D texture with MipLevels > 0. 'layouts' holds
+	// MipLevels * ArraySize footprints in subresource order, with offsets
+	// relative to 'data'. Mip 0 of each array slice is read; every other mip
+	// is overwritten. Returns false for unsupported formats or dimensions.
+	bool Generate(
+		const D3D12_RESOURCE_DESC& desc,
+		void* data,
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts,
+		MipFilter filter = MipFilter::Box) const;
+
+private:
+	ThreadPool* m_Pool = nullptr;
+	MipSimdLevel m_SimdLevel = MipSimdLevel::Scalar;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <cstring>
+
+// Size, sample count, formats and clear colour of the offscreen MSAA
+// targets. A SampleCount of 0 means there are none.
+struct MsaaTargetDesc
+{
+	UINT Width = 0;
+	UINT Height = 0;
+	UINT SampleCount = 0;
+	UINT Quality = 0;
+	DXGI_FORMAT ColorFormat = DXGI_FORMAT_UNKNOWN;
+	DXGI_FORMAT DepthFormat = DXGI_FORMAT_UNKNOWN;
+	// The colour target's optimized clear value; clears with another colour
+	// are slower on some hardware.
+	float ClearColor[4] = {};
+
+	bool operator==(const MsaaTargetDesc& rhs) const
+	{
+		return Width == rhs.Width && Height == rhs.Height && SampleCount == rhs.SampleCount &&
+			Quality == rhs.Quality && ColorFormat == rhs.ColorFormat && DepthFormat == rhs.DepthFormat &&
+			memcmp(ClearColor, rhs.ClearColor, sizeof(ClearColor)) == 0;
+	}
+	bool operator!=(const MsaaTargetDesc& rhs) const { return !(*this == rhs); }
+};
+
+// Creates and releases the targets for MsaaTarget.
+// D3D12MsaaTargetAllocator is the real one; tests drive MsaaTarget with
+// their own.
+class MsaaTargetAllocator
+{
+public:
+	virtual ~MsaaTargetAllocator() = default;
+
+	// Only called with the previous targets released.
+	virtual void Allocate(const MsaaTargetDesc& desc) = 0;
+	virtual void Release() = 0;
+};
+
+// A multisampled colour target and depth buffer, each with its view,
+// registered with ResourceStateTracker in RENDER_TARGET and DEPTH_WRITE.
+class D3D12MsaaTargetAllocator : public MsaaTargetAllocator
+{
+public:
+	D3D12MsaaTargetAllocator() = default;
+	D3D12MsaaTargetAllocator(const D3D12MsaaTargetAllocator& rhs) = delete;
+	D3D12MsaaTargetAllocator& operator=(const D3D12MsaaTargetAllocator& rhs) = delete;
+	~D3D12MsaaTargetAllocator();
+
+	// Creates the RTV and DSV heaps, one descriptor each.
+	void Initialize(ID3D12Device* device);
+
+	void Allocate(const MsaaTargetDesc& desc) override;
+	void Release() override;
+
+	ID3D12Resource* ColorBuffer() const { return m_ColorBuffer.Get(); }
+	ID3D12Resource* DepthBuffer() const { return m_DepthBuffer.Get(); }
+	D3D12_CPU_DESCRIPTOR_HANDLE ColorView() const;
+	D3D12_CPU_DESCRIPTOR_HANDLE DepthView() const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_RtvHeap;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_DsvHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_ColorBuffer;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_DepthBuffer;
+};
+
+// == Offscreen MSAA ==
+//
+// Flip-model swap chains cannot be multisampled, so MSAA used to mean
+// recreating the swap chain, and did not work with FLIP_DISCARD at all.
+// Instead, the scene is drawn into a multisampled colour target and depth
+// buffer, and the colour target is resolved into the back buffer at the
+// end of the render pass (RenderPassStoreOp::Resolve: a render pass
+// RESOLVE, or ResolveSubresource where render passes are emulated).
+//
+// MsaaTarget keeps the wanted settings apart from the allocated targets:
+//
+//  - SetSampleCount(), Resize(), SetFormats() and SetClearColor() only
+//    record what is wanted. A sample count of 1 turns MSAA off.
+//  - Update(), between frames with the GPU idle, brings the targets in line
+//    with it: nothing if they already match, a release if MSAA is off (or
+//    the size is 0), else a release and an allocation. The swap chain is
+//    never touched.
+//
+// Settings changed several times between two Update() calls cost at most
+// one reallocation; toggling MSAA on and back off costs none.
+class MsaaTarget
+{
+public:
+	struct Stats
+	{
+		UINT Allocations = 0;
+		UINT Releases = 0;
+		UINT CoalescedChanges = 0; // settings changes that needed no allocation of their own
+		double LastAllocateMilliseconds = 0.0;
+	};
+
+	MsaaTarget();
+	MsaaTarget(const MsaaTarget& rhs) = delete;
+	MsaaTarget& operator=(const MsaaTarget& rhs) = delete;
+
+	void SetAllocator(MsaaTargetAllocator* allocator) { m_Allocator = allocator; }
+
+	void SetFormats(DXGI_FORMAT colorFormat, DXGI_FORMAT depthFormat);
+	// Takes effect with a reallocation, so it should rarely change.
+	void SetClearColor(const float color[4]);
+	// 'sampleCount' of 1 turns MSAA off. 'quality' is below what
+	// CheckFeatureSupport reports for the count.
+	void SetSampleCount(UINT sampleCount, UINT quality);
+	void Resize(UINT width, UINT height);
+
+	// Whether the settings ask for MSAA, allocated yet or not.
+	bool IsEnabled() const { return m_Requested.SampleCount > 1; }
+	// True if Update() has work to do.
+	bool IsPending() const { return Wanted() != m_Allocated; }
+
+	// Reallocates or releases the targets as needed; the GPU must be done
+	// with them. True if anything changed.
+	bool Update();
+
+	// What is allocated now; SampleCount is 0 if nothing is.
+	const MsaaTargetDesc& GetDesc() const { return m_Allocated; }
+	bool IsAllocated() const { return m_Allocated.SampleCount > 0; }
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	// m_Requested, or nothing if it asks for no MSAA or no pixels.
+	MsaaTargetDesc Wanted() const;
+	void Changed();
+
+private:
+	MsaaTargetAllocator* m_Allocator = nullptr;
+	MsaaTargetDesc m_Requested;
+	MsaaTargetDesc m_Allocated;
+	UINT m_ChangesSinceUpdate = 0;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
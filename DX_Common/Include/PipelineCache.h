@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace PipelineCacheFormat
+{
+	const UINT32 Magic = 0x4C505844; // "DXPL"
+	// Bump when the file layout or PipelineCache::HashPipelineStream changes;
+	// either one makes the names stored in an old library meaningless.
+	const UINT32 Version = 2;
+}
+
+// Written in front of the serialized ID3D12PipelineLibrary. A library is
+// only valid for the adapter and driver that produced it, so the identity of
+// both is kept to throw stale files away before handing them to the driver.
+struct PipelineCacheHeader
+{
+	UINT32 Magic;
+	UINT32 Version;
+	UINT32 VendorId;
+	UINT32 DeviceId;
+	UINT32 SubSysId;
+	UINT32 Revision;
+	UINT64 DriverVersion; // user mode driver version reported by DXGI
+	UINT64 LibrarySize;
+	UINT64 LibraryHash;   // FNV-1a of the serialized library
+};
+static_assert(sizeof(PipelineCacheHeader) == 48, "PipelineCacheHeader layout changed; bump PipelineCacheFormat::Version");
+
+// == Pipeline state cache ==
+//
+// Creating a pipeline state compiles its shaders to GPU code, which can take
+// tens of milliseconds per pipeline. Doing that for every pipeline on every
+// start dominates cold start, so pipelines go through this cache:
+//
+//  1. The pipeline description (a pipeline state stream) is canonicalized
+//     by PipelineCanonicalizer and hashed into a stable 64-bit key. Shaders
+//     are hashed by bytecode, root signatures by their serialized form, and
+//     pointers are followed, so two streams describing the same pipeline
+//     give the same key in every run.
+//  2. The key is looked up in memory; identical requests share one object.
+//  3. Otherwise the pipeline is loaded from an ID3D12PipelineLibrary, which
+//     holds the driver's compiled code from previous runs.
+//  4. Otherwise it is compiled and stored into the library.
+//
+// Save() writes the library to disk. On the next start Initialize() reads it
+// back, unless the file is from another format version, adapter or driver,
+// in which case it is discarded and rebuilt.
+//
+// Root signatures must be registered with RegisterRootSignature() to get a
+// stable key. Pipelines using an unregistered one are still cached in
+// memory, but never stored in the library.
+//
+// GetOrCreate() may be called from several threads at once.
+class PipelineCache
+{
+public:
+	struct Stats
+	{
+		UINT Requests = 0;
+		UINT MemoryHits = 0;
+		UINT LibraryHits = 0;
+		UINT Compiles = 0;
+		bool LibraryFromDisk = false;  // Initialize() found a valid file
+		double InitializeMilliseconds = 0.0;
+		double LibraryMilliseconds = 0.0; // total time spent in LoadPipeline that hit
+		double CompileMilliseconds = 0.0; // total time spent compiling
+	};
+
+	PipelineCache();
+	~PipelineCache() = default;
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+
+	void Initialize(ID3D12Device* device, const std::wstring& filename);
+
+	// Writes the library if anything was added since it was loaded. Returns
+	// false if the file could not be written.
+	bool Save();
+
+	void RegisterRootSignature(ID3D12RootSignature* rootSignature, const void* serializedBlob, SIZE_T size);
+
+	// The returned pipeline is owned by the cache and lives as long as it.
+	ID3D12PipelineState* GetOrCreate(const D3D12_PIPELINE_STATE_STREAM_DESC& desc);
+	ID3D12PipelineState* GetOrCreate(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	ID3D12PipelineState* GetOrCreate(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// Hash of the canonicalized stream. 'persistent' is set to false if the
+	// key depends on something that changes between runs (an unregistered
+	// root signature). Returns 0 for a malformed stream.
+	uint64_t HashPipelineStream(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, bool* persistent = nullptr) const;
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	void ReadAdapterIdentity(ID3D12Device* device);
+	bool LoadLibraryFile();
+	void CreateEmptyLibrary();
+	bool LoadFromLibrary(const std::wstring& name, const D3D12_PIPELINE_STATE_STREAM_DESC& desc,
+		Microsoft::WRL::ComPtr<ID3D12PipelineState>& pipeline);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary1> m_Library;
+	std::wstring m_Filename;
+	PipelineCacheHeader m_Identity = {}; // adapter and driver of this run
+
+	// CreatePipelineLibrary does not copy the blob it is given.
+	std::vector<BYTE> m_LibraryBlob;
+	bool m_Dirty = false;
+
+	mutable std::mutex m_Mutex; // everything below, and m_Dirty / m_Stats
+	std::mutex m_LibraryMutex;  // m_Library calls
+	std::unordered_map<uint64_t, Microsoft::WRL::ComPtr<ID3D12PipelineState>> m_Pipelines;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12PipelineState>> m_Uncached; // streams HashPipelineStream could not parse
+	std::unordered_map<ID3D12RootSignature*, uint64_t> m_RootSignatures;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
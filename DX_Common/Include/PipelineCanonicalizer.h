@@ -0,0 +1,158 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CanonicalShader
+{
+	uint64_t Hash = 0; // 0 = no shader
+	SIZE_T Size = 0;
+
+	bool operator==(const CanonicalShader& rhs) const { return Hash == rhs.Hash && Size == rhs.Size; }
+	bool operator!=(const CanonicalShader& rhs) const { return !(*this == rhs); }
+};
+
+struct CanonicalInputElement
+{
+	std::string SemanticName;
+	UINT SemanticIndex = 0;
+	DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+	UINT InputSlot = 0;
+	UINT AlignedByteOffset = 0;
+	D3D12_INPUT_CLASSIFICATION InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
+	UINT InstanceDataStepRate = 0;
+};
+
+struct CanonicalStreamOutputEntry
+{
+	UINT Stream = 0;
+	std::string SemanticName;
+	UINT SemanticIndex = 0;
+	BYTE StartComponent = 0;
+	BYTE ComponentCount = 0;
+	BYTE OutputSlot = 0;
+};
+
+// D3D12_DEPTH_STENCILOP_DESC1: per-face masks, as in D3D12_DEPTH_STENCIL_DESC2.
+struct CanonicalStencilFace
+{
+	D3D12_STENCIL_OP FailOp = D3D12_STENCIL_OP_KEEP;
+	D3D12_STENCIL_OP DepthFailOp = D3D12_STENCIL_OP_KEEP;
+	D3D12_STENCIL_OP PassOp = D3D12_STENCIL_OP_KEEP;
+	D3D12_COMPARISON_FUNC Func = D3D12_COMPARISON_FUNC_ALWAYS;
+	UINT8 ReadMask = D3D12_DEFAULT_STENCIL_READ_MASK;
+	UINT8 WriteMask = D3D12_DEFAULT_STENCIL_WRITE_MASK;
+};
+
+// Every subobject a pipeline state stream can carry, in its newest form and
+// with the defaults the runtime applies to absent subobjects filled in.
+// Depth-stencil state follows D3D12_DEPTH_STENCIL_DESC2 and rasterizer state
+// D3D12_RASTERIZER_DESC2 (float depth bias, LineRasterizationMode using the
+// D3D12_LINE_RASTERIZATION_MODE values), whichever version the stream used.
+struct CanonicalPipelineDesc
+{
+	ID3D12RootSignature* RootSignature = nullptr;
+	uint64_t SerializedRootSignature = 0; // FNV-1a of an embedded blob, 0 = none
+
+	CanonicalShader VS, PS, DS, HS, GS, CS, AS, MS;
+
+	std::vector<CanonicalInputElement> InputLayout;
+	D3D12_INDEX_BUFFER_STRIP_CUT_VALUE IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
+	D3D12_PRIMITIVE_TOPOLOGY_TYPE PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+
+	std::vector<CanonicalStreamOutputEntry> StreamOutput;
+	std::vector<UINT> StreamOutputStrides;
+	UINT RasterizedStream = 0;
+
+	D3D12_BLEND_DESC Blend = {};
+	UINT SampleMask = UINT_MAX;
+
+	D3D12_FILL_MODE FillMode = D3D12_FILL_MODE_SOLID;
+	D3D12_CULL_MODE CullMode = D3D12_CULL_MODE_BACK;
+	BOOL FrontCounterClockwise = FALSE;
+	FLOAT DepthBias = 0.0f;
+	FLOAT DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
+	FLOAT SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
+	BOOL DepthClipEnable = TRUE;
+	UINT LineRasterizationMode = 0; // ALIASED
+	UINT ForcedSampleCount = 0;
+	D3D12_CONSERVATIVE_RASTERIZATION_MODE ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+	BOOL DepthEnable = FALSE;
+	D3D12_DEPTH_WRITE_MASK DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+	D3D12_COMPARISON_FUNC DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+	BOOL StencilEnable = FALSE;
+	CanonicalStencilFace FrontFace;
+	CanonicalStencilFace BackFace;
+	BOOL DepthBoundsTestEnable = FALSE;
+
+	UINT NumRenderTargets = 0;
+	DXGI_FORMAT RTVFormats[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+	DXGI_FORMAT DSVFormat = DXGI_FORMAT_UNKNOWN;
+	DXGI_SAMPLE_DESC SampleDesc = { 1, 0 };
+
+	std::vector<D3D12_VIEW_INSTANCE_LOCATION> ViewInstances;
+	D3D12_VIEW_INSTANCING_FLAGS ViewInstancingFlags = D3D12_VIEW_INSTANCING_FLAG_NONE;
+
+	UINT NodeMask = 0;
+	D3D12_PIPELINE_STATE_FLAGS Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+
+	bool IsCompute() const { return CS.Hash != 0; }
+};
+
+struct PipelineFieldDiff
+{
+	std::string Field; // e.g. "Blend.RenderTarget[0].SrcBlend"
+	std::string A;
+	std::string B;
+};
+
+// == Pipeline state stream canonicalization ==
+//
+// The same pipeline can be written as many different streams: subobjects
+// in any order, left out or spelled out with their default values,
+// D3D12_DEPTH_STENCIL_DESC vs DESC1 vs DESC2, graphics state in a compute
+// stream built from CD3DX12_PIPELINE_STATE_STREAM, blend factors on a
+// render target with blending disabled... Canonicalize() parses a stream
+// with D3DX12ParsePipelineStream into a CanonicalPipelineDesc and then
+// resets every field the pipeline cannot observe to its default:
+//
+//  - compute pipelines keep only the root signatures, CS, node mask and flags
+//  - blend factors of render targets without blending, logic ops of render
+//    targets without logic ops, and render targets 1..7 when independent
+//    blending is off or beyond NumRenderTargets
+//  - RTV formats beyond NumRenderTargets
+//  - depth write mask and function when depth is off, stencil faces when
+//    stencil is off
+//  - sample mask bits beyond the sample count
+//
+// Pipelines that differ only in such fields then hash alike and collapse
+// into one pipeline state object. Diff() lists the fields two pipelines
+// still differ in, to find near duplicates that could be merged by hand.
+//
+// Nothing here needs a device or Windows APIs beyond the D3D12 headers.
+class PipelineCanonicalizer
+{
+public:
+	// Returns false if the stream is malformed or holds a subobject type
+	// these headers do not know.
+	static bool Canonicalize(const D3D12_PIPELINE_STATE_STREAM_DESC& stream, CanonicalPipelineDesc& desc);
+
+	// 'rootSignatureHash' stands in for desc.RootSignature, which is only a
+	// pointer; pass a hash of the serialized root signature for a key that
+	// is stable across runs.
+	static uint64_t Hash(const CanonicalPipelineDesc& desc, uint64_t rootSignatureHash);
+
+	static std::vector<PipelineFieldDiff> Diff(const CanonicalPipelineDesc& a, const CanonicalPipelineDesc& b);
+
+	// Hash of a shader's bytecode (the container digest when it has one).
+	static CanonicalShader HashShader(const D3D12_SHADER_BYTECODE& bytecode);
+
+private:
+	static void Normalize(CanonicalPipelineDesc& desc);
+};
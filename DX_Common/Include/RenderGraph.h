@@ -0,0 +1,317 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class BarrierBackend;
+class RenderGraph;
+
+// Index of a resource declared in a RenderGraph. Only valid for the frame
+// it was declared in.
+typedef UINT RenderGraphHandle;
+const RenderGraphHandle InvalidRenderGraphHandle = ~0u;
+
+enum class RenderGraphQueue
+{
+	Graphics,
+	AsyncCompute, // honoured only if a compute queue is available and every use is legal on it
+};
+
+// Handed to a pass's setup callback to declare what it touches.
+class RenderGraphBuilder
+{
+public:
+	// Declares a transient resource owned by the graph. Its memory may be
+	// shared with other transients whose lifetimes do not overlap, so the
+	// first pass that uses it must write every texel it later reads.
+	RenderGraphHandle Create(const std::string& name, const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue = nullptr);
+
+	// A pass that blends or draws on top of existing contents both reads
+	// and writes the resource.
+	RenderGraphHandle Read(RenderGraphHandle resource, D3D12_RESOURCE_STATES state);
+	RenderGraphHandle Write(RenderGraphHandle resource, D3D12_RESOURCE_STATES state);
+
+	// The pass does something outside the graph (readback, present, UI...),
+	// so it is never culled.
+	void SetSideEffect();
+
+private:
+	friend class RenderGraph;
+	RenderGraphBuilder(RenderGraph* graph, UINT pass) : m_Graph(graph), m_Pass(pass) {}
+
+	RenderGraph* m_Graph;
+	UINT m_Pass;
+};
+
+// Handed to a pass's execute callback.
+class RenderGraphContext
+{
+public:
+	ID3D12GraphicsCommandList* CommandList = nullptr;
+
+	ID3D12Resource* GetResource(RenderGraphHandle resource) const;
+
+private:
+	friend class RenderGraph;
+	const RenderGraph* m_Graph = nullptr;
+};
+
+// == Render graph (frame graph) ==
+//
+// Rather than hand-wiring resources, barriers and clears inside one big
+// Draw(), a frame is described as a list of passes that declare which
+// (virtual) resources they read and write. From that the graph compiles:
+//
+//  1. Culling. A pass is kept only if it has a side effect, writes an
+//     imported resource, or produces something a kept pass reads.
+//  2. Ordering. Kept passes are sorted topologically over their
+//     read-after-write, write-after-read and write-after-write dependencies.
+//     Async compute passes are hoisted as early as their dependencies allow
+//     so they overlap more graphics work.
+//  3. Queues. Consecutive passes on the same queue form a batch; batches
+//     wait on each other through a fence only where a dependency crosses
+//     queues.
+//  4. Barriers. Every (resource, pass) state change becomes a transition,
+//     split into BEGIN_ONLY/END_ONLY halves when there is work in between
+//     (see SplitBarrierScheduler). Transitions a compute list cannot record
+//     are placed on the graphics queue after the resource's last use there.
+//  5. Transient memory. Transient resources are placed resources. Their
+//     lifetimes (first to last use) are packed into as few heap bytes as
+//     possible, so resources that are never alive at the same time share
+//     memory. The first use of aliased memory gets an aliasing barrier and,
+//     for render targets / depth / UAV textures, a DiscardResource.
+//
+// Usage, once per frame:
+//
+//   graph.Reset();
+//   RenderGraphHandle backBuffer = graph.ImportResource("BackBuffer", buffer,
+//       D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+//   RenderGraphHandle hdr;
+//   graph.AddPass("Scene", RenderGraphQueue::Graphics,
+//       [&](RenderGraphBuilder& builder) {
+//           hdr = builder.Create("HDR", hdrDesc, &clear);
+//           builder.Write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET); },
+//       [&](RenderGraphContext& context) { ... draw into context.GetResource(hdr) ... });
+//   graph.AddPass("Tonemap", ...reads hdr as PIXEL_SHADER_RESOURCE, writes backBuffer...);
+//   graph.Compile(device, computeQueue != nullptr);
+//   graph.Execute(params);
+//
+// Compile(nullptr, ...) runs every step except creating heaps and placed
+// resources, which needs the device. With SetAllocationInfoFunc() it still
+// packs the transients, so compile times, offsets, queues and waits can be
+// measured and tested without a GPU.
+class RenderGraph
+{
+public:
+	typedef std::function<void(RenderGraphBuilder&)> SetupFunc;
+	typedef std::function<void(RenderGraphContext&)> ExecuteFunc;
+	typedef std::function<D3D12_RESOURCE_ALLOCATION_INFO(const D3D12_RESOURCE_DESC&)> AllocationInfoFunc;
+
+	struct ExecuteParams
+	{
+		ID3D12CommandQueue* GraphicsQueue = nullptr;
+		ID3D12CommandQueue* ComputeQueue = nullptr; // required if Compile() was told it is available
+
+		// Signaled after every batch; waited on across queues.
+		ID3D12Fence* Fence = nullptr;
+		UINT64* FenceValue = nullptr;
+
+		// Returns an open command list of the given type. The caller owns it
+		// and keeps its allocator alive until the GPU is done with the frame.
+		std::function<ID3D12GraphicsCommandList*(D3D12_COMMAND_LIST_TYPE)> AcquireCommandList;
+
+		BarrierBackend* Backend = nullptr;
+	};
+
+	struct Stats
+	{
+		UINT PassesDeclared = 0;
+		UINT PassesCulled = 0;
+		UINT AsyncComputePasses = 0;
+		UINT Batches = 0;
+		UINT Transitions = 0;
+		UINT SplitTransitions = 0;
+		UINT AliasingBarriers = 0;
+		UINT TransientResources = 0;
+		UINT64 TransientHeapBytes = 0;   // after aliasing
+		UINT64 TransientResourceBytes = 0; // sum of the individual sizes
+		double CompileMilliseconds = 0.0;
+	};
+
+	RenderGraph();
+	~RenderGraph();
+	RenderGraph(const RenderGraph& rhs) = delete;
+	RenderGraph& operator=(const RenderGraph& rhs) = delete;
+
+	// An externally owned resource (e.g. the back buffer). 'currentState' is
+	// the state it is in when the graph starts; the graph leaves it in
+	// 'finalState'.
+	RenderGraphHandle ImportResource(const std::string& name, ID3D12Resource* resource,
+		D3D12_RESOURCE_STATES currentState, D3D12_RESOURCE_STATES finalState);
+
+	// 'setup' runs immediately; 'execute' runs from Execute() if the pass survives culling.
+	UINT AddPass(const std::string& name, RenderGraphQueue queue, const SetupFunc& setup, const ExecuteFunc& execute);
+
+	// Sizes transients when Compile() has no device. The layout is planned as
+	// for resource heap tier 2 (one heap for everything).
+	void SetAllocationInfoFunc(const AllocationInfoFunc& allocationInfo) { m_AllocationInfo = allocationInfo; }
+
+	void Compile(ID3D12Device* device, bool asyncComputeAvailable);
+	void Execute(const ExecuteParams& params);
+
+	// Forgets the declared passes and resources. Transient heaps and placed
+	// resources are kept and reused as long as the next frame's layout is the same.
+	void Reset();
+
+	bool IsPassCulled(UINT pass) const { return m_Passes[pass].Culled; }
+	RenderGraphQueue GetPassQueue(UINT pass) const { return m_Passes[pass].Queue; }
+	UINT GetPassBatch(UINT pass) const { return m_Passes[pass].Batch; }
+
+	// The kept passes in execution order.
+	UINT GetStepCount() const { return static_cast<UINT>(m_Steps.size()); }
+	UINT GetStepPass(UINT step) const { return m_Steps[step].Pass; }
+
+	// Batches in submission order, and the batches on the other queue each
+	// one waits for.
+	UINT GetBatchCount() const { return static_cast<UINT>(m_Batches.size()); }
+	RenderGraphQueue GetBatchQueue(UINT batch) const { return m_Batches[batch].Queue; }
+	const std::vector<UINT>& GetBatchWaits(UINT batch) const { return m_Batches[batch].Waits; }
+
+	// Where a transient was placed in its heap, and whether another
+	// transient shares any of that memory.
+	UINT64 GetTransientOffset(RenderGraphHandle resource) const { return m_Resources[resource].HeapOffset; }
+	bool IsTransientAliased(RenderGraphHandle resource) const { return m_Resources[resource].Aliased; }
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	friend class RenderGraphBuilder;
+	friend class RenderGraphContext;
+
+	struct Access
+	{
+		RenderGraphHandle Resource;
+		D3D12_RESOURCE_STATES State;
+		bool Read;
+		bool Write;
+	};
+
+	struct PassNode
+	{
+		std::string Name;
+		RenderGraphQueue RequestedQueue;
+		RenderGraphQueue Queue; // after AssignQueues()
+		ExecuteFunc Execute;
+		std::vector<Access> Accesses;
+		std::vector<UINT> Dependencies; // passes that must run first
+		std::vector<UINT> Producers;    // subset of Dependencies this pass reads from
+		bool SideEffect = false;
+		bool Culled = false;
+		UINT Batch = 0;
+	};
+
+	struct ResourceNode
+	{
+		std::string Name;
+		bool Imported = false;
+		ID3D12Resource* Resource = nullptr; // imported resource, or the placed resource once allocated
+		D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON;
+		D3D12_RESOURCE_STATES FinalState = D3D12_RESOURCE_STATE_COMMON;
+		D3D12_RESOURCE_DESC Desc = {};
+		bool HasClearValue = false;
+		D3D12_CLEAR_VALUE ClearValue = {};
+
+		// Compile results (positions in the sorted pass list)
+		int FirstUse = -1;
+		int LastUse = -1;
+		bool UsedOnCompute = false;
+		UINT64 HeapOffset = 0;
+		bool Aliased = false;
+		int Physical = -1;
+	};
+
+	// What the execute step does around one pass.
+	struct BarrierOp
+	{
+		D3D12_RESOURCE_BARRIER_TYPE Type;
+		RenderGraphHandle Resource;
+		D3D12_RESOURCE_STATES StateBefore;
+		D3D12_RESOURCE_STATES StateAfter;
+		D3D12_RESOURCE_BARRIER_FLAGS Flags;
+	};
+
+	struct Step
+	{
+		UINT Pass;
+		std::vector<BarrierOp> Barriers;       // before the pass
+		std::vector<RenderGraphHandle> Discards; // after the barriers, before the pass
+	};
+
+	struct Batch
+	{
+		RenderGraphQueue Queue;
+		UINT FirstStep;
+		UINT StepCount;
+		std::vector<BarrierOp> TailBarriers; // after the last pass
+		std::vector<UINT> Waits;             // batches on the other queue to wait for
+	};
+
+	// A placed resource that survives across frames.
+	struct PhysicalResource
+	{
+		D3D12_RESOURCE_DESC Desc;
+		bool HasClearValue;
+		D3D12_CLEAR_VALUE ClearValue;
+		UINT Heap;
+		UINT64 Offset;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		D3D12_RESOURCE_STATES State; // state at the end of the last executed frame
+	};
+
+	struct RetiredObject
+	{
+		Microsoft::WRL::ComPtr<ID3D12Pageable> Object;
+		UINT FramesLeft;
+	};
+
+	RenderGraphHandle AddAccess(UINT pass, RenderGraphHandle resource, D3D12_RESOURCE_STATES state, bool write);
+
+	void BuildDependencies();
+	void CullPasses();
+	void SortPasses(bool asyncComputeAvailable);
+	void AllocateTransients(ID3D12Device* device);
+	void AssignQueues(bool asyncComputeAvailable);
+	void PlaceBarriers();
+	void AddWait(UINT consumerBatch, UINT producerBatch);
+	void RetireObjects();
+
+	void RecordBarriers(ID3D12GraphicsCommandList* commandList, const std::vector<BarrierOp>& ops, BarrierBackend* backend);
+
+private:
+	std::vector<PassNode> m_Passes;
+	std::vector<ResourceNode> m_Resources;
+
+	// Compile results
+	std::vector<Step> m_Steps;
+	std::vector<Batch> m_Batches;
+	std::vector<BarrierOp> m_EpilogueBarriers; // imported resources back to their final states
+	std::vector<D3D12_RESOURCE_STATES> m_ResourceEndStates;
+	bool m_Compiled = false;
+	bool m_HasPhysicalResources = false;
+
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> m_Heaps;
+	std::vector<PhysicalResource> m_Physical;
+	std::vector<RetiredObject> m_Retired;
+	AllocationInfoFunc m_AllocationInfo;
+
+	// Scratch for translating BarrierOps
+	std::vector<D3D12_RESOURCE_BARRIER> m_BarrierScratch;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
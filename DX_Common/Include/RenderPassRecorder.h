@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <functional>
+#include <vector>
+
+// What happens to an attachment's contents when a render pass begins.
+enum class RenderPassLoadOp
+{
+	Preserve, // keep what is there (costs a load from memory on tiled GPUs)
+	Clear,    // overwrite with ClearValue, cheaper than a separate clear
+	Discard,  // contents are undefined; the pass overwrites everything it reads
+	NoAccess, // the pass does not touch this attachment (e.g. stencil)
+};
+
+// What happens to an attachment's contents when a render pass ends.
+enum class RenderPassStoreOp
+{
+	Preserve, // write the results back to memory
+	Resolve,  // resolve MSAA samples into ResolveTarget
+	Discard,  // results are not needed after the pass (e.g. depth)
+	NoAccess,
+};
+
+struct RenderPassAttachment
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE View = {}; // RTV, or DSV for the depth-stencil attachment
+	ID3D12Resource* Resource = nullptr;    // needed for Discard and Resolve
+
+	RenderPassLoadOp Load = RenderPassLoadOp::Preserve;
+	RenderPassStoreOp Store = RenderPassStoreOp::Preserve;
+
+	D3D12_CLEAR_VALUE ClearValue = {}; // Load == Clear
+
+	// Store == Resolve: mip 0 / slice 0 of Resource is resolved into
+	// ResolveTarget, which must be in RESOLVE_DEST.
+	ID3D12Resource* ResolveTarget = nullptr;
+	DXGI_FORMAT ResolveFormat = DXGI_FORMAT_UNKNOWN;
+};
+
+struct RenderPassDesc
+{
+	UINT NumRenderTargets = 0;
+	RenderPassAttachment RenderTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+
+	bool HasDepthStencil = false;
+	RenderPassAttachment DepthStencil; // Load/Store/ClearValue apply to depth
+	RenderPassLoadOp StencilLoad = RenderPassLoadOp::NoAccess;
+	RenderPassStoreOp StencilStore = RenderPassStoreOp::NoAccess;
+
+	D3D12_RENDER_PASS_FLAGS Flags = D3D12_RENDER_PASS_FLAG_NONE;
+};
+
+// == Render passes with load/store operations ==
+//
+// Binding targets with OMSetRenderTargets and clearing them with
+// Clear*View tells the driver nothing about which contents matter. Tile
+// based GPUs then load every attachment from memory into tile memory at the
+// start and write everything back at the end. A render pass states it:
+// a cleared or discarded attachment needs no load, a discarded one (usually
+// depth) needs no store, and an MSAA colour target can be resolved straight
+// from tile memory.
+//
+// Passes are queued with AddPass() and recorded by Flush(). Adjacent passes
+// that render to the same attachments, where the second one only continues
+// what the first left behind, are merged into one BeginRenderPass/
+// EndRenderPass so the attachments stay in tile memory between them.
+//
+// The record callbacks run inside the render pass: they may set state and
+// draw, but must not record barriers, copies or clears. All attachments must
+// already be in RENDER_TARGET / DEPTH_WRITE when Flush() is called.
+//
+// Command lists without ID3D12GraphicsCommandList4 get the same behaviour
+// through OMSetRenderTargets, Clear*View, DiscardResource and
+// ResolveSubresource.
+class RenderPassRecorder
+{
+public:
+	typedef std::function<void(ID3D12GraphicsCommandList*)> RecordFunc;
+
+	struct Stats
+	{
+		UINT PassesAdded = 0;
+		UINT RenderPassesRecorded = 0; // PassesAdded minus the merged ones
+	};
+
+	RenderPassRecorder() = default;
+	RenderPassRecorder(const RenderPassRecorder& rhs) = delete;
+	RenderPassRecorder& operator=(const RenderPassRecorder& rhs) = delete;
+
+	// Queries D3D12_OPTIONS5 for the render pass tier (for reporting; the
+	// API works on every tier, tier 0 is emulated by the runtime).
+	void Initialize(ID3D12Device* device);
+	D3D12_RENDER_PASS_TIER GetRenderPassTier() const { return m_Tier; }
+
+	void AddPass(const RenderPassDesc& desc, const RecordFunc& record);
+	void Flush(ID3D12GraphicsCommandList* commandList);
+
+	// True if 'second' can continue inside 'first' without changing the
+	// result: same attachments and flags, 'first' keeps every attachment it
+	// writes, 'second' does not clear or resolve in between, and nothing
+	// 'first' discards is preserved by 'second'.
+	static bool CanMerge(const RenderPassDesc& first, const RenderPassDesc& second);
+	// The pass that begins like 'first' and ends like 'second'.
+	static RenderPassDesc Merge(const RenderPassDesc& first, const RenderPassDesc& second);
+
+	const Stats& GetStats() const { return m_Stats; }
+	void ResetStats() { m_Stats = Stats(); }
+
+private:
+	struct Pass
+	{
+		RenderPassDesc Desc;
+		std::vector<RecordFunc> Records;
+	};
+
+	void RecordNative(ID3D12GraphicsCommandList4* commandList, const Pass& pass);
+	void RecordEmulated(ID3D12GraphicsCommandList* commandList, const Pass& pass);
+
+private:
+	D3D12_RENDER_PASS_TIER m_Tier = D3D12_RENDER_PASS_TIER_0;
+	std::vector<Pass> m_Passes;
+	Stats m_Stats;
+};
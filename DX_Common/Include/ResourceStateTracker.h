@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class BarrierBackend;
+
+// == Automatic resource state tracking ==
+//
+// D3D12 makes the application track the state of every (sub)resource and
+// record a transition whenever it is used differently. Doing that by hand
+// is error prone and tends to produce one ResourceBarrier call per
+// transition. This class takes care of it for one command list:
+//
+//  * TransitionResource() records the state a (sub)resource must be in for
+//    the next command. The barrier is not recorded yet; it is queued.
+//  * Queued barriers are merged: A->B followed by B->C becomes A->C, A->B->A
+//    disappears, and a resource that is already in a compatible read state is
+//    left alone.
+//  * FlushBarriers() records everything queued in one ResourceBarrier call.
+//    Call it right before a draw, dispatch, copy or clear.
+//
+// A command list does not know the state a resource will be in when it
+// starts executing, since other lists may run first. So the first use of a
+// resource in a list is remembered as a "pending" barrier instead of being
+// recorded. At submission time, with the global lock held, the pending
+// barriers are resolved against the global states into a small fixup
+// command list that runs just before this one, and the list's final states
+// become the new global states. A first use the global state already
+// satisfies (GENERIC_READ for a PIXEL_SHADER_RESOURCE read) needs no fixup
+// as long as the list does not transition it further; the global state is
+// then left as it was:
+//
+//   tracker.FlushBarriers(commandList);
+//   commandList->Close();
+//   ResourceStateTracker::Lock();
+//   fixupList->Reset(allocator, nullptr);
+//   UINT fixups = tracker.FlushPendingBarriers(fixupList);
+//   fixupList->Close();
+//   tracker.CommitFinalStates();
+//   ResourceStateTracker::Unlock();
+//   execute { fixupList (if fixups > 0), commandList }
+//   tracker.Reset();
+//
+// D3DApp::ExecuteCommandList() wraps this sequence for the app's command list.
+//
+// With a BarrierBackend set, barriers are recorded through it (Enhanced
+// Barriers where supported) instead of ResourceBarrier.
+class ResourceStateTracker
+{
+public:
+	struct Stats
+	{
+		UINT64 TransitionsRequested = 0;
+		UINT64 TransitionsSkipped = 0;  // resource was already in a compatible state
+		UINT64 TransitionsMerged = 0;   // folded into a barrier that was still queued
+		UINT64 BarriersRecorded = 0;    // barriers that reached a command list
+		UINT64 BarrierBatches = 0;      // ResourceBarrier calls
+		UINT64 PendingBarriersResolved = 0;
+	};
+
+	ResourceStateTracker() = default;
+	ResourceStateTracker(const ResourceStateTracker& rhs) = delete;
+	ResourceStateTracker& operator=(const ResourceStateTracker& rhs) = delete;
+
+	// == Global states ==
+	// Every tracked resource must be registered with the state it was created
+	// in, and unregistered before it is released (the pointer is the key).
+	static void RegisterResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES initialState);
+	static void UnregisterResource(ID3D12Resource* resource);
+
+	// Serializes submissions. Hold it from FlushPendingBarriers() through
+	// CommitFinalStates() so no other list updates the global states in between.
+	static void Lock();
+	static void Unlock();
+
+	// Optional; the backend must outlive the tracker.
+	void SetBarrierBackend(BarrierBackend* backend) { m_Backend = backend; }
+
+	// True if a resource in 'current' can be used as 'wanted' without a
+	// barrier, e.g. GENERIC_READ already covers PIXEL_SHADER_RESOURCE.
+	static bool IsStateCompatible(D3D12_RESOURCE_STATES current, D3D12_RESOURCE_STATES wanted);
+
+	// == Recording ==
+	void TransitionResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter,
+		UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+	void UAVBarrier(ID3D12Resource* resource = nullptr);
+	void AliasBarrier(ID3D12Resource* resourceBefore, ID3D12Resource* resourceAfter);
+
+	// Records every queued barrier with a single ResourceBarrier call.
+	void FlushBarriers(ID3D12GraphicsCommandList* commandList);
+	// Same, but appends them to 'barriers' for a caller that records its own
+	// batches.
+	void FlushBarriers(std::vector<D3D12_RESOURCE_BARRIER>& barriers);
+
+	// == Submission ==
+	// Records the barriers that take each resource from its global state to
+	// the state this list expects it in. Returns how many were recorded.
+	UINT FlushPendingBarriers(ID3D12GraphicsCommandList* commandList);
+	UINT FlushPendingBarriers(std::vector<D3D12_RESOURCE_BARRIER>& barriers);
+	// Publishes the states the resources are in at the end of this list.
+	void CommitFinalStates();
+	// Forgets all per-list state; call before recording the list again.
+	void Reset();
+
+	const Stats& GetStats() const { return m_Stats; }
+	void ResetStats() { m_Stats = Stats(); }
+
+private:
+	struct LocalState
+	{
+		// Per subresource. s_UnknownState until the list first touches it.
+		std::vector<D3D12_RESOURCE_STATES> Current;
+		std::vector<D3D12_RESOURCE_STATES> Pending;
+		// True once a barrier was queued after the first use, i.e. the list
+		// relies on the subresource really being in its Pending state.
+		std::vector<bool> Transitioned;
+	};
+
+	LocalState& GetLocalState(ID3D12Resource* resource);
+	void QueueTransition(ID3D12Resource* resource, UINT subresource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after);
+	void RecordBarriers(ID3D12GraphicsCommandList* commandList, const std::vector<D3D12_RESOURCE_BARRIER>& barriers);
+	// Appends the fixup barriers for FlushPendingBarriers(); returns how many.
+	UINT CollectPendingBarriers(std::vector<D3D12_RESOURCE_BARRIER>& barriers);
+	// A first use that needs no fixup barrier; see the class comment.
+	static bool IsFixupSkippable(const LocalState& state, size_t subresource, D3D12_RESOURCE_STATES global);
+
+private:
+	std::unordered_map<ID3D12Resource*, LocalState> m_LocalStates;
+	std::vector<D3D12_RESOURCE_BARRIER> m_Barriers;
+	Stats m_Stats;
+	BarrierBackend* m_Backend = nullptr;
+
+	static std::mutex s_GlobalMutex;
+	static std::unordered_map<ID3D12Resource*, std::vector<D3D12_RESOURCE_STATES>> s_GlobalStates;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PipelineCache;
+
+namespace RootSignatureCacheFormat
+{
+	const UINT32 Magic = 0x53525844; // "DXRS"
+	// Bump when the file layout or RootSignatureCache::Hash changes.
+	const UINT32 Version = 1;
+}
+
+// == Root signature cache ==
+//
+// Every place that builds a root signature used to serialize it with
+// D3DX12SerializeVersionedRootSignature and create its own object, even when
+// the layout was the same as one created a moment before. GetOrCreate()
+// instead:
+//
+//  1. Hashes the description's content: flags, every parameter with its
+//     descriptor ranges, and the static samplers. The description is first
+//     brought to one canonical form, so versions 1.0, 1.1 and 1.2 of the same
+//     root signature hash alike:
+//      - 1.0 ranges and root descriptors get the flags 1.0 implies
+//        (descriptors and data volatile), and 1.1 ones without data flags
+//        get the 1.1 defaults (static while set for CBVs/SRVs, volatile for
+//        UAVs)
+//      - D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND is resolved to the offset
+//      - static samplers without 1.2 flags get D3D12_SAMPLER_FLAG_NONE
+//  2. Returns the existing object for that hash, if any.
+//  3. Otherwise creates it from the serialized blob cached on disk, or
+//     serializes the canonical description (once) and caches the blob.
+//
+// New root signatures are registered with the PipelineCache, so pipelines
+// using them get keys that are stable across runs.
+//
+// GetOrCreate() may be called from several threads at once.
+class RootSignatureCache
+{
+public:
+	struct Stats
+	{
+		UINT Requests = 0;
+		UINT MemoryHits = 0;
+		UINT DiskHits = 0;     // created from a blob read by Initialize()
+		UINT Serialized = 0;
+		UINT BlobsFromDisk = 0;
+		double SerializeMilliseconds = 0.0;
+		double CreateMilliseconds = 0.0;
+	};
+
+	// 'pipelineCache' may be null.
+	explicit RootSignatureCache(PipelineCache* pipelineCache);
+	~RootSignatureCache() = default;
+	RootSignatureCache(const RootSignatureCache& rhs) = delete;
+	RootSignatureCache& operator=(const RootSignatureCache& rhs) = delete;
+
+	void Initialize(ID3D12Device* device, const std::wstring& filename);
+
+	// Writes the blobs if any were added since they were loaded. Returns
+	// false if the file could not be written.
+	bool Save();
+
+	// The returned root signature is owned by the cache and lives as long as
+	// it. Throws DxException if the description does not serialize.
+	ID3D12RootSignature* GetOrCreate(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc);
+	ID3D12RootSignature* GetOrCreate(const D3D12_ROOT_SIGNATURE_DESC& desc);
+
+	// Content hash of the canonical form; equal for descriptions that define
+	// the same root signature, whatever their version.
+	static uint64_t Hash(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc);
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	bool LoadFile();
+	std::vector<BYTE> Serialize(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc) const;
+
+private:
+	PipelineCache* m_PipelineCache = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Device> m_Device;
+	std::wstring m_Filename;
+	D3D_ROOT_SIGNATURE_VERSION m_MaxVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+
+	std::mutex m_Mutex; // everything below
+	std::unordered_map<uint64_t, Microsoft::WRL::ComPtr<ID3D12RootSignature>> m_RootSignatures;
+	std::unordered_map<uint64_t, std::vector<BYTE>> m_Blobs;
+	bool m_Dirty = false;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <string>
+#include <vector>
+
+// How often the application changes a binding.
+enum class BindingFrequency
+{
+	PerFrame,
+	PerPass,
+	PerDraw,
+};
+
+enum class BindingType
+{
+	Constants,      // Num32BitValues of raw data (b register)
+	ConstantBuffer,
+	BufferSRV,      // structured/raw buffers can be root descriptors
+	BufferUAV,
+	TextureSRV,     // textures need descriptors in a table
+	TextureUAV,
+	Sampler,
+};
+
+// One thing the shaders read, as the application thinks of it.
+struct RootBinding
+{
+	std::string Name;
+	BindingType Type = BindingType::ConstantBuffer;
+	BindingFrequency Frequency = BindingFrequency::PerFrame;
+	UINT ShaderRegister = 0;
+	UINT RegisterSpace = 0;
+	UINT Num32BitValues = 0; // BindingType::Constants only
+	UINT NumDescriptors = 1; // table bindings: size of the register range
+	D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL;
+};
+
+// Where a binding ended up.
+enum class RootPlacement
+{
+	Constants,  // SetGraphicsRoot32BitConstants(RootParameter, n, data, Offset)
+	Descriptor, // SetGraphicsRoot*View(RootParameter, gpuAddress)
+	Table,      // descriptor at Offset within the table set on RootParameter
+};
+// BindingType::Constants bindings that end up as a Descriptor or in a Table
+// are bound as a constant buffer holding the values.
+
+struct RootBindingLocation
+{
+	UINT RootParameter = 0;
+	RootPlacement Placement = RootPlacement::Table;
+	UINT Offset = 0; // 32-bit values for Constants, descriptors for Table
+};
+
+// == Root signature layout from update frequencies ==
+//
+// A root signature holds at most 64 DWORDs: 32-bit constants cost one each,
+// root descriptors two, descriptor tables one. What goes where is a trade:
+// constants and root descriptors are set with a single call and need no
+// descriptor heap space, but take room; tables are small but every change
+// means writing descriptors. Build() takes the bindings with how often each
+// changes and lays them out:
+//
+//  1. Every binding starts in its cheapest form to update: Constants (up to
+//     MaxInlineConstants values) as root constants, buffers as root
+//     descriptors, textures and samplers in descriptor tables shared by all
+//     bindings of the same frequency and visibility.
+//  2. While the layout is over 64 DWORDs, the least frequently changed
+//     binding is demoted, largest saving first: root constants become a root
+//     CBV, root descriptors move into a table.
+//  3. Parameters are ordered by frequency, per-draw first. Some hardware
+//     keeps only the first few root parameters in fast registers and spills
+//     the rest to memory, and a change of the root signature only has to
+//     keep the parameters in front of the changed ones.
+//
+// GetLocation() tells the binder where each binding went; GetDesc() is passed
+// to RootSignatureCache::GetOrCreate(). ToString() prints the layout.
+class RootSignatureLayout
+{
+public:
+	static const UINT MaxCost = 64; // DWORDs
+	// Larger blocks of constants are cheaper to bind through a CBV.
+	static const UINT MaxInlineConstants = 16;
+
+	RootSignatureLayout() = default;
+	// The parameters point into the layout's own range arrays.
+	RootSignatureLayout(const RootSignatureLayout& rhs) = delete;
+	RootSignatureLayout& operator=(const RootSignatureLayout& rhs) = delete;
+
+	// Returns false if the bindings cannot fit in 64 DWORDs even with
+	// everything possible in tables.
+	bool Build(const std::vector<RootBinding>& bindings);
+
+	D3D12_VERSIONED_ROOT_SIGNATURE_DESC GetDesc(D3D12_ROOT_SIGNATURE_FLAGS flags,
+		UINT numStaticSamplers = 0, const D3D12_STATIC_SAMPLER_DESC* staticSamplers = nullptr) const;
+
+	// Indexed like the bindings given to Build().
+	const RootBindingLocation& GetLocation(size_t binding) const { return m_Locations[binding]; }
+
+	const std::vector<D3D12_ROOT_PARAMETER1>& GetParameters() const { return m_Parameters; }
+	UINT GetCost() const { return m_Cost; }
+
+	std::string ToString() const;
+
+private:
+	// A root parameter while the layout is being decided.
+	struct Slot
+	{
+		RootPlacement Placement = RootPlacement::Table;
+		BindingFrequency Frequency = BindingFrequency::PerFrame;
+		D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL;
+		bool Samplers = false;
+		std::vector<size_t> Bindings;
+	};
+
+	static UINT Cost(const Slot& slot, const std::vector<RootBinding>& bindings);
+	static size_t FindTable(const std::vector<Slot>& slots, const RootBinding& binding);
+
+private:
+	std::vector<RootBinding> m_Bindings;
+	std::vector<D3D12_ROOT_PARAMETER1> m_Parameters;
+	std::vector<std::vector<D3D12_DESCRIPTOR_RANGE1>> m_Ranges; // per parameter
+	std::vector<RootBindingLocation> m_Locations;
+	UINT m_Cost = 0;
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderRebuild;
+class ThreadPool;
+
+namespace ShaderCacheFormat
+{
+	const UINT32 Magic = 0x48535844; // "DXSH"
+	// Bump when the file layout or the key computation changes.
+	const UINT32 Version = 1;
+}
+
+// Index of a shader added to a ShaderCache.
+typedef UINT ShaderHandle;
+const ShaderHandle InvalidShaderHandle = ~0u;
+
+struct ShaderDefine
+{
+	std::string Name;
+	std::string Value;
+};
+
+struct ShaderCompileDesc
+{
+	std::wstring File;       // HLSL source
+	std::string EntryPoint;
+	std::string Target;      // e.g. "vs_5_1"
+	std::vector<ShaderDefine> Defines;
+	UINT Flags = 0;          // D3DCOMPILE_* (or the compiler's own flags)
+};
+
+// Given to a ShaderCompiler to read the source and everything it includes.
+// Every file read through it becomes a dependency of the shader.
+class ShaderSourceLoader
+{
+public:
+	virtual ~ShaderSourceLoader() = default;
+
+	// Looks 'name' up next to 'includingFile', then in the include
+	// directories. Returns the file's text (owned by the loader) or nullptr,
+	// and its full path in 'resolvedPath'.
+	virtual const std::string* Load(const std::wstring& name, const std::wstring& includingFile, std::wstring* resolvedPath) = 0;
+};
+
+// Turns HLSL into bytecode. The default, D3DShaderCompiler, uses D3DCompile;
+// tests and tools can plug in their own. Compile() is called from several
+// threads at once.
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() = default;
+
+	// Part of every cache key, so switching compilers (or versions of one)
+	// does not pick up the other's bytecode.
+	virtual std::string GetId() const = 0;
+
+	// 'source' is the text of desc.File. Includes must be read through
+	// 'loader'. On failure, 'errors' holds the compiler output.
+	virtual bool Compile(const ShaderCompileDesc& desc, const std::string& source, ShaderSourceLoader& loader,
+		std::vector<BYTE>& bytecode, std::string& errors) = 0;
+};
+
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	std::string GetId() const override { return "d3dcompiler_47"; }
+	bool Compile(const ShaderCompileDesc& desc, const std::string& source, ShaderSourceLoader& loader,
+		std::vector<BYTE>& bytecode, std::string& errors) override;
+};
+
+// == Shader bytecode cache ==
+//
+// Compiling every shader at startup, one after the other, adds seconds to
+// every launch. Shaders are instead added to the cache with Add() and built
+// together with Build(), which compiles them in parallel on a thread pool
+// and keeps the bytecode on disk, one file per shader:
+//
+//  - The file name is a hash of the compile request (source path, entry
+//    point, target, defines, flags, compiler id) and the source text.
+//  - The file lists every included file with a hash of its text. The cached
+//    bytecode is only used if all of them are unchanged, so editing a header
+//    recompiles exactly the shaders that include it.
+//  - Cached files are mapped into memory (MapViewOfFile) and the bytecode is
+//    handed out straight from the mapping, without a copy.
+//
+// GetDependencies(), InvalidateSource() and the rebuild functions are there
+// for hot reloading (see ShaderHotReload).
+class ShaderCache
+{
+public:
+	struct Stats
+	{
+		UINT Shaders = 0;
+		UINT CacheHits = 0;
+		UINT Compiled = 0;
+		UINT Failed = 0;
+		double BuildMilliseconds = 0.0;   // wall clock of the last Build()
+		double CompileMilliseconds = 0.0; // summed over all threads
+	};
+
+	ShaderCache();
+	~ShaderCache();
+	ShaderCache(const ShaderCache& rhs) = delete;
+	ShaderCache& operator=(const ShaderCache& rhs) = delete;
+
+	// Creates 'directory' if needed. Until this is called nothing is cached
+	// on disk.
+	void Initialize(const std::wstring& directory);
+
+	void SetCompiler(std::unique_ptr<ShaderCompiler> compiler) { m_Compiler = std::move(compiler); }
+	void AddIncludeDirectory(const std::wstring& directory);
+
+	// Identical requests share one handle.
+	ShaderHandle Add(const ShaderCompileDesc& desc);
+
+	// Loads or compiles every shader added since the last Build(). 'pool'
+	// may be null. Returns false if any of them failed to compile.
+	bool Build(ThreadPool* pool);
+
+	// Bytecode of a built shader; empty if it failed. Valid until the
+	// shader is rebuilt or the cache is destroyed.
+	D3D12_SHADER_BYTECODE GetBytecode(ShaderHandle handle) const;
+
+	UINT GetShaderCount() const { return static_cast<UINT>(m_Entries.size()); }
+
+	// Full paths of the source and every file it included.
+	std::vector<std::wstring> GetDependencies(ShaderHandle handle) const;
+
+	// Forgets what is known about 'file' (it changed on disk).
+	void InvalidateSource(const std::wstring& file);
+
+	// Builds the given shaders again, from the cache where their sources
+	// are unchanged. A shader that fails keeps its bytecode. The replaced
+	// bytecode stays valid until the same shader is rebuilt again.
+	bool Rebuild(const std::vector<ShaderHandle>& handles, ThreadPool* pool);
+
+	// Rebuild() in three steps, so the compiling can happen in the
+	// background: StageRebuild() takes the requests, BuildStaged() compiles
+	// them without touching the bytecode in use (it may run on another
+	// thread, while GetBytecode() is called), and CommitRebuild() swaps the
+	// results in. Only one rebuild may be staged at a time; Add() and Build()
+	// must wait until it is committed. CommitRebuild() returns the shaders
+	// whose bytecode changed.
+	std::unique_ptr<ShaderRebuild> StageRebuild(const std::vector<ShaderHandle>& handles) const;
+	bool BuildStaged(ShaderRebuild& rebuild, ThreadPool* pool);
+	std::vector<ShaderHandle> CommitRebuild(ShaderRebuild& rebuild);
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	friend class ShaderRebuild;
+
+	struct SourceFile
+	{
+		std::string Text;
+		uint64_t Hash = 0;
+		bool Exists = false;
+	};
+
+	struct Dependency
+	{
+		std::wstring Path;
+		uint64_t Hash = 0;
+	};
+
+	struct MappedFile;
+	class Tracker;
+
+	struct Entry
+	{
+		ShaderCompileDesc Desc;
+		uint64_t RequestKey = 0;
+		bool Built = false;
+		std::vector<Dependency> Dependencies;
+
+		// Either a view into a mapped cache file, or compiled bytecode.
+		std::shared_ptr<MappedFile> Mapping;
+		std::vector<BYTE> Compiled;
+		const BYTE* Data = nullptr;
+		SIZE_T Size = 0;
+
+		// The replaced bytecode, kept alive until the next commit
+		std::shared_ptr<MappedFile> OldMapping;
+		std::vector<BYTE> OldCompiled;
+	};
+
+	bool BuildEntries(const std::vector<Entry*>& entries, ThreadPool* pool, Stats& stats);
+	bool BuildEntry(Entry& entry, double& compileMilliseconds, bool& cacheHit);
+	bool LoadCached(Entry& entry, const std::wstring& path);
+	void WriteCached(const Entry& entry, const std::wstring& path) const;
+
+	std::shared_ptr<const SourceFile> ReadSource(const std::wstring& path);
+	std::wstring Resolve(const std::wstring& name, const std::wstring& includingFile) const;
+
+private:
+	std::unique_ptr<ShaderCompiler> m_Compiler;
+	std::wstring m_Directory;
+	std::vector<std::wstring> m_IncludeDirectories;
+
+	std::vector<Entry> m_Entries;
+	std::unordered_map<uint64_t, ShaderHandle> m_ByRequest;
+	UINT m_FirstUnbuilt = 0;
+
+	std::mutex m_SourceMutex; // m_Sources
+	std::unordered_map<std::wstring, std::shared_ptr<const SourceFile>> m_Sources;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
+
+// Shaders being built again away from the ones in use; see
+// ShaderCache::StageRebuild().
+class ShaderRebuild
+{
+public:
+	const std::vector<ShaderHandle>& GetHandles() const { return m_Handles; }
+	const ShaderCache::Stats& GetStats() const { return m_Stats; }
+
+private:
+	friend class ShaderCache;
+	std::vector<ShaderHandle> m_Handles;
+	std::vector<ShaderCache::Entry> m_Entries;
+	ShaderCache::Stats m_Stats;
+};
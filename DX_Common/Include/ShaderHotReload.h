@@ -0,0 +1,156 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include "ShaderCache.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ThreadPool;
+
+typedef UINT HotPipelineHandle;
+const HotPipelineHandle InvalidHotPipelineHandle = ~0u;
+
+// == Shader hot reload ==
+//
+// Edits to a shader used to mean restarting the application. ShaderHotReload
+// watches the shader directories (ReadDirectoryChangesW on a thread of its
+// own) and, when a file changes:
+//
+//  1. Finds the shaders that depend on it through the include graph the
+//     ShaderCache recorded, and rebuilds only those, in the background
+//     (ShaderCache::StageRebuild/BuildStaged).
+//  2. At the next Update() - the frame boundary - commits the new bytecode
+//     and, for the shaders whose code really changed, recreates the
+//     pipelines using them, again in the background.
+//  3. At a later Update() swaps the new pipelines in. The old ones are kept
+//     until the GPU has passed the fence value of the last frame that could
+//     have used them.
+//
+// A shader that no longer compiles keeps its last good bytecode and its
+// pipelines; the error goes to the debugger output. Quick successive saves
+// are gathered into one reload.
+//
+// Everything but the watcher runs from Update(), on the thread that records
+// the frames. ShaderCache::Add() and Build() must not be called while a
+// reload is in flight (IsIdle() is false).
+class ShaderHotReload
+{
+public:
+	// Creates a pipeline from the current bytecode of its shaders
+	// (ShaderCache::GetBytecode). Called on worker threads for reloads.
+	typedef std::function<Microsoft::WRL::ComPtr<ID3D12PipelineState>()> CreatePipelineFunc;
+
+	static const UINT DefaultDebounceMilliseconds = 100;
+
+	struct Stats
+	{
+		UINT Reloads = 0;
+		UINT ShadersRebuilt = 0;
+		UINT ShadersFailed = 0;
+		UINT PipelinesSwapped = 0;
+		UINT PipelinesRetired = 0;      // released after their fence passed
+		double LastReloadMilliseconds = 0.0; // rebuild started to pipelines swapped
+	};
+
+	// 'pool' may be null, in which case reloads run inside Update().
+	ShaderHotReload(ShaderCache* cache, ThreadPool* pool);
+	~ShaderHotReload();
+	ShaderHotReload(const ShaderHotReload& rhs) = delete;
+	ShaderHotReload& operator=(const ShaderHotReload& rhs) = delete;
+
+	// Watches the directories and everything below them.
+	void Start(const std::vector<std::wstring>& directories);
+	void Stop();
+
+	void SetDebounceMilliseconds(UINT milliseconds) { m_DebounceMilliseconds = milliseconds; }
+
+	// Creates the pipeline now (on this thread) and again whenever the
+	// bytecode of one of 'shaders' changes.
+	HotPipelineHandle AddPipeline(const std::vector<ShaderHandle>& shaders, CreatePipelineFunc create);
+	ID3D12PipelineState* GetPipeline(HotPipelineHandle handle) const;
+
+	// Reports a changed file, as the watcher does.
+	void NotifyChanged(const std::wstring& file);
+
+	// Call once per frame, before recording it. 'submittedFence' is the last
+	// fence value signaled after work that may use the current pipelines,
+	// 'completedFence' the fence's completed value.
+	void Update(UINT64 submittedFence, UINT64 completedFence);
+
+	// No changes waiting and no reload in flight.
+	bool IsIdle() const;
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	enum class State
+	{
+		Idle,
+		Compiling,        // shaders being rebuilt
+		CreatingPipelines,
+	};
+
+	struct Pipeline
+	{
+		std::vector<ShaderHandle> Shaders;
+		CreatePipelineFunc Create;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> Current;
+	};
+
+	// A pipeline being recreated, away from m_Pipelines.
+	struct StagedPipeline
+	{
+		HotPipelineHandle Handle;
+		CreatePipelineFunc Create;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> Result;
+	};
+
+	struct RetiredPipeline
+	{
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> Pipeline;
+		UINT64 Fence;
+	};
+
+	void StartRebuild();
+	void StartPipelines();
+	void SwapPipelines(UINT64 submittedFence);
+	void FinishReload(UINT swapped);
+	void RunInBackground(std::function<void()> task);
+	void WatchThread(std::vector<std::wstring> directories);
+
+private:
+	ShaderCache* m_Cache = nullptr;
+	ThreadPool* m_Pool = nullptr;
+
+	std::vector<Pipeline> m_Pipelines;
+	std::vector<RetiredPipeline> m_Retired;
+
+	// == Reload in flight ==
+	State m_State = State::Idle;
+	std::atomic<bool> m_TaskDone{ false };
+	std::unique_ptr<ShaderRebuild> m_Rebuild;
+	std::vector<StagedPipeline> m_StagedPipelines;
+	LARGE_INTEGER m_ReloadStart = {};
+
+	// == Changes reported by the watcher ==
+	mutable std::mutex m_ChangeMutex; // everything in this block
+	std::vector<std::wstring> m_ChangedFiles;
+	bool m_Overflow = false;          // too many changes to list; rebuild all
+	LARGE_INTEGER m_LastChange = {};
+
+	UINT m_DebounceMilliseconds = DefaultDebounceMilliseconds;
+	std::thread m_WatchThread;
+	HANDLE m_StopEvent = nullptr;
+
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
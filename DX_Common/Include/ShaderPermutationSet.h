@@ -0,0 +1,184 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "AsyncPipelineCompiler.h"
+#include "ShaderCache.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PermutationUsageFormat
+{
+	const UINT32 Magic = 0x55505844; // "DXPU"
+	const UINT32 Version = 1;
+}
+
+// Feature values packed into bits; see PermutationFeature.
+typedef uint32_t PermutationKey;
+
+// A shader feature owning Width bits of the key from bit Shift. Declared as
+// constexpr next to the shader, so keys are built at compile time:
+//
+//   namespace LitFeatures
+//   {
+//       constexpr PermutationFeature NormalMap = { "NORMAL_MAP", 0 };
+//       constexpr PermutationFeature AlphaTest = { "ALPHA_TEST", 1 };
+//       constexpr PermutationFeature Lights    = { "NUM_LIGHTS", 2, 2 }; // 0..3
+//   }
+//   const PermutationKey key = LitFeatures::NormalMap() | LitFeatures::Lights(2);
+//
+// The shader always gets the define, with the feature's value ("0" when
+// off), so it tests features with #if.
+struct PermutationFeature
+{
+	const char* Define;
+	UINT Shift;
+	UINT Width = 1;
+
+	constexpr PermutationKey Mask() const { return ((1u << Width) - 1) << Shift; }
+	constexpr PermutationKey operator()(UINT value = 1) const { return (value << Shift) & Mask(); }
+	constexpr UINT Value(PermutationKey key) const { return (key & Mask()) >> Shift; }
+};
+
+// What a key resolves to.
+struct ShaderPermutation
+{
+	ShaderHandle Shader = InvalidShaderHandle;
+	PipelineHandle Pipeline = InvalidPipelineHandle;
+};
+
+// == Shader permutations ==
+//
+// Every feature a material can toggle doubles the number of shader
+// variants. A ShaderPermutationSet declares the features of one shader
+// entry point, rules out combinations that make no sense, and resolves a
+// key to its shader and pipeline with a single array lookup:
+//
+//  - Constraints: Require(a, b) (a needs b), Exclude(a, b) (never both) and
+//    Limit(feature, max) rule keys out; IsValid() says whether a key is
+//    allowed.
+//  - AddPermutations() adds every valid key to a ShaderCache, which then
+//    builds them in parallel with the rest. The key indexes a table holding
+//    the shader and the pipeline set with SetPipeline().
+//  - Usage: Get() marks the keys asked for. SaveUsage() writes, per key, how
+//    many runs ago it was last used; once that file exists, keys unused for
+//    PruneAfterRuns runs are left out of AddPermutations(). A pruned key
+//    that is asked for after all gets InvalidShaderHandle until
+//    AddMissing() adds it at a safe point (and it is kept from then on).
+//
+// Get() may be called from several threads; everything else may not run at
+// the same time as it.
+class ShaderPermutationSet
+{
+public:
+	// 16 bits make a 64K entry table; more features than that belong in
+	// separate sets.
+	static const UINT MaxKeyBits = 16;
+	static const UINT DefaultPruneAfterRuns = 8;
+
+	struct Stats
+	{
+		UINT Keys = 0;    // 2^bits
+		UINT Valid = 0;   // passing the constraints
+		UINT Added = 0;   // given to the ShaderCache
+		UINT Pruned = 0;  // valid, but unused in recent runs
+		UINT Missed = 0;  // pruned keys asked for by Get()
+	};
+
+	// 'base' is the entry point; its defines are kept and the features'
+	// defines are added to them.
+	ShaderPermutationSet(const ShaderCompileDesc& base, const std::vector<PermutationFeature>& features);
+	ShaderPermutationSet(const ShaderPermutationSet& rhs) = delete;
+	ShaderPermutationSet& operator=(const ShaderPermutationSet& rhs) = delete;
+
+	// == Constraints (before AddPermutations) ==
+	void Require(const PermutationFeature& feature, const PermutationFeature& required);
+	void Exclude(const PermutationFeature& a, const PermutationFeature& b);
+	void Limit(const PermutationFeature& feature, UINT maxValue);
+
+	bool IsValid(PermutationKey key) const;
+
+	// == Usage telemetry ==
+	// A missing file, or one written for other features, is ignored.
+	void LoadUsage(const std::wstring& filename);
+	bool SaveUsage() const;
+	void SetPruneAfterRuns(UINT runs) { m_PruneAfterRuns = runs; }
+
+	// Adds the valid, recently used keys to 'cache'; call cache.Build() after.
+	void AddPermutations(ShaderCache& cache);
+	// Adds the pruned keys Get() was asked for since the last call.
+	UINT AddMissing(ShaderCache& cache);
+
+	void SetPipeline(PermutationKey key, PipelineHandle pipeline);
+
+	// O(1). Invalid keys are a bug (they assert) and resolve to nothing.
+	const ShaderPermutation& Get(PermutationKey key)
+	{
+		assert(!m_Table.empty() && "Get() before AddPermutations()");
+		if (key >= m_Table.size())
+		{
+			assert(false && "Permutation key has bits of no feature");
+			return s_None;
+		}
+		assert(m_Valid[key] && "Permutation key breaks a constraint");
+		MarkUsed(key);
+		return m_Table[key];
+	}
+
+	ShaderCompileDesc GetDesc(PermutationKey key) const;
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	struct Constraint
+	{
+		enum Kind { Requires, Excludes, Limits } Type;
+		PermutationKey A;
+		PermutationKey B; // mask, or the max value in place for Limits
+	};
+
+	void MarkUsed(PermutationKey key)
+	{
+		std::atomic<uint32_t>& word = m_Used[key / 32];
+		const uint32_t bit = 1u << (key % 32);
+		if ((word.load(std::memory_order_relaxed) & bit) == 0)
+		{
+			word.fetch_or(bit, std::memory_order_relaxed);
+			if (m_Table[key].Shader == InvalidShaderHandle)
+				m_Missed.store(true, std::memory_order_relaxed);
+		}
+	}
+
+	bool IsUsed(PermutationKey key) const
+	{
+		return (m_Used[key / 32].load(std::memory_order_relaxed) & (1u << (key % 32))) != 0;
+	}
+
+	uint64_t LayoutHash() const;
+
+private:
+	static const ShaderPermutation s_None;
+	// Runs-since-use counts stop here.
+	static const BYTE MaxRunsSinceUse = 0xFF;
+
+	ShaderCompileDesc m_Base;
+	std::vector<PermutationFeature> m_Features;
+	std::vector<Constraint> m_Constraints;
+	UINT m_KeyBits = 0;
+	PermutationKey m_FeatureMask = 0;
+
+	std::vector<ShaderPermutation> m_Table; // indexed by key
+	std::vector<bool> m_Valid;              // indexed by key
+
+	std::wstring m_UsageFilename;
+	std::vector<BYTE> m_RunsSinceUse;       // loaded; empty if no file
+	UINT m_PruneAfterRuns = DefaultPruneAfterRuns;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_Used; // bit per key, this run
+	std::atomic<bool> m_Missed{ false };
+
+	Stats m_Stats;
+};
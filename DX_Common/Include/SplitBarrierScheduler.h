@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+class BarrierBackend;
+
+// == Split barrier scheduler ==
+//
+// An ordinary transition is recorded right before the pass that needs the
+// new state, so the GPU has to finish the previous work on the resource,
+// do the transition (cache flush, decompression, layout change) and only
+// then start the pass.
+//
+// A split barrier lets the transition start early and overlap with
+// unrelated work: a BEGIN_ONLY half is recorded as soon as the resource's
+// last use in the old state is done, and the END_ONLY half right before the
+// next use. The resource must not be touched in between, which is exactly
+// what "after its last use" guarantees.
+//
+//   pass 0: writes A (RENDER_TARGET)
+//   pass 1: unrelated work         <- BEGIN  A: RENDER_TARGET -> PIXEL_SHADER_RESOURCE
+//   pass 2: unrelated work
+//   pass 3: samples A              <- END    A: RENDER_TARGET -> PIXEL_SHADER_RESOURCE
+//
+// The scheduler needs to see the whole frame up front: declare every pass
+// with the (sub)resources it uses and the state it needs them in, call
+// Compile(), then record each pass after RecordBarriers(pass). When the
+// last use is the pass right before, there is nothing to overlap with and
+// a regular barrier is emitted instead.
+class SplitBarrierScheduler
+{
+public:
+	struct ResourceUse
+	{
+		ID3D12Resource* Resource;
+		D3D12_RESOURCE_STATES State;
+		UINT Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+	};
+
+	struct Stats
+	{
+		UINT SplitBarriers = 0;
+		UINT ImmediateBarriers = 0;
+		UINT TotalDistance = 0; // sum over split barriers of (end pass - begin pass)
+		UINT MaxDistance = 0;
+
+		float AverageDistance() const { return SplitBarriers ? float(TotalDistance) / SplitBarriers : 0.0f; }
+	};
+
+	// State each (sub)resource is in when the frame starts. Resources that
+	// are not given one are assumed to be in COMMON.
+	void SetInitialState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state,
+		UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+
+	// Returns the pass index. A (sub)resource is either always addressed as a
+	// whole or always per subresource within one frame.
+	UINT AddPass(const std::vector<ResourceUse>& uses);
+
+	// Places the barriers for every pass added so far.
+	void Compile();
+
+	// Barriers to record right before 'pass'.
+	const std::vector<D3D12_RESOURCE_BARRIER>& GetBarriers(UINT pass) const { return m_PassBarriers[pass]; }
+	void RecordBarriers(UINT pass, ID3D12GraphicsCommandList* commandList, BarrierBackend* backend = nullptr) const;
+
+	// State of a (sub)resource after the last pass, e.g. to publish it to
+	// ResourceStateTracker::RegisterResource for the next frame.
+	D3D12_RESOURCE_STATES GetFinalState(ID3D12Resource* resource,
+		UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES) const;
+
+	const Stats& GetStats() const { return m_Stats; }
+
+	// Forgets passes, states and stats so the next frame can be declared.
+	void Reset();
+
+private:
+	typedef std::pair<ID3D12Resource*, UINT> Key;
+
+	struct Track
+	{
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+		int LastUse = -1; // last pass that used the current state, -1 = before the frame
+	};
+
+private:
+	std::map<Key, D3D12_RESOURCE_STATES> m_InitialStates;
+	std::map<Key, Track> m_Tracks;
+	std::vector<std::vector<ResourceUse>> m_Passes;
+	std::vector<std::vector<D3D12_RESOURCE_BARRIER>> m_PassBarriers;
+	Stats m_Stats;
+};
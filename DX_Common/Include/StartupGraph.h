@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Index of a task added to a StartupGraph.
+typedef UINT StartupTask;
+const StartupTask InvalidStartupTask = ~0u;
+
+// == Startup task graph ==
+//
+// Startup used to be one long sequence: window, device, command objects,
+// swap chain, then whatever the application compiles and loads. Most of
+// those steps only need one or two of the others, so StartupGraph runs
+// them as a dependency graph:
+//
+//  - Add() declares a task and the tasks it needs. Tasks marked
+//    MainThread (window and swap chain work, which DXGI and USER32 tie to
+//    the window's thread) run on the thread calling Run(); the others on
+//    the ThreadPool as soon as their dependencies are done.
+//  - A task returns false to report failure. Its dependents are skipped
+//    and Run() returns false. An exception thrown by a task (DxException
+//    from ThrowIfFailed) skips the same way and is rethrown by Run().
+//  - Every task is timed. Run() logs the timings and the critical path:
+//    the chain of tasks, each started by the last of its dependencies to
+//    finish, that ended last. That chain is what startup time is made of;
+//    shortening anything else does not help.
+class StartupGraph
+{
+public:
+	enum class Affinity
+	{
+		Any,
+		MainThread,
+	};
+
+	struct TaskTiming
+	{
+		std::wstring Name;
+		double StartMilliseconds = 0.0; // since Run()
+		double EndMilliseconds = 0.0;
+		bool OnMainThread = false;
+		bool Ran = false;               // false if skipped
+		bool Succeeded = false;
+	};
+
+	struct Stats
+	{
+		double WallMilliseconds = 0.0;         // Run() from start to end
+		double SerialMilliseconds = 0.0;       // every task, one after the other
+		double CriticalPathMilliseconds = 0.0; // the tasks on the critical path
+		std::vector<StartupTask> CriticalPath; // first to last
+	};
+
+	// 'pool' may be null, in which case everything runs on the caller.
+	explicit StartupGraph(ThreadPool* pool);
+	StartupGraph(const StartupGraph& rhs) = delete;
+	StartupGraph& operator=(const StartupGraph& rhs) = delete;
+
+	StartupTask Add(const std::wstring& name, std::function<bool()> work,
+		const std::vector<StartupTask>& dependencies = {}, Affinity affinity = Affinity::Any);
+
+	// Runs every task once and returns when all are done or skipped. True
+	// if none failed.
+	bool Run();
+
+	const std::vector<TaskTiming>& GetTimings() const { return m_Timings; }
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	struct Task
+	{
+		std::function<bool()> Work;
+		Affinity RunOn;
+		std::vector<StartupTask> Dependencies;
+		std::vector<StartupTask> Dependents;
+		UINT Remaining = 0;  // dependencies not done yet
+		bool Skip = false;   // a dependency failed
+	};
+
+	void Dispatch(StartupTask task);
+	void Execute(StartupTask task, bool onMainThread);
+	void Complete(StartupTask task, bool succeeded);
+	void FindCriticalPath();
+	void LogTimings() const;
+
+private:
+	ThreadPool* m_Pool = nullptr;
+	std::vector<Task> m_Tasks;
+	std::vector<TaskTiming> m_Timings;
+
+	std::mutex m_Mutex;                 // everything below, while Run() runs
+	std::condition_variable m_Cv;
+	std::deque<StartupTask> m_MainQueue;
+	UINT m_Pending = 0;                 // tasks not done or skipped
+	bool m_Failed = false;
+	std::exception_ptr m_Exception;     // the first one thrown
+
+	LARGE_INTEGER m_Start = {};
+	double m_SecondsPerCount = 0.0;
+	Stats m_Stats;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Handed back for every upload request. The render thread keeps it and polls
+// StreamingUploader::IsComplete() (or makes the GPU wait with QueueWait())
+// before it samples from the destination resource.
+struct UploadTicket
+{
+	UINT64 Sequence = 0; // 0 means "invalid / nothing to wait for"
+
+	bool IsValid() const { return Sequence != 0; }
+};
+
+// The copy queue, its fence and the staging memory as StreamingUploader sees
+// them. D3D12UploadQueue is the real one; tests drive the uploader with
+// their own. Only the uploader's worker thread records and submits;
+// GetCompletedValue() and Wait() may be called from any thread.
+class UploadQueue
+{
+public:
+	virtual ~UploadQueue() = default;
+
+	// Called once. Returns 'size' bytes of CPU-writable staging memory that
+	// the copies below read from; it stays valid until the queue is destroyed.
+	virtual BYTE* CreateStagingBuffer(UINT64 size) = 0;
+
+	// How the device wants the subresources laid out in a buffer, as
+	// ID3D12Device::GetCopyableFootprints with a base offset of 0.
+	virtual void GetCopyableFootprints(const D3D12_RESOURCE_DESC& desc, UINT firstSubresource, UINT numSubresources,
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts, UINT* numRows, UINT64* rowSizes, UINT64* totalBytes) = 0;
+
+	// Record copies from the staging buffer into the current batch.
+	virtual void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 numBytes) = 0;
+	virtual void CopyTexture(ID3D12Resource* dest, UINT subresource, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingLayout) = 0;
+
+	// Executes the batch and returns the fence value signaled when it is done.
+	virtual UINT64 Submit() = 0;
+	virtual UINT64 GetCompletedValue() = 0;
+	// Makes 'queue' wait on the GPU timeline for 'fenceValue'.
+	virtual void Wait(ID3D12CommandQueue* queue, UINT64 fenceValue) = 0;
+};
+
+// A COPY command queue with its own fence, command list and allocators, and
+// a persistently mapped upload heap buffer as the staging memory.
+class D3D12UploadQueue : public UploadQueue
+{
+public:
+	explicit D3D12UploadQueue(ID3D12Device* device);
+	D3D12UploadQueue(const D3D12UploadQueue& rhs) = delete;
+	D3D12UploadQueue& operator=(const D3D12UploadQueue& rhs) = delete;
+	// Waits for the GPU to finish with the staging buffer.
+	~D3D12UploadQueue();
+
+	BYTE* CreateStagingBuffer(UINT64 size) override;
+	void GetCopyableFootprints(const D3D12_RESOURCE_DESC& desc, UINT firstSubresource, UINT numSubresources,
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts, UINT* numRows, UINT64* rowSizes, UINT64* totalBytes) override;
+	void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 numBytes) override;
+	void CopyTexture(ID3D12Resource* dest, UINT subresource, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingLayout) override;
+	UINT64 Submit() override;
+	UINT64 GetCompletedValue() override;
+	void Wait(ID3D12CommandQueue* queue, UINT64 fenceValue) override;
+
+	ID3D12CommandQueue* GetCommandQueue() const { return m_CopyQueue.Get(); }
+
+private:
+	// Opens the command list on an allocator the GPU is done with.
+	void BeginRecording();
+
+private:
+	// An allocator and the fence value of the last batch recorded with it.
+	struct Allocator
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator;
+		UINT64 FenceValue = 0;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> m_d3dDevice;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+	std::deque<Allocator> m_Allocators; // oldest submission first
+	Allocator m_Recording;              // allocator of the open batch
+	bool m_IsRecording = false;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+	UINT64 m_CurrentFence = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_StagingBuffer;
+};
+
+// Background uploader that streams buffer and texture data to the GPU on a
+// dedicated COPY queue instead of the graphics command list.
+//
+// How it works:
+// 1. Any thread calls UploadBuffer()/UploadTexture(). The source bytes are
+//    copied straight into a persistently mapped staging ring (one upload heap
+//    buffer) and a copy command is queued. The caller gets a ticket back.
+// 2. A background thread drains the queue and records as many pending copies
+//    as fit in one batch into a copy command list, executes it and signals a
+//    fence. Every ticket in the batch is backed by that fence value.
+// 3. When a batch's fence completes, the staging memory it used is released
+//    back to the ring.
+//
+// A request needs its whole staging size in the ring at once. Requests
+// larger than the ring are rejected: the Upload*() call returns an invalid
+// ticket and nothing is copied.
+//
+// If recording or submitting throws on the worker (e.g. the device was
+// removed), the error is logged and every ticket not yet completed fails:
+// IsComplete() returns true so nobody waits forever, IsFailed() tells the
+// two apart, and later Upload*() calls return invalid tickets.
+//
+// Note: copy queues can only work with resources in the COMMON state. Create
+// destination resources in D3D12_RESOURCE_STATE_COMMON; they are implicitly
+// promoted to COPY_DEST by the copy and decay back to COMMON afterwards.
+class StreamingUploader
+{
+public:
+	// Uploads through a D3D12UploadQueue on 'device'.
+	StreamingUploader(ID3D12Device* device, UINT64 stagingRingSize = 64ull * 1024 * 1024, UINT64 maxBatchSize = 8ull * 1024 * 1024);
+	// Uploads through 'queue', which must outlive the uploader.
+	StreamingUploader(UploadQueue* queue, UINT64 stagingRingSize = 64ull * 1024 * 1024, UINT64 maxBatchSize = 8ull * 1024 * 1024);
+	StreamingUploader(const StreamingUploader& rhs) = delete;
+	StreamingUploader& operator=(const StreamingUploader& rhs) = delete;
+	~StreamingUploader();
+
+	// Thread-safe. Copies numBytes from srcData into dest at destOffset.
+	UploadTicket UploadBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* srcData, UINT64 numBytes);
+
+	// Thread-safe. Uploads numSubresources subresources of dest starting at
+	// firstSubresource. srcData follows the same convention as UpdateSubresources.
+	UploadTicket UploadTexture(ID3D12Resource* dest, UINT firstSubresource, UINT numSubresources,
+		const D3D12_SUBRESOURCE_DATA* srcData);
+
+	// Thread-safe. Uploads subresources whose bytes are already laid out in
+	// srcData with the given footprints (offsets relative to srcData), such as
+	// an AssetPack payload. When the layout matches the device's copyable
+	// footprints the staging copy is one memcpy for the whole block.
+	UploadTicket UploadTexture(ID3D12Resource* dest, UINT firstSubresource, UINT numSubresources,
+		const void* srcData, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* srcLayouts);
+
+	// Non-blocking. True once the GPU has finished the batch that carried the
+	// ticket, or once the ticket has failed.
+	bool IsComplete(UploadTicket ticket) const;
+	// True if the ticket's upload will never happen (see above).
+	bool IsFailed(UploadTicket ticket) const;
+
+	// Makes 'queue' wait on the GPU timeline for the ticket. Returns false if the
+	// ticket has not been submitted yet (try again next frame).
+	bool QueueWait(ID3D12CommandQueue* queue, UploadTicket ticket) const;
+
+	// Blocks the calling thread until every request issued so far has
+	// completed or failed.
+	void Flush();
+
+	// Null when uploading through a caller's UploadQueue.
+	ID3D12CommandQueue* CopyQueue() const { return m_OwnedQueue ? m_OwnedQueue->GetCommandQueue() : nullptr; }
+
+	// Running totals, useful for measuring MB/s and per-request latency.
+	struct Stats
+	{
+		UINT64 RequestsCompleted = 0;
+		UINT64 BytesCompleted = 0;
+		UINT64 BatchesSubmitted = 0;
+		UINT64 RequestsFailed = 0;
+		double TotalLatencySeconds = 0.0; // sum of enqueue -> fence completion over all requests
+	};
+	Stats GetStats() const;
+
+private:
+	// One upload request. The slot is reserved in sequence order while the
+	// staging memory is allocated, and marked Ready once the caller has
+	// finished copying its bytes into the ring. The worker only consumes
+	// ready requests from the front so ring memory is released in order.
+	struct PendingRequest
+	{
+		UINT64 Sequence = 0;
+		bool Ready = false;
+		ID3D12Resource* Dest = nullptr;
+		bool IsTexture = false;
+		UINT64 DestOffset = 0;          // buffers
+		UINT FirstSubresource = 0;      // textures
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts; // offsets are relative to the staging buffer
+		UINT64 StagingOffset = 0;
+		UINT64 StagingSize = 0;         // bytes reserved in the ring
+		UINT64 NumBytes = 0;            // bytes copied to the destination
+		UINT64 RingEnd = 0;             // ring head right after this allocation
+		LARGE_INTEGER EnqueueTime = {};
+	};
+
+	// A submitted batch of copies.
+	struct InFlightBatch
+	{
+		UINT64 FenceValue = 0;
+		UINT64 FirstSequence = 0;
+		UINT64 LastSequence = 0;
+		UINT64 RingEnd = 0;
+		UINT64 NumBytes = 0;
+		UINT NumRequests = 0;
+		std::vector<LARGE_INTEGER> EnqueueTimes;
+	};
+
+	// Sequence is 0 in the result if the request can never fit in the ring.
+	PendingRequest ReserveRequest(PendingRequest request, UINT64 alignment);
+	// With srcLayouts, Sequence is also 0 if their extents do not match dest's.
+	PendingRequest ReserveTextureRequest(ID3D12Resource* dest, UINT firstSubresource, UINT numSubresources,
+		std::vector<UINT>& numRows, std::vector<UINT64>& rowSizes,
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* srcLayouts = nullptr);
+	void Start();
+	void MarkReady(UINT64 sequence);
+	void WorkerMain();
+	void SubmitBatch(std::vector<PendingRequest>& requests);
+	void RetireCompletedBatches();
+	// Fails every request not yet retired, after the worker caught an error.
+	void FailOutstanding();
+
+private:
+	std::unique_ptr<D3D12UploadQueue> m_OwnedQueue;
+	UploadQueue* m_Queue = nullptr;
+
+	// Staging ring (m_Queue's staging buffer)
+	BYTE* m_StagingData = nullptr;
+	UINT64 m_RingSize = 0;
+	UINT64 m_RingHead = 0;  // total bytes ever allocated (monotonic)
+	UINT64 m_RingTail = 0;  // total bytes ever released (monotonic)
+	UINT64 m_MaxBatchSize = 0;
+
+	// Requests waiting for the worker. Guarded by m_QueueMutex.
+	mutable std::mutex m_QueueMutex;
+	std::condition_variable m_QueueCv;      // worker waits for new requests
+	std::condition_variable m_RingSpaceCv;  // producers wait for staging space
+	std::deque<PendingRequest> m_PendingRequests;
+	UINT64 m_NextSequence = 1;
+
+	// Submitted batches. Guarded by m_InFlightMutex so the render thread can poll.
+	mutable std::mutex m_InFlightMutex;
+	std::deque<InFlightBatch> m_InFlight;
+	std::atomic<UINT64> m_RetiredSequence{ 0 };
+	// First sequence that failed; 0 while the worker is healthy.
+	std::atomic<UINT64> m_FailedSequence{ 0 };
+
+	Stats m_Stats;
+	double m_SecondsPerCount = 0.0;
+
+	std::atomic<bool> m_Quit{ false };
+	std::thread m_Worker;
+};
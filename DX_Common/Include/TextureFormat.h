@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+// Storage description of a DXGI format. Uncompressed formats use 1x1 blocks;
+// block-compressed (BC) formats store 4x4 texel blocks.
+struct FormatInfo
+{
+	UINT BlockWidth = 1;
+	UINT BlockHeight = 1;
+	UINT BytesPerBlock = 0;
+	bool IsSRGB = false;
+	bool IsBlockCompressed = false;
+};
+
+// Returns false for formats the framework does not know how to lay out
+// (planar, video and packed sub-sampled formats).
+bool GetFormatInfo(DXGI_FORMAT format, FormatInfo& info);
+
+// CPU implementation of ID3D12Device::GetCopyableFootprints for the formats
+// GetFormatInfo() understands. It follows the same rules as the runtime:
+// rows are padded to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT (256 bytes) and each
+// subresource starts on a D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT (512 byte)
+// boundary. Having it on the CPU lets offline tools (e.g. the asset packer)
+// produce upload-ready layouts without creating a device.
+// Any of the output arrays may be nullptr. Returns false for unknown formats.
+bool ComputeCopyableFootprints(
+	const D3D12_RESOURCE_DESC& desc,
+	UINT firstSubresource,
+	UINT numSubresources,
+	UINT64 baseOffset,
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts,
+	UINT* numRows,
+	UINT64* rowSizesInBytes,
+	UINT64* totalBytes);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads for CPU-side data processing (mip
+// generation, texture compression, shader compiles, ...).
+//
+// Work is submitted either as single tasks or through ParallelFor, which
+// splits an index range into chunks and blocks until all of them are done.
+// The calling thread helps out while it waits, so ParallelFor may be called
+// from inside a task without deadlocking the pool.
+class ThreadPool
+{
+public:
+	// threadCount = 0 uses one thread per hardware thread, minus the caller.
+	explicit ThreadPool(UINT threadCount = 0);
+	ThreadPool(const ThreadPool& rhs) = delete;
+	ThreadPool& operator=(const ThreadPool& rhs) = delete;
+	~ThreadPool();
+
+	UINT GetThreadCount() const { return static_cast<UINT>(m_Threads.size()); }
+
+	// Fire-and-forget. Use WaitIdle() to wait for everything submitted so far.
+	void Submit(std::function<void()> task);
+	void WaitIdle();
+
+	// Calls body(begin, end) for consecutive sub-ranges of [0, count), each at
+	// most 'grainSize' long. Returns once every sub-range has been processed.
+	void ParallelFor(UINT count, UINT grainSize, const std::function<void(UINT begin, UINT end)>& body);
+
+private:
+	// Runs one queued task on the calling thread. Returns false if none was queued.
+	bool RunOneTask();
+	void WorkerMain();
+
+private:
+	std::vector<std::thread> m_Threads;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkCv;
+	std::condition_variable m_IdleCv;
+	std::deque<std::function<void()>> m_Tasks;
+	UINT m_ActiveTasks = 0;
+	bool m_Quit = false;
+};
+
+// ParallelFor helper that falls back to a plain loop when no pool is given.
+inline void ParallelFor(ThreadPool* pool, UINT count, UINT grainSize, const std::function<void(UINT begin, UINT end)>& body)
+{
+	if (pool)
+		pool->ParallelFor(count, grainSize, body);
+	else if (count > 0)
+		body(0, count);
+}
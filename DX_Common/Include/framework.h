@@ -1,3 +1,4 @@
 #pragma once
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#define NOMINMAX                        // Keep Windows.h min/max macros away from std::min/std::max
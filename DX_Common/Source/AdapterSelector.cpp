@@ -0,0 +1,217 @@
+#include "pch.h"
+
+#include "AdapterSelector.h"
+#include "D3DUtil.h"
+
+#include "directx/d3dx12.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogAdapter(const std::wstring& message)
+	{
+		OutputDebugString((L"AdapterSelector: " + message + L"\n").c_str());
+	}
+
+	std::wstring Lowercase(std::wstring text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+		return text;
+	}
+
+	std::wstring FeatureLevelName(D3D_FEATURE_LEVEL level)
+	{
+		if (level == 0)
+			return L"none";
+		wchar_t name[16];
+		swprintf_s(name, L"%u_%u", (level >> 12) & 0xF, (level >> 8) & 0xF);
+		return name;
+	}
+
+	const UINT64 MemoryStep = 256ull << 20;
+}
+
+AdapterSelector::AdapterSelector(const AdapterPolicy& policy)
+	: m_Policy(policy)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / static_cast<double>(frequency.QuadPart);
+}
+
+// == Enumeration ==
+
+void AdapterSelector::Enumerate(IDXGIFactory6* factory)
+{
+	LARGE_INTEGER start = Now();
+
+	bool haveSoftware = false;
+	Microsoft::WRL::ComPtr<IDXGIAdapter1> adapter;
+	for (UINT i = 0; factory->EnumAdapterByGpuPreference(i, m_Policy.Preference, IID_PPV_ARGS(&adapter)) != DXGI_ERROR_NOT_FOUND; ++i)
+	{
+		AdapterCandidate candidate;
+		candidate.Adapter = adapter;
+		candidate.PreferenceOrder = i;
+		Probe(candidate);
+		haveSoftware |= candidate.Software;
+		m_Candidates.push_back(std::move(candidate));
+		adapter.Reset();
+	}
+
+	if (m_Policy.AllowSoftware && !haveSoftware &&
+		SUCCEEDED(factory->EnumWarpAdapter(IID_PPV_ARGS(&adapter))))
+	{
+		AdapterCandidate candidate;
+		candidate.Adapter = adapter;
+		candidate.PreferenceOrder = static_cast<UINT>(m_Candidates.size());
+		Probe(candidate);
+		candidate.Software = true;
+		m_Candidates.push_back(std::move(candidate));
+	}
+
+	m_Stats.EnumerateMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+}
+
+void AdapterSelector::Probe(AdapterCandidate& candidate) const
+{
+	DXGI_ADAPTER_DESC1 desc = {};
+	candidate.Adapter->GetDesc1(&desc);
+	candidate.Description = desc.Description;
+	candidate.VendorId = desc.VendorId;
+	candidate.DeviceId = desc.DeviceId;
+	candidate.Luid = desc.AdapterLuid;
+	candidate.DedicatedVideoMemory = desc.DedicatedVideoMemory;
+	candidate.SharedSystemMemory = desc.SharedSystemMemory;
+	candidate.Software = (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0;
+
+	// An adapter below the minimum feature level is kept, without a device,
+	// so the log shows why it was passed over.
+	if (FAILED(D3D12CreateDevice(candidate.Adapter.Get(), m_Policy.MinFeatureLevel, IID_PPV_ARGS(&candidate.Device))))
+		return;
+
+	CD3DX12FeatureSupport features;
+	if (FAILED(features.Init(candidate.Device.Get())))
+		return;
+	candidate.MaxFeatureLevel = features.MaxSupportedFeatureLevel();
+	candidate.HighestShaderModel = features.HighestShaderModel();
+	candidate.ResourceBindingTier = features.ResourceBindingTier();
+	candidate.RaytracingTier = features.RaytracingTier();
+	candidate.MeshShaderTier = features.MeshShaderTier();
+}
+
+void AdapterSelector::AddCandidate(const AdapterCandidate& candidate)
+{
+	m_Candidates.push_back(candidate);
+}
+
+// == Selection ==
+
+bool AdapterSelector::IsUsable(const AdapterCandidate& candidate, const AdapterPolicy& policy, std::wstring* reason)
+{
+	const wchar_t* missing = nullptr;
+	if (candidate.Software && !policy.AllowSoftware)
+		missing = L"software adapters not allowed";
+	else if (candidate.MaxFeatureLevel < policy.MinFeatureLevel)
+		missing = L"feature level";
+	else if (candidate.HighestShaderModel < policy.MinShaderModel)
+		missing = L"shader model";
+	else if (candidate.ResourceBindingTier < policy.MinResourceBindingTier)
+		missing = L"resource binding tier";
+	else if (candidate.RaytracingTier < policy.MinRaytracingTier)
+		missing = L"raytracing tier";
+	else if (candidate.MeshShaderTier < policy.MinMeshShaderTier)
+		missing = L"mesh shader tier";
+
+	if (missing != nullptr && reason != nullptr)
+		*reason = missing;
+	return missing == nullptr;
+}
+
+UINT64 AdapterSelector::Score(const AdapterCandidate& candidate, const AdapterPolicy& policy)
+{
+	const UINT64 hardware = candidate.Software ? 0 : 1;
+	const UINT64 featureLevel = static_cast<UINT64>(candidate.MaxFeatureLevel) & 0xFFFF;
+	const UINT64 order = 0xFFFF - std::min<UINT64>(candidate.PreferenceOrder, 0xFFFF);
+
+	if (policy.Preference == DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE)
+	{
+		// 23 bits of 256 MB steps are 2 PB; plenty.
+		const UINT64 memory = std::min<UINT64>(candidate.DedicatedVideoMemory / MemoryStep, (1ull << 23) - 1);
+		return (hardware << 63) | (memory << 40) | (featureLevel << 16) | order;
+	}
+	return (hardware << 63) | (order << 16) | featureLevel;
+}
+
+size_t AdapterSelector::FindOverride() const
+{
+	const std::wstring name = Lowercase(m_Policy.Override);
+	if (name.empty())
+		return NoAdapter;
+
+	for (size_t i = 0; i < m_Candidates.size(); ++i)
+	{
+		const AdapterCandidate& candidate = m_Candidates[i];
+		if ((name == L"warp" && candidate.Software) ||
+			(name[0] == L'#' && name.substr(1) == std::to_wstring(candidate.PreferenceOrder)) ||
+			(name[0] != L'#' && Lowercase(candidate.Description).find(name) != std::wstring::npos))
+		{
+			return i;
+		}
+	}
+	LogAdapter(L"no adapter matches the override \"" + m_Policy.Override + L"\"; choosing by score.");
+	return NoAdapter;
+}
+
+size_t AdapterSelector::Select()
+{
+	size_t best = NoAdapter;
+	UINT64 bestScore = 0;
+	for (size_t i = 0; i < m_Candidates.size(); ++i)
+	{
+		const AdapterCandidate& candidate = m_Candidates[i];
+		std::wstring reason;
+		const bool usable = IsUsable(candidate, m_Policy, &reason);
+		const UINT64 score = usable ? Score(candidate, m_Policy) : 0;
+
+		LogAdapter(L"#" + std::to_wstring(candidate.PreferenceOrder) + L" " + candidate.Description +
+			L": " + std::to_wstring(candidate.DedicatedVideoMemory >> 20) + L" MB, feature level " +
+			FeatureLevelName(candidate.MaxFeatureLevel) + (usable ? L"" : L", unusable (" + reason + L")"));
+
+		if (usable && (best == NoAdapter || score > bestScore))
+		{
+			best = i;
+			bestScore = score;
+		}
+	}
+
+	m_Stats.Overridden = false;
+	const size_t overridden = FindOverride();
+	if (overridden != NoAdapter)
+	{
+		std::wstring reason;
+		if (IsUsable(m_Candidates[overridden], m_Policy, &reason))
+		{
+			best = overridden;
+			m_Stats.Overridden = true;
+		}
+		else
+		{
+			LogAdapter(L"the override names " + m_Candidates[overridden].Description + L", which is unusable (" + reason + L").");
+		}
+	}
+
+	if (best == NoAdapter)
+		LogAdapter(L"no adapter meets the requirements.");
+	else
+		LogAdapter(L"using " + m_Candidates[best].Description + (m_Stats.Overridden ? L" (override)" : L""));
+	return best;
+}
@@ -0,0 +1,470 @@
+#include "pch.h"
+
+#include "AssetPack.h"
+#include "Hash.h"
+#include "TextureFormat.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+namespace
+{
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// True if [offset, offset + size) lies inside a file of fileSize bytes.
+	// Written so that corrupted 64-bit values cannot overflow.
+	bool RangeInFile(UINT64 offset, UINT64 size, UINT64 fileSize)
+	{
+		return offset <= fileSize && size <= fileSize - offset;
+	}
+
+	void LogPackError(const std::wstring& filename, const std::string& message)
+	{
+		std::wstring text = L"***AssetPack: " + filename + L": ";
+		text += std::wstring(message.begin(), message.end());
+		text += L"\n";
+		OutputDebugString(text.c_str());
+	}
+
+	UINT SubresourceCountFor(const D3D12_RESOURCE_DESC& desc)
+	{
+		UINT mips = desc.MipLevels ? desc.MipLevels : 1;
+		UINT arraySize = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : desc.DepthOrArraySize;
+		return mips * arraySize;
+	}
+}
+
+// ============================================================================
+// AssetPack (reader)
+// ============================================================================
+
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+bool AssetPack::Open(const std::wstring& filename)
+{
+	Close();
+
+	m_File = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		LogPackError(filename, "could not open file");
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(AssetPackHeader))
+	{
+		LogPackError(filename, "file is too small to be an asset pack");
+		Close();
+		return false;
+	}
+
+	// Map the whole file read-only. Pages are only faulted in when the upload
+	// path actually touches a payload, and the OS page cache makes warm loads
+	// essentially free.
+	m_Mapping = CreateFileMapping(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping)
+		m_Data = static_cast<const BYTE*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_Data)
+	{
+		LogPackError(filename, "could not map file");
+		Close();
+		return false;
+	}
+
+	if (!Validate(static_cast<UINT64>(fileSize.QuadPart)))
+	{
+		LogPackError(filename, "validation failed");
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void AssetPack::Close()
+{
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = nullptr;
+	m_Data = nullptr;
+	m_Header = nullptr;
+	m_Entries = nullptr;
+	m_Subresources = nullptr;
+	m_Strings = nullptr;
+}
+
+bool AssetPack::Validate(UINT64 fileSize)
+{
+	const AssetPackHeader* header = reinterpret_cast<const AssetPackHeader*>(m_Data);
+
+	if (header->Magic != AssetPackFormat::Magic || header->Version != AssetPackFormat::Version)
+		return false;
+	if (header->FileSize != fileSize)
+		return false;
+
+	// Every table must lie inside the file.
+	UINT64 tocSize = UINT64(header->EntryCount) * sizeof(AssetPackEntry);
+	UINT64 subresourceTableSize = UINT64(header->SubresourceCount) * sizeof(AssetPackSubresource);
+	if (!RangeInFile(header->TocOffset, tocSize, fileSize) ||
+		!RangeInFile(header->SubresourceTableOffset, subresourceTableSize, fileSize) ||
+		!RangeInFile(header->StringTableOffset, header->StringTableSize, fileSize) ||
+		header->PayloadOffset > fileSize)
+		return false;
+
+	// The tables are read in place, so they have to be suitably aligned.
+	if (header->TocOffset % alignof(AssetPackEntry) != 0 ||
+		header->SubresourceTableOffset % alignof(AssetPackSubresource) != 0)
+		return false;
+
+	// One hash covers all three tables.
+	UINT64 tableHash = Fnv1a64(m_Data + header->TocOffset, static_cast<size_t>(tocSize));
+	tableHash = Fnv1a64(m_Data + header->SubresourceTableOffset, static_cast<size_t>(subresourceTableSize), tableHash);
+	tableHash = Fnv1a64(m_Data + header->StringTableOffset, static_cast<size_t>(header->StringTableSize), tableHash);
+	if (tableHash != header->TocHash)
+		return false;
+
+	m_Header = header;
+	m_Entries = reinterpret_cast<const AssetPackEntry*>(m_Data + header->TocOffset);
+	m_Subresources = reinterpret_cast<const AssetPackSubresource*>(m_Data + header->SubresourceTableOffset);
+	m_Strings = reinterpret_cast<const char*>(m_Data + header->StringTableOffset);
+
+	for (UINT i = 0; i < header->EntryCount; ++i)
+	{
+		if (!ValidateEntry(m_Entries[i]))
+			return false;
+
+		// FindAsset relies on the TOC being sorted by hash without duplicates.
+		if (i > 0 && m_Entries[i - 1].NameHash >= m_Entries[i].NameHash)
+			return false;
+	}
+
+	return true;
+}
+
+bool AssetPack::ValidateEntry(const AssetPackEntry& entry) const
+{
+	// Name
+	if (!RangeInFile(entry.NameOffset, entry.NameLength, m_Header->StringTableSize))
+		return false;
+	if (Fnv1a64(m_Strings + entry.NameOffset, entry.NameLength) != entry.NameHash)
+		return false;
+
+	// Payload
+	if (entry.PayloadOffset < m_Header->PayloadOffset ||
+		!RangeInFile(entry.PayloadOffset, entry.PayloadSize, m_Header->FileSize) ||
+		entry.PayloadOffset % AssetPackFormat::PayloadAlignment != 0)
+		return false;
+
+	if (entry.Type == static_cast<UINT32>(AssetType::Raw))
+		return entry.SubresourceCount == 0;
+
+	if (entry.Type != static_cast<UINT32>(AssetType::Texture))
+		return false;
+
+	// Texture: the stored footprints must be exactly what the upload path
+	// expects, otherwise the single-memcpy fast path would copy garbage.
+	if (!RangeInFile(entry.FirstSubresource, entry.SubresourceCount, m_Header->SubresourceCount))
+		return false;
+
+	D3D12_RESOURCE_DESC desc = GetTextureDesc(entry);
+	if (desc.Dimension < D3D12_RESOURCE_DIMENSION_TEXTURE1D || desc.Dimension > D3D12_RESOURCE_DIMENSION_TEXTURE3D ||
+		desc.Width == 0 || desc.Height == 0 || desc.DepthOrArraySize == 0 || desc.MipLevels == 0 ||
+		entry.SubresourceCount != SubresourceCountFor(desc))
+		return false;
+
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(entry.SubresourceCount);
+	std::vector<UINT> numRows(entry.SubresourceCount);
+	std::vector<UINT64> rowSizes(entry.SubresourceCount);
+	UINT64 totalBytes = 0;
+	if (!ComputeCopyableFootprints(desc, 0, entry.SubresourceCount, 0,
+		layouts.data(), numRows.data(), rowSizes.data(), &totalBytes))
+		return false;
+
+	if (totalBytes > entry.PayloadSize)
+		return false;
+
+	for (UINT i = 0; i < entry.SubresourceCount; ++i)
+	{
+		const AssetPackSubresource& stored = m_Subresources[entry.FirstSubresource + i];
+		if (stored.Offset != layouts[i].Offset ||
+			stored.RowPitch != layouts[i].Footprint.RowPitch ||
+			stored.NumRows != numRows[i] ||
+			stored.RowSizeInBytes != rowSizes[i] ||
+			stored.Width != layouts[i].Footprint.Width ||
+			stored.Height != layouts[i].Footprint.Height ||
+			stored.Depth != layouts[i].Footprint.Depth)
+			return false;
+	}
+
+	return true;
+}
+
+UINT AssetPack::GetAssetCount() const
+{
+	return m_Header ? m_Header->EntryCount : 0;
+}
+
+const AssetPackEntry& AssetPack::GetEntry(UINT index) const
+{
+	assert(index < GetAssetCount());
+	return m_Entries[index];
+}
+
+const AssetPackEntry* AssetPack::FindAsset(const std::string& name) const
+{
+	if (!m_Header)
+		return nullptr;
+
+	UINT64 hash = Fnv1a64(name);
+	const AssetPackEntry* first = m_Entries;
+	const AssetPackEntry* last = m_Entries + m_Header->EntryCount;
+	const AssetPackEntry* it = std::lower_bound(first, last, hash,
+		[](const AssetPackEntry& entry, UINT64 value) { return entry.NameHash < value; });
+
+	// Hashes are unique within a pack, but guard against a lookup for a
+	// different name that happens to collide with a stored one.
+	if (it != last && it->NameHash == hash && GetName(*it) == name)
+		return it;
+	return nullptr;
+}
+
+std::string AssetPack::GetName(const AssetPackEntry& entry) const
+{
+	return std::string(m_Strings + entry.NameOffset, entry.NameLength);
+}
+
+const BYTE* AssetPack::GetPayload(const AssetPackEntry& entry) const
+{
+	return m_Data + entry.PayloadOffset;
+}
+
+D3D12_RESOURCE_DESC AssetPack::GetTextureDesc(const AssetPackEntry& entry) const
+{
+	D3D12_RESOURCE_DESC desc = {};
+	desc.Dimension = static_cast<D3D12_RESOURCE_DIMENSION>(entry.Dimension);
+	desc.Alignment = 0;
+	desc.Width = entry.Width;
+	desc.Height = entry.Height;
+	desc.DepthOrArraySize = entry.DepthOrArraySize;
+	desc.MipLevels = entry.MipLevels;
+	desc.Format = static_cast<DXGI_FORMAT>(entry.Format);
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	return desc;
+}
+
+void AssetPack::GetTextureLayouts(const AssetPackEntry& entry, std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts) const
+{
+	layouts.resize(entry.SubresourceCount);
+	for (UINT i = 0; i < entry.SubresourceCount; ++i)
+	{
+		const AssetPackSubresource& stored = m_Subresources[entry.FirstSubresource + i];
+		layouts[i].Offset = stored.Offset;
+		layouts[i].Footprint.Format = static_cast<DXGI_FORMAT>(entry.Format);
+		layouts[i].Footprint.Width = stored.Width;
+		layouts[i].Footprint.Height = stored.Height;
+		layouts[i].Footprint.Depth = stored.Depth;
+		layouts[i].Footprint.RowPitch = stored.RowPitch;
+	}
+}
+
+UploadTicket AssetPack::UploadTexture(StreamingUploader& uploader, ID3D12Resource* dest, const AssetPackEntry& entry) const
+{
+	assert(entry.Type == static_cast<UINT32>(AssetType::Texture));
+
+	// The payload was laid out for the entry's desc; copying it into a
+	// texture of another shape would read past the payload or scramble rows.
+	const D3D12_RESOURCE_DESC wanted = GetTextureDesc(entry);
+	const D3D12_RESOURCE_DESC actual = dest->GetDesc();
+	if (actual.Dimension != wanted.Dimension ||
+		actual.Width != wanted.Width ||
+		actual.Height != wanted.Height ||
+		actual.DepthOrArraySize != wanted.DepthOrArraySize ||
+		actual.MipLevels != wanted.MipLevels ||
+		actual.Format != wanted.Format ||
+		SubresourceCountFor(actual) != entry.SubresourceCount)
+	{
+		const std::string name = GetName(entry);
+		LogPackError(std::wstring(name.begin(), name.end()), "destination texture does not match the packed desc");
+		return UploadTicket();
+	}
+
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts;
+	GetTextureLayouts(entry, layouts);
+	return uploader.UploadTexture(dest, 0, entry.SubresourceCount, GetPayload(entry), layouts.data());
+}
+
+// ============================================================================
+// AssetPackWriter (packer)
+// ============================================================================
+
+bool AssetPackWriter::AddTexture(const std::string& name, const D3D12_RESOURCE_DESC& desc, const D3D12_SUBRESOURCE_DATA* subresources)
+{
+	UINT numSubresources = SubresourceCountFor(desc);
+
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(numSubresources);
+	std::vector<UINT> numRows(numSubresources);
+	std::vector<UINT64> rowSizes(numSubresources);
+	UINT64 totalBytes = 0;
+	if (!ComputeCopyableFootprints(desc, 0, numSubresources, 0,
+		layouts.data(), numRows.data(), rowSizes.data(), &totalBytes))
+		return false;
+
+	PendingAsset asset;
+	asset.Name = name;
+	asset.Entry.Type = static_cast<UINT32>(AssetType::Texture);
+	asset.Entry.Format = static_cast<UINT32>(desc.Format);
+	asset.Entry.Dimension = static_cast<UINT32>(desc.Dimension);
+	asset.Entry.Width = desc.Width;
+	asset.Entry.Height = desc.Height;
+	asset.Entry.DepthOrArraySize = desc.DepthOrArraySize;
+	asset.Entry.MipLevels = desc.MipLevels ? desc.MipLevels : 1;
+	asset.Entry.SubresourceCount = numSubresources;
+	asset.Entry.PayloadSize = totalBytes;
+
+	// Copy each subresource into the pitched layout once, at pack time,
+	// so nobody has to do it at load time.
+	asset.Payload.resize(static_cast<size_t>(totalBytes));
+	asset.Subresources.resize(numSubresources);
+	for (UINT i = 0; i < numSubresources; ++i)
+	{
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = layouts[i];
+		for (UINT z = 0; z < layout.Footprint.Depth; ++z)
+		{
+			for (UINT y = 0; y < numRows[i]; ++y)
+			{
+				BYTE* dst = asset.Payload.data() + layout.Offset + UINT64(z * numRows[i] + y) * layout.Footprint.RowPitch;
+				const BYTE* src = static_cast<const BYTE*>(subresources[i].pData) +
+					subresources[i].SlicePitch * LONG_PTR(z) + subresources[i].RowPitch * LONG_PTR(y);
+				memcpy(dst, src, static_cast<size_t>(rowSizes[i]));
+			}
+		}
+
+		AssetPackSubresource& stored = asset.Subresources[i];
+		stored.Offset = layout.Offset;
+		stored.RowPitch = layout.Footprint.RowPitch;
+		stored.NumRows = numRows[i];
+		stored.RowSizeInBytes = rowSizes[i];
+		stored.Width = layout.Footprint.Width;
+		stored.Height = layout.Footprint.Height;
+		stored.Depth = layout.Footprint.Depth;
+		stored.Reserved = 0;
+	}
+
+	m_Assets.push_back(std::move(asset));
+	return true;
+}
+
+bool AssetPackWriter::AddRaw(const std::string& name, const void* data, UINT64 size)
+{
+	PendingAsset asset;
+	asset.Name = name;
+	asset.Entry.Type = static_cast<UINT32>(AssetType::Raw);
+	asset.Entry.PayloadSize = size;
+	asset.Payload.assign(static_cast<const BYTE*>(data), static_cast<const BYTE*>(data) + size);
+
+	m_Assets.push_back(std::move(asset));
+	return true;
+}
+
+bool AssetPackWriter::Write(const std::wstring& filename) const
+{
+	// Sort by name hash so the reader can binary search the TOC.
+	std::vector<std::pair<UINT64, const PendingAsset*>> sorted;
+	for (const auto& asset : m_Assets)
+		sorted.emplace_back(Fnv1a64(asset.Name), &asset);
+	std::sort(sorted.begin(), sorted.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+
+	for (size_t i = 1; i < sorted.size(); ++i)
+	{
+		if (sorted[i - 1].first == sorted[i].first)
+			return false; // duplicate name (or a genuine 64-bit collision)
+	}
+
+	// == Build the tables ==
+	std::vector<AssetPackEntry> entries;
+	std::vector<AssetPackSubresource> subresources;
+	std::string strings;
+
+	for (const auto& item : sorted)
+	{
+		const PendingAsset& asset = *item.second;
+		AssetPackEntry entry = asset.Entry;
+		entry.NameHash = item.first;
+		entry.NameOffset = static_cast<UINT32>(strings.size());
+		entry.NameLength = static_cast<UINT32>(asset.Name.size());
+		entry.FirstSubresource = static_cast<UINT32>(subresources.size());
+		strings += asset.Name;
+		subresources.insert(subresources.end(), asset.Subresources.begin(), asset.Subresources.end());
+		entries.push_back(entry);
+	}
+
+	AssetPackHeader header = {};
+	header.Magic = AssetPackFormat::Magic;
+	header.Version = AssetPackFormat::Version;
+	header.EntryCount = static_cast<UINT32>(entries.size());
+	header.SubresourceCount = static_cast<UINT32>(subresources.size());
+	header.TocOffset = sizeof(AssetPackHeader);
+	header.SubresourceTableOffset = header.TocOffset + entries.size() * sizeof(AssetPackEntry);
+	header.StringTableOffset = header.SubresourceTableOffset + subresources.size() * sizeof(AssetPackSubresource);
+	header.StringTableSize = strings.size();
+	header.PayloadOffset = AlignUp(header.StringTableOffset + header.StringTableSize, AssetPackFormat::PayloadAlignment);
+
+	// == Place the payloads ==
+	UINT64 offset = header.PayloadOffset;
+	for (auto& entry : entries)
+	{
+		entry.PayloadOffset = offset;
+		offset = AlignUp(offset + entry.PayloadSize, AssetPackFormat::PayloadAlignment);
+	}
+	header.FileSize = entries.empty() ? header.PayloadOffset : entries.back().PayloadOffset + entries.back().PayloadSize;
+
+	header.TocHash = Fnv1a64(entries.data(), entries.size() * sizeof(AssetPackEntry));
+	header.TocHash = Fnv1a64(subresources.data(), subresources.size() * sizeof(AssetPackSubresource), header.TocHash);
+	header.TocHash = Fnv1a64(strings.data(), strings.size(), header.TocHash);
+
+	// == Write ==
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	auto writePadding = [&file](UINT64 target)
+	{
+		static const char zeros[AssetPackFormat::PayloadAlignment] = {};
+		UINT64 position = static_cast<UINT64>(file.tellp());
+		if (target > position)
+			file.write(zeros, static_cast<std::streamsize>(target - position));
+	};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPackEntry));
+	file.write(reinterpret_cast<const char*>(subresources.data()), subresources.size() * sizeof(AssetPackSubresource));
+	file.write(strings.data(), strings.size());
+
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		writePadding(entries[i].PayloadOffset);
+		const std::vector<BYTE>& payload = sorted[i].second->Payload;
+		file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+	}
+
+	return static_cast<bool>(file);
+}
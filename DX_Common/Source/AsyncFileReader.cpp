@@ -0,0 +1,375 @@
+#include "pch.h"
+
+#include "AsyncFileReader.h"
+#include "D3DUtil.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Completion key used to wake the completion thread for shutdown.
+	const ULONG_PTR s_QuitKey = ~ULONG_PTR(0);
+
+	bool IsFinal(AsyncReadStatus status)
+	{
+		return status == AsyncReadStatus::Completed ||
+			status == AsyncReadStatus::Failed ||
+			status == AsyncReadStatus::Cancelled;
+	}
+}
+
+AsyncFileReader::AsyncFileReader(UINT queueDepth)
+	: m_QueueDepth(std::max(1u, queueDepth))
+{
+	// One completion port for every file. A single thread drains it; the OS
+	// does the actual reading in parallel up to the queue depth.
+	m_CompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+	if (!m_CompletionPort)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	m_CompletionThread = std::thread(&AsyncFileReader::CompletionThreadMain, this);
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+	// Cancel whatever is still outstanding and wait for the OS to hand the
+	// OVERLAPPED structures back before they are freed.
+	std::vector<AsyncReadId> pending;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const auto& it : m_Ops)
+		{
+			if (!IsFinal(it.second->Status))
+				pending.push_back(it.first);
+		}
+	}
+	for (AsyncReadId id : pending)
+		Cancel(id);
+	WaitIdle();
+
+	PostQueuedCompletionStatus(m_CompletionPort, 0, s_QuitKey, nullptr);
+	if (m_CompletionThread.joinable())
+		m_CompletionThread.join();
+
+	for (auto& file : m_Files)
+	{
+		if (file.Handle != INVALID_HANDLE_VALUE)
+			CloseHandle(file.Handle);
+	}
+	CloseHandle(m_CompletionPort);
+}
+
+AsyncFileHandle AsyncFileReader::OpenFile(const std::wstring& filename, bool unbuffered)
+{
+	DWORD flags = FILE_FLAG_OVERLAPPED | (unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN);
+	HANDLE handle = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return 0;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) ||
+		CreateIoCompletionPort(handle, m_CompletionPort, 0, 0) == nullptr)
+	{
+		CloseHandle(handle);
+		return 0;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	OpenFileInfo info;
+	info.Handle = handle;
+	info.Size = static_cast<UINT64>(size.QuadPart);
+	info.Unbuffered = unbuffered;
+
+	// Reuse a closed slot if there is one.
+	for (size_t i = 0; i < m_Files.size(); ++i)
+	{
+		if (m_Files[i].Handle == INVALID_HANDLE_VALUE)
+		{
+			m_Files[i] = info;
+			return static_cast<AsyncFileHandle>(i + 1);
+		}
+	}
+
+	m_Files.push_back(info);
+	return static_cast<AsyncFileHandle>(m_Files.size());
+}
+
+void AsyncFileReader::CloseFile(AsyncFileHandle file)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	assert(file > 0 && file <= m_Files.size());
+
+#if defined(DEBUG) || defined(_DEBUG)
+	for (const auto& it : m_Ops)
+		assert((it.second->Request.File != file || IsFinal(it.second->Status)) && "Closing a file with pending reads");
+#endif
+
+	OpenFileInfo& info = m_Files[file - 1];
+	if (info.Handle != INVALID_HANDLE_VALUE)
+		CloseHandle(info.Handle);
+	info = OpenFileInfo();
+}
+
+UINT64 AsyncFileReader::GetFileSize(AsyncFileHandle file) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	assert(file > 0 && file <= m_Files.size());
+	return m_Files[file - 1].Size;
+}
+
+void AsyncFileReader::SetQueueDepth(UINT queueDepth)
+{
+	std::vector<FinishedRead> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_QueueDepth = std::max(1u, queueDepth);
+
+		// A deeper queue can take more work right away. A shallower one simply
+		// stops issuing until enough reads have drained.
+		IssueReadsLocked(finished);
+	}
+	RunCallbacks(finished);
+}
+
+UINT AsyncFileReader::GetQueueDepth() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_QueueDepth;
+}
+
+AsyncReadId AsyncFileReader::Submit(const AsyncReadRequest& request)
+{
+	AsyncReadId id = 0;
+	Submit(&request, 1, &id);
+	return id;
+}
+
+void AsyncFileReader::Submit(const AsyncReadRequest* requests, UINT count, AsyncReadId* ids)
+{
+	std::vector<FinishedRead> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		for (UINT i = 0; i < count; ++i)
+			ids[i] = QueueLocked(requests[i]);
+
+		IssueReadsLocked(finished);
+	}
+	RunCallbacks(finished);
+}
+
+AsyncReadId AsyncFileReader::QueueLocked(const AsyncReadRequest& request)
+{
+	assert(request.File > 0 && request.File <= m_Files.size());
+	assert(request.Buffer && request.Size > 0);
+
+#if defined(DEBUG) || defined(_DEBUG)
+	if (m_Files[request.File - 1].Unbuffered)
+	{
+		const UINT64 alignment = GetSectorAlignment();
+		assert(request.Offset % alignment == 0 && "Unbuffered reads need a sector-aligned offset");
+		assert(request.Size % alignment == 0 && "Unbuffered reads need a sector-multiple size");
+		assert(reinterpret_cast<UINT64>(request.Buffer) % alignment == 0 && "Unbuffered reads need a sector-aligned buffer");
+	}
+#endif
+
+	auto op = std::make_unique<ReadOp>();
+	op->Id = m_NextId++;
+	op->Request = request;
+	op->Status = AsyncReadStatus::Queued;
+
+	m_Queued[(int)request.Priority].push_back(op.get());
+
+	AsyncReadId id = op->Id;
+	m_Ops.emplace(id, std::move(op));
+	return id;
+}
+
+void AsyncFileReader::IssueReadsLocked(std::vector<FinishedRead>& finished)
+{
+	while (m_InFlight < m_QueueDepth)
+	{
+		// Highest priority class with work wins.
+		ReadOp* op = nullptr;
+		for (auto& queue : m_Queued)
+		{
+			if (!queue.empty())
+			{
+				op = queue.front();
+				queue.pop_front();
+				break;
+			}
+		}
+		if (!op)
+			break;
+
+		const OpenFileInfo& file = m_Files[op->Request.File - 1];
+
+		op->Overlapped = {};
+		op->Overlapped.Offset = static_cast<DWORD>(op->Request.Offset & 0xFFFFFFFF);
+		op->Overlapped.OffsetHigh = static_cast<DWORD>(op->Request.Offset >> 32);
+		op->Status = AsyncReadStatus::InFlight;
+		m_InFlight++;
+
+		// ReadFile may complete synchronously; with a completion port the
+		// completion packet is queued either way, so the completion thread
+		// always finishes the request.
+		if (!ReadFile(file.Handle, op->Request.Buffer, op->Request.Size, nullptr, &op->Overlapped))
+		{
+			DWORD error = GetLastError();
+			if (error != ERROR_IO_PENDING)
+			{
+				m_InFlight--;
+				FinishLocked(op, error == ERROR_HANDLE_EOF ? AsyncReadStatus::Completed : AsyncReadStatus::Failed, 0, finished);
+			}
+		}
+	}
+}
+
+void AsyncFileReader::FinishLocked(ReadOp* op, AsyncReadStatus status, UINT bytesRead, std::vector<FinishedRead>& finished)
+{
+	op->Status = status;
+	op->BytesRead = bytesRead;
+	if (op->Request.OnComplete)
+	{
+		// The callback is the only report the caller gets, so nothing would
+		// ever Poll() the op away: forget it here.
+		finished.push_back({ std::move(op->Request.OnComplete), op->Id, status, bytesRead });
+		m_Ops.erase(op->Id);
+	}
+	m_FinishedCv.notify_all();
+}
+
+void AsyncFileReader::RunCallbacks(const std::vector<FinishedRead>& finished)
+{
+	// Always called without the lock held, so callbacks may submit new reads.
+	for (const FinishedRead& read : finished)
+		read.Callback(read.Id, read.Status, read.BytesRead);
+}
+
+bool AsyncFileReader::Cancel(AsyncReadId id)
+{
+	std::vector<FinishedRead> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto it = m_Ops.find(id);
+		if (it == m_Ops.end() || IsFinal(it->second->Status))
+			return false;
+
+		ReadOp* op = it->second.get();
+		if (op->Status == AsyncReadStatus::Queued)
+		{
+			// Never reached the OS: just drop it from its queue.
+			auto& queue = m_Queued[(int)op->Request.Priority];
+			queue.erase(std::remove(queue.begin(), queue.end(), op), queue.end());
+			FinishLocked(op, AsyncReadStatus::Cancelled, 0, finished);
+		}
+		else
+		{
+			// In flight: ask the OS to abort. The completion packet still
+			// arrives (with ERROR_OPERATION_ABORTED, or success if it won the race).
+			CancelIoEx(m_Files[op->Request.File - 1].Handle, &op->Overlapped);
+		}
+	}
+
+	RunCallbacks(finished);
+	return true;
+}
+
+AsyncReadStatus AsyncFileReader::Poll(AsyncReadId id, UINT* bytesRead)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto it = m_Ops.find(id);
+	if (it == m_Ops.end())
+		return AsyncReadStatus::Unknown;
+
+	AsyncReadStatus status = it->second->Status;
+	if (bytesRead)
+		*bytesRead = it->second->BytesRead;
+
+	if (IsFinal(status))
+		m_Ops.erase(it);
+
+	return status;
+}
+
+AsyncReadStatus AsyncFileReader::Wait(AsyncReadId id, UINT* bytesRead)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	// Look the op up again on every wake: another thread's Poll() or Wait(),
+	// or a callback request finishing, may free it while the lock is released.
+	auto it = m_Ops.find(id);
+	m_FinishedCv.wait(lock, [&]()
+	{
+		it = m_Ops.find(id);
+		return it == m_Ops.end() || IsFinal(it->second->Status);
+	});
+	if (it == m_Ops.end())
+		return AsyncReadStatus::Unknown;
+
+	AsyncReadStatus status = it->second->Status;
+	if (bytesRead)
+		*bytesRead = it->second->BytesRead;
+	m_Ops.erase(it);
+	return status;
+}
+
+void AsyncFileReader::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_FinishedCv.wait(lock, [this]()
+	{
+		if (m_InFlight != 0)
+			return false;
+		for (const auto& queue : m_Queued)
+		{
+			if (!queue.empty())
+				return false;
+		}
+		return true;
+	});
+}
+
+void AsyncFileReader::CompletionThreadMain()
+{
+	std::vector<FinishedRead> finished;
+
+	while (true)
+	{
+		DWORD bytes = 0;
+		ULONG_PTR key = 0;
+		OVERLAPPED* overlapped = nullptr;
+		BOOL ok = GetQueuedCompletionStatus(m_CompletionPort, &bytes, &key, &overlapped, INFINITE);
+
+		if (key == s_QuitKey && overlapped == nullptr)
+			return;
+		if (overlapped == nullptr)
+			continue; // the port itself failed; nothing to finish
+
+		ReadOp* op = reinterpret_cast<ReadOp*>(overlapped);
+		DWORD error = ok ? 0 : GetLastError();
+
+		finished.clear();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+
+			AsyncReadStatus status = AsyncReadStatus::Completed;
+			if (error == ERROR_OPERATION_ABORTED)
+				status = AsyncReadStatus::Cancelled;
+			else if (error != 0 && error != ERROR_HANDLE_EOF)
+				status = AsyncReadStatus::Failed;
+
+			m_InFlight--;
+			FinishLocked(op, status, bytes, finished);
+
+			// A slot just freed up: keep the device queue full.
+			IssueReadsLocked(finished);
+		}
+
+		RunCallbacks(finished);
+	}
+}
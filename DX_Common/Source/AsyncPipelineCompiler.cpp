@@ -0,0 +1,281 @@
+#include "pch.h"
+
+#include "AsyncPipelineCompiler.h"
+#include "PipelineCache.h"
+#include "ThreadPool.h"
+#include "D3DUtil.h"
+#include "directx/d3dx12.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+}
+
+AsyncPipelineCompiler::AsyncPipelineCompiler(PipelineCache* cache, ThreadPool* pool)
+	: m_Cache(cache)
+	, m_Pool(pool)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+
+	if (m_Cache)
+	{
+		m_Compile = [cache](const D3D12_PIPELINE_STATE_STREAM_DESC& desc)
+		{
+			return cache->GetOrCreate(desc);
+		};
+	}
+}
+
+AsyncPipelineCompiler::~AsyncPipelineCompiler()
+{
+	// Runners still in the pool's queue find nothing to do, but they do
+	// touch this object, so wait for all of them.
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (Entry* entry : m_Pending)
+		entry->Status.store(PipelineStatus::Failed);
+	m_Pending.clear();
+	m_IdleCv.wait(lock, [this]() { return m_QueuedRunners == 0; });
+}
+
+PipelineHandle AsyncPipelineCompiler::Request(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, PipelinePriority priority)
+{
+	assert(m_Compile && "no PipelineCache and no CompileFunc");
+
+	bool persistent = false;
+	const uint64_t key = m_Cache ? m_Cache->HashPipelineStream(desc, &persistent) : 0;
+
+	PipelineHandle handle = InvalidPipelineHandle;
+	Entry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.Requests++;
+
+		if (key != 0)
+		{
+			auto it = m_ByKey.find(key);
+			if (it != m_ByKey.end())
+			{
+				Entry& existing = m_Entries[it->second];
+				if (existing.Status.load() != PipelineStatus::Failed)
+				{
+					m_Stats.Deduplicated++;
+					existing.Priority = std::max(existing.Priority, priority);
+					return it->second;
+				}
+
+				// Try a failed pipeline again, from this request's copy of
+				// the description: the arrays the first one pointed to may
+				// be gone by now.
+				m_Stats.Retries++;
+				handle = it->second;
+				entry = &existing;
+			}
+		}
+
+		if (!entry)
+		{
+			handle = static_cast<PipelineHandle>(m_Entries.size());
+			m_Entries.emplace_back();
+			entry = &m_Entries.back();
+			if (key != 0)
+				m_ByKey[key] = handle;
+		}
+
+		entry->StreamSize = desc.SizeInBytes;
+		entry->Stream.resize((desc.SizeInBytes + sizeof(void*) - 1) / sizeof(void*));
+		memcpy(entry->Stream.data(), desc.pPipelineStateSubobjectStream, desc.SizeInBytes);
+		entry->Key = key;
+		entry->Priority = priority;
+		entry->Sequence = m_NextSequence++;
+		entry->RequestTime = Now();
+		entry->Status.store(PipelineStatus::Pending);
+
+		if (m_Pool)
+		{
+			m_Pending.push_back(entry);
+			m_QueuedRunners++;
+		}
+	}
+
+	if (m_Pool)
+	{
+		// The runner compiles whatever is most urgent when it gets to run,
+		// which is not necessarily this request.
+		m_Pool->Submit([this]() { RunHighestPriority(); });
+	}
+	else
+	{
+		entry->Status.store(PipelineStatus::Compiling);
+		Compile(*entry);
+	}
+	return handle;
+}
+
+PipelineHandle AsyncPipelineCompiler::Request(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, PipelinePriority priority)
+{
+	CD3DX12_PIPELINE_STATE_STREAM stream(desc);
+	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+	return Request(streamDesc, priority);
+}
+
+PipelineHandle AsyncPipelineCompiler::Request(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, PipelinePriority priority)
+{
+	CD3DX12_PIPELINE_STATE_STREAM stream(desc);
+	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+	return Request(streamDesc, priority);
+}
+
+void AsyncPipelineCompiler::SetFallback(PipelineHandle handle, PipelineHandle fallback)
+{
+	assert(handle < m_Entries.size() && (fallback == InvalidPipelineHandle || fallback < m_Entries.size()));
+	m_Entries[handle].Fallback = fallback;
+}
+
+void AsyncPipelineCompiler::Boost(PipelineHandle handle, PipelinePriority priority)
+{
+	assert(handle < m_Entries.size());
+	Entry& entry = m_Entries[handle];
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (entry.Status.load() == PipelineStatus::Pending && entry.Priority < priority)
+	{
+		entry.Priority = priority;
+		m_Stats.Boosts++;
+	}
+}
+
+PipelineStatus AsyncPipelineCompiler::GetStatus(PipelineHandle handle) const
+{
+	assert(handle < m_Entries.size());
+	return m_Entries[handle].Status.load();
+}
+
+ID3D12PipelineState* AsyncPipelineCompiler::GetPipeline(PipelineHandle handle)
+{
+	assert(handle < m_Entries.size());
+	Entry& entry = m_Entries[handle];
+
+	// Fast path, once per draw: no lock.
+	if (ID3D12PipelineState* pipeline = entry.Pipeline.load(std::memory_order_acquire))
+	{
+		m_DrawsReady.fetch_add(1, std::memory_order_relaxed);
+		return pipeline;
+	}
+
+	Boost(handle, PipelinePriority::Visible);
+
+	if (entry.Fallback != InvalidPipelineHandle)
+	{
+		if (ID3D12PipelineState* fallback = m_Entries[entry.Fallback].Pipeline.load(std::memory_order_acquire))
+		{
+			m_DrawsWithFallback.fetch_add(1, std::memory_order_relaxed);
+			return fallback;
+		}
+	}
+
+	m_DrawsSkipped.fetch_add(1, std::memory_order_relaxed);
+	return nullptr;
+}
+
+void AsyncPipelineCompiler::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_IdleCv.wait(lock, [this]() { return m_QueuedRunners == 0; });
+}
+
+AsyncPipelineCompiler::Stats AsyncPipelineCompiler::GetStats() const
+{
+	Stats stats;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		stats = m_Stats;
+	}
+	stats.DrawsReady = m_DrawsReady.load(std::memory_order_relaxed);
+	stats.DrawsWithFallback = m_DrawsWithFallback.load(std::memory_order_relaxed);
+	stats.DrawsSkipped = m_DrawsSkipped.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void AsyncPipelineCompiler::RunHighestPriority()
+{
+	Entry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Pending.empty())
+		{
+			// The pending list is short (what is being loaded right now), so
+			// a linear scan is cheaper than keeping a heap in order through
+			// priority boosts.
+			auto best = m_Pending.begin();
+			for (auto it = m_Pending.begin() + 1; it != m_Pending.end(); ++it)
+			{
+				if ((*it)->Priority > (*best)->Priority ||
+					((*it)->Priority == (*best)->Priority && (*it)->Sequence < (*best)->Sequence))
+					best = it;
+			}
+			entry = *best;
+			*best = m_Pending.back();
+			m_Pending.pop_back();
+			entry->Status.store(PipelineStatus::Compiling);
+		}
+	}
+
+	if (entry)
+		Compile(*entry);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_QueuedRunners--;
+	if (m_QueuedRunners == 0)
+		m_IdleCv.notify_all();
+}
+
+void AsyncPipelineCompiler::Compile(Entry& entry)
+{
+	D3D12_PIPELINE_STATE_STREAM_DESC desc = { entry.StreamSize, entry.Stream.data() };
+
+	ID3D12PipelineState* pipeline = nullptr;
+	try
+	{
+		pipeline = m_Compile(desc);
+	}
+	catch (const DxException& e)
+	{
+		// Nothing on a worker thread can handle it; the pipeline just never
+		// becomes ready and draws keep using the fallback.
+		OutputDebugString((L"***AsyncPipelineCompiler: " + e.ToString() + L"\n").c_str());
+	}
+	catch (...)
+	{
+		// Same for anything else a CompileFunc throws. Letting it escape
+		// would skip the runner bookkeeping and hang WaitIdle().
+		OutputDebugString(L"***AsyncPipelineCompiler: pipeline creation threw an exception\n");
+	}
+
+	const double latency = (Now().QuadPart - entry.RequestTime.QuadPart) * m_SecondsPerCount * 1000.0;
+
+	entry.Pipeline.store(pipeline, std::memory_order_release);
+	entry.Status.store(pipeline ? PipelineStatus::Ready : PipelineStatus::Failed);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (pipeline)
+	{
+		m_Stats.Compiled++;
+		m_Stats.TotalLatencyMilliseconds += latency;
+		m_Stats.MaxLatencyMilliseconds = std::max(m_Stats.MaxLatencyMilliseconds, latency);
+	}
+	else
+	{
+		m_Stats.Failed++;
+	}
+}
@@ -0,0 +1,923 @@
+#include "pch.h"
+
+#include "BCEncoder.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include <emmintrin.h>
+
+namespace
+{
+	// 16 texels of one 4x4 block, channel-major (all reds, all greens, ...)
+	// so the SSE code can work on four texels at a time. Values are 0..255.
+	struct BlockTexels
+	{
+		alignas(16) float C[4][16];
+	};
+
+	struct Endpoints
+	{
+		float E0[4] = {};
+		float E1[4] = {};
+	};
+
+	const UINT16 s_AllTexels = 0xFFFF;
+
+	// Reads a 4x4 block of R8G8B8A8 texels, repeating the last row/column
+	// when the block hangs over the edge of the surface.
+	void LoadBlock(const BYTE* src, UINT rowPitch, UINT width, UINT height, UINT blockX, UINT blockY, BlockTexels& block)
+	{
+		for (UINT ty = 0; ty < 4; ++ty)
+		{
+			const UINT y = std::min(blockY * 4 + ty, height - 1);
+			const BYTE* row = src + size_t(y) * rowPitch;
+			for (UINT tx = 0; tx < 4; ++tx)
+			{
+				const UINT x = std::min(blockX * 4 + tx, width - 1);
+				const BYTE* texel = row + x * 4;
+				for (UINT c = 0; c < 4; ++c)
+					block.C[c][ty * 4 + tx] = texel[c];
+			}
+		}
+	}
+
+	float Clamp255(float v)
+	{
+		return std::min(std::max(v, 0.0f), 255.0f);
+	}
+
+	// == Palette search ==
+	// For every texel, finds the closest palette entry (squared distance over
+	// the first 'channels' channels). Returns the summed error of the texels
+	// in 'mask'. SSE2 only, which every x64 CPU has.
+	float FindIndices(const BlockTexels& block, UINT channels, const float (*palette)[4], UINT paletteSize, UINT16 mask, BYTE indices[16])
+	{
+		alignas(16) float bestDistance[16];
+		alignas(16) int bestIndex[16];
+
+		for (UINT group = 0; group < 16; group += 4)
+		{
+			__m128 best = _mm_set1_ps(1e30f);
+			__m128i bestI = _mm_setzero_si128();
+
+			for (UINT p = 0; p < paletteSize; ++p)
+			{
+				__m128 distance = _mm_setzero_ps();
+				for (UINT c = 0; c < channels; ++c)
+				{
+					__m128 d = _mm_sub_ps(_mm_load_ps(&block.C[c][group]), _mm_set1_ps(palette[p][c]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+				}
+
+				// Strictly-less keeps the lowest index on ties.
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				bestI = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestI));
+				best = _mm_min_ps(distance, best);
+			}
+
+			_mm_store_ps(&bestDistance[group], best);
+			_mm_store_si128(reinterpret_cast<__m128i*>(&bestIndex[group]), bestI);
+		}
+
+		float error = 0.0f;
+		for (UINT i = 0; i < 16; ++i)
+		{
+			indices[i] = static_cast<BYTE>(bestIndex[i]);
+			if (mask & (1 << i))
+				error += bestDistance[i];
+		}
+		return error;
+	}
+
+	// == Endpoint selection ==
+
+	void BoundingBoxEndpoints(const BlockTexels& block, UINT channels, UINT16 mask, Endpoints& e)
+	{
+		for (UINT c = 0; c < channels; ++c)
+		{
+			float lo = 255.0f;
+			float hi = 0.0f;
+			for (UINT i = 0; i < 16; ++i)
+			{
+				if (mask & (1 << i))
+				{
+					lo = std::min(lo, block.C[c][i]);
+					hi = std::max(hi, block.C[c][i]);
+				}
+			}
+
+			// Pull the endpoints in a little: the extremes are rarely worth
+			// spending a whole palette entry on.
+			const float inset = (hi - lo) / 16.0f;
+			e.E0[c] = hi - inset;
+			e.E1[c] = lo + inset;
+		}
+	}
+
+	// Endpoints along the principal axis of the texel cloud, which is the
+	// line the palette is interpolated along.
+	void PrincipalAxisEndpoints(const BlockTexels& block, UINT channels, UINT16 mask, Endpoints& e)
+	{
+		float mean[4] = {};
+		float count = 0.0f;
+		for (UINT i = 0; i < 16; ++i)
+		{
+			if (mask & (1 << i))
+			{
+				for (UINT c = 0; c < channels; ++c)
+					mean[c] += block.C[c][i];
+				count += 1.0f;
+			}
+		}
+		for (UINT c = 0; c < channels; ++c)
+			mean[c] /= count;
+
+		float covariance[4][4] = {};
+		for (UINT i = 0; i < 16; ++i)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+			for (UINT a = 0; a < channels; ++a)
+			{
+				for (UINT b = a; b < channels; ++b)
+					covariance[a][b] += (block.C[a][i] - mean[a]) * (block.C[b][i] - mean[b]);
+			}
+		}
+		for (UINT a = 0; a < channels; ++a)
+		{
+			for (UINT b = 0; b < a; ++b)
+				covariance[a][b] = covariance[b][a];
+		}
+
+		// Power iteration converges on the dominant eigenvector.
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			for (UINT a = 0; a < channels; ++a)
+			{
+				for (UINT b = 0; b < channels; ++b)
+					next[a] += covariance[a][b] * axis[b];
+			}
+
+			float length = 0.0f;
+			for (UINT c = 0; c < channels; ++c)
+				length = std::max(length, std::fabs(next[c]));
+			if (length < 1e-6f)
+				break;
+			for (UINT c = 0; c < channels; ++c)
+				axis[c] = next[c] / length;
+		}
+
+		float axisLengthSq = 0.0f;
+		for (UINT c = 0; c < channels; ++c)
+			axisLengthSq += axis[c] * axis[c];
+
+		float tMin = 0.0f;
+		float tMax = 0.0f;
+		for (UINT i = 0; i < 16; ++i)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+			float t = 0.0f;
+			for (UINT c = 0; c < channels; ++c)
+				t += (block.C[c][i] - mean[c]) * axis[c];
+			t /= axisLengthSq;
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+
+		for (UINT c = 0; c < channels; ++c)
+		{
+			e.E0[c] = Clamp255(mean[c] + tMax * axis[c]);
+			e.E1[c] = Clamp255(mean[c] + tMin * axis[c]);
+		}
+	}
+
+	// Least-squares endpoints for fixed indices: every texel is modelled as
+	// (1 - w) * E0 + w * E1, with w given per index by 'weights'.
+	bool RefineEndpoints(const BlockTexels& block, UINT channels, UINT16 mask, const BYTE indices[16], const float* weights, Endpoints& e)
+	{
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+
+		for (UINT i = 0; i < 16; ++i)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+			const float w = weights[indices[i]];
+			const float a = 1.0f - w;
+			aa += a * a;
+			bb += w * w;
+			ab += a * w;
+			for (UINT c = 0; c < channels; ++c)
+			{
+				ax[c] += a * block.C[c][i];
+				bx[c] += w * block.C[c][i];
+			}
+		}
+
+		const float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f)
+			return false;
+
+		for (UINT c = 0; c < channels; ++c)
+		{
+			e.E0[c] = Clamp255((ax[c] * bb - bx[c] * ab) / det);
+			e.E1[c] = Clamp255((bx[c] * aa - ax[c] * ab) / det);
+		}
+		return true;
+	}
+
+	int RefinementPasses(BCQuality quality)
+	{
+		return quality == BCQuality::Fast ? 0 : quality == BCQuality::Normal ? 1 : 4;
+	}
+
+	// == BC1 colour block ==
+
+	// Position between c0 and c1 of each BC1 index, per mode.
+	const float s_Bc1Weights4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	const float s_Bc1Weights3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+	UINT16 To565(const float* c)
+	{
+		UINT r = static_cast<UINT>(c[0] * 31.0f / 255.0f + 0.5f);
+		UINT g = static_cast<UINT>(c[1] * 63.0f / 255.0f + 0.5f);
+		UINT b = static_cast<UINT>(c[2] * 31.0f / 255.0f + 0.5f);
+		return static_cast<UINT16>((r << 11) | (g << 5) | b);
+	}
+
+	void From565(UINT16 v, int* c)
+	{
+		const int r = (v >> 11) & 31;
+		const int g = (v >> 5) & 63;
+		const int b = v & 31;
+		c[0] = (r << 3) | (r >> 2);
+		c[1] = (g << 2) | (g >> 4);
+		c[2] = (b << 3) | (b >> 2);
+	}
+
+	// BC1 palette in index order. With c0 > c1 (or always, for BC2/BC3 colour
+	// blocks) it has four colours; otherwise three plus transparent black.
+	UINT BuildBc1Palette(UINT16 c0, UINT16 c1, bool fourColor, int (*palette)[4])
+	{
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = 255;
+		for (UINT c = 0; c < 3; ++c)
+		{
+			if (fourColor)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = fourColor ? 255 : 0;
+		return fourColor ? 4 : 3;
+	}
+
+	struct Bc1Result
+	{
+		UINT16 C0 = 0;
+		UINT16 C1 = 0;
+		bool ThreeColor = false;
+		BYTE Indices[16] = {};
+		float Error = 1e30f;
+	};
+
+	void EvaluateBc1(const BlockTexels& block, const Endpoints& e, bool threeColor, UINT16 opaqueMask, Bc1Result& result)
+	{
+		UINT16 c0 = To565(e.E0);
+		UINT16 c1 = To565(e.E1);
+
+		// The order of the endpoints selects the mode.
+		if ((!threeColor && c0 < c1) || (threeColor && c0 > c1))
+			std::swap(c0, c1);
+
+		int palette[4][4];
+		UINT paletteSize = BuildBc1Palette(c0, c1, !threeColor, palette);
+		if (c0 == c1)
+			paletteSize = 1;
+
+		float paletteF[4][4];
+		for (UINT p = 0; p < 4; ++p)
+		{
+			for (UINT c = 0; c < 4; ++c)
+				paletteF[p][c] = static_cast<float>(palette[p][c]);
+		}
+
+		result.C0 = c0;
+		result.C1 = c1;
+		result.ThreeColor = threeColor;
+		result.Error = FindIndices(block, 3, paletteF, paletteSize, opaqueMask, result.Indices);
+
+		// Transparent texels use index 3 of the three-colour palette.
+		for (UINT i = 0; i < 16; ++i)
+		{
+			if (!(opaqueMask & (1 << i)))
+				result.Indices[i] = 3;
+		}
+	}
+
+	void EncodeBc1Block(const BlockTexels& block, BCQuality quality, bool allowTransparent, BYTE* out)
+	{
+		UINT16 opaqueMask = s_AllTexels;
+		if (allowTransparent)
+		{
+			for (UINT i = 0; i < 16; ++i)
+			{
+				if (block.C[3][i] < 128.0f)
+					opaqueMask &= ~(1 << i);
+			}
+		}
+
+		Bc1Result best;
+		if (opaqueMask == 0)
+		{
+			// Fully transparent: three-colour mode, every texel index 3.
+			best.ThreeColor = true;
+			memset(best.Indices, 3, sizeof(best.Indices));
+		}
+		else
+		{
+			// Any transparent texel forces three-colour mode.
+			const bool mustUseThreeColor = opaqueMask != s_AllTexels;
+
+			Endpoints start;
+			if (quality == BCQuality::Fast)
+				BoundingBoxEndpoints(block, 3, opaqueMask, start);
+			else
+				PrincipalAxisEndpoints(block, 3, opaqueMask, start);
+
+			const int modeCount = (quality == BCQuality::High && !mustUseThreeColor) ? 2 : 1;
+			for (int mode = 0; mode < modeCount; ++mode)
+			{
+				const bool threeColor = mustUseThreeColor || mode == 1;
+
+				Endpoints e = start;
+				Bc1Result current;
+				EvaluateBc1(block, e, threeColor, opaqueMask, current);
+
+				for (int pass = 0; pass < RefinementPasses(quality); ++pass)
+				{
+					Endpoints refined;
+					if (!RefineEndpoints(block, 3, opaqueMask, current.Indices, threeColor ? s_Bc1Weights3 : s_Bc1Weights4, refined))
+						break;
+
+					Bc1Result candidate;
+					EvaluateBc1(block, refined, threeColor, opaqueMask, candidate);
+					if (candidate.Error >= current.Error)
+						break;
+					current = candidate;
+				}
+
+				if (current.Error < best.Error)
+					best = current;
+			}
+		}
+
+		out[0] = static_cast<BYTE>(best.C0 & 0xFF);
+		out[1] = static_cast<BYTE>(best.C0 >> 8);
+		out[2] = static_cast<BYTE>(best.C1 & 0xFF);
+		out[3] = static_cast<BYTE>(best.C1 >> 8);
+
+		UINT32 bits = 0;
+		for (UINT i = 0; i < 16; ++i)
+			bits |= UINT32(best.Indices[i]) << (i * 2);
+		memcpy(out + 4, &bits, 4);
+	}
+
+	// == BC4 / BC3 alpha / BC5 channel block ==
+
+	// Interpolated values in index order. a0 > a1 selects eight interpolated
+	// values; otherwise six plus explicit 0 and 255.
+	void BuildAlphaPalette(int a0, int a1, int palette[8])
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1)
+		{
+			for (int i = 2; i < 8; ++i)
+				palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 2; i < 6; ++i)
+				palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	struct AlphaResult
+	{
+		int A0 = 0;
+		int A1 = 0;
+		BYTE Indices[16] = {};
+		int Error = INT_MAX;
+	};
+
+	void EvaluateAlpha(const int values[16], int a0, int a1, AlphaResult& result)
+	{
+		int palette[8];
+		BuildAlphaPalette(a0, a1, palette);
+
+		result.A0 = a0;
+		result.A1 = a1;
+		result.Error = 0;
+		for (UINT i = 0; i < 16; ++i)
+		{
+			int bestIndex = 0;
+			int bestError = INT_MAX;
+			for (int p = 0; p < 8; ++p)
+			{
+				const int d = values[i] - palette[p];
+				if (d * d < bestError)
+				{
+					bestError = d * d;
+					bestIndex = p;
+				}
+			}
+			result.Indices[i] = static_cast<BYTE>(bestIndex);
+			result.Error += bestError;
+		}
+	}
+
+	void TryAlpha(const int values[16], int a0, int a1, AlphaResult& best)
+	{
+		AlphaResult candidate;
+		EvaluateAlpha(values, a0, a1, candidate);
+		if (candidate.Error < best.Error)
+			best = candidate;
+	}
+
+	void EncodeAlphaBlock(const float* channel, BCQuality quality, BYTE* out)
+	{
+		int values[16];
+		int lo = 255, hi = 0;
+		int innerLo = 255, innerHi = 0; // ignoring exact 0 and 255
+		for (UINT i = 0; i < 16; ++i)
+		{
+			values[i] = static_cast<int>(channel[i]);
+			lo = std::min(lo, values[i]);
+			hi = std::max(hi, values[i]);
+			if (values[i] != 0 && values[i] != 255)
+			{
+				innerLo = std::min(innerLo, values[i]);
+				innerHi = std::max(innerHi, values[i]);
+			}
+		}
+
+		AlphaResult best;
+		if (lo == hi)
+		{
+			EvaluateAlpha(values, lo, hi, best);
+		}
+		else
+		{
+			// Eight-value mode over the full range.
+			TryAlpha(values, hi, lo, best);
+
+			// Six-value mode spends its range on the in-between values and
+			// gets exact 0 and 255 for free.
+			if (quality != BCQuality::Fast && innerLo <= innerHi)
+				TryAlpha(values, innerLo, innerHi, best);
+
+			if (quality == BCQuality::High)
+			{
+				// Small search around the best endpoints found so far.
+				const int base0 = best.A0;
+				const int base1 = best.A1;
+				for (int d0 = -2; d0 <= 2; ++d0)
+				{
+					for (int d1 = -2; d1 <= 2; ++d1)
+					{
+						const int a0 = base0 + d0;
+						const int a1 = base1 + d1;
+						if (a0 < 0 || a0 > 255 || a1 < 0 || a1 > 255)
+							continue;
+						// Stay in the mode the base endpoints were in.
+						if ((base0 > base1) != (a0 > a1))
+							continue;
+						TryAlpha(values, a0, a1, best);
+					}
+				}
+			}
+		}
+
+		out[0] = static_cast<BYTE>(best.A0);
+		out[1] = static_cast<BYTE>(best.A1);
+
+		UINT64 bits = 0;
+		for (UINT i = 0; i < 16; ++i)
+			bits |= UINT64(best.Indices[i]) << (i * 3);
+		for (UINT i = 0; i < 6; ++i)
+			out[2 + i] = static_cast<BYTE>(bits >> (i * 8));
+	}
+
+	// == BC7 (mode 6) ==
+	// Mode 6 is a single subset with RGBA endpoints stored as 7 bits plus a
+	// shared low bit ("p-bit") per endpoint, and 4-bit indices. It handles
+	// smooth colour and alpha gradients well and is the cheapest BC7 mode to
+	// search.
+
+	const int s_Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	const float s_Bc7WeightsF[16] =
+	{
+		0 / 64.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+		34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f,
+	};
+
+	void QuantizeBc7(const float* v, int pbit, int q[4])
+	{
+		for (UINT c = 0; c < 4; ++c)
+			q[c] = std::min(std::max(static_cast<int>((v[c] - pbit) / 2.0f + 0.5f), 0), 127);
+	}
+
+	float QuantizationError(const float* v, int pbit)
+	{
+		int q[4];
+		QuantizeBc7(v, pbit, q);
+		float error = 0.0f;
+		for (UINT c = 0; c < 4; ++c)
+		{
+			const float d = v[c] - ((q[c] << 1) | pbit);
+			error += d * d;
+		}
+		return error;
+	}
+
+	struct Bc7Result
+	{
+		int Q[2][4] = {};
+		int P[2] = {};
+		BYTE Indices[16] = {};
+		float Error = 1e30f;
+	};
+
+	void EvaluateBc7(const BlockTexels& block, const Endpoints& e, int p0, int p1, Bc7Result& result)
+	{
+		QuantizeBc7(e.E0, p0, result.Q[0]);
+		QuantizeBc7(e.E1, p1, result.Q[1]);
+		result.P[0] = p0;
+		result.P[1] = p1;
+
+		float palette[16][4];
+		for (UINT i = 0; i < 16; ++i)
+		{
+			for (UINT c = 0; c < 4; ++c)
+			{
+				const int e0 = (result.Q[0][c] << 1) | p0;
+				const int e1 = (result.Q[1][c] << 1) | p1;
+				palette[i][c] = static_cast<float>(((64 - s_Bc7Weights[i]) * e0 + s_Bc7Weights[i] * e1 + 32) >> 6);
+			}
+		}
+
+		result.Error = FindIndices(block, 4, palette, 16, s_AllTexels, result.Indices);
+	}
+
+	// Evaluates the endpoints with the best p-bits (all four combinations for
+	// High quality, otherwise the per-endpoint best).
+	void EvaluateBc7BestPBits(const BlockTexels& block, const Endpoints& e, BCQuality quality, Bc7Result& result)
+	{
+		if (quality == BCQuality::High)
+		{
+			result = Bc7Result();
+			for (int p = 0; p < 4; ++p)
+			{
+				Bc7Result candidate;
+				EvaluateBc7(block, e, p & 1, p >> 1, candidate);
+				if (candidate.Error < result.Error)
+					result = candidate;
+			}
+			return;
+		}
+
+		const int p0 = QuantizationError(e.E0, 1) < QuantizationError(e.E0, 0) ? 1 : 0;
+		const int p1 = QuantizationError(e.E1, 1) < QuantizationError(e.E1, 0) ? 1 : 0;
+		EvaluateBc7(block, e, p0, p1, result);
+	}
+
+	struct BitWriter
+	{
+		BYTE* Out;
+		UINT Position = 0;
+
+		void Write(UINT value, UINT bitCount)
+		{
+			for (UINT i = 0; i < bitCount; ++i, ++Position)
+			{
+				if ((value >> i) & 1)
+					Out[Position >> 3] |= static_cast<BYTE>(1 << (Position & 7));
+			}
+		}
+	};
+
+	struct BitReader
+	{
+		const BYTE* In;
+		UINT Position = 0;
+
+		UINT Read(UINT bitCount)
+		{
+			UINT value = 0;
+			for (UINT i = 0; i < bitCount; ++i, ++Position)
+				value |= ((In[Position >> 3] >> (Position & 7)) & 1u) << i;
+			return value;
+		}
+	};
+
+	void EncodeBc7Block(const BlockTexels& block, BCQuality quality, BYTE* out)
+	{
+		Endpoints e;
+		if (quality == BCQuality::Fast)
+			BoundingBoxEndpoints(block, 4, s_AllTexels, e);
+		else
+			PrincipalAxisEndpoints(block, 4, s_AllTexels, e);
+
+		Bc7Result best;
+		EvaluateBc7BestPBits(block, e, quality, best);
+
+		for (int pass = 0; pass < RefinementPasses(quality); ++pass)
+		{
+			Endpoints refined;
+			if (!RefineEndpoints(block, 4, s_AllTexels, best.Indices, s_Bc7WeightsF, refined))
+				break;
+
+			Bc7Result candidate;
+			EvaluateBc7BestPBits(block, refined, quality, candidate);
+			if (candidate.Error >= best.Error)
+				break;
+			best = candidate;
+		}
+
+		// The first index is stored with 3 bits (its top bit is implied 0).
+		// Swapping the endpoints and inverting the indices makes that true.
+		if (best.Indices[0] & 8)
+		{
+			std::swap(best.Q[0], best.Q[1]);
+			std::swap(best.P[0], best.P[1]);
+			for (UINT i = 0; i < 16; ++i)
+				best.Indices[i] = static_cast<BYTE>(15 - best.Indices[i]);
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer = { out };
+		writer.Write(1 << 6, 7); // mode 6
+		for (UINT c = 0; c < 4; ++c)
+		{
+			writer.Write(best.Q[0][c], 7);
+			writer.Write(best.Q[1][c], 7);
+		}
+		writer.Write(best.P[0], 1);
+		writer.Write(best.P[1], 1);
+		writer.Write(best.Indices[0], 3);
+		for (UINT i = 1; i < 16; ++i)
+			writer.Write(best.Indices[i], 4);
+	}
+
+	void EncodeBlock(DXGI_FORMAT format, const BlockTexels& block, BCQuality quality, BYTE* out)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			EncodeBc1Block(block, quality, true, out);
+			break;
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			EncodeAlphaBlock(block.C[3], quality, out);
+			EncodeBc1Block(block, quality, false, out + 8);
+			break;
+		case DXGI_FORMAT_BC4_UNORM:
+			EncodeAlphaBlock(block.C[0], quality, out);
+			break;
+		case DXGI_FORMAT_BC5_UNORM:
+			EncodeAlphaBlock(block.C[0], quality, out);
+			EncodeAlphaBlock(block.C[1], quality, out + 8);
+			break;
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			EncodeBc7Block(block, quality, out);
+			break;
+		default:
+			assert(false);
+		}
+	}
+
+	// == Decoding (quality checks) ==
+
+	void DecodeBc1Block(const BYTE* in, bool allowThreeColor, BYTE* rgba)
+	{
+		const UINT16 c0 = static_cast<UINT16>(in[0] | (in[1] << 8));
+		const UINT16 c1 = static_cast<UINT16>(in[2] | (in[3] << 8));
+		UINT32 bits;
+		memcpy(&bits, in + 4, 4);
+
+		int palette[4][4];
+		BuildBc1Palette(c0, c1, !allowThreeColor || c0 > c1, palette);
+		for (UINT i = 0; i < 16; ++i)
+		{
+			const int* color = palette[(bits >> (i * 2)) & 3];
+			for (UINT c = 0; c < 4; ++c)
+				rgba[i * 4 + c] = static_cast<BYTE>(color[c]);
+		}
+	}
+
+	void DecodeAlphaBlock(const BYTE* in, BYTE* rgba, UINT channel)
+	{
+		int palette[8];
+		BuildAlphaPalette(in[0], in[1], palette);
+
+		UINT64 bits = 0;
+		for (UINT i = 0; i < 6; ++i)
+			bits |= UINT64(in[2 + i]) << (i * 8);
+		for (UINT i = 0; i < 16; ++i)
+			rgba[i * 4 + channel] = static_cast<BYTE>(palette[(bits >> (i * 3)) & 7]);
+	}
+
+	bool DecodeBc7Block(const BYTE* in, BYTE* rgba)
+	{
+		BitReader reader = { in };
+		if (reader.Read(7) != (1 << 6))
+			return false; // not mode 6
+
+		int q[2][4];
+		for (UINT c = 0; c < 4; ++c)
+		{
+			q[0][c] = reader.Read(7);
+			q[1][c] = reader.Read(7);
+		}
+		const int p0 = reader.Read(1);
+		const int p1 = reader.Read(1);
+
+		for (UINT i = 0; i < 16; ++i)
+		{
+			const int index = reader.Read(i == 0 ? 3 : 4);
+			const int w = s_Bc7Weights[index];
+			for (UINT c = 0; c < 4; ++c)
+			{
+				const int e0 = (q[0][c] << 1) | p0;
+				const int e1 = (q[1][c] << 1) | p1;
+				rgba[i * 4 + c] = static_cast<BYTE>(((64 - w) * e0 + w * e1 + 32) >> 6);
+			}
+		}
+		return true;
+	}
+}
+
+BCEncoder::BCEncoder(ThreadPool* pool)
+	: m_Pool(pool)
+{
+}
+
+bool BCEncoder::IsFormatSupported(DXGI_FORMAT format)
+{
+	return GetBlockSize(format) != 0;
+}
+
+UINT BCEncoder::GetBlockSize(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+		return 8;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+bool BCEncoder::EncodeSurface(
+	DXGI_FORMAT format,
+	const BYTE* src, UINT srcRowPitch, UINT width, UINT height,
+	BYTE* dst, UINT dstRowPitch,
+	BCQuality quality) const
+{
+	const UINT blockSize = GetBlockSize(format);
+	if (blockSize == 0)
+	{
+		OutputDebugString(L"BCEncoder: unsupported format.\n");
+		return false;
+	}
+	if (width == 0 || height == 0)
+		return true;
+
+	const UINT blocksX = (width + 3) / 4;
+	const UINT blocksY = (height + 3) / 4;
+
+	// A block row of a 1024-wide texture is 256 blocks; that is a reasonable
+	// amount of work per chunk.
+	const UINT rowsPerChunk = std::max(1u, 256 / blocksX);
+
+	ParallelFor(m_Pool, blocksY, rowsPerChunk, [&](UINT begin, UINT end)
+	{
+		BlockTexels block;
+		for (UINT by = begin; by < end; ++by)
+		{
+			BYTE* out = dst + size_t(by) * dstRowPitch;
+			for (UINT bx = 0; bx < blocksX; ++bx)
+			{
+				LoadBlock(src, srcRowPitch, width, height, bx, by, block);
+				EncodeBlock(format, block, quality, out + bx * blockSize);
+			}
+		}
+	});
+
+	return true;
+}
+
+bool BCEncoder::EncodeTexture(
+	const D3D12_RESOURCE_DESC& srcDesc,
+	const void* srcData, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* srcLayouts,
+	DXGI_FORMAT format,
+	void* dstData, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* dstLayouts,
+	BCQuality quality) const
+{
+	assert(srcData && srcLayouts && dstData && dstLayouts);
+
+	if (srcDesc.Format != DXGI_FORMAT_R8G8B8A8_UNORM && srcDesc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+	{
+		OutputDebugString(L"BCEncoder: source must be R8G8B8A8.\n");
+		return false;
+	}
+	if (srcDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		OutputDebugString(L"BCEncoder: only 2D textures can be block compressed.\n");
+		return false;
+	}
+
+	const BYTE* src = static_cast<const BYTE*>(srcData);
+	BYTE* dst = static_cast<BYTE*>(dstData);
+
+	const UINT subresourceCount = srcDesc.MipLevels * srcDesc.DepthOrArraySize;
+	for (UINT i = 0; i < subresourceCount; ++i)
+	{
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& in = srcLayouts[i];
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& out = dstLayouts[i];
+
+		if (!EncodeSurface(format,
+			src + in.Offset, in.Footprint.RowPitch, in.Footprint.Width, in.Footprint.Height,
+			dst + out.Offset, out.Footprint.RowPitch,
+			quality))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BCEncoder::DecodeBlock(DXGI_FORMAT format, const BYTE* block, BYTE rgba[16 * 4])
+{
+	// Channels a format does not store decode as 0 (alpha as 255).
+	for (UINT i = 0; i < 16; ++i)
+	{
+		rgba[i * 4 + 0] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = 0;
+		rgba[i * 4 + 3] = 255;
+	}
+
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		DecodeBc1Block(block, true, rgba);
+		return true;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		DecodeBc1Block(block + 8, false, rgba);
+		DecodeAlphaBlock(block, rgba, 3);
+		return true;
+	case DXGI_FORMAT_BC4_UNORM:
+		DecodeAlphaBlock(block, rgba, 0);
+		return true;
+	case DXGI_FORMAT_BC5_UNORM:
+		DecodeAlphaBlock(block, rgba, 0);
+		DecodeAlphaBlock(block + 8, rgba, 1);
+		return true;
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return DecodeBc7Block(block, rgba);
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,263 @@
+#include "pch.h"
+
+#include "BarrierBackend.h"
+#include "D3DUtil.h"
+#include "directx/d3dx12.h"
+
+#include <algorithm>
+#include <cassert>
+
+void BarrierBackend::Initialize(ID3D12Device* device, bool allowEnhanced)
+{
+	m_UseEnhanced = false;
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	D3D12_FEATURE_DATA_D3D12_OPTIONS12 options12 = {};
+	if (allowEnhanced && SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS12, &options12, sizeof(options12))))
+		m_UseEnhanced = options12.EnhancedBarriersSupported != FALSE;
+#else
+	(void)device;
+	(void)allowEnhanced;
+#endif
+
+	OutputDebugString(m_UseEnhanced
+		? L"BarrierBackend: using Enhanced Barriers.\n"
+		: L"BarrierBackend: using legacy resource barriers.\n");
+}
+
+void BarrierBackend::Record(ID3D12GraphicsCommandList* commandList, UINT numBarriers, const D3D12_RESOURCE_BARRIER* barriers)
+{
+	if (numBarriers == 0)
+		return;
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> commandList7;
+	if (m_UseEnhanced)
+		commandList->QueryInterface(IID_PPV_ARGS(&commandList7));
+
+	if (commandList7)
+	{
+		m_Translation.Clear();
+		Translate(numBarriers, barriers, m_Translation);
+
+		const Translation& translation = m_Translation;
+		for (const Translation::Call& call : translation.Calls)
+		{
+			if (call.Legacy)
+			{
+				commandList->ResourceBarrier(1, call.Legacy);
+				continue;
+			}
+
+			D3D12_BARRIER_GROUP groups[3];
+			UINT32 groupCount = 0;
+			if (call.GlobalCount > 0)
+				groups[groupCount++] = CD3DX12_BARRIER_GROUP(call.GlobalCount, &translation.GlobalBarriers[call.FirstGlobal]);
+			if (call.BufferCount > 0)
+				groups[groupCount++] = CD3DX12_BARRIER_GROUP(call.BufferCount, &translation.BufferBarriers[call.FirstBuffer]);
+			if (call.TextureCount > 0)
+				groups[groupCount++] = CD3DX12_BARRIER_GROUP(call.TextureCount, &translation.TextureBarriers[call.FirstTexture]);
+			commandList7->Barrier(groupCount, groups);
+		}
+		return;
+	}
+#endif
+
+	commandList->ResourceBarrier(numBarriers, barriers);
+}
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+
+namespace
+{
+	// ClearUnorderedAccessView* writes through its own sync scope, not a shader stage.
+	const D3D12_BARRIER_SYNC s_UnorderedAccessSync =
+		D3D12_BARRIER_SYNC_ALL_SHADING | D3D12_BARRIER_SYNC_CLEAR_UNORDERED_ACCESS_VIEW;
+
+	struct StateMapping
+	{
+		D3D12_RESOURCE_STATES State;
+		D3D12_BARRIER_SYNC Sync;
+		D3D12_BARRIER_ACCESS Access;
+		D3D12_BARRIER_LAYOUT Layout;
+	};
+
+	const StateMapping s_StateMappings[] =
+	{
+		{ D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_BARRIER_SYNC_ALL_SHADING,        D3D12_BARRIER_ACCESS_VERTEX_BUFFER | D3D12_BARRIER_ACCESS_CONSTANT_BUFFER, D3D12_BARRIER_LAYOUT_GENERIC_READ },
+		{ D3D12_RESOURCE_STATE_INDEX_BUFFER,               D3D12_BARRIER_SYNC_INDEX_INPUT,        D3D12_BARRIER_ACCESS_INDEX_BUFFER,        D3D12_BARRIER_LAYOUT_GENERIC_READ },
+		{ D3D12_RESOURCE_STATE_RENDER_TARGET,              D3D12_BARRIER_SYNC_RENDER_TARGET,      D3D12_BARRIER_ACCESS_RENDER_TARGET,       D3D12_BARRIER_LAYOUT_RENDER_TARGET },
+		{ D3D12_RESOURCE_STATE_UNORDERED_ACCESS,           s_UnorderedAccessSync,                 D3D12_BARRIER_ACCESS_UNORDERED_ACCESS,    D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS },
+		{ D3D12_RESOURCE_STATE_DEPTH_WRITE,                D3D12_BARRIER_SYNC_DEPTH_STENCIL,      D3D12_BARRIER_ACCESS_DEPTH_STENCIL_WRITE, D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_WRITE },
+		{ D3D12_RESOURCE_STATE_DEPTH_READ,                 D3D12_BARRIER_SYNC_DEPTH_STENCIL,      D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ,  D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ },
+		{ D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,  D3D12_BARRIER_SYNC_NON_PIXEL_SHADING,  D3D12_BARRIER_ACCESS_SHADER_RESOURCE,     D3D12_BARRIER_LAYOUT_SHADER_RESOURCE },
+		{ D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,      D3D12_BARRIER_SYNC_PIXEL_SHADING,      D3D12_BARRIER_ACCESS_SHADER_RESOURCE,     D3D12_BARRIER_LAYOUT_SHADER_RESOURCE },
+		{ D3D12_RESOURCE_STATE_STREAM_OUT,                 D3D12_BARRIER_SYNC_VERTEX_SHADING,     D3D12_BARRIER_ACCESS_STREAM_OUTPUT,       D3D12_BARRIER_LAYOUT_COMMON },
+		{ D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,          D3D12_BARRIER_SYNC_EXECUTE_INDIRECT,   D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT,   D3D12_BARRIER_LAYOUT_GENERIC_READ },
+		{ D3D12_RESOURCE_STATE_COPY_DEST,                  D3D12_BARRIER_SYNC_COPY,               D3D12_BARRIER_ACCESS_COPY_DEST,           D3D12_BARRIER_LAYOUT_COPY_DEST },
+		{ D3D12_RESOURCE_STATE_COPY_SOURCE,                D3D12_BARRIER_SYNC_COPY,               D3D12_BARRIER_ACCESS_COPY_SOURCE,         D3D12_BARRIER_LAYOUT_COPY_SOURCE },
+		{ D3D12_RESOURCE_STATE_RESOLVE_DEST,               D3D12_BARRIER_SYNC_RESOLVE,            D3D12_BARRIER_ACCESS_RESOLVE_DEST,        D3D12_BARRIER_LAYOUT_RESOLVE_DEST },
+		{ D3D12_RESOURCE_STATE_RESOLVE_SOURCE,             D3D12_BARRIER_SYNC_RESOLVE,            D3D12_BARRIER_ACCESS_RESOLVE_SOURCE,      D3D12_BARRIER_LAYOUT_RESOLVE_SOURCE },
+	};
+}
+
+bool BarrierBackend::TranslateState(D3D12_RESOURCE_STATES state, EnhancedState& out)
+{
+	if (state == D3D12_RESOURCE_STATE_COMMON)
+	{
+		// COMMON (== PRESENT) allows implicit promotion to other states, so
+		// the list may have touched the resource without a barrier. Stay as
+		// conservative as the legacy path here.
+		out.Sync = D3D12_BARRIER_SYNC_ALL;
+		out.Access = D3D12_BARRIER_ACCESS_COMMON;
+		out.Layout = D3D12_BARRIER_LAYOUT_COMMON;
+		return true;
+	}
+
+	out.Sync = D3D12_BARRIER_SYNC_NONE;
+	out.Access = D3D12_BARRIER_ACCESS_COMMON;
+	out.Layout = D3D12_BARRIER_LAYOUT_UNDEFINED;
+
+	D3D12_RESOURCE_STATES remaining = state;
+	UINT layoutCount = 0;
+	bool depthRead = false;
+	for (const StateMapping& mapping : s_StateMappings)
+	{
+		if ((state & mapping.State) == 0)
+			continue;
+
+		remaining = static_cast<D3D12_RESOURCE_STATES>(remaining & ~mapping.State);
+		out.Sync |= mapping.Sync;
+		out.Access |= mapping.Access;
+		depthRead |= mapping.State == D3D12_RESOURCE_STATE_DEPTH_READ;
+		if (layoutCount++ == 0)
+			out.Layout = mapping.Layout;
+		else if (out.Layout != mapping.Layout)
+			out.Layout = D3D12_BARRIER_LAYOUT_GENERIC_READ;
+	}
+
+	// DEPTH_READ combined with shader reads: the depth-read layout allows
+	// both, GENERIC_READ would not allow depth testing.
+	if (depthRead)
+		out.Layout = D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ;
+
+	return remaining == 0;
+}
+
+void BarrierBackend::Translation::Clear()
+{
+	Calls.clear();
+	GlobalBarriers.clear();
+	BufferBarriers.clear();
+	TextureBarriers.clear();
+	RunResources.clear();
+}
+
+void BarrierBackend::Translate(UINT numBarriers, const D3D12_RESOURCE_BARRIER* barriers, Translation& out)
+{
+	out.RunResources.clear();
+	for (UINT i = 0; i < numBarriers; ++i)
+	{
+		// Barriers inside one Barrier() call are not ordered against each
+		// other, so a second barrier on the same resource starts a new call.
+		// A null resource (global UAV barrier) overlaps every resource.
+		ID3D12Resource* resource =
+			barriers[i].Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION ? barriers[i].Transition.pResource :
+			barriers[i].Type == D3D12_RESOURCE_BARRIER_TYPE_UAV ? barriers[i].UAV.pResource : nullptr;
+		const std::vector<ID3D12Resource*>& run = out.RunResources;
+		const bool overlaps = !run.empty() && (resource == nullptr ||
+			std::find(run.begin(), run.end(), resource) != run.end() ||
+			std::find(run.begin(), run.end(), nullptr) != run.end());
+		if (overlaps)
+			EndCall(out);
+
+		if (TranslateBarrier(barriers[i], out))
+		{
+			out.RunResources.push_back(resource);
+			continue;
+		}
+
+		// No enhanced equivalent: keep it in order on the legacy path.
+		EndCall(out);
+		Translation::Call call;
+		call.Legacy = &barriers[i];
+		call.FirstGlobal = static_cast<UINT32>(out.GlobalBarriers.size());
+		call.FirstBuffer = static_cast<UINT32>(out.BufferBarriers.size());
+		call.FirstTexture = static_cast<UINT32>(out.TextureBarriers.size());
+		out.Calls.push_back(call);
+	}
+	EndCall(out);
+}
+
+bool BarrierBackend::TranslateBarrier(const D3D12_RESOURCE_BARRIER& barrier, Translation& out)
+{
+	if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV)
+	{
+		const D3D12_BARRIER_ACCESS uav = D3D12_BARRIER_ACCESS_UNORDERED_ACCESS;
+		ID3D12Resource* resource = barrier.UAV.pResource;
+		if (resource == nullptr)
+			out.GlobalBarriers.push_back(CD3DX12_GLOBAL_BARRIER(s_UnorderedAccessSync, s_UnorderedAccessSync, uav, uav));
+		else if (resource->GetDesc().Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			out.BufferBarriers.push_back(CD3DX12_BUFFER_BARRIER(s_UnorderedAccessSync, s_UnorderedAccessSync, uav, uav, resource));
+		else
+			out.TextureBarriers.push_back(CD3DX12_TEXTURE_BARRIER(
+				s_UnorderedAccessSync, s_UnorderedAccessSync, uav, uav,
+				D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS,
+				resource, CD3DX12_BARRIER_SUBRESOURCE_RANGE(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)));
+		return true;
+	}
+
+	// Aliasing barriers need to know the layout the new resource is used in,
+	// which the legacy barrier does not carry.
+	if (barrier.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+		return false;
+
+	const D3D12_RESOURCE_TRANSITION_BARRIER& transition = barrier.Transition;
+	EnhancedState before;
+	EnhancedState after;
+	if (!TranslateState(transition.StateBefore, before) || !TranslateState(transition.StateAfter, after))
+		return false;
+
+	// Split barriers: the begin half does not block later work, the end half
+	// does not wait for earlier work. Access and layout must match across halves.
+	if (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+		after.Sync = D3D12_BARRIER_SYNC_SPLIT;
+	if (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_END_ONLY)
+		before.Sync = D3D12_BARRIER_SYNC_SPLIT;
+
+	if (transition.pResource->GetDesc().Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+	{
+		out.BufferBarriers.push_back(CD3DX12_BUFFER_BARRIER(
+			before.Sync, after.Sync, before.Access, after.Access, transition.pResource));
+	}
+	else
+	{
+		out.TextureBarriers.push_back(CD3DX12_TEXTURE_BARRIER(
+			before.Sync, after.Sync, before.Access, after.Access,
+			before.Layout, after.Layout,
+			transition.pResource, CD3DX12_BARRIER_SUBRESOURCE_RANGE(transition.Subresource)));
+	}
+	return true;
+}
+
+void BarrierBackend::EndCall(Translation& out)
+{
+	// The open call holds every barrier added since the last call ended.
+	Translation::Call call;
+	if (!out.Calls.empty())
+	{
+		const Translation::Call& last = out.Calls.back();
+		call.FirstGlobal = last.FirstGlobal + last.GlobalCount;
+		call.FirstBuffer = last.FirstBuffer + last.BufferCount;
+		call.FirstTexture = last.FirstTexture + last.TextureCount;
+	}
+	call.GlobalCount = static_cast<UINT32>(out.GlobalBarriers.size()) - call.FirstGlobal;
+	call.BufferCount = static_cast<UINT32>(out.BufferBarriers.size()) - call.FirstBuffer;
+	call.TextureCount = static_cast<UINT32>(out.TextureBarriers.size()) - call.FirstTexture;
+
+	if (call.GlobalCount + call.BufferCount + call.TextureCount > 0)
+		out.Calls.push_back(call);
+	out.RunResources.clear();
+}
+
+#endif // ENHANCED_BARRIERS_AVAILABLE
@@ -5,6 +5,8 @@
 #include "directx/d3dx12.h"
 #include "Windowsx.h"
 
+#include <algorithm>
+
 LRESULT CALLBACK
 MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -15,10 +17,16 @@ MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
 D3DApp::D3DApp(HINSTANCE hInstance)
 	: m_hAppInst(hInstance)
+	, m_RootSignatureCache(&m_PipelineCache)
+	, m_PipelineCompiler(&m_PipelineCache, &m_ThreadPool)
+	, m_ShaderHotReload(&m_ShaderCache, &m_ThreadPool)
 {
 	// Only one D3DApp can be constructed.
 	assert(m_App == nullptr);
 	m_App = this;
+
+	// The samples use DirectX 12 Ultimate features.
+	m_AdapterPolicy.MinFeatureLevel = D3D_FEATURE_LEVEL_12_2;
 }
 
 D3DApp::~D3DApp()
@@ -30,7 +38,18 @@ D3DApp::~D3DApp()
 	// before we destroy any resources the GPU is still referencing.
 	// Otherwise, the GPU might crash when the application exits.
 	if (m_d3dDevice != nullptr)
+	{
 		FlushCommandQueue();
+
+		// Keep the pipelines compiled during this run for the next one.
+		// Compiles still running on the pool would otherwise race the save
+		// (and write into the cache while it is being serialized).
+		m_PipelineCompiler.WaitIdle();
+		if (!m_PipelineCache.Save())
+			OutputDebugString(L"***Could not write the pipeline cache.\n");
+		if (!m_RootSignatureCache.Save())
+			OutputDebugString(L"***Could not write the root signature cache.\n");
+	}
 }
 
 D3DApp* D3DApp::GetApp()
@@ -69,12 +88,74 @@ void D3DApp::Set4xMsaaState(bool value)
 	{
 		m_4xMsaaState = value;
 
-		// Recreate the swapchain and buffers with new multisample settings.
-		CreateSwapChain();
-		OnResize();
+		// Only the offscreen targets change; the swap chain is never
+		// multisampled. Before InitDirect3D() the quality is unknown and
+		// the state is picked up there.
+		if (m_4xMsaaQuality > 0)
+			m_Msaa.SetSampleCount(m_4xMsaaState ? 4 : 1, m_4xMsaaState ? (m_4xMsaaQuality - 1) : 0);
 	}
 }
 
+UINT D3DApp::GetSwapChainBufferCount() const
+{
+	return m_SwapChainBufferCount;
+}
+
+void D3DApp::SetSwapChainBufferCount(UINT count)
+{
+	assert(count >= s_MinSwapChainBufferCount && count <= s_MaxSwapChainBufferCount);
+	count = std::min(std::max(count, s_MinSwapChainBufferCount), s_MaxSwapChainBufferCount);
+	if (m_SwapChainBufferCount == count)
+		return;
+	m_SwapChainBufferCount = count;
+
+	// Before Initialize() has created the swap chain, the count is simply
+	// used when it does.
+	if (!m_SwapChain)
+		return;
+
+	// The RTV heap holds one view per back buffer, so it is recreated; the
+	// GPU must be done with the old one first. OnResize() then resizes the
+	// swap chain to the new count and creates the views.
+	FlushCommandQueue();
+	CreateRtvAndDsvDescriptorHeaps();
+	OnResize();
+	// The frame latency may have to come down with the count.
+	ResetPresentQueue();
+}
+
+UINT D3DApp::GetMaxFrameLatency() const
+{
+	return m_MaxFrameLatency;
+}
+
+void D3DApp::SetMaxFrameLatency(UINT latency)
+{
+	assert(latency > 0);
+	m_MaxFrameLatency = std::max(latency, 1u);
+	if (m_SwapChain)
+		ResetPresentQueue();
+}
+
+bool D3DApp::GetDynamicResolution() const
+{
+	return m_DynamicResolution;
+}
+
+void D3DApp::SetDynamicResolution(bool enabled)
+{
+	m_DynamicResolution = enabled;
+	// Off means full resolution; on starts over from the top of the range.
+	m_ResolutionController.Reset(m_DynamicResolutionSettings.MaxScale);
+	if (m_SwapChain)
+		ApplyRenderScale(enabled ? m_ResolutionController.GetScale() : 1.0f);
+}
+
+float D3DApp::GetRenderScale() const
+{
+	return m_RenderScale;
+}
+
 int D3DApp::Run()
 {
 	MSG msg = { 0 };
@@ -92,11 +173,24 @@ int D3DApp::Run()
 		// Otherwise, do animation/game stuff.
 		else
 		{
+			// Wait for the display before the time (and input) is read, so
+			// the frame shows them as late as possible.
+			if (!m_AppPaused)
+				m_FramePacer.WaitForFrame();
+
 			m_Timer.Tick();
 
 			if (!m_AppPaused)
 			{
 				CalculateFrameStats();
+				// Between frames: reallocate the MSAA targets if toggled.
+				if (m_Msaa.IsPending())
+				{
+					FlushCommandQueue();
+					m_Msaa.Update();
+				}
+				// Between frames: swap in pipelines rebuilt from edited shaders.
+				m_ShaderHotReload.Update(m_CurrentFence, m_Fence->GetCompletedValue());
 				Update(m_Timer);
 				Draw(m_Timer);
 			}
@@ -112,16 +206,60 @@ int D3DApp::Run()
 
 bool D3DApp::Initialize()
 {
-	if (!InitMainWindow())
-		return false;
+	// == Startup graph ==
+	// The window and the device do not need each other, so they are created
+	// at the same time, along with whatever the application adds (shaders,
+	// pipelines, assets). Window and swap chain work stays on this thread,
+	// which owns the window. The timings and the critical path go to the
+	// debugger output. Failures are reported here, on this thread, once the
+	// graph is done; stages only record them (SetStartupError()).
+	StartupGraph startup(&m_ThreadPool);
+	StartupStages stages;
+	stages.Window = startup.Add(L"Window", [this]() { return InitMainWindow(); },
+		{}, StartupGraph::Affinity::MainThread);
+	stages.Device = startup.Add(L"Device", [this]() { return InitDirect3D(); });
+	stages.ShaderCache = startup.Add(L"Shader cache", [this]()
+	{
+		m_ShaderCache.Initialize(L"ShaderCache");
+		return true;
+	});
+	stages.CommandObjects = startup.Add(L"Command objects", [this]()
+	{
+		CreateCommandObjects();
+		CreateRtvAndDsvDescriptorHeaps();
+		return true;
+	}, { stages.Device });
+	stages.SwapChain = startup.Add(L"Swap chain", [this]()
+	{
+		CreateSwapChain();
+		// Do the initial resize code.
+		OnResize();
+		return true;
+	}, { stages.Window, stages.CommandObjects }, StartupGraph::Affinity::MainThread);
 
-	if (!InitDirect3D())
-		return false;
+	AddStartupTasks(startup, stages);
+	if (startup.Run())
+		return true;
 
-	// Do the initial resize code.
-	OnResize();
+	std::wstring message = m_StartupError;
+	if (message.empty())
+	{
+		message = L"Startup failed:";
+		for (const StartupGraph::TaskTiming& timing : startup.GetTimings())
+		{
+			if (timing.Ran && !timing.Succeeded)
+				message += L" " + timing.Name;
+		}
+	}
+	MessageBox(0, message.c_str(), 0, 0);
+	return false;
+}
 
-	return true;
+void D3DApp::SetStartupError(const std::wstring& message)
+{
+	std::lock_guard<std::mutex> lock(m_StartupErrorMutex);
+	if (m_StartupError.empty())
+		m_StartupError = message;
 }
 
 bool D3DApp::InitMainWindow()
@@ -140,7 +278,7 @@ bool D3DApp::InitMainWindow()
 
 	if (!RegisterClass(&wc))
 	{
-		MessageBox(0, L"RegisterClass Failed.", 0, 0);
+		SetStartupError(L"RegisterClass Failed.");
 		return false;
 	}
 
@@ -153,7 +291,7 @@ bool D3DApp::InitMainWindow()
 		WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, width, height, 0, 0, m_hAppInst, 0);
 	if (!m_hMainWnd)
 	{
-		MessageBox(0, L"CreateWindow Failed.", 0, 0);
+		SetStartupError(L"CreateWindow Failed.");
 		return false;
 	}
 
@@ -177,22 +315,41 @@ bool D3DApp::InitDirect3D()
 	ThrowIfFailed(CreateDXGIFactory1(IID_PPV_ARGS(&m_dxgiFactory)));
 	
 	// == Create Direct3D 12 device ==
-	HRESULT hardwareResult = D3D12CreateDevice(
-		nullptr,
-		D3D_FEATURE_LEVEL_12_2,
-		IID_PPV_ARGS(&m_d3dDevice));
+	// On the best adapter for m_AdapterPolicy rather than the first one DXGI
+	// lists (often the integrated GPU of a laptop). WARP is the last resort.
+	{
+		AdapterSelector selector(m_AdapterPolicy);
+		selector.Enumerate(m_dxgiFactory.Get());
+		const size_t adapter = selector.Select();
+		if (adapter == AdapterSelector::NoAdapter)
+		{
+			SetStartupError(L"No adapter supports the required Direct3D 12 features.");
+			return false;
+		}
+		m_d3dDevice = selector.GetCandidates()[adapter].Device;
+	}
 
-	// Fallback to WARP device
-	if (FAILED(hardwareResult))
+	// == Read the device capabilities ==
+	// Asked of the device on the first run on this adapter and driver, read
+	// from disk afterwards.
 	{
-		Microsoft::WRL::ComPtr<IDXGIAdapter> p_WarpAdapter;
-		ThrowIfFailed(m_dxgiFactory->EnumWarpAdapter(IID_PPV_ARGS(&p_WarpAdapter)));
-		ThrowIfFailed(D3D12CreateDevice(
-			p_WarpAdapter.Get(),
-			D3D_FEATURE_LEVEL_12_2,
-			IID_PPV_ARGS(&m_d3dDevice)));
+		D3D12FeatureSource featureSource(m_d3dDevice.Get());
+		m_DeviceCaps.Initialize(featureSource, L"DeviceCapabilities.bin", { m_BackBufferFormat, m_DepthStencilFormat });
 	}
 
+	// == Pick the barrier API ==
+	// Enhanced Barriers (D3D12_OPTIONS12) let barriers name the exact pipeline
+	// stages and caches involved; older drivers fall back to ResourceBarrier.
+	m_BarrierBackend.Initialize(m_d3dDevice.Get());
+	m_StateTracker.SetBarrierBackend(&m_BarrierBackend);
+	m_RenderPasses.Initialize(m_d3dDevice.Get());
+
+	// == Load the pipeline cache ==
+	// Pipelines compiled by previous runs on this adapter and driver are
+	// loaded from disk instead of being compiled again.
+	m_PipelineCache.Initialize(m_d3dDevice.Get(), L"PipelineCache.bin");
+	m_RootSignatureCache.Initialize(m_d3dDevice.Get(), L"RootSignatureCache.bin");
+
 	// == Create Fence and Descriptor Sizes ==
 	
 	// 1. Fence object for CPU/GPU synchronization
@@ -200,9 +357,9 @@ bool D3DApp::InitDirect3D()
 		0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_Fence)));
 
 	// 2. Descriptor sizes can vary across GPUs. Query and cache this information for working with various descriptor types when we need
-	m_RtvDescriptorSize = m_d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-	m_DsvDescriptorSize = m_d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
-	m_CbvSrvUavDescriptorSize = m_d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	m_RtvDescriptorSize = m_DeviceCaps.GetDescriptorIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+	m_DsvDescriptorSize = m_DeviceCaps.GetDescriptorIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+	m_CbvSrvUavDescriptorSize = m_DeviceCaps.GetDescriptorIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
 	// == Check 4X MSAA Quality Support ==
 	// Check 4X MSAA quality support for our back buffer format.
@@ -212,23 +369,26 @@ bool D3DApp::InitDirect3D()
 	// Why 4X MSSA?
 		// 1. Good improvement in image quality without too much performance impact
 		// 2. 4X is widely supported on most hardware esp all Direct3D 11 capable devices
-	D3D12_FEATURE_DATA_MULTISAMPLE_QUALITY_LEVELS msQualityLevels;
-	msQualityLevels.Format = m_BackBufferFormat;
-	msQualityLevels.SampleCount = 4;
-	msQualityLevels.Flags = D3D12_MULTISAMPLE_QUALITY_LEVELS_FLAG_NONE;
-	msQualityLevels.NumQualityLevels = 0;
-	ThrowIfFailed(m_d3dDevice->CheckFeatureSupport(
-		D3D12_FEATURE_MULTISAMPLE_QUALITY_LEVELS,
-		&msQualityLevels,
-		sizeof(msQualityLevels)));
-
-	m_4xMsaaQuality = msQualityLevels.NumQualityLevels;
+	m_4xMsaaQuality = m_DeviceCaps.Get().GetMsaaQualityLevels(m_BackBufferFormat, 4);
 	assert(m_4xMsaaQuality > 0 && "Unexpected Max MSAA sample count"); // because 4X MSAA is always supported, the returned quality should always be greater than 0; 
 																	   // therefore, we assert that this is the case.
 
-	CreateCommandObjects();
-	CreateSwapChain();
-
+	// == Dynamic resolution ==
+	// The GPU timer needs the command queue; see CreateCommandObjects().
+	m_ResolutionController.SetSettings(m_DynamicResolutionSettings);
+	m_ResolutionController.Reset(m_DynamicResolutionSettings.MaxScale);
+	if (m_DynamicResolution)
+		m_RenderScale = m_ResolutionController.GetScale();
+
+	// == Offscreen MSAA targets ==
+	// Allocated by OnResize() once the size is known.
+	m_MsaaTargets.Initialize(m_d3dDevice.Get());
+	m_Msaa.SetAllocator(&m_MsaaTargets);
+	m_Msaa.SetFormats(m_BackBufferFormat, m_DepthStencilFormat);
+	m_Msaa.SetSampleCount(m_4xMsaaState ? 4 : 1, m_4xMsaaState ? (m_4xMsaaQuality - 1) : 0);
+
+	// The command objects and the swap chain are stages of their own; see
+	// Initialize().
 	return true;
 }
 
@@ -245,14 +405,18 @@ void D3DApp::CreateCommandObjects()
 		&queueDesc,
 		IID_PPV_ARGS(&m_CommandQueue)));
 
-	ThrowIfFailed(m_d3dDevice->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(m_DirectCmdListAlloc.GetAddressOf()))); // why not &m_DirectCmdListAlloc?
+	// All of them, whatever the buffer count: it can change at runtime.
+	for (UINT i = 0; i < s_MaxSwapChainBufferCount; ++i)
+	{
+		ThrowIfFailed(m_d3dDevice->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(m_DirectCmdListAlloc[i].GetAddressOf()))); // why not &m_DirectCmdListAlloc[i]?
+	}
 	
 	ThrowIfFailed(m_d3dDevice->CreateCommandList(
 		0,
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		m_DirectCmdListAlloc.Get(), // ID3D12CommandAllocator*
+		m_DirectCmdListAlloc[0].Get(), // ID3D12CommandAllocator*
 		nullptr, // initial pipeline state object (we don't set for now b/c we don't need a valid pipeline state object yet)
 		IID_PPV_ARGS(m_CommandList.GetAddressOf())));
 
@@ -260,6 +424,20 @@ void D3DApp::CreateCommandObjects()
 	// refer to the command list we will Reset it, and it needs to be 
 	// closed before calling Reset.
 	m_CommandList->Close();
+
+	// Small list that ExecuteCommandList() records the pending state
+	// transitions into. It shares the frame's allocator: it is only ever
+	// recorded after m_CommandList has been closed.
+	ThrowIfFailed(m_d3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_DIRECT,
+		m_DirectCmdListAlloc[0].Get(),
+		nullptr,
+		IID_PPV_ARGS(m_FixupCommandList.GetAddressOf())));
+	m_FixupCommandList->Close();
+
+	// One timing slot per back buffer.
+	m_GpuTimer.Initialize(m_d3dDevice.Get(), m_CommandQueue.Get(), s_MaxSwapChainBufferCount);
 }
 
 void D3DApp::CreateSwapChain()
@@ -268,7 +446,7 @@ void D3DApp::CreateSwapChain()
 	// that we created earlier. The swap chain needs to be associated
 	// with a window handle (HWND) so that DXGI knows where to put the
 	// images that are being rendered. The swap chain is created based
-	// on a DXGI_SWAP_CHAIN_DESC structure.
+	// on a DXGI_SWAP_CHAIN_DESC1 structure.
 	// 
 	// Note: Swap chain creation modifies the command queue to associate
 	// it with the swap chain. So after this call, the command queue
@@ -281,38 +459,120 @@ void D3DApp::CreateSwapChain()
 	// in particular, we can change the multisampling settings at runtime.
 
 	// Release the previous swapchain we will be recreating
+	m_PresentQueue.Reset(nullptr, 0);
 	m_SwapChain.Reset();
 
-	DXGI_SWAP_CHAIN_DESC sd;
-	sd.BufferDesc.Width = m_ClientWidth;
-	sd.BufferDesc.Height = m_ClientHeight;
-	sd.BufferDesc.RefreshRate.Numerator = 60;
-	sd.BufferDesc.RefreshRate.Denominator = 1;
-	sd.BufferDesc.Format = m_BackBufferFormat;
-	sd.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-	sd.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-	sd.SampleDesc.Count = m_4xMsaaState ? 4 : 1;
-	sd.SampleDesc.Quality = m_4xMsaaState ? (m_4xMsaaQuality - 1) : 0;
+	// Flip model: the back buffers are handed to the compositor instead of
+	// being copied, and frames are paced with the waitable object. Flip
+	// model swap chains cannot be multisampled, and their refresh rate is
+	// the display's.
+	const bool tearingSupported = FramePacer::CheckTearingSupport(m_dxgiFactory.Get());
+	m_SwapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if (tearingSupported)
+		m_SwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+	DXGI_SWAP_CHAIN_DESC1 sd = {};
+	sd.Width = m_ClientWidth;
+	sd.Height = m_ClientHeight;
+	sd.Format = m_BackBufferFormat;
+	sd.Stereo = FALSE;
+	sd.SampleDesc.Count = 1;
+	sd.SampleDesc.Quality = 0;
 	sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	sd.BufferCount = s_SwapChainBufferCount;
-	sd.OutputWindow = m_hMainWnd;
-	sd.Windowed = true;
+	sd.BufferCount = m_SwapChainBufferCount;
+	sd.Scaling = DXGI_SCALING_STRETCH;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-	sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+	sd.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+	sd.Flags = m_SwapChainFlags;
 	// Note: Swap chain uses queue to perform flush
-	ThrowIfFailed(m_dxgiFactory->CreateSwapChain(
+	Microsoft::WRL::ComPtr<IDXGISwapChain1> swapChain;
+	ThrowIfFailed(m_dxgiFactory->CreateSwapChainForHwnd(
 		m_CommandQueue.Get(),
+		m_hMainWnd,
 		&sd,
-		m_SwapChain.GetAddressOf()));
+		nullptr,
+		nullptr,
+		swapChain.GetAddressOf()));
+	ThrowIfFailed(swapChain.As(&m_SwapChain));
+
+	ResetPresentQueue();
+	m_FramePacer.SetPresentQueue(&m_PresentQueue, tearingSupported);
+	m_FramePacer.SetVSync(m_VSync);
+}
+
+void D3DApp::ResetPresentQueue()
+{
+	// With as many frames queued as there are back buffers, Present() itself
+	// blocks for a free buffer and the waitable object stops pacing anything.
+	const UINT latency = std::min(m_MaxFrameLatency, m_SwapChainBufferCount - 1);
+	m_PresentQueue.Reset(m_SwapChain.Get(), latency);
+}
+
+void D3DApp::Present()
+{
+	// End the frame's GPU timing in a small list after the frame's own.
+	if (m_GpuFrameBegun)
+	{
+		ThrowIfFailed(m_FixupCommandList->Reset(CurrentCommandAllocator(), nullptr));
+		m_GpuTimer.End(m_FixupCommandList.Get(), m_CurrentBackBuffer);
+		ThrowIfFailed(m_FixupCommandList->Close());
+		ID3D12CommandList* cmdsLists[] = { m_FixupCommandList.Get() };
+		m_CommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+		m_BackBufferScale[m_CurrentBackBuffer] = m_RenderScale;
+		m_GpuFrameBegun = false;
+	}
+
+	ThrowIfFailed(m_FramePacer.Present());
+
+	// Mark the frame that rendered into this back buffer.
+	m_BackBufferFence[m_CurrentBackBuffer] = ++m_CurrentFence;
+	ThrowIfFailed(m_CommandQueue->Signal(m_Fence.Get(), m_CurrentFence));
+
+	// Flip model hands out the back buffers in its own order. The next one
+	// may still be in use by the frame m_SwapChainBufferCount frames back.
+	m_CurrentBackBuffer = m_SwapChain->GetCurrentBackBufferIndex();
+	WaitForFence(m_BackBufferFence[m_CurrentBackBuffer]);
+	// Nothing on the GPU uses the buffer's allocator any more either.
+	ThrowIfFailed(CurrentCommandAllocator()->Reset());
+
+	// That frame is done, so its GPU time can be read; it sets the scale
+	// of the next frame.
+	double gpuMilliseconds = 0.0;
+	if (m_GpuTimer.Read(m_CurrentBackBuffer, gpuMilliseconds) && m_DynamicResolution)
+	{
+		const float scale = m_ResolutionController.Update(gpuMilliseconds, m_BackBufferScale[m_CurrentBackBuffer]);
+		if (scale != m_RenderScale)
+			ApplyRenderScale(scale);
+	}
+}
+
+void D3DApp::ApplyRenderScale(float scale)
+{
+	m_RenderScale = scale;
+	const UINT width = std::max(1u, static_cast<UINT>(m_ClientWidth * scale + 0.5f));
+	const UINT height = std::max(1u, static_cast<UINT>(m_ClientHeight * scale + 0.5f));
+
+	m_ScreenViewport.TopLeftX = 0;
+	m_ScreenViewport.TopLeftY = 0;
+	m_ScreenViewport.Width = static_cast<float>(width);
+	m_ScreenViewport.Height = static_cast<float>(height);
+	m_ScreenViewport.MinDepth = 0.0f;
+	m_ScreenViewport.MaxDepth = 1.0f;
+
+	m_ScissorRect = { 0, 0, static_cast<LONG>(width), static_cast<LONG>(height) };
+
+	// The back buffers stay full size; the swap chain shows the rendered
+	// region, stretched to the window, from the next Present() on.
+	ThrowIfFailed(m_SwapChain->SetSourceSize(width, height));
 }
 
 void D3DApp::CreateRtvAndDsvDescriptorHeaps()
 {
 	// RTV Heap
-	// Need s_SwapChainBufferCount render target views
+	// Need m_SwapChainBufferCount render target views
 	// to describe the buffer resources in the swap chain we will render into
 	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
-	rtvHeapDesc.NumDescriptors = s_SwapChainBufferCount;
+	rtvHeapDesc.NumDescriptors = m_SwapChainBufferCount;
 	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	rtvHeapDesc.NodeMask = 0;
@@ -337,34 +597,47 @@ void D3DApp::OnResize()
 {
 	assert(m_d3dDevice);
 	assert(m_SwapChain);
-	assert(m_DirectCmdListAlloc);
+	assert(m_DirectCmdListAlloc[0]);
 
 	// Flush before changing any resources
 	FlushCommandQueue();
 
-	ThrowIfFailed(m_CommandList->Reset(m_DirectCmdListAlloc.Get(), nullptr));
+	// The GPU is idle, so every frame's allocator can be reset.
+	for (UINT i = 0; i < s_MaxSwapChainBufferCount; ++i)
+		ThrowIfFailed(m_DirectCmdListAlloc[i]->Reset());
+	ThrowIfFailed(m_CommandList->Reset(CurrentCommandAllocator(), nullptr));
 
 	// Release the previous resources we will be recreating.
-	for (int i = 0; i < s_SwapChainBufferCount; ++i)
+	// The state tracker keys on the pointers, so forget them first.
+	// All of them: the count may have changed since they were created.
+	for (UINT i = 0; i < s_MaxSwapChainBufferCount; ++i)
+	{
+		if (m_SwapChainBuffer[i])
+			ResourceStateTracker::UnregisterResource(m_SwapChainBuffer[i].Get());
 		m_SwapChainBuffer[i].Reset();
+	}
+	if (m_DepthStencilBuffer)
+		ResourceStateTracker::UnregisterResource(m_DepthStencilBuffer.Get());
 	m_DepthStencilBuffer.Reset();
 
 	// Resize the swap chain.
 	ThrowIfFailed(m_SwapChain->ResizeBuffers(
-		s_SwapChainBufferCount,
+		m_SwapChainBufferCount,
 		m_ClientWidth, m_ClientHeight,
 		m_BackBufferFormat,
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		m_SwapChainFlags));
 
-	m_CurrentBackBuffer = 0;
+	m_CurrentBackBuffer = m_SwapChain->GetCurrentBackBufferIndex();
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHeapHandle(m_RtvHeap->GetCPUDescriptorHandleForHeapStart());
-	for (UINT i = 0; i < s_SwapChainBufferCount; ++i)
+	for (UINT i = 0; i < m_SwapChainBufferCount; ++i)
 	{
 		ThrowIfFailed(m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&m_SwapChainBuffer[i])));
 		m_d3dDevice->CreateRenderTargetView(m_SwapChainBuffer[i].Get(), nullptr, rtvHeapHandle);
 		rtvHeapHandle.Offset(1, m_RtvDescriptorSize);
 
+		// Swap chain buffers start out in the PRESENT state
+		ResourceStateTracker::RegisterResource(m_SwapChainBuffer[i].Get(), D3D12_RESOURCE_STATE_PRESENT);
 	}
 
 	// Create the depth/stencil buffer and view.
@@ -383,8 +656,9 @@ void D3DApp::OnResize()
 	// we need to create the depth buffer resource with a typeless format.  
 	depthStencilDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
 
-	depthStencilDesc.SampleDesc.Count = m_4xMsaaState ? 4 : 1;
-	depthStencilDesc.SampleDesc.Quality = m_4xMsaaState ? (m_4xMsaaQuality - 1) : 0;
+	// Single-sampled, like the back buffer; m_Msaa has its own depth buffer.
+	depthStencilDesc.SampleDesc.Count = 1;
+	depthStencilDesc.SampleDesc.Quality = 0;
 	depthStencilDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 	depthStencilDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
 
@@ -400,6 +674,7 @@ void D3DApp::OnResize()
 		D3D12_RESOURCE_STATE_COMMON,
 		&optClear,
 		IID_PPV_ARGS(m_DepthStencilBuffer.GetAddressOf())));
+	ResourceStateTracker::RegisterResource(m_DepthStencilBuffer.Get(), D3D12_RESOURCE_STATE_COMMON);
 
 	// Create descriptor to mip level 0 of entire resource using the format of the resource.
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
@@ -410,27 +685,25 @@ void D3DApp::OnResize()
 	m_d3dDevice->CreateDepthStencilView(m_DepthStencilBuffer.Get(), &dsvDesc, DepthStencilView());
 
 	// Transition the resource from its initial state to be used as a depth buffer.
-	auto ds_transition = CD3DX12_RESOURCE_BARRIER::Transition(m_DepthStencilBuffer.Get(),
-		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-	m_CommandList->ResourceBarrier(1, &ds_transition);
+	// The tracker knows the buffer was created in COMMON and records the
+	// barrier when the list is submitted.
+	m_StateTracker.TransitionResource(m_DepthStencilBuffer.Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+	// The MSAA targets follow the back buffer size (the GPU is idle).
+	m_Msaa.Resize(m_ClientWidth, m_ClientHeight);
+	m_Msaa.Update();
 
 	// Execute the resize commands.
-	ThrowIfFailed(m_CommandList->Close());
-	ID3D12CommandList* cmdsLists[] = { m_CommandList.Get() };
-	m_CommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	ExecuteCommandList();
 
 	// Wait until resize is complete.
 	FlushCommandQueue();
+	// The resize is not a frame; leave it out of the GPU timings.
+	m_GpuFrameBegun = false;
 
-	// Update the viewport transform to cover the client area.
-	m_ScreenViewport.TopLeftX = 0;
-	m_ScreenViewport.TopLeftY = 0;
-	m_ScreenViewport.Width = static_cast<float>(m_ClientWidth);
-	m_ScreenViewport.Height = static_cast<float>(m_ClientHeight);
-	m_ScreenViewport.MinDepth = 0.0f;
-	m_ScreenViewport.MaxDepth = 1.0f;
-
-	m_ScissorRect = { 0, 0, m_ClientWidth, m_ClientHeight };
+	// Update the viewport transform to cover the client area, or the part
+	// of it dynamic resolution renders.
+	ApplyRenderScale(m_RenderScale);
 }
 
 void D3DApp::FlushCommandQueue()
@@ -447,16 +720,56 @@ void D3DApp::FlushCommandQueue()
 	// this Signal().
 	ThrowIfFailed(m_CommandQueue->Signal(m_Fence.Get(), m_CurrentFence));
 	// Wait until the GPU has completed commands up to this fence point.
-	if (m_Fence->GetCompletedValue() < m_CurrentFence)
+	WaitForFence(m_CurrentFence);
+}
+
+void D3DApp::WaitForFence(UINT64 fenceValue)
+{
+	if (m_Fence->GetCompletedValue() < fenceValue)
 	{
 		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-		// Fire event when GPU hits current fence. 
-		ThrowIfFailed(m_Fence->SetEventOnCompletion(m_CurrentFence, eventHandle));
-		// Wait until the GPU hits current fence event is fired.
+		// Fire event when GPU hits the fence value. 
+		ThrowIfFailed(m_Fence->SetEventOnCompletion(fenceValue, eventHandle));
+		// Wait until the event is fired.
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+}
+
+void D3DApp::ExecuteCommandList()
+{
+	m_StateTracker.FlushBarriers(m_CommandList.Get());
+	ThrowIfFailed(m_CommandList->Close());
+
+	// Resolve the states the list expects at its start against the global
+	// states. The lock keeps another submission from changing them between
+	// the fixup and the commit.
+	ResourceStateTracker::Lock();
+	ThrowIfFailed(m_FixupCommandList->Reset(CurrentCommandAllocator(), nullptr));
+	// The frame's first submission starts its GPU timing.
+	const bool beginFrame = m_DynamicResolution && !m_GpuFrameBegun;
+	if (beginFrame)
+	{
+		m_GpuTimer.Begin(m_FixupCommandList.Get(), m_CurrentBackBuffer);
+		m_GpuFrameBegun = true;
+	}
+	UINT fixupCount = m_StateTracker.FlushPendingBarriers(m_FixupCommandList.Get());
+	ThrowIfFailed(m_FixupCommandList->Close());
+	m_StateTracker.CommitFinalStates();
+	ResourceStateTracker::Unlock();
+
+	if (fixupCount > 0 || beginFrame)
+	{
+		ID3D12CommandList* cmdsLists[] = { m_FixupCommandList.Get(), m_CommandList.Get() };
+		m_CommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	}
+	else
+	{
+		ID3D12CommandList* cmdsLists[] = { m_CommandList.Get() };
+		m_CommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	}
 
+	m_StateTracker.Reset();
 }
 
 LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -484,7 +797,9 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		// Save the new client area dimensions.
 		m_ClientWidth = LOWORD(lParam);
 		m_ClientHeight = HIWORD(lParam);
-		if (m_d3dDevice)
+		// The device is created on a worker during startup; the swap chain,
+		// on this thread, is what the resize code needs.
+		if (m_SwapChain)
 		{
 			if (wParam == SIZE_MINIMIZED)
 			{
@@ -601,6 +916,11 @@ ID3D12Resource* D3DApp::CurrentBackBuffer() const
 	return m_SwapChainBuffer[m_CurrentBackBuffer].Get();
 }
 
+ID3D12CommandAllocator* D3DApp::CurrentCommandAllocator() const
+{
+	return m_DirectCmdListAlloc[m_CurrentBackBuffer].Get();
+}
+
 D3D12_CPU_DESCRIPTOR_HANDLE D3DApp::CurrentBackBufferView() const
 {
 	// CD3DX12 constructor to offset to the RTV of the current back buffer
@@ -616,6 +936,64 @@ D3D12_CPU_DESCRIPTOR_HANDLE D3DApp::DepthStencilView() const
 	return m_DsvHeap->GetCPUDescriptorHandleForHeapStart();
 }
 
+RenderPassDesc D3DApp::BackBufferRenderPass(const float clearColor[4])
+{
+	// A new colour reallocates the target at the next Update().
+	m_Msaa.SetClearColor(clearColor);
+
+	RenderPassDesc desc;
+	desc.NumRenderTargets = 1;
+
+	const bool msaa = m_Msaa.IsAllocated();
+
+	RenderPassAttachment& color = desc.RenderTargets[0];
+	color.View = msaa ? m_MsaaTargets.ColorView() : CurrentBackBufferView();
+	color.Resource = msaa ? m_MsaaTargets.ColorBuffer() : CurrentBackBuffer();
+	color.Load = RenderPassLoadOp::Clear;
+	color.Store = RenderPassStoreOp::Preserve;
+	color.ClearValue.Format = m_BackBufferFormat;
+	for (int i = 0; i < 4; ++i)
+		color.ClearValue.Color[i] = clearColor[i];
+	if (msaa)
+	{
+		// Resolved straight from tile memory; the samples are not kept.
+		color.Store = RenderPassStoreOp::Resolve;
+		color.ResolveTarget = CurrentBackBuffer();
+		color.ResolveFormat = m_BackBufferFormat;
+	}
+
+	// Depth is only needed while drawing, so it never has to leave tile memory.
+	desc.HasDepthStencil = true;
+	RenderPassAttachment& depth = desc.DepthStencil;
+	depth.View = msaa ? m_MsaaTargets.DepthView() : DepthStencilView();
+	depth.Resource = msaa ? m_MsaaTargets.DepthBuffer() : m_DepthStencilBuffer.Get();
+	depth.Load = RenderPassLoadOp::Clear;
+	depth.Store = RenderPassStoreOp::Discard;
+	depth.ClearValue.Format = m_DepthStencilFormat;
+	depth.ClearValue.DepthStencil.Depth = 1.0f;
+	depth.ClearValue.DepthStencil.Stencil = 0;
+	desc.StencilLoad = RenderPassLoadOp::Clear;
+	desc.StencilStore = RenderPassStoreOp::Discard;
+	return desc;
+}
+
+void D3DApp::PrepareBackBufferRenderPass()
+{
+	if (m_Msaa.IsAllocated())
+	{
+		// The pass resolves into the back buffer rather than drawing to it.
+		m_StateTracker.TransitionResource(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RESOLVE_DEST);
+		m_StateTracker.TransitionResource(m_MsaaTargets.ColorBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+		m_StateTracker.TransitionResource(m_MsaaTargets.DepthBuffer(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	}
+	else
+	{
+		m_StateTracker.TransitionResource(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+		m_StateTracker.TransitionResource(m_DepthStencilBuffer.Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	}
+	m_StateTracker.FlushBarriers(m_CommandList.Get());
+}
+
 void D3DApp::CalculateFrameStats()
 {
 	// Frame Statistics - here I simply count the number of frames processed (and storei t) over some specified time period.
@@ -0,0 +1,341 @@
+#include "pch.h"
+
+#include "DeviceCapabilities.h"
+#include "D3DUtil.h"
+#include "Hash.h"
+
+#include "directx/d3dx12.h"
+
+#include <dxgi1_6.h>
+
+#include <cassert>
+#include <fstream>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogCapabilities(const std::wstring& message)
+	{
+		OutputDebugString((L"DeviceCapabilityCache: " + message + L"\n").c_str());
+	}
+
+	const UINT s_MsaaSampleCounts[MsaaQualityLevels::SampleCountCount] = { 2, 4, 8, 16 };
+
+#if defined(D3D12_SDK_VERSION)
+	const UINT32 s_SdkVersion = D3D12_SDK_VERSION;
+#else
+	const UINT32 s_SdkVersion = 0;
+#endif
+}
+
+UINT DeviceCapabilities::GetMsaaQualityLevels(DXGI_FORMAT format, UINT sampleCount) const
+{
+	for (UINT i = 0; i < MsaaFormatCount; ++i)
+	{
+		if (Msaa[i].Format != format)
+			continue;
+		for (UINT j = 0; j < MsaaQualityLevels::SampleCountCount; ++j)
+		{
+			if (s_MsaaSampleCounts[j] == sampleCount)
+				return Msaa[i].QualityLevels[j];
+		}
+	}
+	return 0;
+}
+
+// == D3D12FeatureSource ==
+
+DeviceIdentity D3D12FeatureSource::GetIdentity()
+{
+	DeviceIdentity identity = {};
+
+	Microsoft::WRL::ComPtr<IDXGIFactory4> factory;
+	Microsoft::WRL::ComPtr<IDXGIAdapter1> adapter;
+	if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))) ||
+		FAILED(factory->EnumAdapterByLuid(m_Device->GetAdapterLuid(), IID_PPV_ARGS(&adapter))))
+	{
+		LogCapabilities(L"could not identify the adapter; capabilities will not be cached.");
+		return identity;
+	}
+
+	DXGI_ADAPTER_DESC desc = {};
+	adapter->GetDesc(&desc);
+	identity.VendorId = desc.VendorId;
+	identity.DeviceId = desc.DeviceId;
+	identity.SubSysId = desc.SubSysId;
+	identity.Revision = desc.Revision;
+
+	LARGE_INTEGER driverVersion = {};
+	if (SUCCEEDED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion)))
+		identity.DriverVersion = static_cast<UINT64>(driverVersion.QuadPart);
+	return identity;
+}
+
+void D3D12FeatureSource::Query(const std::vector<DXGI_FORMAT>& msaaFormats, DeviceCapabilities& caps)
+{
+	CD3DX12FeatureSupport features;
+	ThrowIfFailed(features.Init(m_Device));
+
+	caps.DoublePrecisionFloatShaderOps = features.DoublePrecisionFloatShaderOps();
+	caps.OutputMergerLogicOp = features.OutputMergerLogicOp();
+	caps.MinPrecisionSupport = features.MinPrecisionSupport();
+	caps.TiledResourcesTier = features.TiledResourcesTier();
+	caps.ResourceBindingTier = features.ResourceBindingTier();
+	caps.PSSpecifiedStencilRefSupported = features.PSSpecifiedStencilRefSupported();
+	caps.TypedUAVLoadAdditionalFormats = features.TypedUAVLoadAdditionalFormats();
+	caps.ROVsSupported = features.ROVsSupported();
+	caps.ConservativeRasterizationTier = features.ConservativeRasterizationTier();
+	caps.StandardSwizzle64KBSupported = features.StandardSwizzle64KBSupported();
+	caps.CrossAdapterRowMajorTextureSupported = features.CrossAdapterRowMajorTextureSupported();
+	caps.VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation =
+		features.VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation();
+	caps.ResourceHeapTier = features.ResourceHeapTier();
+	caps.CrossNodeSharingTier = features.CrossNodeSharingTier();
+	caps.MaxGPUVirtualAddressBitsPerResource = features.MaxGPUVirtualAddressBitsPerResource();
+
+	caps.MaxSupportedFeatureLevel = features.MaxSupportedFeatureLevel();
+	caps.MaxGPUVirtualAddressBitsPerProcess = features.MaxGPUVirtualAddressBitsPerProcess();
+	caps.HighestShaderModel = features.HighestShaderModel();
+	caps.HighestRootSignatureVersion = features.HighestRootSignatureVersion();
+
+	caps.WaveOps = features.WaveOps();
+	caps.WaveLaneCountMin = features.WaveLaneCountMin();
+	caps.WaveLaneCountMax = features.WaveLaneCountMax();
+	caps.TotalLaneCount = features.TotalLaneCount();
+	caps.ExpandedComputeResourceStates = features.ExpandedComputeResourceStates();
+	caps.Int64ShaderOps = features.Int64ShaderOps();
+
+	caps.ProtectedResourceSessionSupport = features.ProtectedResourceSessionSupport();
+	caps.TileBasedRenderer = features.TileBasedRenderer();
+	caps.UMA = features.UMA();
+	caps.CacheCoherentUMA = features.CacheCoherentUMA();
+	caps.IsolatedMMU = features.IsolatedMMU();
+	caps.HeapSerializationTier = features.HeapSerializationTier();
+	caps.ProtectedResourceSessionTypeCount = features.ProtectedResourceSessionTypeCount();
+
+	caps.DepthBoundsTestSupported = features.DepthBoundsTestSupported();
+	caps.ProgrammableSamplePositionsTier = features.ProgrammableSamplePositionsTier();
+	caps.ShaderCacheSupportFlags = features.ShaderCacheSupportFlags();
+	caps.CopyQueueTimestampQueriesSupported = features.CopyQueueTimestampQueriesSupported();
+	caps.CastingFullyTypedFormatSupported = features.CastingFullyTypedFormatSupported();
+	caps.WriteBufferImmediateSupportFlags = features.WriteBufferImmediateSupportFlags();
+	caps.ViewInstancingTier = features.ViewInstancingTier();
+	caps.BarycentricsSupported = features.BarycentricsSupported();
+	caps.ExistingHeapsSupported = features.ExistingHeapsSupported();
+	caps.MSAA64KBAlignedTextureSupported = features.MSAA64KBAlignedTextureSupported();
+	caps.SharedResourceCompatibilityTier = features.SharedResourceCompatibilityTier();
+	caps.Native16BitShaderOpsSupported = features.Native16BitShaderOpsSupported();
+	caps.CrossNodeAtomicShaderInstructions = features.CrossNodeAtomicShaderInstructions();
+	caps.SRVOnlyTiledResourceTier3 = features.SRVOnlyTiledResourceTier3();
+	caps.RenderPassesTier = features.RenderPassesTier();
+	caps.RaytracingTier = features.RaytracingTier();
+	caps.AdditionalShadingRatesSupported = features.AdditionalShadingRatesSupported();
+	caps.PerPrimitiveShadingRateSupportedWithViewportIndexing = features.PerPrimitiveShadingRateSupportedWithViewportIndexing();
+	caps.VariableShadingRateTier = features.VariableShadingRateTier();
+	caps.ShadingRateImageTileSize = features.ShadingRateImageTileSize();
+	caps.BackgroundProcessingSupported = features.BackgroundProcessingSupported();
+	caps.MeshShaderTier = features.MeshShaderTier();
+	caps.SamplerFeedbackTier = features.SamplerFeedbackTier();
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 3)
+	caps.UnalignedBlockTexturesSupported = features.UnalignedBlockTexturesSupported();
+	caps.MeshShaderPipelineStatsSupported = features.MeshShaderPipelineStatsSupported();
+	caps.MeshShaderSupportsFullRangeRenderTargetArrayIndex = features.MeshShaderSupportsFullRangeRenderTargetArrayIndex();
+	caps.AtomicInt64OnTypedResourceSupported = features.AtomicInt64OnTypedResourceSupported();
+	caps.AtomicInt64OnGroupSharedSupported = features.AtomicInt64OnGroupSharedSupported();
+	caps.DerivativesInMeshAndAmplificationShadersSupported = features.DerivativesInMeshAndAmplificationShadersSupported();
+	caps.WaveMMATier = features.WaveMMATier();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 4)
+	caps.DisplayableTexture = features.DisplayableTexture();
+	caps.VariableRateShadingSumCombinerSupported = features.VariableRateShadingSumCombinerSupported();
+	caps.MeshShaderPerPrimitiveShadingRateSupported = features.MeshShaderPerPrimitiveShadingRateSupported();
+	caps.AtomicInt64OnDescriptorHeapResourceSupported = features.AtomicInt64OnDescriptorHeapResourceSupported();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 600)
+	caps.MSPrimitivesPipelineStatisticIncludesCulledPrimitives = features.MSPrimitivesPipelineStatisticIncludesCulledPrimitives();
+	caps.EnhancedBarriersSupported = features.EnhancedBarriersSupported();
+	caps.RelaxedFormatCastingSupported = features.RelaxedFormatCastingSupported();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 602)
+	caps.UnrestrictedBufferTextureCopyPitchSupported = features.UnrestrictedBufferTextureCopyPitchSupported();
+	caps.UnrestrictedVertexElementAlignmentSupported = features.UnrestrictedVertexElementAlignmentSupported();
+	caps.InvertedViewportHeightFlipsYSupported = features.InvertedViewportHeightFlipsYSupported();
+	caps.InvertedViewportDepthFlipsZSupported = features.InvertedViewportDepthFlipsZSupported();
+	caps.TextureCopyBetweenDimensionsSupported = features.TextureCopyBetweenDimensionsSupported();
+	caps.AlphaBlendFactorSupported = features.AlphaBlendFactorSupported();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 606)
+	caps.AdvancedTextureOpsSupported = features.AdvancedTextureOpsSupported();
+	caps.WriteableMSAATexturesSupported = features.WriteableMSAATexturesSupported();
+	caps.IndependentFrontAndBackStencilRefMaskSupported = features.IndependentFrontAndBackStencilRefMaskSupported();
+	caps.TriangleFanSupported = features.TriangleFanSupported();
+	caps.DynamicIndexBufferStripCutSupported = features.DynamicIndexBufferStripCutSupported();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 608)
+	caps.DynamicDepthBiasSupported = features.DynamicDepthBiasSupported();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 609)
+	caps.GPUUploadHeapSupported = features.GPUUploadHeapSupported();
+	caps.NonNormalizedCoordinateSamplersSupported = features.NonNormalizedCoordinateSamplersSupported();
+	caps.ManualWriteTrackingResourceSupported = features.ManualWriteTrackingResourceSupported();
+	caps.RenderPassesValid = features.RenderPassesValid();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 610)
+	caps.MismatchingOutputDimensionsSupported = features.MismatchingOutputDimensionsSupported();
+	caps.SupportedSampleCountsWithNoOutputs = features.SupportedSampleCountsWithNoOutputs();
+	caps.PointSamplingAddressesNeverRoundUp = features.PointSamplingAddressesNeverRoundUp();
+	caps.RasterizerDesc2Supported = features.RasterizerDesc2Supported();
+	caps.NarrowQuadrilateralLinesSupported = features.NarrowQuadrilateralLinesSupported();
+	caps.AnisoFilterWithPointMipSupported = features.AnisoFilterWithPointMipSupported();
+	caps.MaxSamplerDescriptorHeapSize = features.MaxSamplerDescriptorHeapSize();
+	caps.MaxSamplerDescriptorHeapSizeWithStaticSamplers = features.MaxSamplerDescriptorHeapSizeWithStaticSamplers();
+	caps.MaxViewDescriptorHeapSize = features.MaxViewDescriptorHeapSize();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 611)
+	caps.ComputeOnlyWriteWatchSupported = features.ComputeOnlyWriteWatchSupported();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 612)
+	caps.ExecuteIndirectTier = features.ExecuteIndirectTier();
+	caps.WorkGraphsTier = features.WorkGraphsTier();
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 617)
+	caps.TightAlignmentSupportTier = features.TightAlignmentSupportTier();
+#endif
+
+	for (UINT type = 0; type < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++type)
+		caps.DescriptorIncrementSize[type] = m_Device->GetDescriptorHandleIncrementSize(static_cast<D3D12_DESCRIPTOR_HEAP_TYPE>(type));
+
+	for (DXGI_FORMAT format : msaaFormats)
+	{
+		MsaaQualityLevels& levels = caps.Msaa[caps.MsaaFormatCount++];
+		levels.Format = format;
+		for (UINT i = 0; i < MsaaQualityLevels::SampleCountCount; ++i)
+		{
+			// Fails for formats that cannot be multisampled at all.
+			UINT count = 0;
+			if (SUCCEEDED(features.MultisampleQualityLevels(format, s_MsaaSampleCounts[i],
+				D3D12_MULTISAMPLE_QUALITY_LEVELS_FLAG_NONE, count)))
+			{
+				levels.QualityLevels[i] = count;
+			}
+		}
+	}
+}
+
+// == DeviceCapabilityCache ==
+
+DeviceCapabilityCache::DeviceCapabilityCache()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / static_cast<double>(frequency.QuadPart);
+}
+
+void DeviceCapabilityCache::Initialize(DeviceFeatureSource& source, const std::wstring& filename, const std::vector<DXGI_FORMAT>& msaaFormats)
+{
+	assert(msaaFormats.size() <= DeviceCapabilities::MaxMsaaFormats && "Too many MSAA formats");
+	m_Filename = filename;
+	m_Stats = Stats();
+
+	FileHeader header = {};
+	header.Magic = DeviceCapabilityFormat::Magic;
+	header.Version = DeviceCapabilityFormat::Version;
+	header.Identity = source.GetIdentity();
+	header.SdkVersion = s_SdkVersion;
+	header.SnapshotSize = sizeof(DeviceCapabilities);
+	header.FormatsHash = Fnv1a64(msaaFormats.data(), msaaFormats.size() * sizeof(DXGI_FORMAT));
+
+	LARGE_INTEGER start = Now();
+	m_Stats.FromDisk = Load(header);
+	LARGE_INTEGER loaded = Now();
+	m_Stats.LoadMilliseconds = (loaded.QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+	if (m_Stats.FromDisk)
+		return;
+
+	m_Caps = DeviceCapabilities();
+	source.Query(msaaFormats, m_Caps);
+	m_Stats.QueryMilliseconds = (Now().QuadPart - loaded.QuadPart) * m_SecondsPerCount * 1000.0;
+
+	header.SnapshotHash = Fnv1a64(&m_Caps, sizeof(m_Caps));
+	if (header.Identity.DriverVersion != 0 && !Save(header))
+		LogCapabilities(L"could not write " + m_Filename);
+}
+
+bool DeviceCapabilityCache::Load(const FileHeader& expected)
+{
+	if (expected.Identity.DriverVersion == 0)
+		return false;
+
+	std::ifstream file(m_Filename, std::ios::binary);
+	if (!file)
+		return false; // first run
+
+	// The header and the snapshot, about a kilobyte: one read of the file
+	// through the stream's buffer.
+	struct
+	{
+		FileHeader Header;
+		DeviceCapabilities Caps;
+	} contents;
+	file.read(reinterpret_cast<char*>(&contents.Header), sizeof(contents.Header));
+	file.read(reinterpret_cast<char*>(&contents.Caps), sizeof(contents.Caps));
+	if (!file || contents.Header.Magic != DeviceCapabilityFormat::Magic || contents.Header.Version != DeviceCapabilityFormat::Version ||
+		contents.Header.SdkVersion != expected.SdkVersion || contents.Header.SnapshotSize != expected.SnapshotSize)
+	{
+		LogCapabilities(m_Filename + L": unknown format, querying the device.");
+		return false;
+	}
+
+	const DeviceIdentity& identity = contents.Header.Identity;
+	if (identity.VendorId != expected.Identity.VendorId || identity.DeviceId != expected.Identity.DeviceId ||
+		identity.SubSysId != expected.Identity.SubSysId || identity.Revision != expected.Identity.Revision ||
+		identity.DriverVersion != expected.Identity.DriverVersion)
+	{
+		LogCapabilities(m_Filename + L": written for another adapter or driver, querying the device.");
+		return false;
+	}
+
+	if (contents.Header.FormatsHash != expected.FormatsHash)
+		return false; // the application asks for other MSAA formats now
+
+	if (Fnv1a64(&contents.Caps, sizeof(contents.Caps)) != contents.Header.SnapshotHash)
+	{
+		LogCapabilities(m_Filename + L": corrupted, querying the device.");
+		return false;
+	}
+
+	m_Caps = contents.Caps;
+	return true;
+}
+
+bool DeviceCapabilityCache::Save(const FileHeader& header) const
+{
+	const std::wstring tempFilename = m_Filename + L".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&m_Caps), sizeof(m_Caps));
+		if (!file)
+			return false;
+	}
+	return MoveFileEx(tempFilename.c_str(), m_Filename.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
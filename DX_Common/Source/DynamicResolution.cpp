@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings)
+{
+	SetSettings(settings);
+	Reset(m_Settings.MaxScale);
+}
+
+void DynamicResolutionController::SetSettings(const DynamicResolutionSettings& settings)
+{
+	assert(settings.TargetMilliseconds > 0.0);
+	assert(settings.MinScale > 0.0f && settings.MinScale <= settings.MaxScale);
+	m_Settings = settings;
+	m_Scale = std::min(std::max(m_Scale, m_Settings.MinScale), m_Settings.MaxScale);
+}
+
+void DynamicResolutionController::Reset(float scale)
+{
+	m_Scale = std::min(std::max(scale, m_Settings.MinScale), m_Settings.MaxScale);
+	m_HaveHistory = false;
+	m_Smoothed = 0.0;
+	m_PreviousError = 0.0;
+	m_PreviousDelta = 0.0;
+}
+
+float DynamicResolutionController::Update(double gpuMilliseconds, float renderedScale)
+{
+	++m_Stats.Frames;
+	if (gpuMilliseconds <= 0.0 || renderedScale <= 0.0f)
+		return m_Scale;
+
+	// What the frame would have cost at the current scale.
+	const double pixelRatio = static_cast<double>(m_Scale) / renderedScale;
+	const double estimate = gpuMilliseconds * pixelRatio * pixelRatio;
+	if (!m_HaveHistory)
+	{
+		m_Smoothed = estimate;
+		m_HaveHistory = true;
+	}
+	else
+	{
+		const double weight = estimate > m_Smoothed ? m_Settings.RisingSmoothing : m_Settings.FallingSmoothing;
+		m_Smoothed += weight * (estimate - m_Smoothed);
+	}
+	m_Stats.SmoothedMilliseconds = m_Smoothed;
+
+	// Over budget is always corrected. Under budget by less than the
+	// deadband is left alone, so the scale settles just under the target
+	// rather than hunting around it.
+	const double rawError = std::log(m_Settings.TargetMilliseconds / m_Smoothed);
+	m_Stats.Error = rawError;
+	const double error = (rawError > 0.0 && rawError < m_Settings.Deadband) ? 0.0 : rawError;
+
+	// Velocity form: the terms give the change of ln(scale squared), so
+	// the clamps below cannot wind the integral up.
+	const double delta = error - m_PreviousError;
+	const double change = m_Settings.Kp * delta + m_Settings.Ki * error + m_Settings.Kd * (delta - m_PreviousDelta);
+	m_PreviousError = error;
+	m_PreviousDelta = delta;
+
+	float scale = m_Scale * static_cast<float>(std::exp(0.5 * change));
+	scale = std::min(std::max(scale, m_Scale - m_Settings.MaxScaleStep), m_Scale + m_Settings.MaxScaleStep);
+	scale = std::min(std::max(scale, m_Settings.MinScale), m_Settings.MaxScale);
+	if (scale != m_Scale)
+	{
+		// The smoothed time follows the scale, like the estimates above.
+		const double ratio = static_cast<double>(scale) / m_Scale;
+		m_Smoothed *= ratio * ratio;
+		m_Scale = scale;
+		++m_Stats.ScaleChanges;
+	}
+	return m_Scale;
+}
@@ -0,0 +1,126 @@
+#include "pch.h"
+
+#include "FramePacer.h"
+#include "D3DUtil.h"
+
+#include <cassert>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+}
+
+// == DxgiPresentQueue ==
+
+DxgiPresentQueue::~DxgiPresentQueue()
+{
+	Reset(nullptr, 0);
+}
+
+void DxgiPresentQueue::Reset(IDXGISwapChain2* swapChain, UINT maxFrameLatency)
+{
+	if (m_FrameLatencyWaitable != nullptr)
+	{
+		CloseHandle(m_FrameLatencyWaitable);
+		m_FrameLatencyWaitable = nullptr;
+	}
+	m_SwapChain = swapChain;
+	if (m_SwapChain == nullptr)
+		return;
+
+	ThrowIfFailed(m_SwapChain->SetMaximumFrameLatency(maxFrameLatency));
+	m_FrameLatencyWaitable = m_SwapChain->GetFrameLatencyWaitableObject();
+}
+
+bool DxgiPresentQueue::WaitForFrame(DWORD timeoutMilliseconds)
+{
+	if (m_FrameLatencyWaitable == nullptr)
+		return true;
+	return WaitForSingleObjectEx(m_FrameLatencyWaitable, timeoutMilliseconds, TRUE) == WAIT_OBJECT_0;
+}
+
+HRESULT DxgiPresentQueue::Present(UINT syncInterval, UINT flags)
+{
+	return m_SwapChain->Present(syncInterval, flags);
+}
+
+bool DxgiPresentQueue::IsExclusiveFullscreen()
+{
+	BOOL fullscreen = FALSE;
+	return SUCCEEDED(m_SwapChain->GetFullscreenState(&fullscreen, nullptr)) && fullscreen;
+}
+
+// == FramePacer ==
+
+FramePacer::FramePacer()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / static_cast<double>(frequency.QuadPart);
+}
+
+bool FramePacer::CheckTearingSupport(IDXGIFactory5* factory)
+{
+	BOOL allowTearing = FALSE;
+	if (FAILED(factory->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))))
+		return false;
+	return allowTearing != FALSE;
+}
+
+void FramePacer::SetPresentQueue(PresentQueue* queue, bool tearingSupported)
+{
+	m_Queue = queue;
+	m_TearingSupported = tearingSupported;
+	m_Waited = false;
+}
+
+void FramePacer::WaitForFrame()
+{
+	assert(m_Queue != nullptr);
+	if (m_Waited)
+		return; // already waited for this frame
+
+	const LARGE_INTEGER start = Now();
+	if (!m_Queue->WaitForFrame(WaitTimeoutMilliseconds))
+		++m_Stats.WaitTimeouts;
+	m_Waited = true;
+
+	m_Stats.LastWaitMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+	m_Stats.TotalWaitMilliseconds += m_Stats.LastWaitMilliseconds;
+}
+
+void FramePacer::GetPresentParameters(UINT& syncInterval, UINT& flags) const
+{
+	syncInterval = m_VSync ? 1 : 0;
+	flags = 0;
+	// Only valid with a sync interval of 0, and not in exclusive fullscreen.
+	if (!m_VSync && m_TearingSupported && !m_Queue->IsExclusiveFullscreen())
+		flags = DXGI_PRESENT_ALLOW_TEARING;
+}
+
+HRESULT FramePacer::Present()
+{
+	assert(m_Queue != nullptr);
+	// A frame that skipped the wait would leave the waitable object one
+	// signal ahead for good, and the latency one frame higher.
+	if (!m_Waited)
+		WaitForFrame();
+
+	UINT syncInterval;
+	UINT flags;
+	GetPresentParameters(syncInterval, flags);
+	const HRESULT hr = m_Queue->Present(syncInterval, flags);
+	m_Waited = false;
+
+	++m_Stats.Frames;
+	if (flags & DXGI_PRESENT_ALLOW_TEARING)
+		++m_Stats.TearingPresents;
+	if (hr == DXGI_STATUS_OCCLUDED)
+		++m_Stats.OccludedPresents;
+	return hr;
+}
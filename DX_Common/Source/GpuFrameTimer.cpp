@@ -0,0 +1,77 @@
+#include "pch.h"
+
+#include "GpuFrameTimer.h"
+#include "D3DUtil.h"
+#include "directx/d3dx12.h"
+
+#include <cassert>
+
+GpuFrameTimer::~GpuFrameTimer()
+{
+	if (m_Timestamps != nullptr)
+		m_Readback->Unmap(0, nullptr);
+}
+
+void GpuFrameTimer::Initialize(ID3D12Device* device, ID3D12CommandQueue* queue, UINT slotCount)
+{
+	assert(slotCount > 0);
+
+	UINT64 frequency = 0;
+	ThrowIfFailed(queue->GetTimestampFrequency(&frequency));
+	m_MillisecondsPerTick = 1000.0 / static_cast<double>(frequency);
+
+	// Two timestamps per slot: begin and end.
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = slotCount * 2;
+	ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(m_QueryHeap.GetAddressOf())));
+
+	const CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_READBACK);
+	const CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * slotCount * 2);
+	ThrowIfFailed(device->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&bufferDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(m_Readback.GetAddressOf())));
+
+	// Readback buffers may stay mapped; each slot is only read after the
+	// fence of the frame that wrote it.
+	void* mapped = nullptr;
+	ThrowIfFailed(m_Readback->Map(0, nullptr, &mapped));
+	m_Timestamps = static_cast<const UINT64*>(mapped);
+
+	m_Ended.assign(slotCount, false);
+}
+
+void GpuFrameTimer::Begin(ID3D12GraphicsCommandList* commandList, UINT slot)
+{
+	assert(slot < m_Ended.size());
+	commandList->EndQuery(m_QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, slot * 2);
+}
+
+void GpuFrameTimer::End(ID3D12GraphicsCommandList* commandList, UINT slot)
+{
+	assert(slot < m_Ended.size());
+	commandList->EndQuery(m_QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, slot * 2 + 1);
+	commandList->ResolveQueryData(m_QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, slot * 2, 2,
+		m_Readback.Get(), sizeof(UINT64) * slot * 2);
+	m_Ended[slot] = true;
+}
+
+bool GpuFrameTimer::Read(UINT slot, double& milliseconds)
+{
+	assert(slot < m_Ended.size());
+	if (!m_Ended[slot])
+		return false;
+	m_Ended[slot] = false;
+
+	const UINT64 begin = m_Timestamps[slot * 2];
+	const UINT64 end = m_Timestamps[slot * 2 + 1];
+	// A disjoint pair (power state change) is dropped.
+	if (end <= begin)
+		return false;
+	milliseconds = (end - begin) * m_MillisecondsPerTick;
+	return true;
+}
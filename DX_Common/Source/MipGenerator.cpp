@@ -0,0 +1,515 @@
+#include "pch.h"
+
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <intrin.h>
+#include <immintrin.h>
+
+namespace
+{
+	// How a supported DXGI format is stored, as far as filtering cares.
+	// Channel order (RGBA vs BGRA) does not matter: every channel is filtered
+	// independently, and alpha is the 4th channel either way.
+	struct PixelFormat
+	{
+		UINT Channels = 0;
+		bool IsFloat = false;
+		bool IsSRGB = false;
+	};
+
+	bool GetPixelFormat(DXGI_FORMAT format, PixelFormat& pf)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R8_UNORM:
+		case DXGI_FORMAT_A8_UNORM:
+			pf = { 1, false, false }; return true;
+		case DXGI_FORMAT_R8G8_UNORM:
+			pf = { 2, false, false }; return true;
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+			pf = { 4, false, false }; return true;
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+			pf = { 4, false, true }; return true;
+		case DXGI_FORMAT_R32_FLOAT:
+			pf = { 1, true, false }; return true;
+		case DXGI_FORMAT_R32G32_FLOAT:
+			pf = { 2, true, false }; return true;
+		case DXGI_FORMAT_R32G32B32_FLOAT:
+			pf = { 3, true, false }; return true;
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+			pf = { 4, true, false }; return true;
+		default:
+			return false;
+		}
+	}
+
+	// == 8-bit <-> float conversion ==
+	// Decoding is a 256-entry table lookup. Encoding sRGB must round in sRGB
+	// space, so instead of evaluating pow() per texel we binary-search the
+	// linear values that sit exactly halfway between two sRGB codes.
+	float SrgbToLinear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	struct ConversionTables
+	{
+		float UnormToFloat[256];
+		float SrgbToFloat[256];
+		float SrgbMidpoints[255]; // linear value halfway between code i and i + 1
+
+		ConversionTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				UnormToFloat[i] = i / 255.0f;
+				SrgbToFloat[i] = SrgbToLinear(i / 255.0f);
+			}
+			for (int i = 0; i < 255; ++i)
+				SrgbMidpoints[i] = SrgbToLinear((i + 0.5f) / 255.0f);
+		}
+	};
+
+	const ConversionTables& GetTables()
+	{
+		static const ConversionTables s_Tables;
+		return s_Tables;
+	}
+
+	BYTE EncodeSrgb(float linear, const float* midpoints)
+	{
+		// Number of midpoints <= linear, found in 8 steps. NaN encodes to 0.
+		UINT code = 0;
+		for (UINT step = 128; step > 0; step >>= 1)
+		{
+			if (linear >= midpoints[code + step - 1])
+				code += step;
+		}
+		return static_cast<BYTE>(code);
+	}
+
+	BYTE EncodeUnorm(float value)
+	{
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return static_cast<BYTE>(value * 255.0f + 0.5f);
+	}
+
+	void DecodeRow(const BYTE* src, const PixelFormat& pf, UINT width, float* dst)
+	{
+		const UINT count = width * pf.Channels;
+		if (pf.IsFloat)
+		{
+			memcpy(dst, src, count * sizeof(float));
+			return;
+		}
+
+		const ConversionTables& tables = GetTables();
+		if (!pf.IsSRGB)
+		{
+			for (UINT i = 0; i < count; ++i)
+				dst[i] = tables.UnormToFloat[src[i]];
+			return;
+		}
+
+		// sRGB formats are all 4-channel; alpha is stored linearly.
+		for (UINT i = 0; i < count; i += 4)
+		{
+			dst[i + 0] = tables.SrgbToFloat[src[i + 0]];
+			dst[i + 1] = tables.SrgbToFloat[src[i + 1]];
+			dst[i + 2] = tables.SrgbToFloat[src[i + 2]];
+			dst[i + 3] = tables.UnormToFloat[src[i + 3]];
+		}
+	}
+
+	void EncodeRow(const float* src, const PixelFormat& pf, UINT width, BYTE* dst, MipSimdLevel simd)
+	{
+		const UINT count = width * pf.Channels;
+		if (pf.IsFloat)
+		{
+			memcpy(dst, src, count * sizeof(float));
+			return;
+		}
+
+		if (pf.IsSRGB)
+		{
+			const float* midpoints = GetTables().SrgbMidpoints;
+			for (UINT i = 0; i < count; i += 4)
+			{
+				dst[i + 0] = EncodeSrgb(src[i + 0], midpoints);
+				dst[i + 1] = EncodeSrgb(src[i + 1], midpoints);
+				dst[i + 2] = EncodeSrgb(src[i + 2], midpoints);
+				dst[i + 3] = EncodeUnorm(src[i + 3]);
+			}
+			return;
+		}
+
+		UINT i = 0;
+		if (simd != MipSimdLevel::Scalar)
+		{
+			// Clamp, scale, round and narrow 4 values at a time.
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 scale = _mm_set1_ps(255.0f);
+			const __m128 half = _mm_set1_ps(0.5f);
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 v = _mm_loadu_ps(src + i);
+				v = _mm_min_ps(_mm_max_ps(v, zero), one);
+				v = _mm_add_ps(_mm_mul_ps(v, scale), half);
+				__m128i packed = _mm_cvttps_epi32(v);
+				packed = _mm_packs_epi32(packed, packed);
+				packed = _mm_packus_epi16(packed, packed);
+				int bytes = _mm_cvtsi128_si32(packed);
+				memcpy(dst + i, &bytes, 4);
+			}
+		}
+		for (; i < count; ++i)
+			dst[i] = EncodeUnorm(src[i]);
+	}
+
+	// == Filter taps ==
+	// For every destination texel along one axis: the first source texel it
+	// reads, how many it reads, and their weights. Texels outside the image
+	// are clamped to the edge by folding their weight onto the edge texel.
+	struct FilterTaps
+	{
+		std::vector<UINT> First;
+		std::vector<UINT> Count;
+		std::vector<float> Weights; // MaxTaps per destination texel
+		UINT MaxTaps = 0;
+
+		const float* GetWeights(UINT i) const { return &Weights[i * MaxTaps]; }
+	};
+
+	// Kaiser window parameters: radius in destination texels and the window
+	// shape (larger alpha = less ringing, softer result).
+	const float s_KaiserRadius = 3.0f;
+	const float s_KaiserAlpha = 4.0f;
+
+	float BesselI0(float x)
+	{
+		// Power series; converges quickly for the small arguments used here.
+		float sum = 1.0f;
+		float term = 1.0f;
+		const float halfX = x * 0.5f;
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= (halfX / k) * (halfX / k);
+			sum += term;
+			if (term < sum * 1e-7f)
+				break;
+		}
+		return sum;
+	}
+
+	float KaiserSinc(float t)
+	{
+		if (std::fabs(t) >= s_KaiserRadius)
+			return 0.0f;
+
+		const float pi = 3.14159265358979f;
+		float sinc = t == 0.0f ? 1.0f : std::sin(pi * t) / (pi * t);
+		float r = t / s_KaiserRadius;
+		float window = BesselI0(s_KaiserAlpha * std::sqrt(1.0f - r * r)) / BesselI0(s_KaiserAlpha);
+		return sinc * window;
+	}
+
+	FilterTaps BuildFilterTaps(UINT srcSize, UINT dstSize, MipFilter filter)
+	{
+		const float scale = static_cast<float>(srcSize) / dstSize;
+		const float support = filter == MipFilter::Box ? scale * 0.5f : s_KaiserRadius * scale;
+
+		std::vector<std::vector<float>> perTexel(dstSize);
+		FilterTaps taps;
+		taps.First.resize(dstSize);
+		taps.Count.resize(dstSize);
+
+		for (UINT x = 0; x < dstSize; ++x)
+		{
+			const float center = (x + 0.5f) * scale;
+			const int lo = static_cast<int>(std::floor(center - support));
+			const int hi = static_cast<int>(std::ceil(center + support));
+			const int first = std::max(lo, 0);
+			const int last = std::min(hi, static_cast<int>(srcSize) - 1);
+
+			std::vector<float>& weights = perTexel[x];
+			weights.assign(last - first + 1, 0.0f);
+
+			for (int i = lo; i <= hi; ++i)
+			{
+				float w;
+				if (filter == MipFilter::Box)
+				{
+					// Overlap of source texel [i, i+1) with the footprint of x.
+					float begin = std::max(static_cast<float>(i), center - support);
+					float end = std::min(static_cast<float>(i + 1), center + support);
+					w = std::max(end - begin, 0.0f);
+				}
+				else
+				{
+					w = KaiserSinc((i + 0.5f - center) / scale);
+				}
+
+				int clamped = std::min(std::max(i, first), last);
+				weights[clamped - first] += w;
+			}
+
+			// Drop zero weights at either end so the loops stay short.
+			UINT begin = 0;
+			UINT end = static_cast<UINT>(weights.size());
+			while (end - begin > 1 && weights[begin] == 0.0f)
+				++begin;
+			while (end - begin > 1 && weights[end - 1] == 0.0f)
+				--end;
+			weights = std::vector<float>(weights.begin() + begin, weights.begin() + end);
+
+			float sum = 0.0f;
+			for (float w : weights)
+				sum += w;
+			for (float& w : weights)
+				w /= sum;
+
+			taps.First[x] = first + begin;
+			taps.Count[x] = end - begin;
+			taps.MaxTaps = std::max(taps.MaxTaps, taps.Count[x]);
+		}
+
+		taps.Weights.assign(dstSize * taps.MaxTaps, 0.0f);
+		for (UINT x = 0; x < dstSize; ++x)
+			std::copy(perTexel[x].begin(), perTexel[x].end(), taps.Weights.begin() + x * taps.MaxTaps);
+
+		return taps;
+	}
+
+	// == Kernels ==
+	// The filter is separable: first a vertical pass that blends whole source
+	// rows into one row (a weighted sum of flat float arrays, which vectorizes
+	// perfectly), then a horizontal pass over that row.
+
+	void VerticalScalar(const float* const* rows, const float* weights, UINT tapCount, float* out, UINT count)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			float sum = 0.0f;
+			for (UINT k = 0; k < tapCount; ++k)
+				sum += rows[k][i] * weights[k];
+			out[i] = sum;
+		}
+	}
+
+	void VerticalSSE(const float* const* rows, const float* weights, UINT tapCount, float* out, UINT count)
+	{
+		UINT i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), _mm_set1_ps(weights[0]));
+			for (UINT k = 1; k < tapCount; ++k)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(weights[k])));
+			_mm_storeu_ps(out + i, sum);
+		}
+		for (; i < count; ++i)
+		{
+			float sum = 0.0f;
+			for (UINT k = 0; k < tapCount; ++k)
+				sum += rows[k][i] * weights[k];
+			out[i] = sum;
+		}
+	}
+
+	void VerticalAVX(const float* const* rows, const float* weights, UINT tapCount, float* out, UINT count)
+	{
+		UINT i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(rows[0] + i), _mm256_set1_ps(weights[0]));
+			for (UINT k = 1; k < tapCount; ++k)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(weights[k])));
+			_mm256_storeu_ps(out + i, sum);
+		}
+		// Avoid the AVX -> SSE transition penalty in the code that follows.
+		_mm256_zeroupper();
+
+		for (; i < count; ++i)
+		{
+			float sum = 0.0f;
+			for (UINT k = 0; k < tapCount; ++k)
+				sum += rows[k][i] * weights[k];
+			out[i] = sum;
+		}
+	}
+
+	void Horizontal(const float* src, const FilterTaps& taps, UINT channels, UINT dstWidth, float* dst, MipSimdLevel simd)
+	{
+		if (channels == 4 && simd != MipSimdLevel::Scalar)
+		{
+			// One RGBA texel per SSE register.
+			for (UINT x = 0; x < dstWidth; ++x)
+			{
+				const float* texel = src + taps.First[x] * 4;
+				const float* weights = taps.GetWeights(x);
+				__m128 sum = _mm_setzero_ps();
+				for (UINT k = 0; k < taps.Count[x]; ++k)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(texel + k * 4), _mm_set1_ps(weights[k])));
+				_mm_storeu_ps(dst + x * 4, sum);
+			}
+			return;
+		}
+
+		for (UINT x = 0; x < dstWidth; ++x)
+		{
+			const float* texel = src + taps.First[x] * channels;
+			const float* weights = taps.GetWeights(x);
+			for (UINT c = 0; c < channels; ++c)
+			{
+				float sum = 0.0f;
+				for (UINT k = 0; k < taps.Count[x]; ++k)
+					sum += texel[k * channels + c] * weights[k];
+				dst[x * channels + c] = sum;
+			}
+		}
+	}
+
+	// Roughly this many texels per ParallelFor chunk.
+	const UINT s_TexelsPerChunk = 16 * 1024;
+
+	UINT RowsPerChunk(UINT width)
+	{
+		return std::max(1u, s_TexelsPerChunk / width);
+	}
+}
+
+MipGenerator::MipGenerator(ThreadPool* pool)
+	: m_Pool(pool)
+	, m_SimdLevel(GetSupportedSimdLevel())
+{
+}
+
+bool MipGenerator::IsFormatSupported(DXGI_FORMAT format)
+{
+	PixelFormat pf;
+	return GetPixelFormat(format, pf);
+}
+
+MipSimdLevel MipGenerator::GetSupportedSimdLevel()
+{
+	// SSE2 is part of x64. AVX needs the CPU flag *and* the OS saving the
+	// YMM registers on context switches (OSXSAVE + XCR0 bits 1 and 2).
+	int info[4];
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+		return MipSimdLevel::AVX;
+	return MipSimdLevel::SSE;
+}
+
+void MipGenerator::SetSimdLevel(MipSimdLevel level)
+{
+	m_SimdLevel = std::min(level, GetSupportedSimdLevel());
+}
+
+bool MipGenerator::Generate(
+	const D3D12_RESOURCE_DESC& desc,
+	void* data,
+	const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts,
+	MipFilter filter) const
+{
+	assert(data && layouts);
+	assert(desc.MipLevels > 0 && "Resolve MipLevels = 0 to a concrete count first");
+
+	PixelFormat pf;
+	if (!GetPixelFormat(desc.Format, pf))
+	{
+		OutputDebugString(L"MipGenerator: unsupported format.\n");
+		return false;
+	}
+	if (desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE1D && desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		OutputDebugString(L"MipGenerator: only 1D and 2D textures are supported.\n");
+		return false;
+	}
+
+	const UINT mipLevels = desc.MipLevels;
+	if (mipLevels == 1)
+		return true;
+
+	BYTE* bytes = static_cast<BYTE*>(data);
+	const UINT channels = pf.Channels;
+	const MipSimdLevel simd = m_SimdLevel;
+
+	auto vertical = simd == MipSimdLevel::AVX ? VerticalAVX :
+		simd == MipSimdLevel::SSE ? VerticalSSE : VerticalScalar;
+
+	// Float copies of the previous and the current mip.
+	std::vector<float> previous;
+	std::vector<float> current;
+
+	for (UINT slice = 0; slice < desc.DepthOrArraySize; ++slice)
+	{
+		// Subresource index = mip + slice * MipLevels (D3D12CalcSubresource).
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* sliceLayouts = layouts + slice * mipLevels;
+
+		UINT srcWidth = static_cast<UINT>(desc.Width);
+		UINT srcHeight = desc.Height;
+
+		previous.resize(size_t(srcWidth) * srcHeight * channels);
+		ParallelFor(m_Pool, srcHeight, RowsPerChunk(srcWidth), [&](UINT begin, UINT end)
+		{
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = sliceLayouts[0];
+			for (UINT y = begin; y < end; ++y)
+			{
+				const BYTE* row = bytes + layout.Offset + size_t(y) * layout.Footprint.RowPitch;
+				DecodeRow(row, pf, srcWidth, &previous[size_t(y) * srcWidth * channels]);
+			}
+		});
+
+		for (UINT mip = 1; mip < mipLevels; ++mip)
+		{
+			const UINT dstWidth = std::max(1u, srcWidth >> 1);
+			const UINT dstHeight = std::max(1u, srcHeight >> 1);
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = sliceLayouts[mip];
+			assert(layout.Footprint.Width == dstWidth && layout.Footprint.Height == dstHeight);
+
+			const FilterTaps tapsX = BuildFilterTaps(srcWidth, dstWidth, filter);
+			const FilterTaps tapsY = BuildFilterTaps(srcHeight, dstHeight, filter);
+
+			current.resize(size_t(dstWidth) * dstHeight * channels);
+
+			ParallelFor(m_Pool, dstHeight, RowsPerChunk(srcWidth * tapsY.MaxTaps), [&](UINT begin, UINT end)
+			{
+				std::vector<float> blended(size_t(srcWidth) * channels);
+				std::vector<const float*> rows(tapsY.MaxTaps);
+
+				for (UINT y = begin; y < end; ++y)
+				{
+					for (UINT k = 0; k < tapsY.Count[y]; ++k)
+						rows[k] = &previous[size_t(tapsY.First[y] + k) * srcWidth * channels];
+
+					float* dstRow = &current[size_t(y) * dstWidth * channels];
+					vertical(rows.data(), tapsY.GetWeights(y), tapsY.Count[y], blended.data(), srcWidth * channels);
+					Horizontal(blended.data(), tapsX, channels, dstWidth, dstRow, simd);
+
+					BYTE* out = bytes + layout.Offset + size_t(y) * layout.Footprint.RowPitch;
+					EncodeRow(dstRow, pf, dstWidth, out, simd);
+				}
+			});
+
+			std::swap(previous, current);
+			srcWidth = dstWidth;
+			srcHeight = dstHeight;
+		}
+	}
+
+	return true;
+}
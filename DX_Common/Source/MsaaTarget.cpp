@@ -0,0 +1,188 @@
+#include "pch.h"
+
+#include "MsaaTarget.h"
+#include "D3DUtil.h"
+#include "ResourceStateTracker.h"
+#include "directx/d3dx12.h"
+
+#include <cassert>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+}
+
+// == D3D12MsaaTargetAllocator ==
+
+D3D12MsaaTargetAllocator::~D3D12MsaaTargetAllocator()
+{
+	Release();
+}
+
+void D3D12MsaaTargetAllocator::Initialize(ID3D12Device* device)
+{
+	m_Device = device;
+
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = 1;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	ThrowIfFailed(m_Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(m_RtvHeap.GetAddressOf())));
+
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	ThrowIfFailed(m_Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(m_DsvHeap.GetAddressOf())));
+}
+
+void D3D12MsaaTargetAllocator::Allocate(const MsaaTargetDesc& desc)
+{
+	assert(m_Device && "Initialize() first");
+	assert(!m_ColorBuffer && !m_DepthBuffer);
+
+	const CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
+
+	// Created in the states they are drawn in, so no barrier is needed
+	// before the first frame.
+	CD3DX12_RESOURCE_DESC colorDesc = CD3DX12_RESOURCE_DESC::Tex2D(desc.ColorFormat, desc.Width, desc.Height,
+		1, 1, desc.SampleCount, desc.Quality, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+	D3D12_CLEAR_VALUE colorClear = {};
+	colorClear.Format = desc.ColorFormat;
+	memcpy(colorClear.Color, desc.ClearColor, sizeof(colorClear.Color));
+	ThrowIfFailed(m_Device->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&colorDesc,
+		D3D12_RESOURCE_STATE_RENDER_TARGET,
+		&colorClear,
+		IID_PPV_ARGS(m_ColorBuffer.GetAddressOf())));
+	ResourceStateTracker::RegisterResource(m_ColorBuffer.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+	m_Device->CreateRenderTargetView(m_ColorBuffer.Get(), nullptr, ColorView());
+
+	CD3DX12_RESOURCE_DESC depthDesc = CD3DX12_RESOURCE_DESC::Tex2D(desc.DepthFormat, desc.Width, desc.Height,
+		1, 1, desc.SampleCount, desc.Quality, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE);
+	D3D12_CLEAR_VALUE depthClear = {};
+	depthClear.Format = desc.DepthFormat;
+	depthClear.DepthStencil.Depth = 1.0f;
+	depthClear.DepthStencil.Stencil = 0;
+	ThrowIfFailed(m_Device->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&depthDesc,
+		D3D12_RESOURCE_STATE_DEPTH_WRITE,
+		&depthClear,
+		IID_PPV_ARGS(m_DepthBuffer.GetAddressOf())));
+	ResourceStateTracker::RegisterResource(m_DepthBuffer.Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	m_Device->CreateDepthStencilView(m_DepthBuffer.Get(), nullptr, DepthView());
+}
+
+void D3D12MsaaTargetAllocator::Release()
+{
+	// The state tracker keys on the pointers, so forget them first.
+	if (m_ColorBuffer)
+		ResourceStateTracker::UnregisterResource(m_ColorBuffer.Get());
+	if (m_DepthBuffer)
+		ResourceStateTracker::UnregisterResource(m_DepthBuffer.Get());
+	m_ColorBuffer.Reset();
+	m_DepthBuffer.Reset();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE D3D12MsaaTargetAllocator::ColorView() const
+{
+	return m_RtvHeap->GetCPUDescriptorHandleForHeapStart();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE D3D12MsaaTargetAllocator::DepthView() const
+{
+	return m_DsvHeap->GetCPUDescriptorHandleForHeapStart();
+}
+
+// == MsaaTarget ==
+
+MsaaTarget::MsaaTarget()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / static_cast<double>(frequency.QuadPart);
+}
+
+void MsaaTarget::SetFormats(DXGI_FORMAT colorFormat, DXGI_FORMAT depthFormat)
+{
+	if (m_Requested.ColorFormat == colorFormat && m_Requested.DepthFormat == depthFormat)
+		return;
+	m_Requested.ColorFormat = colorFormat;
+	m_Requested.DepthFormat = depthFormat;
+	Changed();
+}
+
+void MsaaTarget::SetClearColor(const float color[4])
+{
+	if (memcmp(m_Requested.ClearColor, color, sizeof(m_Requested.ClearColor)) == 0)
+		return;
+	memcpy(m_Requested.ClearColor, color, sizeof(m_Requested.ClearColor));
+	Changed();
+}
+
+void MsaaTarget::SetSampleCount(UINT sampleCount, UINT quality)
+{
+	assert(sampleCount > 0);
+	if (sampleCount <= 1)
+		quality = 0;
+	if (m_Requested.SampleCount == sampleCount && m_Requested.Quality == quality)
+		return;
+	m_Requested.SampleCount = sampleCount;
+	m_Requested.Quality = quality;
+	Changed();
+}
+
+void MsaaTarget::Resize(UINT width, UINT height)
+{
+	if (m_Requested.Width == width && m_Requested.Height == height)
+		return;
+	m_Requested.Width = width;
+	m_Requested.Height = height;
+	Changed();
+}
+
+void MsaaTarget::Changed()
+{
+	++m_ChangesSinceUpdate;
+}
+
+MsaaTargetDesc MsaaTarget::Wanted() const
+{
+	if (!IsEnabled() || m_Requested.Width == 0 || m_Requested.Height == 0)
+		return MsaaTargetDesc();
+	return m_Requested;
+}
+
+bool MsaaTarget::Update()
+{
+	const MsaaTargetDesc wanted = Wanted();
+	const bool changed = wanted != m_Allocated;
+	if (m_ChangesSinceUpdate > 0)
+		m_Stats.CoalescedChanges += m_ChangesSinceUpdate - (changed ? 1 : 0);
+	m_ChangesSinceUpdate = 0;
+	if (!changed)
+		return false;
+
+	assert(m_Allocator != nullptr);
+	if (IsAllocated())
+	{
+		m_Allocator->Release();
+		m_Allocated = MsaaTargetDesc();
+		++m_Stats.Releases;
+	}
+	if (wanted.SampleCount > 0)
+	{
+		const LARGE_INTEGER start = Now();
+		m_Allocator->Allocate(wanted);
+		m_Allocated = wanted;
+		++m_Stats.Allocations;
+		m_Stats.LastAllocateMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+	}
+	return true;
+}
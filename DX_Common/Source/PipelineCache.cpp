@@ -0,0 +1,312 @@
+#include "pch.h"
+
+#include "PipelineCache.h"
+#include "D3DUtil.h"
+#include "Hash.h"
+#include "PipelineCanonicalizer.h"
+#include "directx/d3dx12.h"
+
+#include <dxgi1_6.h>
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogCache(const std::wstring& message)
+	{
+		OutputDebugString((L"PipelineCache: " + message + L"\n").c_str());
+	}
+
+	std::wstring PipelineName(uint64_t key)
+	{
+		wchar_t name[24];
+		swprintf_s(name, L"PSO_%016llX", static_cast<unsigned long long>(key));
+		return name;
+	}
+}
+
+PipelineCache::PipelineCache()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+}
+
+void PipelineCache::Initialize(ID3D12Device* device, const std::wstring& filename)
+{
+	const LARGE_INTEGER start = Now();
+
+	ThrowIfFailed(device->QueryInterface(IID_PPV_ARGS(&m_Device)));
+	m_Filename = filename;
+
+	ReadAdapterIdentity(device);
+	if (!LoadLibraryFile())
+		CreateEmptyLibrary();
+
+	m_Stats.InitializeMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+}
+
+void PipelineCache::ReadAdapterIdentity(ID3D12Device* device)
+{
+	m_Identity.Magic = PipelineCacheFormat::Magic;
+	m_Identity.Version = PipelineCacheFormat::Version;
+
+	Microsoft::WRL::ComPtr<IDXGIFactory4> factory;
+	Microsoft::WRL::ComPtr<IDXGIAdapter1> adapter;
+	if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))) ||
+		FAILED(factory->EnumAdapterByLuid(device->GetAdapterLuid(), IID_PPV_ARGS(&adapter))))
+	{
+		LogCache(L"could not identify the adapter; cached pipelines will not be trusted.");
+		return;
+	}
+
+	DXGI_ADAPTER_DESC desc = {};
+	adapter->GetDesc(&desc);
+	m_Identity.VendorId = desc.VendorId;
+	m_Identity.DeviceId = desc.DeviceId;
+	m_Identity.SubSysId = desc.SubSysId;
+	m_Identity.Revision = desc.Revision;
+
+	LARGE_INTEGER driverVersion = {};
+	if (SUCCEEDED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion)))
+		m_Identity.DriverVersion = static_cast<UINT64>(driverVersion.QuadPart);
+}
+
+bool PipelineCache::LoadLibraryFile()
+{
+	std::ifstream file(m_Filename, std::ios::binary);
+	if (!file)
+		return false; // first run
+
+	PipelineCacheHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.Magic != PipelineCacheFormat::Magic || header.Version != PipelineCacheFormat::Version)
+	{
+		LogCache(m_Filename + L": unknown format, rebuilding.");
+		return false;
+	}
+
+	if (m_Identity.DriverVersion == 0 ||
+		header.VendorId != m_Identity.VendorId || header.DeviceId != m_Identity.DeviceId ||
+		header.SubSysId != m_Identity.SubSysId || header.Revision != m_Identity.Revision ||
+		header.DriverVersion != m_Identity.DriverVersion)
+	{
+		LogCache(m_Filename + L": written for another adapter or driver, rebuilding.");
+		return false;
+	}
+
+	m_LibraryBlob.resize(static_cast<size_t>(header.LibrarySize));
+	file.read(reinterpret_cast<char*>(m_LibraryBlob.data()), m_LibraryBlob.size());
+	if (!file || Fnv1a64(m_LibraryBlob.data(), m_LibraryBlob.size()) != header.LibraryHash)
+	{
+		LogCache(m_Filename + L": truncated or corrupted, rebuilding.");
+		m_LibraryBlob.clear();
+		return false;
+	}
+
+	// The runtime checks the blob against the device and driver as well and
+	// fails with D3D12_ERROR_ADAPTER_NOT_FOUND / DRIVER_VERSION_MISMATCH.
+	Microsoft::WRL::ComPtr<ID3D12Device1> device1;
+	ThrowIfFailed(m_Device.As(&device1));
+	HRESULT hr = device1->CreatePipelineLibrary(m_LibraryBlob.data(), m_LibraryBlob.size(), IID_PPV_ARGS(&m_Library));
+	if (FAILED(hr))
+	{
+		LogCache(m_Filename + L": rejected by the driver, rebuilding.");
+		m_LibraryBlob.clear();
+		return false;
+	}
+
+	m_Stats.LibraryFromDisk = true;
+	return true;
+}
+
+void PipelineCache::CreateEmptyLibrary()
+{
+	m_LibraryBlob.clear();
+	m_Dirty = true; // replace whatever stale file is on disk
+
+	Microsoft::WRL::ComPtr<ID3D12Device1> device1;
+	ThrowIfFailed(m_Device.As(&device1));
+	HRESULT hr = device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&m_Library));
+	if (FAILED(hr))
+	{
+		// E.g. DXGI_ERROR_UNSUPPORTED under some graphics debuggers. Pipelines
+		// are then only shared in memory.
+		LogCache(L"pipeline libraries are not supported, caching in memory only.");
+		m_Library.Reset();
+	}
+}
+
+bool PipelineCache::Save()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_Library || !m_Dirty)
+		return true;
+
+	std::vector<BYTE> blob;
+	{
+		std::lock_guard<std::mutex> libraryLock(m_LibraryMutex);
+		blob.resize(m_Library->GetSerializedSize());
+		ThrowIfFailed(m_Library->Serialize(blob.data(), blob.size()));
+	}
+
+	PipelineCacheHeader header = m_Identity;
+	header.LibrarySize = blob.size();
+	header.LibraryHash = Fnv1a64(blob.data(), blob.size());
+
+	// Write next to the file and swap it in, so a crash mid-write leaves the
+	// previous library intact.
+	const std::wstring tempFilename = m_Filename + L".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+		if (!file)
+			return false;
+	}
+	if (!MoveFileEx(tempFilename.c_str(), m_Filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+		return false;
+
+	m_Dirty = false;
+	return true;
+}
+
+void PipelineCache::RegisterRootSignature(ID3D12RootSignature* rootSignature, const void* serializedBlob, SIZE_T size)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_RootSignatures[rootSignature] = Fnv1a64(serializedBlob, size);
+}
+
+uint64_t PipelineCache::HashPipelineStream(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, bool* persistent) const
+{
+	// Streams that describe the same pipeline in different ways (subobject
+	// order, defaults spelled out, state the pipeline ignores) get one key.
+	CanonicalPipelineDesc canonical;
+	if (!PipelineCanonicalizer::Canonicalize(desc, canonical))
+	{
+		if (persistent)
+			*persistent = false;
+		return 0;
+	}
+
+	uint64_t rootSignatureHash = 0;
+	bool registered = true;
+	if (canonical.RootSignature)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_RootSignatures.find(canonical.RootSignature);
+		if (it != m_RootSignatures.end())
+		{
+			rootSignatureHash = it->second;
+		}
+		else
+		{
+			// Still unique within this run, but not across runs.
+			rootSignatureHash = reinterpret_cast<uintptr_t>(canonical.RootSignature);
+			registered = false;
+		}
+	}
+
+	if (persistent)
+		*persistent = registered;
+	return HashCombine(Fnv1a64(&PipelineCacheFormat::Version, sizeof(PipelineCacheFormat::Version)),
+		PipelineCanonicalizer::Hash(canonical, rootSignatureHash));
+}
+
+ID3D12PipelineState* PipelineCache::GetOrCreate(const D3D12_PIPELINE_STATE_STREAM_DESC& desc)
+{
+	assert(m_Device && "Initialize() first");
+
+	bool persistent = false;
+	const uint64_t key = HashPipelineStream(desc, &persistent);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.Requests++;
+		auto it = m_Pipelines.find(key);
+		if (key != 0 && it != m_Pipelines.end())
+		{
+			m_Stats.MemoryHits++;
+			return it->second.Get();
+		}
+	}
+
+	// Load or compile without holding the lock so other threads can keep
+	// hitting the memory cache.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline;
+	const bool useLibrary = m_Library && key != 0 && persistent;
+	const std::wstring name = PipelineName(key);
+
+	LARGE_INTEGER start = Now();
+	if (useLibrary && LoadFromLibrary(name, desc, pipeline))
+	{
+		const double milliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.LibraryHits++;
+		m_Stats.LibraryMilliseconds += milliseconds;
+	}
+	else
+	{
+		start = Now();
+		ThrowIfFailed(m_Device->CreatePipelineState(&desc, IID_PPV_ARGS(&pipeline)));
+		const double milliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+
+		// E_INVALIDARG here means another thread stored the same name first.
+		bool stored = false;
+		if (useLibrary)
+		{
+			std::lock_guard<std::mutex> libraryLock(m_LibraryMutex);
+			stored = SUCCEEDED(m_Library->StorePipeline(name.c_str(), pipeline.Get()));
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.Compiles++;
+		m_Stats.CompileMilliseconds += milliseconds;
+		m_Dirty |= stored;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (key == 0)
+	{
+		// Malformed for our parser but accepted by the runtime: keep it alive,
+		// but never hand it out for another request.
+		LogCache(L"could not hash a pipeline stream; it is not cached.");
+		m_Uncached.push_back(pipeline);
+		return pipeline.Get();
+	}
+	auto result = m_Pipelines.emplace(key, pipeline); // keeps the first one if two threads raced
+	return result.first->second.Get();
+}
+
+bool PipelineCache::LoadFromLibrary(const std::wstring& name, const D3D12_PIPELINE_STATE_STREAM_DESC& desc,
+	Microsoft::WRL::ComPtr<ID3D12PipelineState>& pipeline)
+{
+	// The library synchronizes itself, except for loads of the same name
+	// from several threads at once.
+	std::lock_guard<std::mutex> lock(m_LibraryMutex);
+	return SUCCEEDED(m_Library->LoadPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pipeline)));
+}
+
+ID3D12PipelineState* PipelineCache::GetOrCreate(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	CD3DX12_PIPELINE_STATE_STREAM stream(desc);
+	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+	return GetOrCreate(streamDesc);
+}
+
+ID3D12PipelineState* PipelineCache::GetOrCreate(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	CD3DX12_PIPELINE_STATE_STREAM stream(desc);
+	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+	return GetOrCreate(streamDesc);
+}
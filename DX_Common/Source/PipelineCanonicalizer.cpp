@@ -0,0 +1,626 @@
+#include "pch.h"
+
+#include "PipelineCanonicalizer.h"
+#include "Hash.h"
+#include "directx/d3dx12.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Accumulates FNV-1a over individual fields. Structures are never hashed
+	// as a whole where they may contain padding or pointers.
+	struct FieldHasher
+	{
+		uint64_t Value = Fnv1a64(nullptr, 0);
+
+		template <typename T>
+		void Add(const T& value) { Value = Fnv1a64(&value, sizeof(value), Value); }
+
+		void Add(const std::string& str)
+		{
+			Add(static_cast<UINT>(str.size()));
+			Value = Fnv1a64(str, Value);
+		}
+
+		void Add(const CanonicalShader& shader)
+		{
+			Add(shader.Hash);
+			Add(static_cast<UINT64>(shader.Size));
+		}
+
+		void Add(const CanonicalStencilFace& face)
+		{
+			Add(face.FailOp);
+			Add(face.DepthFailOp);
+			Add(face.PassOp);
+			Add(face.Func);
+			Add(face.ReadMask);
+			Add(face.WriteMask);
+		}
+	};
+
+	CanonicalStencilFace ToStencilFace(const D3D12_DEPTH_STENCILOP_DESC& op, UINT8 readMask, UINT8 writeMask)
+	{
+		CanonicalStencilFace face;
+		face.FailOp = op.StencilFailOp;
+		face.DepthFailOp = op.StencilDepthFailOp;
+		face.PassOp = op.StencilPassOp;
+		face.Func = op.StencilFunc;
+		face.ReadMask = readMask;
+		face.WriteMask = writeMask;
+		return face;
+	}
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 606)
+	CanonicalStencilFace ToStencilFace(const D3D12_DEPTH_STENCILOP_DESC1& op)
+	{
+		CanonicalStencilFace face;
+		face.FailOp = op.StencilFailOp;
+		face.DepthFailOp = op.StencilDepthFailOp;
+		face.PassOp = op.StencilPassOp;
+		face.Func = op.StencilFunc;
+		face.ReadMask = op.StencilReadMask;
+		face.WriteMask = op.StencilWriteMask;
+		return face;
+	}
+#endif
+
+	// The D3D12_LINE_RASTERIZATION_MODE values, which older headers lack.
+	enum LineMode : UINT
+	{
+		LineAliased = 0,
+		LineAlphaAntialiased = 1,
+		LineQuadrilateralWide = 2,
+		LineQuadrilateralNarrow = 3,
+	};
+
+	// Fills a CanonicalPipelineDesc from the stream. Absent subobjects keep
+	// their defaults; the depth default follows the
+	// CD3DX12_PIPELINE_STATE_STREAM*_PARSE_HELPER rule (on if there is a DSV
+	// format and no depth-stencil subobject).
+	class CanonicalParser : public ID3DX12PipelineParserCallbacks
+	{
+	public:
+		explicit CanonicalParser(CanonicalPipelineDesc& desc) : m_Desc(desc) {}
+
+		bool Failed = false;
+		bool SeenDepthStencil = false;
+
+		void FlagsCb(D3D12_PIPELINE_STATE_FLAGS flags) override { m_Desc.Flags = flags; }
+		void NodeMaskCb(UINT mask) override { m_Desc.NodeMask = mask; }
+		void RootSignatureCb(ID3D12RootSignature* rootSignature) override { m_Desc.RootSignature = rootSignature; }
+		void IBStripCutValueCb(D3D12_INDEX_BUFFER_STRIP_CUT_VALUE value) override { m_Desc.IBStripCutValue = value; }
+		void PrimitiveTopologyTypeCb(D3D12_PRIMITIVE_TOPOLOGY_TYPE type) override { m_Desc.PrimitiveTopologyType = type; }
+		void DSVFormatCb(DXGI_FORMAT format) override { m_Desc.DSVFormat = format; }
+		void SampleMaskCb(UINT mask) override { m_Desc.SampleMask = mask; }
+		void SampleDescCb(const DXGI_SAMPLE_DESC& desc) override { m_Desc.SampleDesc = desc; }
+		void BlendStateCb(const D3D12_BLEND_DESC& desc) override { m_Desc.Blend = desc; }
+
+		void VSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.VS = PipelineCanonicalizer::HashShader(bytecode); }
+		void PSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.PS = PipelineCanonicalizer::HashShader(bytecode); }
+		void DSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.DS = PipelineCanonicalizer::HashShader(bytecode); }
+		void HSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.HS = PipelineCanonicalizer::HashShader(bytecode); }
+		void GSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.GS = PipelineCanonicalizer::HashShader(bytecode); }
+		void CSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.CS = PipelineCanonicalizer::HashShader(bytecode); }
+		void ASCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.AS = PipelineCanonicalizer::HashShader(bytecode); }
+		void MSCb(const D3D12_SHADER_BYTECODE& bytecode) override { m_Desc.MS = PipelineCanonicalizer::HashShader(bytecode); }
+
+		void InputLayoutCb(const D3D12_INPUT_LAYOUT_DESC& layout) override
+		{
+			m_Desc.InputLayout.resize(layout.NumElements);
+			for (UINT i = 0; i < layout.NumElements; ++i)
+			{
+				const D3D12_INPUT_ELEMENT_DESC& src = layout.pInputElementDescs[i];
+				CanonicalInputElement& dst = m_Desc.InputLayout[i];
+				dst.SemanticName = src.SemanticName ? src.SemanticName : "";
+				dst.SemanticIndex = src.SemanticIndex;
+				dst.Format = src.Format;
+				dst.InputSlot = src.InputSlot;
+				dst.AlignedByteOffset = src.AlignedByteOffset;
+				dst.InputSlotClass = src.InputSlotClass;
+				dst.InstanceDataStepRate = src.InstanceDataStepRate;
+			}
+		}
+
+		void StreamOutputCb(const D3D12_STREAM_OUTPUT_DESC& desc) override
+		{
+			m_Desc.StreamOutput.resize(desc.NumEntries);
+			for (UINT i = 0; i < desc.NumEntries; ++i)
+			{
+				const D3D12_SO_DECLARATION_ENTRY& src = desc.pSODeclaration[i];
+				CanonicalStreamOutputEntry& dst = m_Desc.StreamOutput[i];
+				dst.Stream = src.Stream;
+				dst.SemanticName = src.SemanticName ? src.SemanticName : "";
+				dst.SemanticIndex = src.SemanticIndex;
+				dst.StartComponent = src.StartComponent;
+				dst.ComponentCount = src.ComponentCount;
+				dst.OutputSlot = src.OutputSlot;
+			}
+			m_Desc.StreamOutputStrides.assign(desc.pBufferStrides, desc.pBufferStrides + desc.NumStrides);
+			m_Desc.RasterizedStream = desc.RasterizedStream;
+		}
+
+		void DepthStencilStateCb(const D3D12_DEPTH_STENCIL_DESC& desc) override
+		{
+			SetDepthStencil(desc);
+			m_Desc.DepthBoundsTestEnable = FALSE;
+		}
+
+		void DepthStencilState1Cb(const D3D12_DEPTH_STENCIL_DESC1& desc) override
+		{
+			SetDepthStencil(desc);
+			m_Desc.DepthBoundsTestEnable = desc.DepthBoundsTestEnable;
+		}
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 606)
+		void DepthStencilState2Cb(const D3D12_DEPTH_STENCIL_DESC2& desc) override
+		{
+			SeenDepthStencil = true;
+			m_Desc.DepthEnable = desc.DepthEnable;
+			m_Desc.DepthWriteMask = desc.DepthWriteMask;
+			m_Desc.DepthFunc = desc.DepthFunc;
+			m_Desc.StencilEnable = desc.StencilEnable;
+			m_Desc.FrontFace = ToStencilFace(desc.FrontFace);
+			m_Desc.BackFace = ToStencilFace(desc.BackFace);
+			m_Desc.DepthBoundsTestEnable = desc.DepthBoundsTestEnable;
+		}
+#endif
+
+		void RasterizerStateCb(const D3D12_RASTERIZER_DESC& desc) override
+		{
+			SetRasterizerCommon(desc);
+			m_Desc.DepthBias = static_cast<FLOAT>(desc.DepthBias);
+			// Same mapping as CD3DX12_RASTERIZER_DESC2's conversion constructor.
+			m_Desc.LineRasterizationMode = desc.MultisampleEnable ? LineQuadrilateralWide
+				: desc.AntialiasedLineEnable ? LineAlphaAntialiased : LineAliased;
+		}
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 608)
+		void RasterizerState1Cb(const D3D12_RASTERIZER_DESC1& desc) override
+		{
+			SetRasterizerCommon(desc);
+			m_Desc.DepthBias = desc.DepthBias;
+			m_Desc.LineRasterizationMode = desc.MultisampleEnable ? LineQuadrilateralWide
+				: desc.AntialiasedLineEnable ? LineAlphaAntialiased : LineAliased;
+		}
+#endif
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 610)
+		void RasterizerState2Cb(const D3D12_RASTERIZER_DESC2& desc) override
+		{
+			SetRasterizerCommon(desc);
+			m_Desc.DepthBias = desc.DepthBias;
+			m_Desc.LineRasterizationMode = static_cast<UINT>(desc.LineRasterizationMode);
+		}
+#endif
+
+		void RTVFormatsCb(const D3D12_RT_FORMAT_ARRAY& formats) override
+		{
+			m_Desc.NumRenderTargets = formats.NumRenderTargets;
+			for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+				m_Desc.RTVFormats[i] = formats.RTFormats[i];
+		}
+
+		void ViewInstancingCb(const D3D12_VIEW_INSTANCING_DESC& desc) override
+		{
+			m_Desc.ViewInstances.assign(desc.pViewInstanceLocations, desc.pViewInstanceLocations + desc.ViewInstanceCount);
+			m_Desc.ViewInstancingFlags = desc.Flags;
+		}
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 618)
+		void SerializedRootSignatureCb(const D3D12_SERIALIZED_ROOT_SIGNATURE_DESC& desc) override
+		{
+			m_Desc.SerializedRootSignature = Fnv1a64(desc.pSerializedBlob, desc.SerializedBlobSizeInBytes);
+			if (m_Desc.SerializedRootSignature == 0)
+				m_Desc.SerializedRootSignature = 1;
+		}
+#endif
+
+		// A cached blob only speeds creation up; it does not change the pipeline.
+		void CachedPSOCb(const D3D12_CACHED_PIPELINE_STATE&) override {}
+
+		void ErrorBadInputParameter(UINT) override { Failed = true; }
+		void ErrorDuplicateSubobject(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE) override { Failed = true; }
+		void ErrorUnknownSubobject(UINT) override { Failed = true; }
+
+	private:
+		template <typename T>
+		void SetDepthStencil(const T& desc)
+		{
+			SeenDepthStencil = true;
+			m_Desc.DepthEnable = desc.DepthEnable;
+			m_Desc.DepthWriteMask = desc.DepthWriteMask;
+			m_Desc.DepthFunc = desc.DepthFunc;
+			m_Desc.StencilEnable = desc.StencilEnable;
+			m_Desc.FrontFace = ToStencilFace(desc.FrontFace, desc.StencilReadMask, desc.StencilWriteMask);
+			m_Desc.BackFace = ToStencilFace(desc.BackFace, desc.StencilReadMask, desc.StencilWriteMask);
+		}
+
+		template <typename T>
+		void SetRasterizerCommon(const T& desc)
+		{
+			m_Desc.FillMode = desc.FillMode;
+			m_Desc.CullMode = desc.CullMode;
+			m_Desc.FrontCounterClockwise = desc.FrontCounterClockwise;
+			m_Desc.DepthBiasClamp = desc.DepthBiasClamp;
+			m_Desc.SlopeScaledDepthBias = desc.SlopeScaledDepthBias;
+			m_Desc.DepthClipEnable = desc.DepthClipEnable;
+			m_Desc.ForcedSampleCount = desc.ForcedSampleCount;
+			m_Desc.ConservativeRaster = desc.ConservativeRaster;
+		}
+
+	private:
+		CanonicalPipelineDesc& m_Desc;
+	};
+
+	// == Diff helpers ==
+
+	std::string ToString(UINT64 value) { return std::to_string(value); }
+	std::string ToString(FLOAT value) { return std::to_string(value); }
+	std::string ToString(const std::string& value) { return "\"" + value + "\""; }
+	std::string ToString(const CanonicalShader& shader)
+	{
+		if (shader.Hash == 0)
+			return "none";
+		char text[48];
+		snprintf(text, sizeof(text), "%016llx (%llu bytes)",
+			static_cast<unsigned long long>(shader.Hash), static_cast<unsigned long long>(shader.Size));
+		return text;
+	}
+	std::string ToString(const void* pointer)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "%p", pointer);
+		return text;
+	}
+
+	class Differ
+	{
+	public:
+		std::vector<PipelineFieldDiff> Diffs;
+
+		template <typename T>
+		void Field(const std::string& name, const T& a, const T& b)
+		{
+			if (!(a == b))
+				Diffs.push_back({ name, Str(a), Str(b) });
+		}
+
+		void Face(const std::string& name, const CanonicalStencilFace& a, const CanonicalStencilFace& b)
+		{
+			Field(name + ".FailOp", a.FailOp, b.FailOp);
+			Field(name + ".DepthFailOp", a.DepthFailOp, b.DepthFailOp);
+			Field(name + ".PassOp", a.PassOp, b.PassOp);
+			Field(name + ".Func", a.Func, b.Func);
+			Field(name + ".ReadMask", a.ReadMask, b.ReadMask);
+			Field(name + ".WriteMask", a.WriteMask, b.WriteMask);
+		}
+
+	private:
+		// Enums, BOOLs and other integers print as numbers.
+		template <typename T>
+		static std::string Str(const T& value) { return ToString(static_cast<UINT64>(value)); }
+		static std::string Str(const FLOAT& value) { return ToString(value); }
+		static std::string Str(const std::string& value) { return ToString(value); }
+		static std::string Str(const CanonicalShader& value) { return ToString(value); }
+		static std::string Str(ID3D12RootSignature* const& value) { return ToString(static_cast<const void*>(value)); }
+	};
+
+	std::string Indexed(const char* name, size_t index)
+	{
+		return std::string(name) + "[" + std::to_string(index) + "]";
+	}
+}
+
+CanonicalShader PipelineCanonicalizer::HashShader(const D3D12_SHADER_BYTECODE& bytecode)
+{
+	CanonicalShader shader;
+	const BYTE* data = static_cast<const BYTE*>(bytecode.pShaderBytecode);
+	if (!data || bytecode.BytecodeLength == 0)
+		return shader;
+
+	shader.Size = bytecode.BytecodeLength;
+
+	// DXBC and DXIL containers start with "DXBC" and a 16 byte digest of the
+	// rest of the container, written by the compiler/validator. Use it
+	// instead of reading the whole shader; it is zero if never computed.
+	static const BYTE s_Zero[16] = {};
+	if (shader.Size >= 20 && memcmp(data, "DXBC", 4) == 0 && memcmp(data + 4, s_Zero, 16) != 0)
+		shader.Hash = Fnv1a64(data + 4, 16);
+	else
+		shader.Hash = Fnv1a64(data, shader.Size);
+
+	if (shader.Hash == 0)
+		shader.Hash = 1; // 0 means "no shader"
+	return shader;
+}
+
+bool PipelineCanonicalizer::Canonicalize(const D3D12_PIPELINE_STATE_STREAM_DESC& stream, CanonicalPipelineDesc& desc)
+{
+	desc = CanonicalPipelineDesc();
+	desc.Blend = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+
+	CanonicalParser parser(desc);
+	if (FAILED(D3DX12ParsePipelineStream(stream, &parser)) || parser.Failed)
+		return false;
+
+	if (!parser.SeenDepthStencil)
+		desc.DepthEnable = desc.DSVFormat != DXGI_FORMAT_UNKNOWN;
+
+	Normalize(desc);
+	return true;
+}
+
+void PipelineCanonicalizer::Normalize(CanonicalPipelineDesc& desc)
+{
+	const CD3DX12_BLEND_DESC defaultBlend(D3D12_DEFAULT);
+	const D3D12_RENDER_TARGET_BLEND_DESC& defaultTarget = defaultBlend.RenderTarget[0];
+
+	if (desc.IsCompute())
+	{
+		CanonicalPipelineDesc compute;
+		compute.Blend = defaultBlend;
+		compute.RootSignature = desc.RootSignature;
+		compute.SerializedRootSignature = desc.SerializedRootSignature;
+		compute.CS = desc.CS;
+		compute.NodeMask = desc.NodeMask;
+		compute.Flags = desc.Flags;
+		desc = compute;
+		return;
+	}
+
+	// == Blend ==
+	desc.NumRenderTargets = std::min<UINT>(desc.NumRenderTargets, D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
+	const UINT usedTargets = desc.Blend.IndependentBlendEnable ? desc.NumRenderTargets : 1;
+	for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+	{
+		D3D12_RENDER_TARGET_BLEND_DESC& target = desc.Blend.RenderTarget[i];
+		if (i >= usedTargets)
+		{
+			target = defaultTarget;
+			continue;
+		}
+		if (!target.BlendEnable)
+		{
+			target.SrcBlend = defaultTarget.SrcBlend;
+			target.DestBlend = defaultTarget.DestBlend;
+			target.BlendOp = defaultTarget.BlendOp;
+			target.SrcBlendAlpha = defaultTarget.SrcBlendAlpha;
+			target.DestBlendAlpha = defaultTarget.DestBlendAlpha;
+			target.BlendOpAlpha = defaultTarget.BlendOpAlpha;
+		}
+		if (!target.LogicOpEnable)
+			target.LogicOp = defaultTarget.LogicOp;
+	}
+	// With a single render target there is nothing to blend independently.
+	if (desc.NumRenderTargets <= 1)
+		desc.Blend.IndependentBlendEnable = FALSE;
+
+	for (UINT i = desc.NumRenderTargets; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+		desc.RTVFormats[i] = DXGI_FORMAT_UNKNOWN;
+
+	// == Depth-stencil ==
+	const CanonicalPipelineDesc defaults;
+	if (!desc.DepthEnable)
+	{
+		desc.DepthWriteMask = defaults.DepthWriteMask;
+		desc.DepthFunc = defaults.DepthFunc;
+	}
+	if (!desc.StencilEnable)
+	{
+		desc.FrontFace = CanonicalStencilFace();
+		desc.BackFace = CanonicalStencilFace();
+	}
+
+	// == Multisampling ==
+	if (desc.SampleDesc.Count < 32)
+		desc.SampleMask &= (1u << desc.SampleDesc.Count) - 1;
+}
+
+uint64_t PipelineCanonicalizer::Hash(const CanonicalPipelineDesc& desc, uint64_t rootSignatureHash)
+{
+	FieldHasher h;
+	h.Add(rootSignatureHash);
+	h.Add(desc.SerializedRootSignature);
+	h.Add(desc.CS);
+	h.Add(desc.NodeMask);
+	h.Add(desc.Flags);
+	if (desc.IsCompute())
+		return h.Value; // Normalize() reset the rest
+
+	for (const CanonicalShader* shader : { &desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS, &desc.AS, &desc.MS })
+		h.Add(*shader);
+
+	h.Add(static_cast<UINT>(desc.InputLayout.size()));
+	for (const CanonicalInputElement& element : desc.InputLayout)
+	{
+		h.Add(element.SemanticName);
+		h.Add(element.SemanticIndex);
+		h.Add(element.Format);
+		h.Add(element.InputSlot);
+		h.Add(element.AlignedByteOffset);
+		h.Add(element.InputSlotClass);
+		h.Add(element.InstanceDataStepRate);
+	}
+	h.Add(desc.IBStripCutValue);
+	h.Add(desc.PrimitiveTopologyType);
+
+	h.Add(static_cast<UINT>(desc.StreamOutput.size()));
+	for (const CanonicalStreamOutputEntry& entry : desc.StreamOutput)
+	{
+		h.Add(entry.Stream);
+		h.Add(entry.SemanticName);
+		h.Add(entry.SemanticIndex);
+		h.Add(entry.StartComponent);
+		h.Add(entry.ComponentCount);
+		h.Add(entry.OutputSlot);
+	}
+	h.Add(static_cast<UINT>(desc.StreamOutputStrides.size()));
+	for (UINT stride : desc.StreamOutputStrides)
+		h.Add(stride);
+	h.Add(desc.RasterizedStream);
+
+	h.Add(desc.Blend.AlphaToCoverageEnable);
+	h.Add(desc.Blend.IndependentBlendEnable);
+	for (const D3D12_RENDER_TARGET_BLEND_DESC& target : desc.Blend.RenderTarget)
+	{
+		h.Add(target.BlendEnable);
+		h.Add(target.LogicOpEnable);
+		h.Add(target.SrcBlend);
+		h.Add(target.DestBlend);
+		h.Add(target.BlendOp);
+		h.Add(target.SrcBlendAlpha);
+		h.Add(target.DestBlendAlpha);
+		h.Add(target.BlendOpAlpha);
+		h.Add(target.LogicOp);
+		h.Add(target.RenderTargetWriteMask);
+	}
+	h.Add(desc.SampleMask);
+
+	h.Add(desc.FillMode);
+	h.Add(desc.CullMode);
+	h.Add(desc.FrontCounterClockwise);
+	h.Add(desc.DepthBias);
+	h.Add(desc.DepthBiasClamp);
+	h.Add(desc.SlopeScaledDepthBias);
+	h.Add(desc.DepthClipEnable);
+	h.Add(desc.LineRasterizationMode);
+	h.Add(desc.ForcedSampleCount);
+	h.Add(desc.ConservativeRaster);
+
+	h.Add(desc.DepthEnable);
+	h.Add(desc.DepthWriteMask);
+	h.Add(desc.DepthFunc);
+	h.Add(desc.StencilEnable);
+	h.Add(desc.FrontFace);
+	h.Add(desc.BackFace);
+	h.Add(desc.DepthBoundsTestEnable);
+
+	h.Add(desc.NumRenderTargets);
+	for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+		h.Add(desc.RTVFormats[i]);
+	h.Add(desc.DSVFormat);
+	h.Add(desc.SampleDesc.Count);
+	h.Add(desc.SampleDesc.Quality);
+
+	h.Add(static_cast<UINT>(desc.ViewInstances.size()));
+	for (const D3D12_VIEW_INSTANCE_LOCATION& location : desc.ViewInstances)
+	{
+		h.Add(location.ViewportArrayIndex);
+		h.Add(location.RenderTargetArrayIndex);
+	}
+	h.Add(desc.ViewInstancingFlags);
+	return h.Value;
+}
+
+std::vector<PipelineFieldDiff> PipelineCanonicalizer::Diff(const CanonicalPipelineDesc& a, const CanonicalPipelineDesc& b)
+{
+	Differ d;
+	d.Field("RootSignature", a.RootSignature, b.RootSignature);
+	d.Field("SerializedRootSignature", a.SerializedRootSignature, b.SerializedRootSignature);
+	d.Field("VS", a.VS, b.VS);
+	d.Field("PS", a.PS, b.PS);
+	d.Field("DS", a.DS, b.DS);
+	d.Field("HS", a.HS, b.HS);
+	d.Field("GS", a.GS, b.GS);
+	d.Field("CS", a.CS, b.CS);
+	d.Field("AS", a.AS, b.AS);
+	d.Field("MS", a.MS, b.MS);
+
+	d.Field("InputLayout.NumElements", a.InputLayout.size(), b.InputLayout.size());
+	for (size_t i = 0; i < a.InputLayout.size() && i < b.InputLayout.size(); ++i)
+	{
+		const CanonicalInputElement& ea = a.InputLayout[i];
+		const CanonicalInputElement& eb = b.InputLayout[i];
+		const std::string name = Indexed("InputLayout", i);
+		d.Field(name + ".SemanticName", ea.SemanticName, eb.SemanticName);
+		d.Field(name + ".SemanticIndex", ea.SemanticIndex, eb.SemanticIndex);
+		d.Field(name + ".Format", ea.Format, eb.Format);
+		d.Field(name + ".InputSlot", ea.InputSlot, eb.InputSlot);
+		d.Field(name + ".AlignedByteOffset", ea.AlignedByteOffset, eb.AlignedByteOffset);
+		d.Field(name + ".InputSlotClass", ea.InputSlotClass, eb.InputSlotClass);
+		d.Field(name + ".InstanceDataStepRate", ea.InstanceDataStepRate, eb.InstanceDataStepRate);
+	}
+	d.Field("IBStripCutValue", a.IBStripCutValue, b.IBStripCutValue);
+	d.Field("PrimitiveTopologyType", a.PrimitiveTopologyType, b.PrimitiveTopologyType);
+
+	d.Field("StreamOutput.NumEntries", a.StreamOutput.size(), b.StreamOutput.size());
+	for (size_t i = 0; i < a.StreamOutput.size() && i < b.StreamOutput.size(); ++i)
+	{
+		const CanonicalStreamOutputEntry& ea = a.StreamOutput[i];
+		const CanonicalStreamOutputEntry& eb = b.StreamOutput[i];
+		const std::string name = Indexed("StreamOutput", i);
+		d.Field(name + ".Stream", ea.Stream, eb.Stream);
+		d.Field(name + ".SemanticName", ea.SemanticName, eb.SemanticName);
+		d.Field(name + ".SemanticIndex", ea.SemanticIndex, eb.SemanticIndex);
+		d.Field(name + ".StartComponent", ea.StartComponent, eb.StartComponent);
+		d.Field(name + ".ComponentCount", ea.ComponentCount, eb.ComponentCount);
+		d.Field(name + ".OutputSlot", ea.OutputSlot, eb.OutputSlot);
+	}
+	d.Field("StreamOutput.NumStrides", a.StreamOutputStrides.size(), b.StreamOutputStrides.size());
+	for (size_t i = 0; i < a.StreamOutputStrides.size() && i < b.StreamOutputStrides.size(); ++i)
+		d.Field(Indexed("StreamOutput.Strides", i), a.StreamOutputStrides[i], b.StreamOutputStrides[i]);
+	d.Field("StreamOutput.RasterizedStream", a.RasterizedStream, b.RasterizedStream);
+
+	d.Field("Blend.AlphaToCoverageEnable", a.Blend.AlphaToCoverageEnable, b.Blend.AlphaToCoverageEnable);
+	d.Field("Blend.IndependentBlendEnable", a.Blend.IndependentBlendEnable, b.Blend.IndependentBlendEnable);
+	for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+	{
+		const D3D12_RENDER_TARGET_BLEND_DESC& ta = a.Blend.RenderTarget[i];
+		const D3D12_RENDER_TARGET_BLEND_DESC& tb = b.Blend.RenderTarget[i];
+		const std::string name = Indexed("Blend.RenderTarget", i);
+		d.Field(name + ".BlendEnable", ta.BlendEnable, tb.BlendEnable);
+		d.Field(name + ".LogicOpEnable", ta.LogicOpEnable, tb.LogicOpEnable);
+		d.Field(name + ".SrcBlend", ta.SrcBlend, tb.SrcBlend);
+		d.Field(name + ".DestBlend", ta.DestBlend, tb.DestBlend);
+		d.Field(name + ".BlendOp", ta.BlendOp, tb.BlendOp);
+		d.Field(name + ".SrcBlendAlpha", ta.SrcBlendAlpha, tb.SrcBlendAlpha);
+		d.Field(name + ".DestBlendAlpha", ta.DestBlendAlpha, tb.DestBlendAlpha);
+		d.Field(name + ".BlendOpAlpha", ta.BlendOpAlpha, tb.BlendOpAlpha);
+		d.Field(name + ".LogicOp", ta.LogicOp, tb.LogicOp);
+		d.Field(name + ".RenderTargetWriteMask", ta.RenderTargetWriteMask, tb.RenderTargetWriteMask);
+	}
+	d.Field("SampleMask", a.SampleMask, b.SampleMask);
+
+	d.Field("Rasterizer.FillMode", a.FillMode, b.FillMode);
+	d.Field("Rasterizer.CullMode", a.CullMode, b.CullMode);
+	d.Field("Rasterizer.FrontCounterClockwise", a.FrontCounterClockwise, b.FrontCounterClockwise);
+	d.Field("Rasterizer.DepthBias", a.DepthBias, b.DepthBias);
+	d.Field("Rasterizer.DepthBiasClamp", a.DepthBiasClamp, b.DepthBiasClamp);
+	d.Field("Rasterizer.SlopeScaledDepthBias", a.SlopeScaledDepthBias, b.SlopeScaledDepthBias);
+	d.Field("Rasterizer.DepthClipEnable", a.DepthClipEnable, b.DepthClipEnable);
+	d.Field("Rasterizer.LineRasterizationMode", a.LineRasterizationMode, b.LineRasterizationMode);
+	d.Field("Rasterizer.ForcedSampleCount", a.ForcedSampleCount, b.ForcedSampleCount);
+	d.Field("Rasterizer.ConservativeRaster", a.ConservativeRaster, b.ConservativeRaster);
+
+	d.Field("DepthStencil.DepthEnable", a.DepthEnable, b.DepthEnable);
+	d.Field("DepthStencil.DepthWriteMask", a.DepthWriteMask, b.DepthWriteMask);
+	d.Field("DepthStencil.DepthFunc", a.DepthFunc, b.DepthFunc);
+	d.Field("DepthStencil.StencilEnable", a.StencilEnable, b.StencilEnable);
+	d.Face("DepthStencil.FrontFace", a.FrontFace, b.FrontFace);
+	d.Face("DepthStencil.BackFace", a.BackFace, b.BackFace);
+	d.Field("DepthStencil.DepthBoundsTestEnable", a.DepthBoundsTestEnable, b.DepthBoundsTestEnable);
+
+	d.Field("NumRenderTargets", a.NumRenderTargets, b.NumRenderTargets);
+	for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+		d.Field(Indexed("RTVFormats", i), a.RTVFormats[i], b.RTVFormats[i]);
+	d.Field("DSVFormat", a.DSVFormat, b.DSVFormat);
+	d.Field("SampleDesc.Count", a.SampleDesc.Count, b.SampleDesc.Count);
+	d.Field("SampleDesc.Quality", a.SampleDesc.Quality, b.SampleDesc.Quality);
+
+	d.Field("ViewInstancing.ViewInstanceCount", a.ViewInstances.size(), b.ViewInstances.size());
+	for (size_t i = 0; i < a.ViewInstances.size() && i < b.ViewInstances.size(); ++i)
+	{
+		const std::string name = Indexed("ViewInstancing.Locations", i);
+		d.Field(name + ".ViewportArrayIndex", a.ViewInstances[i].ViewportArrayIndex, b.ViewInstances[i].ViewportArrayIndex);
+		d.Field(name + ".RenderTargetArrayIndex", a.ViewInstances[i].RenderTargetArrayIndex, b.ViewInstances[i].RenderTargetArrayIndex);
+	}
+	d.Field("ViewInstancing.Flags", a.ViewInstancingFlags, b.ViewInstancingFlags);
+
+	d.Field("NodeMask", a.NodeMask, b.NodeMask);
+	d.Field("Flags", a.Flags, b.Flags);
+	return d.Diffs;
+}
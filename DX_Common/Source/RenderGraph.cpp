@@ -0,0 +1,873 @@
+#include "pch.h"
+
+#include "RenderGraph.h"
+#include "BarrierBackend.h"
+#include "ResourceStateTracker.h"
+#include "D3DUtil.h"
+
+#include <algorithm>
+#include <cassert>
+#include <queue>
+
+namespace
+{
+	// Placed resources and heaps replaced by a new layout are released only
+	// after this many more compiles, so frames still in flight can finish.
+	const UINT s_RetireFrameCount = 3;
+
+	// States a compute command list may transition to, from, or use.
+	const D3D12_RESOURCE_STATES s_ComputeQueueStates =
+		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+		D3D12_RESOURCE_STATE_COPY_DEST |
+		D3D12_RESOURCE_STATE_COPY_SOURCE;
+
+	bool IsComputeQueueState(D3D12_RESOURCE_STATES state)
+	{
+		return (state & ~s_ComputeQueueStates) == 0;
+	}
+
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	bool SameDesc(const D3D12_RESOURCE_DESC& a, const D3D12_RESOURCE_DESC& b)
+	{
+		return memcmp(&a, &b, sizeof(a)) == 0;
+	}
+
+	// Heap categories for resource heap tier 1, which cannot mix buffers,
+	// render target / depth textures and other textures in one heap.
+	enum HeapCategory
+	{
+		HeapCategory_Buffers,
+		HeapCategory_RtDsTextures,
+		HeapCategory_OtherTextures,
+		HeapCategory_Count,
+	};
+
+	const D3D12_HEAP_FLAGS s_Tier1HeapFlags[HeapCategory_Count] =
+	{
+		D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+	};
+}
+
+// == Builder / context ==
+
+RenderGraphHandle RenderGraphBuilder::Create(const std::string& name, const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue)
+{
+	RenderGraph::ResourceNode node;
+	node.Name = name;
+	node.Desc = desc;
+	if (clearValue)
+	{
+		node.HasClearValue = true;
+		node.ClearValue = *clearValue;
+	}
+	m_Graph->m_Resources.push_back(node);
+	return static_cast<RenderGraphHandle>(m_Graph->m_Resources.size() - 1);
+}
+
+RenderGraphHandle RenderGraphBuilder::Read(RenderGraphHandle resource, D3D12_RESOURCE_STATES state)
+{
+	return m_Graph->AddAccess(m_Pass, resource, state, false);
+}
+
+RenderGraphHandle RenderGraphBuilder::Write(RenderGraphHandle resource, D3D12_RESOURCE_STATES state)
+{
+	return m_Graph->AddAccess(m_Pass, resource, state, true);
+}
+
+void RenderGraphBuilder::SetSideEffect()
+{
+	m_Graph->m_Passes[m_Pass].SideEffect = true;
+}
+
+ID3D12Resource* RenderGraphContext::GetResource(RenderGraphHandle resource) const
+{
+	return m_Graph->m_Resources[resource].Resource;
+}
+
+// == Declaration ==
+
+RenderGraph::RenderGraph()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+}
+
+RenderGraph::~RenderGraph()
+{
+}
+
+RenderGraphHandle RenderGraph::ImportResource(const std::string& name, ID3D12Resource* resource,
+	D3D12_RESOURCE_STATES currentState, D3D12_RESOURCE_STATES finalState)
+{
+	assert(resource);
+
+	ResourceNode node;
+	node.Name = name;
+	node.Imported = true;
+	node.Resource = resource;
+	node.InitialState = currentState;
+	node.FinalState = finalState;
+	m_Resources.push_back(node);
+	return static_cast<RenderGraphHandle>(m_Resources.size() - 1);
+}
+
+UINT RenderGraph::AddPass(const std::string& name, RenderGraphQueue queue, const SetupFunc& setup, const ExecuteFunc& execute)
+{
+	const UINT index = static_cast<UINT>(m_Passes.size());
+
+	PassNode node;
+	node.Name = name;
+	node.RequestedQueue = queue;
+	node.Queue = RenderGraphQueue::Graphics;
+	node.Execute = execute;
+	m_Passes.push_back(std::move(node));
+
+	RenderGraphBuilder builder(this, index);
+	setup(builder);
+	return index;
+}
+
+RenderGraphHandle RenderGraph::AddAccess(UINT pass, RenderGraphHandle resource, D3D12_RESOURCE_STATES state, bool write)
+{
+	assert(resource < m_Resources.size());
+
+	for (Access& access : m_Passes[pass].Accesses)
+	{
+		if (access.Resource != resource)
+			continue;
+
+		// One state per pass, except that several read states combine.
+		assert((access.State == state || (!write && !access.Write)) && "conflicting states for one resource in one pass");
+		access.State = access.State | state;
+		access.Read = access.Read || !write;
+		access.Write = access.Write || write;
+		return resource;
+	}
+
+	m_Passes[pass].Accesses.push_back({ resource, state, !write, write });
+	return resource;
+}
+
+void RenderGraph::Reset()
+{
+	m_Passes.clear();
+	m_Resources.clear();
+	m_Steps.clear();
+	m_Batches.clear();
+	m_EpilogueBarriers.clear();
+	m_ResourceEndStates.clear();
+	m_Compiled = false;
+}
+
+// == Compilation ==
+
+void RenderGraph::Compile(ID3D12Device* device, bool asyncComputeAvailable)
+{
+	const LARGE_INTEGER start = Now();
+
+	m_Stats = Stats();
+	m_Stats.PassesDeclared = static_cast<UINT>(m_Passes.size());
+
+	RetireObjects();
+	BuildDependencies();
+	CullPasses();
+	SortPasses(asyncComputeAvailable);
+	AllocateTransients(device);
+	AssignQueues(asyncComputeAvailable);
+	PlaceBarriers();
+
+	m_Compiled = true;
+	m_Stats.CompileMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+}
+
+void RenderGraph::BuildDependencies()
+{
+	std::vector<int> lastWriter(m_Resources.size(), -1);
+	std::vector<std::vector<UINT>> readers(m_Resources.size());
+
+	for (UINT i = 0; i < m_Passes.size(); ++i)
+	{
+		PassNode& pass = m_Passes[i];
+		pass.Dependencies.clear();
+		pass.Producers.clear();
+
+		// Read-after-write
+		for (const Access& access : pass.Accesses)
+		{
+			const int writer = lastWriter[access.Resource];
+			if (access.Read && writer >= 0)
+			{
+				pass.Producers.push_back(writer);
+				pass.Dependencies.push_back(writer);
+			}
+		}
+
+		// Write-after-write and write-after-read
+		for (const Access& access : pass.Accesses)
+		{
+			if (!access.Write)
+				continue;
+
+			const int writer = lastWriter[access.Resource];
+			if (writer >= 0 && writer != static_cast<int>(i))
+				pass.Dependencies.push_back(writer);
+			for (UINT reader : readers[access.Resource])
+			{
+				if (reader != i)
+					pass.Dependencies.push_back(reader);
+			}
+			readers[access.Resource].clear();
+			lastWriter[access.Resource] = i;
+		}
+
+		for (const Access& access : pass.Accesses)
+		{
+			if (access.Read && !access.Write)
+				readers[access.Resource].push_back(i);
+		}
+
+		std::sort(pass.Dependencies.begin(), pass.Dependencies.end());
+		pass.Dependencies.erase(std::unique(pass.Dependencies.begin(), pass.Dependencies.end()), pass.Dependencies.end());
+		std::sort(pass.Producers.begin(), pass.Producers.end());
+		pass.Producers.erase(std::unique(pass.Producers.begin(), pass.Producers.end()), pass.Producers.end());
+	}
+}
+
+void RenderGraph::CullPasses()
+{
+	// Producers always come earlier in declaration order, so one backwards
+	// sweep reaches everything the roots depend on.
+	std::vector<bool> alive(m_Passes.size(), false);
+	for (size_t i = m_Passes.size(); i-- > 0;)
+	{
+		PassNode& pass = m_Passes[i];
+
+		bool root = pass.SideEffect;
+		for (const Access& access : pass.Accesses)
+			root = root || (access.Write && m_Resources[access.Resource].Imported);
+
+		if (root)
+			alive[i] = true;
+		if (alive[i])
+		{
+			for (UINT producer : pass.Producers)
+				alive[producer] = true;
+		}
+
+		pass.Culled = !alive[i];
+		if (pass.Culled)
+			m_Stats.PassesCulled++;
+	}
+}
+
+void RenderGraph::SortPasses(bool asyncComputeAvailable)
+{
+	// Kahn's algorithm over the kept passes. Among the passes that are ready,
+	// async compute goes first (so it overlaps more graphics work), then
+	// declaration order.
+	const UINT passCount = static_cast<UINT>(m_Passes.size());
+	std::vector<UINT> inDegree(passCount, 0);
+	std::vector<std::vector<UINT>> successors(passCount);
+	for (UINT i = 0; i < passCount; ++i)
+	{
+		if (m_Passes[i].Culled)
+			continue;
+		for (UINT dependency : m_Passes[i].Dependencies)
+		{
+			if (m_Passes[dependency].Culled)
+				continue;
+			successors[dependency].push_back(i);
+			inDegree[i]++;
+		}
+	}
+
+	auto priority = [&](UINT pass)
+	{
+		const bool compute = asyncComputeAvailable && m_Passes[pass].RequestedQueue == RenderGraphQueue::AsyncCompute;
+		return std::make_pair(compute ? 0u : 1u, pass);
+	};
+	auto later = [&](UINT a, UINT b) { return priority(a) > priority(b); };
+	std::priority_queue<UINT, std::vector<UINT>, decltype(later)> ready(later);
+
+	for (UINT i = 0; i < passCount; ++i)
+	{
+		if (!m_Passes[i].Culled && inDegree[i] == 0)
+			ready.push(i);
+	}
+
+	m_Steps.clear();
+	while (!ready.empty())
+	{
+		const UINT pass = ready.top();
+		ready.pop();
+
+		Step step;
+		step.Pass = pass;
+		m_Steps.push_back(step);
+
+		for (UINT successor : successors[pass])
+		{
+			if (--inDegree[successor] == 0)
+				ready.push(successor);
+		}
+	}
+	assert(m_Steps.size() == passCount - m_Stats.PassesCulled);
+
+	// Resource lifetimes in sorted positions
+	for (ResourceNode& resource : m_Resources)
+	{
+		resource.FirstUse = -1;
+		resource.LastUse = -1;
+		resource.UsedOnCompute = false;
+		resource.HeapOffset = 0;
+		resource.Aliased = false;
+		resource.Physical = -1;
+	}
+	for (UINT s = 0; s < m_Steps.size(); ++s)
+	{
+		const PassNode& pass = m_Passes[m_Steps[s].Pass];
+		const bool compute = asyncComputeAvailable && pass.RequestedQueue == RenderGraphQueue::AsyncCompute;
+		for (const Access& access : pass.Accesses)
+		{
+			ResourceNode& resource = m_Resources[access.Resource];
+			if (resource.FirstUse < 0)
+				resource.FirstUse = s;
+			resource.LastUse = s;
+			resource.UsedOnCompute = resource.UsedOnCompute || compute;
+		}
+	}
+}
+
+void RenderGraph::AllocateTransients(ID3D12Device* device)
+{
+	struct Candidate
+	{
+		RenderGraphHandle Handle;
+		UINT64 Size;
+		UINT64 Alignment;
+		UINT Category;
+		int Begin;
+		int End;
+		UINT64 Offset;
+	};
+
+	m_HasPhysicalResources = device != nullptr;
+	if (!device && !m_AllocationInfo)
+	{
+		// Logical compile only: assume fresh resources created in COMMON.
+		for (ResourceNode& resource : m_Resources)
+		{
+			if (!resource.Imported && resource.FirstUse >= 0)
+				m_Stats.TransientResources++;
+		}
+		return;
+	}
+
+	// Without a device the layout is only planned, as for tier 2.
+	bool mixedHeaps = true;
+	if (device)
+	{
+		D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+		ThrowIfFailed(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+		mixedHeaps = options.ResourceHeapTier >= D3D12_RESOURCE_HEAP_TIER_2;
+	}
+
+	std::vector<Candidate> candidates;
+	for (UINT i = 0; i < m_Resources.size(); ++i)
+	{
+		ResourceNode& resource = m_Resources[i];
+		if (resource.Imported || resource.FirstUse < 0)
+			continue;
+
+		const D3D12_RESOURCE_ALLOCATION_INFO info = device ?
+			device->GetResourceAllocationInfo(0, 1, &resource.Desc) : m_AllocationInfo(resource.Desc);
+
+		Candidate candidate;
+		candidate.Handle = i;
+		candidate.Size = info.SizeInBytes;
+		candidate.Alignment = info.Alignment;
+		if (mixedHeaps || resource.Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			candidate.Category = HeapCategory_Buffers; // tier 2: everything shares category 0
+		else if (resource.Desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+			candidate.Category = HeapCategory_RtDsTextures;
+		else
+			candidate.Category = HeapCategory_OtherTextures;
+
+		// Queues run concurrently, so memory used on async compute is not
+		// shared with anything: it gets a lifetime spanning the whole frame.
+		candidate.Begin = resource.UsedOnCompute ? 0 : resource.FirstUse;
+		candidate.End = resource.UsedOnCompute ? static_cast<int>(m_Steps.size()) : resource.LastUse;
+		candidate.Offset = 0;
+		candidates.push_back(candidate);
+
+		m_Stats.TransientResources++;
+		m_Stats.TransientResourceBytes += info.SizeInBytes;
+	}
+
+	// Largest first, each at the lowest offset that does not collide with a
+	// resource placed earlier whose lifetime overlaps. The placed resources
+	// are kept sorted by offset, so the search is one walk that stops at the
+	// first gap that fits.
+	std::stable_sort(candidates.begin(), candidates.end(),
+		[](const Candidate& a, const Candidate& b) { return a.Size > b.Size; });
+
+	UINT64 heapSizes[HeapCategory_Count] = {};
+	UINT64 heapAlignments[HeapCategory_Count] = {};
+	std::vector<const Candidate*> placed[HeapCategory_Count];
+	for (Candidate& candidate : candidates)
+	{
+		std::vector<const Candidate*>& sameHeap = placed[candidate.Category];
+
+		UINT64 offset = 0;
+		for (const Candidate* other : sameHeap)
+		{
+			if (other->Begin > candidate.End || candidate.Begin > other->End)
+				continue; // never alive at the same time
+			if (AlignUp(offset, candidate.Alignment) + candidate.Size <= other->Offset)
+				break;
+			offset = std::max(offset, other->Offset + other->Size);
+		}
+		candidate.Offset = AlignUp(offset, candidate.Alignment);
+
+		const auto position = std::upper_bound(sameHeap.begin(), sameHeap.end(), &candidate,
+			[](const Candidate* a, const Candidate* b) { return a->Offset < b->Offset; });
+		sameHeap.insert(position, &candidate);
+
+		heapSizes[candidate.Category] = std::max(heapSizes[candidate.Category], candidate.Offset + candidate.Size);
+		heapAlignments[candidate.Category] = std::max(heapAlignments[candidate.Category], candidate.Alignment);
+	}
+
+	// Heaps are created per category actually used; map categories to heap slots.
+	int heapSlots[HeapCategory_Count];
+	UINT heapCount = 0;
+	for (UINT c = 0; c < HeapCategory_Count; ++c)
+	{
+		heapSlots[c] = heapSizes[c] > 0 ? static_cast<int>(heapCount++) : -1;
+		m_Stats.TransientHeapBytes += heapSizes[c];
+	}
+
+	// A resource needs an aliasing barrier if any other resource shares its
+	// memory. In offset order that means it starts before an earlier one
+	// ends, or the next one starts before it ends.
+	for (const std::vector<const Candidate*>& sameHeap : placed)
+	{
+		UINT64 end = 0;
+		for (size_t i = 0; i < sameHeap.size(); ++i)
+		{
+			const Candidate& candidate = *sameHeap[i];
+			ResourceNode& resource = m_Resources[candidate.Handle];
+			resource.HeapOffset = candidate.Offset;
+			resource.Aliased = (i > 0 && candidate.Offset < end) ||
+				(i + 1 < sameHeap.size() && sameHeap[i + 1]->Offset < candidate.Offset + candidate.Size);
+			end = std::max(end, candidate.Offset + candidate.Size);
+		}
+	}
+	if (!device)
+		return;
+
+	std::vector<PhysicalResource> layout(candidates.size());
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		const Candidate& candidate = candidates[i];
+		const ResourceNode& resource = m_Resources[candidate.Handle];
+
+		PhysicalResource& physical = layout[i];
+		physical.Desc = resource.Desc;
+		physical.HasClearValue = resource.HasClearValue;
+		physical.ClearValue = resource.ClearValue;
+		physical.Heap = static_cast<UINT>(heapSlots[candidate.Category]);
+		physical.Offset = candidate.Offset;
+		physical.State = D3D12_RESOURCE_STATE_COMMON;
+	}
+
+	// Reuse last frame's heaps and resources if nothing changed.
+	bool reuse = layout.size() == m_Physical.size() && heapCount == m_Heaps.size();
+	for (size_t i = 0; i < layout.size() && reuse; ++i)
+	{
+		const PhysicalResource& a = layout[i];
+		const PhysicalResource& b = m_Physical[i];
+		reuse = SameDesc(a.Desc, b.Desc) && a.Heap == b.Heap && a.Offset == b.Offset &&
+			a.HasClearValue == b.HasClearValue &&
+			(!a.HasClearValue || memcmp(&a.ClearValue, &b.ClearValue, sizeof(a.ClearValue)) == 0);
+	}
+	for (UINT h = 0; h < heapCount && reuse; ++h)
+	{
+		// Heap sizes follow from the offsets, but check anyway.
+		for (UINT c = 0; c < HeapCategory_Count; ++c)
+		{
+			if (heapSlots[c] == static_cast<int>(h))
+				reuse = reuse && m_Heaps[h]->GetDesc().SizeInBytes >= heapSizes[c];
+		}
+	}
+
+	if (!reuse)
+	{
+		for (PhysicalResource& physical : m_Physical)
+			m_Retired.push_back({ physical.Resource, s_RetireFrameCount });
+		for (auto& heap : m_Heaps)
+			m_Retired.push_back({ heap, s_RetireFrameCount });
+		m_Physical.clear();
+		m_Heaps.clear();
+
+		m_Heaps.resize(heapCount);
+		for (UINT c = 0; c < HeapCategory_Count; ++c)
+		{
+			if (heapSlots[c] < 0)
+				continue;
+
+			D3D12_HEAP_DESC heapDesc = {};
+			heapDesc.SizeInBytes = AlignUp(heapSizes[c], D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+			heapDesc.Alignment = std::max<UINT64>(heapAlignments[c], D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			heapDesc.Flags = mixedHeaps ? D3D12_HEAP_FLAG_NONE : s_Tier1HeapFlags[c];
+			ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&m_Heaps[heapSlots[c]])));
+		}
+
+		for (PhysicalResource& physical : layout)
+		{
+			ThrowIfFailed(device->CreatePlacedResource(
+				m_Heaps[physical.Heap].Get(),
+				physical.Offset,
+				&physical.Desc,
+				physical.State,
+				physical.HasClearValue ? &physical.ClearValue : nullptr,
+				IID_PPV_ARGS(&physical.Resource)));
+		}
+		m_Physical = std::move(layout);
+	}
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		ResourceNode& resource = m_Resources[candidates[i].Handle];
+		resource.Physical = static_cast<int>(i);
+		resource.Resource = m_Physical[i].Resource.Get();
+		resource.InitialState = m_Physical[i].State;
+	}
+}
+
+void RenderGraph::AssignQueues(bool asyncComputeAvailable)
+{
+	// A pass runs on async compute only if every state it uses is legal on a
+	// compute list, and any transition into those states that a compute list
+	// could not record can be recorded on graphics right after the resource's
+	// last use. That last use must therefore be on graphics.
+	std::vector<D3D12_RESOURCE_STATES> states(m_Resources.size());
+	std::vector<bool> lastUseOnGraphics(m_Resources.size(), false);
+	for (size_t i = 0; i < m_Resources.size(); ++i)
+		states[i] = m_Resources[i].InitialState;
+
+	m_Batches.clear();
+	for (UINT s = 0; s < m_Steps.size(); ++s)
+	{
+		PassNode& pass = m_Passes[m_Steps[s].Pass];
+
+		bool compute = asyncComputeAvailable && pass.RequestedQueue == RenderGraphQueue::AsyncCompute;
+		for (const Access& access : pass.Accesses)
+		{
+			if (!compute)
+				break;
+
+			const D3D12_RESOURCE_STATES current = states[access.Resource];
+			if (!IsComputeQueueState(access.State))
+				compute = false;
+			else if (!ResourceStateTracker::IsStateCompatible(current, access.State) &&
+				!IsComputeQueueState(current) && !lastUseOnGraphics[access.Resource])
+				compute = false;
+		}
+		pass.Queue = compute ? RenderGraphQueue::AsyncCompute : RenderGraphQueue::Graphics;
+		if (compute)
+			m_Stats.AsyncComputePasses++;
+
+		for (const Access& access : pass.Accesses)
+		{
+			if (!ResourceStateTracker::IsStateCompatible(states[access.Resource], access.State))
+				states[access.Resource] = access.State;
+			lastUseOnGraphics[access.Resource] = !compute;
+		}
+
+		if (m_Batches.empty() || m_Batches.back().Queue != pass.Queue)
+		{
+			Batch batch;
+			batch.Queue = pass.Queue;
+			batch.FirstStep = s;
+			batch.StepCount = 0;
+			m_Batches.push_back(batch);
+		}
+		m_Batches.back().StepCount++;
+		pass.Batch = static_cast<UINT>(m_Batches.size() - 1);
+	}
+}
+
+void RenderGraph::AddWait(UINT consumerBatch, UINT producerBatch)
+{
+	if (m_Batches[consumerBatch].Queue == m_Batches[producerBatch].Queue)
+		return; // same queue: already ordered
+
+	std::vector<UINT>& waits = m_Batches[consumerBatch].Waits;
+	if (std::find(waits.begin(), waits.end(), producerBatch) == waits.end())
+		waits.push_back(producerBatch);
+}
+
+void RenderGraph::PlaceBarriers()
+{
+	auto makeTransition = [](RenderGraphHandle resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after, D3D12_RESOURCE_BARRIER_FLAGS flags)
+	{
+		BarrierOp op = { D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, resource, before, after, flags };
+		return op;
+	};
+	auto stepBatch = [&](int step) { return m_Passes[m_Steps[step].Pass].Batch; };
+
+	std::vector<int> lastUse(m_Resources.size(), -1);
+	m_ResourceEndStates.resize(m_Resources.size());
+	for (size_t i = 0; i < m_Resources.size(); ++i)
+		m_ResourceEndStates[i] = m_Resources[i].InitialState;
+	std::vector<D3D12_RESOURCE_STATES>& states = m_ResourceEndStates;
+
+	// Cross-queue execution dependencies
+	for (UINT s = 0; s < m_Steps.size(); ++s)
+	{
+		const PassNode& pass = m_Passes[m_Steps[s].Pass];
+		for (UINT dependency : pass.Dependencies)
+		{
+			if (!m_Passes[dependency].Culled)
+				AddWait(pass.Batch, m_Passes[dependency].Batch);
+		}
+	}
+
+	for (UINT s = 0; s < m_Steps.size(); ++s)
+	{
+		Step& step = m_Steps[s];
+		const PassNode& pass = m_Passes[step.Pass];
+		const Batch& batch = m_Batches[pass.Batch];
+
+		for (const Access& access : pass.Accesses)
+		{
+			const RenderGraphHandle handle = access.Resource;
+			const ResourceNode& resource = m_Resources[handle];
+			D3D12_RESOURCE_STATES& current = states[handle];
+			const int previous = lastUse[handle];
+			lastUse[handle] = s;
+
+			// First use of memory another transient may have used: the old
+			// contents are garbage and the hardware metadata must be reset.
+			const bool firstAliasedUse = !resource.Imported && static_cast<int>(s) == resource.FirstUse &&
+				resource.Aliased;
+			if (firstAliasedUse)
+			{
+				step.Barriers.push_back({ D3D12_RESOURCE_BARRIER_TYPE_ALIASING, handle, current, current, D3D12_RESOURCE_BARRIER_FLAG_NONE });
+				m_Stats.AliasingBarriers++;
+			}
+
+			if (!ResourceStateTracker::IsStateCompatible(current, access.State))
+			{
+				m_Stats.Transitions++;
+
+				if (pass.Queue == RenderGraphQueue::AsyncCompute && !IsComputeQueueState(current))
+				{
+					// A compute list cannot leave this state. AssignQueues made
+					// sure the resource's last use was on graphics, so record
+					// the transition there, right after that use.
+					assert(previous >= 0);
+					const UINT producerBatch = stepBatch(previous);
+					assert(m_Batches[producerBatch].Queue == RenderGraphQueue::Graphics);
+					const BarrierOp op = makeTransition(handle, current, access.State, D3D12_RESOURCE_BARRIER_FLAG_NONE);
+					if (previous + 1 < static_cast<int>(m_Steps.size()) && stepBatch(previous + 1) == producerBatch)
+						m_Steps[previous + 1].Barriers.push_back(op);
+					else
+						m_Batches[producerBatch].TailBarriers.push_back(op);
+					AddWait(pass.Batch, producerBatch);
+				}
+				else
+				{
+					// Readers on the other queue must be done before the state changes.
+					if (previous >= 0)
+						AddWait(pass.Batch, stepBatch(previous));
+
+					// Begin right after the previous use when it is in this
+					// batch, otherwise at the start of the batch.
+					const int begin = (previous >= 0 && stepBatch(previous) == pass.Batch) ? previous + 1 : static_cast<int>(batch.FirstStep);
+					if (begin < static_cast<int>(s) && !firstAliasedUse)
+					{
+						m_Steps[begin].Barriers.push_back(makeTransition(handle, current, access.State, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+						step.Barriers.push_back(makeTransition(handle, current, access.State, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+						m_Stats.SplitTransitions++;
+					}
+					else
+					{
+						step.Barriers.push_back(makeTransition(handle, current, access.State, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+					}
+				}
+				current = access.State;
+			}
+
+			const D3D12_RESOURCE_FLAGS discardable =
+				D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+			if (firstAliasedUse && access.Write && resource.Desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER &&
+				(resource.Desc.Flags & discardable) &&
+				(access.State == D3D12_RESOURCE_STATE_RENDER_TARGET || access.State == D3D12_RESOURCE_STATE_DEPTH_WRITE ||
+				 access.State == D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
+			{
+				step.Discards.push_back(handle);
+			}
+		}
+	}
+
+	// Imported resources go back to the state the caller expects. That is
+	// recorded on graphics at the very end, after any outstanding compute work.
+	m_EpilogueBarriers.clear();
+	for (RenderGraphHandle i = 0; i < m_Resources.size(); ++i)
+	{
+		if (m_Resources[i].Imported && !ResourceStateTracker::IsStateCompatible(states[i], m_Resources[i].FinalState))
+		{
+			m_EpilogueBarriers.push_back(makeTransition(i, states[i], m_Resources[i].FinalState, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+			states[i] = m_Resources[i].FinalState;
+			m_Stats.Transitions++;
+		}
+	}
+
+	if (m_Batches.empty() || m_Batches.back().Queue != RenderGraphQueue::Graphics)
+	{
+		Batch batch;
+		batch.Queue = RenderGraphQueue::Graphics;
+		batch.FirstStep = static_cast<UINT>(m_Steps.size());
+		batch.StepCount = 0;
+		m_Batches.push_back(batch);
+	}
+	const UINT lastBatch = static_cast<UINT>(m_Batches.size() - 1);
+	for (UINT b = lastBatch; b-- > 0;)
+	{
+		if (m_Batches[b].Queue == RenderGraphQueue::AsyncCompute)
+		{
+			AddWait(lastBatch, b);
+			break;
+		}
+	}
+
+	m_Stats.Batches = static_cast<UINT>(m_Batches.size());
+}
+
+void RenderGraph::RetireObjects()
+{
+	for (size_t i = 0; i < m_Retired.size();)
+	{
+		if (--m_Retired[i].FramesLeft == 0)
+		{
+			m_Retired[i] = m_Retired.back();
+			m_Retired.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+// == Execution ==
+
+void RenderGraph::RecordBarriers(ID3D12GraphicsCommandList* commandList, const std::vector<BarrierOp>& ops, BarrierBackend* backend)
+{
+	if (ops.empty())
+		return;
+
+	m_BarrierScratch.clear();
+	for (const BarrierOp& op : ops)
+	{
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = op.Type;
+		barrier.Flags = op.Flags;
+		if (op.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING)
+		{
+			barrier.Aliasing.pResourceBefore = nullptr; // whatever used the memory before
+			barrier.Aliasing.pResourceAfter = m_Resources[op.Resource].Resource;
+		}
+		else
+		{
+			barrier.Transition.pResource = m_Resources[op.Resource].Resource;
+			barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+			barrier.Transition.StateBefore = op.StateBefore;
+			barrier.Transition.StateAfter = op.StateAfter;
+		}
+		m_BarrierScratch.push_back(barrier);
+	}
+
+	if (backend)
+		backend->Record(commandList, static_cast<UINT>(m_BarrierScratch.size()), m_BarrierScratch.data());
+	else
+		commandList->ResourceBarrier(static_cast<UINT>(m_BarrierScratch.size()), m_BarrierScratch.data());
+}
+
+void RenderGraph::Execute(const ExecuteParams& params)
+{
+	assert(m_Compiled && m_HasPhysicalResources && "Compile() with a device before Execute()");
+	assert(params.GraphicsQueue && params.Fence && params.FenceValue && params.AcquireCommandList);
+
+	std::vector<UINT64> signaled(m_Batches.size(), 0);
+	for (UINT b = 0; b < m_Batches.size(); ++b)
+	{
+		const Batch& batch = m_Batches[b];
+		const bool compute = batch.Queue == RenderGraphQueue::AsyncCompute;
+		ID3D12CommandQueue* queue = compute ? params.ComputeQueue : params.GraphicsQueue;
+		assert(queue);
+
+		// Batches on the other queue are signaled in order, so waiting for
+		// the latest one covers the rest.
+		UINT64 waitValue = 0;
+		for (UINT producer : batch.Waits)
+			waitValue = std::max(waitValue, signaled[producer]);
+		if (waitValue > 0)
+			ThrowIfFailed(queue->Wait(params.Fence, waitValue));
+
+		ID3D12GraphicsCommandList* commandList = params.AcquireCommandList(
+			compute ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+		RenderGraphContext context;
+		context.CommandList = commandList;
+		context.m_Graph = this;
+
+		for (UINT s = batch.FirstStep; s < batch.FirstStep + batch.StepCount; ++s)
+		{
+			const Step& step = m_Steps[s];
+			RecordBarriers(commandList, step.Barriers, params.Backend);
+			for (RenderGraphHandle discard : step.Discards)
+				commandList->DiscardResource(m_Resources[discard].Resource, nullptr);
+
+			PassNode& pass = m_Passes[step.Pass];
+			if (pass.Execute)
+				pass.Execute(context);
+		}
+		RecordBarriers(commandList, batch.TailBarriers, params.Backend);
+		if (b + 1 == m_Batches.size())
+			RecordBarriers(commandList, m_EpilogueBarriers, params.Backend);
+
+		ThrowIfFailed(commandList->Close());
+		ID3D12CommandList* cmdsLists[] = { commandList };
+		queue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+		ThrowIfFailed(queue->Signal(params.Fence, ++*params.FenceValue));
+		signaled[b] = *params.FenceValue;
+	}
+
+	// The next frame's transients start where this one left them.
+	for (size_t i = 0; i < m_Resources.size(); ++i)
+	{
+		if (m_Resources[i].Physical >= 0)
+			m_Physical[m_Resources[i].Physical].State = m_ResourceEndStates[i];
+	}
+}
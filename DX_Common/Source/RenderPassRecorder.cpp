@@ -0,0 +1,278 @@
+#include "pch.h"
+
+#include "RenderPassRecorder.h"
+#include "D3DUtil.h"
+#include "directx/d3dx12.h"
+
+#include <cassert>
+
+namespace
+{
+	// Can an attachment left with 'store' by one pass be picked up with
+	// 'load' by the next, inside the same render pass?
+	bool Continues(RenderPassStoreOp store, RenderPassLoadOp load)
+	{
+		if (store == RenderPassStoreOp::NoAccess || load == RenderPassLoadOp::NoAccess)
+			return store == RenderPassStoreOp::NoAccess && load == RenderPassLoadOp::NoAccess;
+
+		// A resolve has to happen where the first pass ends, and a clear has
+		// to happen where the second begins.
+		if (store == RenderPassStoreOp::Resolve || load == RenderPassLoadOp::Clear)
+			return false;
+
+		// Contents the first pass discards are undefined to the next one, so
+		// merging would hand a preserving pass data it must not see.
+		return store != RenderPassStoreOp::Discard || load == RenderPassLoadOp::Discard;
+	}
+
+	D3D12_RENDER_PASS_BEGINNING_ACCESS MakeBeginningAccess(RenderPassLoadOp load, const D3D12_CLEAR_VALUE& clearValue)
+	{
+		D3D12_RENDER_PASS_BEGINNING_ACCESS access = {};
+		switch (load)
+		{
+		case RenderPassLoadOp::Preserve: access.Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE; break;
+		case RenderPassLoadOp::Clear:    access.Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR; break;
+		case RenderPassLoadOp::Discard:  access.Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_DISCARD; break;
+		case RenderPassLoadOp::NoAccess: access.Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS; break;
+		}
+		if (load == RenderPassLoadOp::Clear)
+			access.Clear.ClearValue = clearValue;
+		return access;
+	}
+
+	D3D12_RENDER_PASS_ENDING_ACCESS MakeEndingAccess(RenderPassStoreOp store, const RenderPassAttachment& attachment,
+		D3D12_RENDER_PASS_ENDING_ACCESS_RESOLVE_SUBRESOURCE_PARAMETERS& resolveParameters)
+	{
+		D3D12_RENDER_PASS_ENDING_ACCESS access = {};
+		switch (store)
+		{
+		case RenderPassStoreOp::Preserve: access.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE; break;
+		case RenderPassStoreOp::Resolve:  access.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_RESOLVE; break;
+		case RenderPassStoreOp::Discard:  access.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_DISCARD; break;
+		case RenderPassStoreOp::NoAccess: access.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_NO_ACCESS; break;
+		}
+
+		if (store == RenderPassStoreOp::Resolve)
+		{
+			assert(attachment.Resource && attachment.ResolveTarget);
+			const D3D12_RESOURCE_DESC desc = attachment.Resource->GetDesc();
+
+			resolveParameters = {};
+			resolveParameters.SrcRect = { 0, 0, static_cast<LONG>(desc.Width), static_cast<LONG>(desc.Height) };
+
+			access.Resolve.pSrcResource = attachment.Resource;
+			access.Resolve.pDstResource = attachment.ResolveTarget;
+			access.Resolve.SubresourceCount = 1;
+			access.Resolve.pSubresourceParameters = &resolveParameters;
+			access.Resolve.Format = attachment.ResolveFormat;
+			access.Resolve.ResolveMode = D3D12_RESOLVE_MODE_AVERAGE;
+			access.Resolve.PreserveResolveSource = FALSE; // the samples are not needed afterwards
+		}
+		return access;
+	}
+}
+
+void RenderPassRecorder::Initialize(ID3D12Device* device)
+{
+	D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5 = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &options5, sizeof(options5))))
+		m_Tier = options5.RenderPassesTier;
+}
+
+void RenderPassRecorder::AddPass(const RenderPassDesc& desc, const RecordFunc& record)
+{
+	Pass pass;
+	pass.Desc = desc;
+	pass.Records.push_back(record);
+	m_Passes.push_back(std::move(pass));
+	m_Stats.PassesAdded++;
+}
+
+bool RenderPassRecorder::CanMerge(const RenderPassDesc& first, const RenderPassDesc& second)
+{
+	if (first.NumRenderTargets != second.NumRenderTargets ||
+		first.HasDepthStencil != second.HasDepthStencil ||
+		first.Flags != second.Flags)
+		return false;
+
+	for (UINT i = 0; i < first.NumRenderTargets; ++i)
+	{
+		const RenderPassAttachment& a = first.RenderTargets[i];
+		const RenderPassAttachment& b = second.RenderTargets[i];
+		if (a.View.ptr != b.View.ptr || !Continues(a.Store, b.Load))
+			return false;
+	}
+
+	if (first.HasDepthStencil)
+	{
+		const RenderPassAttachment& a = first.DepthStencil;
+		const RenderPassAttachment& b = second.DepthStencil;
+		if (a.View.ptr != b.View.ptr ||
+			!Continues(a.Store, b.Load) ||
+			!Continues(first.StencilStore, second.StencilLoad))
+			return false;
+	}
+	return true;
+}
+
+RenderPassDesc RenderPassRecorder::Merge(const RenderPassDesc& first, const RenderPassDesc& second)
+{
+	assert(CanMerge(first, second));
+
+	RenderPassDesc merged = first;
+	for (UINT i = 0; i < merged.NumRenderTargets; ++i)
+	{
+		merged.RenderTargets[i].Store = second.RenderTargets[i].Store;
+		merged.RenderTargets[i].ResolveTarget = second.RenderTargets[i].ResolveTarget;
+		merged.RenderTargets[i].ResolveFormat = second.RenderTargets[i].ResolveFormat;
+	}
+	if (merged.HasDepthStencil)
+	{
+		merged.DepthStencil.Store = second.DepthStencil.Store;
+		merged.DepthStencil.ResolveTarget = second.DepthStencil.ResolveTarget;
+		merged.DepthStencil.ResolveFormat = second.DepthStencil.ResolveFormat;
+		merged.StencilStore = second.StencilStore;
+	}
+	return merged;
+}
+
+void RenderPassRecorder::Flush(ID3D12GraphicsCommandList* commandList)
+{
+	if (m_Passes.empty())
+		return;
+
+	// Fold each pass into the previous one when it only continues it.
+	std::vector<Pass> merged;
+	merged.reserve(m_Passes.size());
+	for (Pass& pass : m_Passes)
+	{
+		if (!merged.empty() && CanMerge(merged.back().Desc, pass.Desc))
+		{
+			Pass& previous = merged.back();
+			previous.Desc = Merge(previous.Desc, pass.Desc);
+			previous.Records.insert(previous.Records.end(), pass.Records.begin(), pass.Records.end());
+		}
+		else
+		{
+			merged.push_back(std::move(pass));
+		}
+	}
+	m_Passes.clear();
+
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList4> commandList4;
+	commandList->QueryInterface(IID_PPV_ARGS(&commandList4));
+
+	for (const Pass& pass : merged)
+	{
+		if (commandList4)
+			RecordNative(commandList4.Get(), pass);
+		else
+			RecordEmulated(commandList, pass);
+		m_Stats.RenderPassesRecorded++;
+	}
+}
+
+void RenderPassRecorder::RecordNative(ID3D12GraphicsCommandList4* commandList, const Pass& pass)
+{
+	const RenderPassDesc& desc = pass.Desc;
+
+	D3D12_RENDER_PASS_RENDER_TARGET_DESC renderTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	D3D12_RENDER_PASS_ENDING_ACCESS_RESOLVE_SUBRESOURCE_PARAMETERS resolves[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT + 1];
+	for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+	{
+		const RenderPassAttachment& attachment = desc.RenderTargets[i];
+		renderTargets[i].cpuDescriptor = attachment.View;
+		renderTargets[i].BeginningAccess = MakeBeginningAccess(attachment.Load, attachment.ClearValue);
+		renderTargets[i].EndingAccess = MakeEndingAccess(attachment.Store, attachment, resolves[i]);
+	}
+
+	D3D12_RENDER_PASS_DEPTH_STENCIL_DESC depthStencil = {};
+	if (desc.HasDepthStencil)
+	{
+		const RenderPassAttachment& attachment = desc.DepthStencil;
+		assert(attachment.Store != RenderPassStoreOp::Resolve && "only render targets are resolved");
+
+		D3D12_RENDER_PASS_ENDING_ACCESS_RESOLVE_SUBRESOURCE_PARAMETERS& unused = resolves[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		depthStencil.cpuDescriptor = attachment.View;
+		depthStencil.DepthBeginningAccess = MakeBeginningAccess(attachment.Load, attachment.ClearValue);
+		depthStencil.StencilBeginningAccess = MakeBeginningAccess(desc.StencilLoad, attachment.ClearValue);
+		depthStencil.DepthEndingAccess = MakeEndingAccess(attachment.Store, attachment, unused);
+		depthStencil.StencilEndingAccess = MakeEndingAccess(desc.StencilStore, attachment, unused);
+	}
+
+	commandList->BeginRenderPass(desc.NumRenderTargets, renderTargets, desc.HasDepthStencil ? &depthStencil : nullptr, desc.Flags);
+	for (const RecordFunc& record : pass.Records)
+		record(commandList);
+	commandList->EndRenderPass();
+}
+
+void RenderPassRecorder::RecordEmulated(ID3D12GraphicsCommandList* commandList, const Pass& pass)
+{
+	const RenderPassDesc& desc = pass.Desc;
+
+	// == Begin: bind, then clear or discard ==
+	D3D12_CPU_DESCRIPTOR_HANDLE rtvs[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+		rtvs[i] = desc.RenderTargets[i].View;
+	commandList->OMSetRenderTargets(desc.NumRenderTargets, rtvs, FALSE, desc.HasDepthStencil ? &desc.DepthStencil.View : nullptr);
+
+	for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+	{
+		const RenderPassAttachment& attachment = desc.RenderTargets[i];
+		if (attachment.Load == RenderPassLoadOp::Clear)
+			commandList->ClearRenderTargetView(attachment.View, attachment.ClearValue.Color, 0, nullptr);
+		else if (attachment.Load == RenderPassLoadOp::Discard && attachment.Resource)
+			commandList->DiscardResource(attachment.Resource, nullptr);
+	}
+
+	if (desc.HasDepthStencil)
+	{
+		const RenderPassAttachment& attachment = desc.DepthStencil;
+		UINT clearFlags = 0;
+		if (attachment.Load == RenderPassLoadOp::Clear)
+			clearFlags |= D3D12_CLEAR_FLAG_DEPTH;
+		if (desc.StencilLoad == RenderPassLoadOp::Clear)
+			clearFlags |= D3D12_CLEAR_FLAG_STENCIL;
+
+		if (clearFlags != 0)
+		{
+			commandList->ClearDepthStencilView(attachment.View, static_cast<D3D12_CLEAR_FLAGS>(clearFlags),
+				attachment.ClearValue.DepthStencil.Depth, attachment.ClearValue.DepthStencil.Stencil, 0, nullptr);
+		}
+		else if (attachment.Load == RenderPassLoadOp::Discard && attachment.Resource &&
+			(desc.StencilLoad == RenderPassLoadOp::Discard || desc.StencilLoad == RenderPassLoadOp::NoAccess))
+		{
+			commandList->DiscardResource(attachment.Resource, nullptr);
+		}
+	}
+
+	for (const RecordFunc& record : pass.Records)
+		record(commandList);
+
+	// == End: resolve or discard ==
+	for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+	{
+		const RenderPassAttachment& attachment = desc.RenderTargets[i];
+		if (attachment.Store == RenderPassStoreOp::Resolve)
+		{
+			assert(attachment.Resource && attachment.ResolveTarget);
+			auto toSource = CD3DX12_RESOURCE_BARRIER::Transition(attachment.Resource,
+				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_RESOLVE_SOURCE);
+			commandList->ResourceBarrier(1, &toSource);
+			commandList->ResolveSubresource(attachment.ResolveTarget, 0, attachment.Resource, 0, attachment.ResolveFormat);
+			auto toTarget = CD3DX12_RESOURCE_BARRIER::Transition(attachment.Resource,
+				D3D12_RESOURCE_STATE_RESOLVE_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			commandList->ResourceBarrier(1, &toTarget);
+		}
+		else if (attachment.Store == RenderPassStoreOp::Discard && attachment.Resource)
+		{
+			commandList->DiscardResource(attachment.Resource, nullptr);
+		}
+	}
+
+	if (desc.HasDepthStencil && desc.DepthStencil.Store == RenderPassStoreOp::Discard && desc.DepthStencil.Resource &&
+		(desc.StencilStore == RenderPassStoreOp::Discard || desc.StencilStore == RenderPassStoreOp::NoAccess))
+	{
+		commandList->DiscardResource(desc.DepthStencil.Resource, nullptr);
+	}
+}
@@ -0,0 +1,364 @@
+#include "pch.h"
+
+#include "ResourceStateTracker.h"
+#include "BarrierBackend.h"
+#include "D3DUtil.h"
+
+#include <cassert>
+
+std::mutex ResourceStateTracker::s_GlobalMutex;
+std::unordered_map<ID3D12Resource*, std::vector<D3D12_RESOURCE_STATES>> ResourceStateTracker::s_GlobalStates;
+
+namespace
+{
+	// Marks a subresource this list has not touched yet.
+	const D3D12_RESOURCE_STATES s_UnknownState = static_cast<D3D12_RESOURCE_STATES>(-1);
+
+	// States that only read. A resource may be in several of them at once.
+	const D3D12_RESOURCE_STATES s_ReadOnlyStates =
+		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+		D3D12_RESOURCE_STATE_INDEX_BUFFER |
+		D3D12_RESOURCE_STATE_DEPTH_READ |
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+		D3D12_RESOURCE_STATE_COPY_SOURCE |
+		D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+
+	UINT GetPlaneCount(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+			return 2; // depth and stencil are separate planes
+		default:
+			return 1;
+		}
+	}
+
+	UINT GetSubresourceCount(ID3D12Resource* resource)
+	{
+		D3D12_RESOURCE_DESC desc = resource->GetDesc();
+		if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			return 1;
+
+		const UINT arraySize = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : desc.DepthOrArraySize;
+		return desc.MipLevels * arraySize * GetPlaneCount(desc.Format);
+	}
+
+	D3D12_RESOURCE_BARRIER MakeTransition(ID3D12Resource* resource, UINT subresource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+	{
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		barrier.Transition.pResource = resource;
+		barrier.Transition.Subresource = subresource;
+		barrier.Transition.StateBefore = before;
+		barrier.Transition.StateAfter = after;
+		return barrier;
+	}
+
+	// Appends the transitions that take 'from' to 'to' for every subresource
+	// where 'to' is known and differs. Uses a single ALL_SUBRESOURCES barrier
+	// when every subresource makes the same transition.
+	void AppendTransitions(
+		ID3D12Resource* resource,
+		const std::vector<D3D12_RESOURCE_STATES>& from,
+		const std::vector<D3D12_RESOURCE_STATES>& to,
+		std::vector<D3D12_RESOURCE_BARRIER>& barriers)
+	{
+		const size_t count = from.size();
+
+		bool uniform = true;
+		for (size_t i = 0; i < count && uniform; ++i)
+			uniform = to[i] != s_UnknownState && from[i] == from[0] && to[i] == to[0];
+
+		if (uniform)
+		{
+			if (from[0] != to[0])
+				barriers.push_back(MakeTransition(resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, from[0], to[0]));
+			return;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (to[i] != s_UnknownState && from[i] != to[i])
+				barriers.push_back(MakeTransition(resource, static_cast<UINT>(i), from[i], to[i]));
+		}
+	}
+}
+
+bool ResourceStateTracker::IsStateCompatible(D3D12_RESOURCE_STATES current, D3D12_RESOURCE_STATES wanted)
+{
+	if (current == wanted)
+		return true;
+
+	const bool bothReadOnly = wanted != 0 && (current & ~s_ReadOnlyStates) == 0 && (wanted & ~s_ReadOnlyStates) == 0;
+	return bothReadOnly && (current & wanted) == wanted;
+}
+
+void ResourceStateTracker::RegisterResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES initialState)
+{
+	assert(resource);
+	std::lock_guard<std::mutex> lock(s_GlobalMutex);
+	s_GlobalStates[resource].assign(GetSubresourceCount(resource), initialState);
+}
+
+void ResourceStateTracker::UnregisterResource(ID3D12Resource* resource)
+{
+	std::lock_guard<std::mutex> lock(s_GlobalMutex);
+	s_GlobalStates.erase(resource);
+}
+
+void ResourceStateTracker::Lock()
+{
+	s_GlobalMutex.lock();
+}
+
+void ResourceStateTracker::Unlock()
+{
+	s_GlobalMutex.unlock();
+}
+
+ResourceStateTracker::LocalState& ResourceStateTracker::GetLocalState(ID3D12Resource* resource)
+{
+	auto it = m_LocalStates.find(resource);
+	if (it != m_LocalStates.end())
+		return it->second;
+
+	const UINT count = GetSubresourceCount(resource);
+	LocalState& state = m_LocalStates[resource];
+	state.Current.assign(count, s_UnknownState);
+	state.Pending.assign(count, s_UnknownState);
+	state.Transitioned.assign(count, false);
+	return state;
+}
+
+void ResourceStateTracker::TransitionResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, UINT subresource)
+{
+	assert(resource);
+	m_Stats.TransitionsRequested++;
+
+	LocalState& state = GetLocalState(resource);
+	const UINT count = static_cast<UINT>(state.Current.size());
+
+	UINT first = subresource;
+	UINT last = subresource;
+	if (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+	{
+		first = 0;
+		last = count - 1;
+
+		// Whole resource in one known, uniform state: one barrier covers it.
+		const D3D12_RESOURCE_STATES current = state.Current[0];
+		bool uniform = current != s_UnknownState;
+		for (UINT i = 1; i < count && uniform; ++i)
+			uniform = state.Current[i] == current;
+
+		if (uniform)
+		{
+			if (IsStateCompatible(current, stateAfter))
+			{
+				m_Stats.TransitionsSkipped++;
+				return;
+			}
+			QueueTransition(resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, current, stateAfter);
+			state.Current.assign(count, stateAfter);
+			state.Transitioned.assign(count, true);
+			return;
+		}
+	}
+	assert(last < count);
+
+	for (UINT i = first; i <= last; ++i)
+	{
+		D3D12_RESOURCE_STATES& current = state.Current[i];
+		if (current == s_UnknownState)
+		{
+			// First use in this list: resolved against the global state at submission.
+			state.Pending[i] = stateAfter;
+			current = stateAfter;
+		}
+		else if (!IsStateCompatible(current, stateAfter))
+		{
+			QueueTransition(resource, i, current, stateAfter);
+			current = stateAfter;
+			state.Transitioned[i] = true;
+		}
+		else
+		{
+			m_Stats.TransitionsSkipped++;
+		}
+	}
+}
+
+void ResourceStateTracker::QueueTransition(ID3D12Resource* resource, UINT subresource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+{
+	// A queued transition of the same subresource has not executed yet, so
+	// the two can be folded into one (A->B + B->C = A->C). Stop at anything
+	// that must stay ordered with it.
+	for (size_t i = m_Barriers.size(); i-- > 0;)
+	{
+		D3D12_RESOURCE_BARRIER& queued = m_Barriers[i];
+		if (queued.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV &&
+			(queued.UAV.pResource == nullptr || queued.UAV.pResource == resource))
+			break;
+		if (queued.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING)
+			break;
+		if (queued.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION || queued.Transition.pResource != resource)
+			continue;
+		if (queued.Transition.Subresource != subresource)
+			break; // mixed whole/partial transitions must keep their order
+
+		assert(queued.Transition.StateAfter == before);
+		m_Stats.TransitionsMerged++;
+		if (queued.Transition.StateBefore == after)
+			m_Barriers.erase(m_Barriers.begin() + i);
+		else
+			queued.Transition.StateAfter = after;
+		return;
+	}
+
+	m_Barriers.push_back(MakeTransition(resource, subresource, before, after));
+}
+
+void ResourceStateTracker::UAVBarrier(ID3D12Resource* resource)
+{
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	barrier.UAV.pResource = resource;
+	m_Barriers.push_back(barrier);
+}
+
+void ResourceStateTracker::AliasBarrier(ID3D12Resource* resourceBefore, ID3D12Resource* resourceAfter)
+{
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+	barrier.Aliasing.pResourceBefore = resourceBefore;
+	barrier.Aliasing.pResourceAfter = resourceAfter;
+	m_Barriers.push_back(barrier);
+}
+
+void ResourceStateTracker::FlushBarriers(ID3D12GraphicsCommandList* commandList)
+{
+	if (m_Barriers.empty())
+		return;
+
+	RecordBarriers(commandList, m_Barriers);
+	m_Barriers.clear();
+}
+
+void ResourceStateTracker::FlushBarriers(std::vector<D3D12_RESOURCE_BARRIER>& barriers)
+{
+	if (m_Barriers.empty())
+		return;
+
+	barriers.insert(barriers.end(), m_Barriers.begin(), m_Barriers.end());
+	m_Stats.BarriersRecorded += m_Barriers.size();
+	m_Stats.BarrierBatches++;
+	m_Barriers.clear();
+}
+
+void ResourceStateTracker::RecordBarriers(ID3D12GraphicsCommandList* commandList, const std::vector<D3D12_RESOURCE_BARRIER>& barriers)
+{
+	if (m_Backend)
+		m_Backend->Record(commandList, static_cast<UINT>(barriers.size()), barriers.data());
+	else
+		commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+
+	m_Stats.BarriersRecorded += barriers.size();
+	m_Stats.BarrierBatches++;
+}
+
+bool ResourceStateTracker::IsFixupSkippable(const LocalState& state, size_t subresource, D3D12_RESOURCE_STATES global)
+{
+	return state.Pending[subresource] != s_UnknownState && !state.Transitioned[subresource] &&
+		IsStateCompatible(global, state.Pending[subresource]);
+}
+
+UINT ResourceStateTracker::FlushPendingBarriers(ID3D12GraphicsCommandList* commandList)
+{
+	// Caller holds Lock().
+	std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	const UINT count = CollectPendingBarriers(barriers);
+	if (count > 0)
+		RecordBarriers(commandList, barriers);
+	return count;
+}
+
+UINT ResourceStateTracker::FlushPendingBarriers(std::vector<D3D12_RESOURCE_BARRIER>& barriers)
+{
+	// Caller holds Lock().
+	const UINT count = CollectPendingBarriers(barriers);
+	if (count > 0)
+	{
+		m_Stats.BarriersRecorded += count;
+		m_Stats.BarrierBatches++;
+	}
+	return count;
+}
+
+UINT ResourceStateTracker::CollectPendingBarriers(std::vector<D3D12_RESOURCE_BARRIER>& barriers)
+{
+	const size_t first = barriers.size();
+	std::vector<D3D12_RESOURCE_STATES> wanted;
+
+	for (auto& it : m_LocalStates)
+	{
+		auto global = s_GlobalStates.find(it.first);
+		if (global == s_GlobalStates.end())
+		{
+			OutputDebugString(L"ResourceStateTracker: resource used without RegisterResource().\n");
+			continue;
+		}
+		assert(global->second.size() == it.second.Pending.size());
+
+		wanted = it.second.Pending;
+		for (size_t i = 0; i < wanted.size(); ++i)
+		{
+			if (IsFixupSkippable(it.second, i, global->second[i]))
+			{
+				wanted[i] = global->second[i];
+				m_Stats.TransitionsSkipped++;
+			}
+		}
+		AppendTransitions(it.first, global->second, wanted, barriers);
+	}
+
+	const UINT count = static_cast<UINT>(barriers.size() - first);
+	m_Stats.PendingBarriersResolved += count;
+	return count;
+}
+
+void ResourceStateTracker::CommitFinalStates()
+{
+	// Caller holds Lock().
+	assert(m_Barriers.empty() && "FlushBarriers() before submitting");
+
+	for (auto& it : m_LocalStates)
+	{
+		auto global = s_GlobalStates.find(it.first);
+		if (global == s_GlobalStates.end())
+			continue;
+
+		for (size_t i = 0; i < it.second.Current.size(); ++i)
+		{
+			// A skipped fixup left the resource in the global state.
+			if (it.second.Current[i] != s_UnknownState && !IsFixupSkippable(it.second, i, global->second[i]))
+				global->second[i] = it.second.Current[i];
+		}
+	}
+}
+
+void ResourceStateTracker::Reset()
+{
+	m_LocalStates.clear();
+	m_Barriers.clear();
+}
@@ -0,0 +1,571 @@
+#include "pch.h"
+
+#include "RootSignatureCache.h"
+#include "PipelineCache.h"
+#include "D3DUtil.h"
+#include "Hash.h"
+#include "directx/d3dx12.h"
+
+#include <cassert>
+#include <fstream>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogCache(const std::wstring& message)
+	{
+		OutputDebugString((L"RootSignatureCache: " + message + L"\n").c_str());
+	}
+
+	struct FileHeader
+	{
+		UINT32 Magic;
+		UINT32 Version;
+		UINT32 Count;
+		UINT32 Reserved;
+	};
+
+	struct BlobHeader
+	{
+		UINT64 Key;
+		UINT64 Size;
+	};
+
+	// Far above any real root signature; only guards against garbage sizes.
+	const UINT64 MaxBlobSize = 1 << 20;
+
+	// == Canonical form ==
+	// Every version of a root signature description is turned into this one,
+	// which is a 1.2 description with all defaults and offsets written out.
+
+	struct CanonicalParameter
+	{
+		D3D12_ROOT_PARAMETER_TYPE Type = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL;
+		UINT ShaderRegister = 0;
+		UINT RegisterSpace = 0;
+		UINT Num32BitValues = 0;
+		D3D12_ROOT_DESCRIPTOR_FLAGS DescriptorFlags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE;
+		std::vector<D3D12_DESCRIPTOR_RANGE1> Ranges;
+	};
+
+	struct CanonicalSampler
+	{
+		D3D12_STATIC_SAMPLER_DESC Desc;
+		UINT Flags; // D3D12_SAMPLER_FLAGS
+	};
+
+	struct CanonicalRootSignature
+	{
+		D3D12_ROOT_SIGNATURE_FLAGS Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+		std::vector<CanonicalParameter> Parameters;
+		std::vector<CanonicalSampler> Samplers;
+	};
+
+	const D3D12_DESCRIPTOR_RANGE_FLAGS RangeDataFlags =
+		D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE |
+		D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE |
+		D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC;
+
+	const D3D12_ROOT_DESCRIPTOR_FLAGS DescriptorDataFlags =
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE |
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE |
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC;
+
+	// Version 1.0 has no flags: descriptors and the data behind them may
+	// change at any time.
+	D3D12_DESCRIPTOR_RANGE_FLAGS Version10RangeFlags(D3D12_DESCRIPTOR_RANGE_TYPE type)
+	{
+		if (type == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER)
+			return D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
+		return D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+	}
+
+	// Version 1.1 defaults when no data flag is given.
+	D3D12_DESCRIPTOR_RANGE_FLAGS DefaultRangeFlags(D3D12_DESCRIPTOR_RANGE_TYPE type, D3D12_DESCRIPTOR_RANGE_FLAGS flags)
+	{
+		if (type == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER || (flags & RangeDataFlags) != 0)
+			return flags;
+		return flags | (type == D3D12_DESCRIPTOR_RANGE_TYPE_UAV
+			? D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE
+			: D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+	}
+
+	D3D12_ROOT_DESCRIPTOR_FLAGS DefaultDescriptorFlags(D3D12_ROOT_PARAMETER_TYPE type, D3D12_ROOT_DESCRIPTOR_FLAGS flags)
+	{
+		if ((flags & DescriptorDataFlags) != 0)
+			return flags;
+		return flags | (type == D3D12_ROOT_PARAMETER_TYPE_UAV
+			? D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE
+			: D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+	}
+
+	void ResolveAppendOffsets(std::vector<D3D12_DESCRIPTOR_RANGE1>& ranges)
+	{
+		UINT next = 0;
+		for (D3D12_DESCRIPTOR_RANGE1& range : ranges)
+		{
+			if (range.OffsetInDescriptorsFromTableStart == D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND)
+			{
+				// Nothing can follow an unbounded range, so 'next' is known
+				// whenever APPEND is valid.
+				if (next == UINT_MAX)
+					return;
+				range.OffsetInDescriptorsFromTableStart = next;
+			}
+			next = range.NumDescriptors == UINT_MAX
+				? UINT_MAX
+				: range.OffsetInDescriptorsFromTableStart + range.NumDescriptors;
+		}
+	}
+
+	// D3D12_ROOT_PARAMETER (1.0) and D3D12_ROOT_PARAMETER1 (1.1 and 1.2)
+	// share everything but the range and descriptor flags.
+	template <typename Parameter>
+	CanonicalParameter CanonicalizeParameter(const Parameter& src)
+	{
+		CanonicalParameter dst;
+		dst.Type = src.ParameterType;
+		dst.Visibility = src.ShaderVisibility;
+		switch (src.ParameterType)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			dst.ShaderRegister = src.Constants.ShaderRegister;
+			dst.RegisterSpace = src.Constants.RegisterSpace;
+			dst.Num32BitValues = src.Constants.Num32BitValues;
+			break;
+
+		case D3D12_ROOT_PARAMETER_TYPE_CBV:
+		case D3D12_ROOT_PARAMETER_TYPE_SRV:
+		case D3D12_ROOT_PARAMETER_TYPE_UAV:
+			dst.ShaderRegister = src.Descriptor.ShaderRegister;
+			dst.RegisterSpace = src.Descriptor.RegisterSpace;
+			break;
+
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			dst.Ranges.resize(src.DescriptorTable.NumDescriptorRanges);
+			for (UINT i = 0; i < src.DescriptorTable.NumDescriptorRanges; ++i)
+			{
+				const auto& range = src.DescriptorTable.pDescriptorRanges[i];
+				D3D12_DESCRIPTOR_RANGE1& out = dst.Ranges[i];
+				out.RangeType = range.RangeType;
+				out.NumDescriptors = range.NumDescriptors;
+				out.BaseShaderRegister = range.BaseShaderRegister;
+				out.RegisterSpace = range.RegisterSpace;
+				out.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE;
+				out.OffsetInDescriptorsFromTableStart = range.OffsetInDescriptorsFromTableStart;
+			}
+			ResolveAppendOffsets(dst.Ranges);
+			break;
+
+		default:
+			break;
+		}
+		return dst;
+	}
+
+	void SetFlags(CanonicalParameter& dst, const D3D12_ROOT_PARAMETER&)
+	{
+		if (dst.Type == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+		{
+			for (D3D12_DESCRIPTOR_RANGE1& range : dst.Ranges)
+				range.Flags = Version10RangeFlags(range.RangeType);
+		}
+		else if (dst.Type != D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+		{
+			dst.DescriptorFlags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+		}
+	}
+
+	void SetFlags(CanonicalParameter& dst, const D3D12_ROOT_PARAMETER1& src)
+	{
+		if (dst.Type == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+		{
+			for (UINT i = 0; i < dst.Ranges.size(); ++i)
+				dst.Ranges[i].Flags = DefaultRangeFlags(dst.Ranges[i].RangeType, src.DescriptorTable.pDescriptorRanges[i].Flags);
+		}
+		else if (dst.Type != D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+		{
+			dst.DescriptorFlags = DefaultDescriptorFlags(dst.Type, src.Descriptor.Flags);
+		}
+	}
+
+	template <typename Parameter, typename Sampler>
+	void CanonicalizeDesc(const Parameter* parameters, UINT numParameters, const Sampler* samplers, UINT numSamplers,
+		D3D12_ROOT_SIGNATURE_FLAGS flags, CanonicalRootSignature& out)
+	{
+		out.Flags = flags;
+		out.Parameters.reserve(numParameters);
+		for (UINT i = 0; i < numParameters; ++i)
+		{
+			out.Parameters.push_back(CanonicalizeParameter(parameters[i]));
+			SetFlags(out.Parameters.back(), parameters[i]);
+		}
+
+		out.Samplers.resize(numSamplers);
+		for (UINT i = 0; i < numSamplers; ++i)
+		{
+			// D3D12_STATIC_SAMPLER_DESC1 is D3D12_STATIC_SAMPLER_DESC with
+			// Flags appended.
+			memcpy(&out.Samplers[i].Desc, &samplers[i], sizeof(D3D12_STATIC_SAMPLER_DESC));
+			out.Samplers[i].Flags = 0;
+		}
+	}
+
+	CanonicalRootSignature Canonicalize(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+	{
+		CanonicalRootSignature out;
+		switch (desc.Version)
+		{
+		case D3D_ROOT_SIGNATURE_VERSION_1_0:
+			CanonicalizeDesc(desc.Desc_1_0.pParameters, desc.Desc_1_0.NumParameters,
+				desc.Desc_1_0.pStaticSamplers, desc.Desc_1_0.NumStaticSamplers, desc.Desc_1_0.Flags, out);
+			break;
+
+		case D3D_ROOT_SIGNATURE_VERSION_1_1:
+			CanonicalizeDesc(desc.Desc_1_1.pParameters, desc.Desc_1_1.NumParameters,
+				desc.Desc_1_1.pStaticSamplers, desc.Desc_1_1.NumStaticSamplers, desc.Desc_1_1.Flags, out);
+			break;
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 609)
+		case D3D_ROOT_SIGNATURE_VERSION_1_2:
+			CanonicalizeDesc(desc.Desc_1_2.pParameters, desc.Desc_1_2.NumParameters,
+				desc.Desc_1_2.pStaticSamplers, desc.Desc_1_2.NumStaticSamplers, desc.Desc_1_2.Flags, out);
+			for (UINT i = 0; i < desc.Desc_1_2.NumStaticSamplers; ++i)
+				out.Samplers[i].Flags = desc.Desc_1_2.pStaticSamplers[i].Flags;
+			break;
+#endif
+
+		default:
+			assert(false && "unknown root signature version");
+			break;
+		}
+		return out;
+	}
+
+	struct FieldHasher
+	{
+		uint64_t Value = Fnv1a64(nullptr, 0);
+
+		template <typename T>
+		void Add(const T& value) { Value = Fnv1a64(&value, sizeof(value), Value); }
+	};
+
+	uint64_t HashCanonical(const CanonicalRootSignature& rs)
+	{
+		FieldHasher h;
+		h.Add(RootSignatureCacheFormat::Version);
+		h.Add(rs.Flags);
+
+		h.Add(static_cast<UINT>(rs.Parameters.size()));
+		for (const CanonicalParameter& parameter : rs.Parameters)
+		{
+			h.Add(parameter.Type);
+			h.Add(parameter.Visibility);
+			h.Add(parameter.ShaderRegister);
+			h.Add(parameter.RegisterSpace);
+			h.Add(parameter.Num32BitValues);
+			h.Add(parameter.DescriptorFlags);
+			h.Add(static_cast<UINT>(parameter.Ranges.size()));
+			for (const D3D12_DESCRIPTOR_RANGE1& range : parameter.Ranges)
+			{
+				h.Add(range.RangeType);
+				h.Add(range.NumDescriptors);
+				h.Add(range.BaseShaderRegister);
+				h.Add(range.RegisterSpace);
+				h.Add(range.Flags);
+				h.Add(range.OffsetInDescriptorsFromTableStart);
+			}
+		}
+
+		h.Add(static_cast<UINT>(rs.Samplers.size()));
+		for (const CanonicalSampler& sampler : rs.Samplers)
+		{
+			const D3D12_STATIC_SAMPLER_DESC& s = sampler.Desc;
+			h.Add(s.Filter);
+			h.Add(s.AddressU);
+			h.Add(s.AddressV);
+			h.Add(s.AddressW);
+			h.Add(s.MipLODBias);
+			h.Add(s.MaxAnisotropy);
+			h.Add(s.ComparisonFunc);
+			h.Add(s.BorderColor);
+			h.Add(s.MinLOD);
+			h.Add(s.MaxLOD);
+			h.Add(s.ShaderRegister);
+			h.Add(s.RegisterSpace);
+			h.Add(s.ShaderVisibility);
+			h.Add(sampler.Flags);
+		}
+		return h.Value;
+	}
+}
+
+RootSignatureCache::RootSignatureCache(PipelineCache* pipelineCache)
+	: m_PipelineCache(pipelineCache)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+}
+
+void RootSignatureCache::Initialize(ID3D12Device* device, const std::wstring& filename)
+{
+	m_Device = device;
+	m_Filename = filename;
+
+	// Blobs are serialized for the highest version the device takes, which
+	// is part of the key.
+	D3D12_FEATURE_DATA_ROOT_SIGNATURE feature = {};
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 609)
+	feature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_2;
+#else
+	feature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+#endif
+	while (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &feature, sizeof(feature))) &&
+		feature.HighestVersion != D3D_ROOT_SIGNATURE_VERSION_1_0)
+	{
+		feature.HighestVersion = static_cast<D3D_ROOT_SIGNATURE_VERSION>(feature.HighestVersion - 1);
+	}
+	m_MaxVersion = feature.HighestVersion;
+
+	if (!LoadFile())
+	{
+		m_Blobs.clear();
+		m_Dirty = true; // replace whatever stale file is on disk
+	}
+}
+
+bool RootSignatureCache::LoadFile()
+{
+	std::ifstream file(m_Filename, std::ios::binary);
+	if (!file)
+		return false; // first run
+
+	FileHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.Magic != RootSignatureCacheFormat::Magic || header.Version != RootSignatureCacheFormat::Version)
+	{
+		LogCache(m_Filename + L": unknown format, rebuilding.");
+		return false;
+	}
+
+	for (UINT32 i = 0; i < header.Count; ++i)
+	{
+		BlobHeader blobHeader = {};
+		file.read(reinterpret_cast<char*>(&blobHeader), sizeof(blobHeader));
+		if (!file || blobHeader.Size > MaxBlobSize)
+		{
+			LogCache(m_Filename + L": truncated or corrupted, rebuilding.");
+			return false;
+		}
+
+		std::vector<BYTE>& blob = m_Blobs[blobHeader.Key];
+		blob.resize(static_cast<size_t>(blobHeader.Size));
+		file.read(reinterpret_cast<char*>(blob.data()), blob.size());
+		if (!file)
+		{
+			LogCache(m_Filename + L": truncated or corrupted, rebuilding.");
+			return false;
+		}
+	}
+
+	// A corrupted blob is caught by CreateRootSignature, which checks the
+	// container's digest, and is then serialized again.
+	m_Stats.BlobsFromDisk = header.Count;
+	return true;
+}
+
+bool RootSignatureCache::Save()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_Dirty)
+		return true;
+
+	FileHeader header = {};
+	header.Magic = RootSignatureCacheFormat::Magic;
+	header.Version = RootSignatureCacheFormat::Version;
+	header.Count = static_cast<UINT32>(m_Blobs.size());
+
+	// Write next to the file and swap it in, so a crash mid-write leaves the
+	// previous file intact.
+	const std::wstring tempFilename = m_Filename + L".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const auto& entry : m_Blobs)
+		{
+			const BlobHeader blobHeader = { entry.first, entry.second.size() };
+			file.write(reinterpret_cast<const char*>(&blobHeader), sizeof(blobHeader));
+			file.write(reinterpret_cast<const char*>(entry.second.data()), entry.second.size());
+		}
+		if (!file)
+			return false;
+	}
+	if (!MoveFileEx(tempFilename.c_str(), m_Filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+		return false;
+
+	m_Dirty = false;
+	return true;
+}
+
+uint64_t RootSignatureCache::Hash(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+{
+	return HashCanonical(Canonicalize(desc));
+}
+
+ID3D12RootSignature* RootSignatureCache::GetOrCreate(const D3D12_ROOT_SIGNATURE_DESC& desc)
+{
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC versioned;
+	versioned.Init_1_0(desc.NumParameters, desc.pParameters, desc.NumStaticSamplers, desc.pStaticSamplers, desc.Flags);
+	return GetOrCreate(versioned);
+}
+
+ID3D12RootSignature* RootSignatureCache::GetOrCreate(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+{
+	assert(m_Device && "Initialize() first");
+
+	const uint64_t key = HashCombine(Hash(desc), m_MaxVersion);
+
+	std::vector<BYTE> blob;
+	bool fromDisk = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.Requests++;
+		auto it = m_RootSignatures.find(key);
+		if (it != m_RootSignatures.end())
+		{
+			m_Stats.MemoryHits++;
+			return it->second.Get();
+		}
+
+		auto blobIt = m_Blobs.find(key);
+		if (blobIt != m_Blobs.end())
+		{
+			blob = blobIt->second;
+			fromDisk = true;
+		}
+	}
+
+	// Serialize and create without holding the lock.
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+	LARGE_INTEGER start = Now();
+	if (fromDisk && FAILED(m_Device->CreateRootSignature(0, blob.data(), blob.size(), IID_PPV_ARGS(&rootSignature))))
+	{
+		LogCache(L"cached blob rejected, serializing again.");
+		fromDisk = false;
+	}
+
+	double serializeMilliseconds = 0.0;
+	if (!fromDisk)
+	{
+		blob = Serialize(desc);
+		serializeMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+		start = Now();
+		ThrowIfFailed(m_Device->CreateRootSignature(0, blob.data(), blob.size(), IID_PPV_ARGS(&rootSignature)));
+	}
+	const double createMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto inserted = m_RootSignatures.emplace(key, rootSignature);
+	if (!inserted.second)
+		return inserted.first->second.Get(); // another thread got there first
+
+	if (fromDisk)
+	{
+		m_Stats.DiskHits++;
+	}
+	else
+	{
+		m_Stats.Serialized++;
+		m_Stats.SerializeMilliseconds += serializeMilliseconds;
+		m_Blobs[key] = blob;
+		m_Dirty = true;
+	}
+	m_Stats.CreateMilliseconds += createMilliseconds;
+
+	if (m_PipelineCache)
+		m_PipelineCache->RegisterRootSignature(rootSignature.Get(), blob.data(), blob.size());
+	return rootSignature.Get();
+}
+
+std::vector<BYTE> RootSignatureCache::Serialize(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc) const
+{
+	// Serialize the canonical form rather than 'desc', so the blob stored for
+	// a key does not depend on which of the equal descriptions came first.
+	const CanonicalRootSignature canonical = Canonicalize(desc);
+
+	std::vector<CD3DX12_ROOT_PARAMETER1> parameters(canonical.Parameters.size());
+	for (size_t i = 0; i < parameters.size(); ++i)
+	{
+		const CanonicalParameter& src = canonical.Parameters[i];
+		CD3DX12_ROOT_PARAMETER1& dst = parameters[i];
+		switch (src.Type)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			dst.InitAsConstants(src.Num32BitValues, src.ShaderRegister, src.RegisterSpace, src.Visibility);
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_CBV:
+			dst.InitAsConstantBufferView(src.ShaderRegister, src.RegisterSpace, src.DescriptorFlags, src.Visibility);
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_SRV:
+			dst.InitAsShaderResourceView(src.ShaderRegister, src.RegisterSpace, src.DescriptorFlags, src.Visibility);
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_UAV:
+			dst.InitAsUnorderedAccessView(src.ShaderRegister, src.RegisterSpace, src.DescriptorFlags, src.Visibility);
+			break;
+		default:
+			dst.InitAsDescriptorTable(static_cast<UINT>(src.Ranges.size()), src.Ranges.data(), src.Visibility);
+			break;
+		}
+	}
+
+	std::vector<D3D12_STATIC_SAMPLER_DESC> samplers(canonical.Samplers.size());
+	bool samplerFlags = false;
+	for (size_t i = 0; i < samplers.size(); ++i)
+	{
+		samplers[i] = canonical.Samplers[i].Desc;
+		samplerFlags |= canonical.Samplers[i].Flags != 0;
+	}
+
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC versioned;
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 609)
+	std::vector<D3D12_STATIC_SAMPLER_DESC1> samplers1;
+	if (samplerFlags)
+	{
+		// Only 1.2 can carry sampler flags.
+		samplers1.resize(canonical.Samplers.size());
+		for (size_t i = 0; i < samplers1.size(); ++i)
+		{
+			memcpy(&samplers1[i], &samplers[i], sizeof(D3D12_STATIC_SAMPLER_DESC));
+			samplers1[i].Flags = static_cast<D3D12_SAMPLER_FLAGS>(canonical.Samplers[i].Flags);
+		}
+		versioned.Init_1_2(static_cast<UINT>(parameters.size()), parameters.data(),
+			static_cast<UINT>(samplers1.size()), samplers1.data(), canonical.Flags);
+	}
+	else
+#endif
+	{
+		assert(!samplerFlags);
+		versioned.Init_1_1(static_cast<UINT>(parameters.size()), parameters.data(),
+			static_cast<UINT>(samplers.size()), samplers.data(), canonical.Flags);
+	}
+
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	Microsoft::WRL::ComPtr<ID3DBlob> errors;
+	const HRESULT hr = D3DX12SerializeVersionedRootSignature(&versioned, m_MaxVersion, &blob, &errors);
+	if (errors)
+		OutputDebugStringA(static_cast<const char*>(errors->GetBufferPointer()));
+	ThrowIfFailed(hr);
+
+	const BYTE* data = static_cast<const BYTE*>(blob->GetBufferPointer());
+	return std::vector<BYTE>(data, data + blob->GetBufferSize());
+}
@@ -0,0 +1,322 @@
+#include "pch.h"
+
+#include "RootSignatureLayout.h"
+#include "directx/d3dx12.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+namespace
+{
+	const size_t NoSlot = ~size_t(0);
+
+	bool IsBuffer(BindingType type)
+	{
+		return type == BindingType::Constants || type == BindingType::ConstantBuffer ||
+			type == BindingType::BufferSRV || type == BindingType::BufferUAV;
+	}
+
+	D3D12_DESCRIPTOR_RANGE_TYPE RangeType(BindingType type)
+	{
+		switch (type)
+		{
+		case BindingType::BufferSRV:
+		case BindingType::TextureSRV:
+			return D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+		case BindingType::BufferUAV:
+		case BindingType::TextureUAV:
+			return D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+		case BindingType::Sampler:
+			return D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
+		default:
+			return D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
+		}
+	}
+
+	const char* FrequencyName(BindingFrequency frequency)
+	{
+		switch (frequency)
+		{
+		case BindingFrequency::PerDraw: return "per-draw";
+		case BindingFrequency::PerPass: return "per-pass";
+		default: return "per-frame";
+		}
+	}
+
+	const char* RangeName(D3D12_DESCRIPTOR_RANGE_TYPE type)
+	{
+		switch (type)
+		{
+		case D3D12_DESCRIPTOR_RANGE_TYPE_SRV: return "SRV";
+		case D3D12_DESCRIPTOR_RANGE_TYPE_UAV: return "UAV";
+		case D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER: return "Sampler";
+		default: return "CBV";
+		}
+	}
+
+	char RegisterLetter(D3D12_DESCRIPTOR_RANGE_TYPE type)
+	{
+		switch (type)
+		{
+		case D3D12_DESCRIPTOR_RANGE_TYPE_SRV: return 't';
+		case D3D12_DESCRIPTOR_RANGE_TYPE_UAV: return 'u';
+		case D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER: return 's';
+		default: return 'b';
+		}
+	}
+}
+
+UINT RootSignatureLayout::Cost(const Slot& slot, const std::vector<RootBinding>& bindings)
+{
+	switch (slot.Placement)
+	{
+	case RootPlacement::Constants:
+		return bindings[slot.Bindings[0]].Num32BitValues;
+	case RootPlacement::Descriptor:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+size_t RootSignatureLayout::FindTable(const std::vector<Slot>& slots, const RootBinding& binding)
+{
+	// Samplers live in their own heap and cannot share a table with views.
+	const bool samplers = binding.Type == BindingType::Sampler;
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		const Slot& slot = slots[i];
+		if (slot.Placement == RootPlacement::Table && slot.Frequency == binding.Frequency &&
+			slot.Visibility == binding.Visibility && slot.Samplers == samplers)
+			return i;
+	}
+	return NoSlot;
+}
+
+bool RootSignatureLayout::Build(const std::vector<RootBinding>& bindings)
+{
+	m_Bindings = bindings;
+	m_Parameters.clear();
+	m_Ranges.clear();
+	m_Locations.assign(bindings.size(), RootBindingLocation());
+	m_Cost = 0;
+
+	// == 1. Cheapest form to update ==
+	std::vector<Slot> slots;
+	for (size_t i = 0; i < bindings.size(); ++i)
+	{
+		const RootBinding& binding = bindings[i];
+		assert(binding.Type != BindingType::Constants || binding.Num32BitValues > 0);
+
+		Slot slot;
+		slot.Frequency = binding.Frequency;
+		slot.Visibility = binding.Visibility;
+		slot.Bindings.push_back(i);
+
+		if (binding.Type == BindingType::Constants && binding.Num32BitValues <= MaxInlineConstants)
+		{
+			slot.Placement = RootPlacement::Constants;
+		}
+		else if (IsBuffer(binding.Type))
+		{
+			slot.Placement = RootPlacement::Descriptor;
+		}
+		else
+		{
+			const size_t table = FindTable(slots, binding);
+			if (table != NoSlot)
+			{
+				slots[table].Bindings.push_back(i);
+				continue;
+			}
+			slot.Placement = RootPlacement::Table;
+			slot.Samplers = binding.Type == BindingType::Sampler;
+		}
+		slots.push_back(slot);
+	}
+
+	UINT cost = 0;
+	for (const Slot& slot : slots)
+		cost += Cost(slot, bindings);
+
+	// == 2. Demote until it fits ==
+	while (cost > MaxCost)
+	{
+		size_t best = NoSlot;
+		UINT bestSaving = 0;
+		RootPlacement bestTarget = RootPlacement::Table;
+		for (size_t i = 0; i < slots.size(); ++i)
+		{
+			const Slot& slot = slots[i];
+			if (slot.Placement == RootPlacement::Table)
+				continue;
+
+			// Root constants become a root CBV when that is smaller; anything
+			// else goes into a table, which may already exist.
+			const UINT current = Cost(slot, bindings);
+			RootPlacement target = RootPlacement::Table;
+			UINT demoted = FindTable(slots, bindings[slot.Bindings[0]]) != NoSlot ? 0 : 1;
+			if (slot.Placement == RootPlacement::Constants && current > 2)
+			{
+				target = RootPlacement::Descriptor;
+				demoted = 2;
+			}
+			if (current <= demoted)
+				continue;
+
+			const UINT saving = current - demoted;
+			if (best == NoSlot || slot.Frequency < slots[best].Frequency ||
+				(slot.Frequency == slots[best].Frequency && saving > bestSaving))
+			{
+				best = i;
+				bestSaving = saving;
+				bestTarget = target;
+			}
+		}
+
+		if (best == NoSlot)
+			return false; // everything that can be is already in a table
+
+		Slot& slot = slots[best];
+		const size_t binding = slot.Bindings[0];
+		const size_t table = FindTable(slots, bindings[binding]);
+		if (bestTarget == RootPlacement::Descriptor)
+		{
+			slot.Placement = RootPlacement::Descriptor;
+		}
+		else if (table != NoSlot)
+		{
+			slots[table].Bindings.push_back(binding);
+			slots.erase(slots.begin() + best);
+		}
+		else
+		{
+			slot.Placement = RootPlacement::Table;
+			slot.Samplers = false; // only buffers are demoted
+		}
+		cost -= bestSaving;
+	}
+
+	// == 3. Most frequently changed first ==
+	std::stable_sort(slots.begin(), slots.end(), [](const Slot& a, const Slot& b)
+	{
+		if (a.Frequency != b.Frequency)
+			return a.Frequency > b.Frequency;
+		return a.Placement < b.Placement;
+	});
+
+	// == Emit ==
+	m_Parameters.resize(slots.size());
+	m_Ranges.resize(slots.size());
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		const Slot& slot = slots[i];
+		const UINT rootParameter = static_cast<UINT>(i);
+		const RootBinding& first = bindings[slot.Bindings[0]];
+		CD3DX12_ROOT_PARAMETER1 parameter;
+
+		switch (slot.Placement)
+		{
+		case RootPlacement::Constants:
+			parameter.InitAsConstants(first.Num32BitValues, first.ShaderRegister, first.RegisterSpace, slot.Visibility);
+			m_Locations[slot.Bindings[0]] = { rootParameter, RootPlacement::Constants, 0 };
+			break;
+
+		case RootPlacement::Descriptor:
+			if (first.Type == BindingType::BufferSRV)
+				parameter.InitAsShaderResourceView(first.ShaderRegister, first.RegisterSpace, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, slot.Visibility);
+			else if (first.Type == BindingType::BufferUAV)
+				parameter.InitAsUnorderedAccessView(first.ShaderRegister, first.RegisterSpace, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, slot.Visibility);
+			else
+				parameter.InitAsConstantBufferView(first.ShaderRegister, first.RegisterSpace, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, slot.Visibility);
+			m_Locations[slot.Bindings[0]] = { rootParameter, RootPlacement::Descriptor, 0 };
+			break;
+
+		case RootPlacement::Table:
+		{
+			std::vector<D3D12_DESCRIPTOR_RANGE1>& ranges = m_Ranges[i];
+			UINT offset = 0;
+			for (size_t index : slot.Bindings)
+			{
+				const RootBinding& binding = bindings[index];
+				const UINT count = binding.Type == BindingType::Constants ? 1 : binding.NumDescriptors;
+				CD3DX12_DESCRIPTOR_RANGE1 range;
+				range.Init(RangeType(binding.Type), count, binding.ShaderRegister, binding.RegisterSpace,
+					D3D12_DESCRIPTOR_RANGE_FLAG_NONE, offset);
+				ranges.push_back(range);
+				m_Locations[index] = { rootParameter, RootPlacement::Table, offset };
+				offset += count;
+			}
+			parameter.InitAsDescriptorTable(static_cast<UINT>(ranges.size()), ranges.data(), slot.Visibility);
+			break;
+		}
+		}
+
+		m_Parameters[i] = parameter;
+		m_Cost += Cost(slot, bindings);
+	}
+	assert(m_Cost == cost);
+	return true;
+}
+
+D3D12_VERSIONED_ROOT_SIGNATURE_DESC RootSignatureLayout::GetDesc(D3D12_ROOT_SIGNATURE_FLAGS flags,
+	UINT numStaticSamplers, const D3D12_STATIC_SAMPLER_DESC* staticSamplers) const
+{
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC desc;
+	desc.Init_1_1(static_cast<UINT>(m_Parameters.size()), m_Parameters.data(), numStaticSamplers, staticSamplers, flags);
+	return desc;
+}
+
+std::string RootSignatureLayout::ToString() const
+{
+	char line[256];
+	snprintf(line, sizeof(line), "Root signature layout: %u/%u DWORDs\n", m_Cost, MaxCost);
+	std::string text = line;
+
+	// Binding names per parameter, in binding order.
+	std::vector<std::vector<size_t>> names(m_Parameters.size());
+	for (size_t i = 0; i < m_Locations.size(); ++i)
+		names[m_Locations[i].RootParameter].push_back(i);
+
+	for (size_t i = 0; i < m_Parameters.size(); ++i)
+	{
+		const D3D12_ROOT_PARAMETER1& parameter = m_Parameters[i];
+		const RootBinding& first = m_Bindings[names[i][0]];
+		switch (parameter.ParameterType)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			snprintf(line, sizeof(line), "  [%zu] constants b%u space%u, %u DWORDs, %s: %s\n", i,
+				parameter.Constants.ShaderRegister, parameter.Constants.RegisterSpace,
+				parameter.Constants.Num32BitValues, FrequencyName(first.Frequency), first.Name.c_str());
+			text += line;
+			break;
+
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			snprintf(line, sizeof(line), "  [%zu] table, 1 DWORD, %s:\n", i, FrequencyName(first.Frequency));
+			text += line;
+			for (size_t index : names[i])
+			{
+				const RootBinding& binding = m_Bindings[index];
+				const D3D12_DESCRIPTOR_RANGE_TYPE type = RangeType(binding.Type);
+				snprintf(line, sizeof(line), "        @%u %s %c%u space%u x%u: %s\n", m_Locations[index].Offset,
+					RangeName(type), RegisterLetter(type), binding.ShaderRegister, binding.RegisterSpace,
+					binding.Type == BindingType::Constants ? 1 : binding.NumDescriptors, binding.Name.c_str());
+				text += line;
+			}
+			break;
+
+		default:
+		{
+			const char* kind = parameter.ParameterType == D3D12_ROOT_PARAMETER_TYPE_SRV ? "SRV t"
+				: parameter.ParameterType == D3D12_ROOT_PARAMETER_TYPE_UAV ? "UAV u" : "CBV b";
+			snprintf(line, sizeof(line), "  [%zu] root %s%u space%u, 2 DWORDs, %s: %s\n", i, kind,
+				parameter.Descriptor.ShaderRegister, parameter.Descriptor.RegisterSpace,
+				FrequencyName(first.Frequency), first.Name.c_str());
+			text += line;
+			break;
+		}
+		}
+	}
+	return text;
+}
@@ -0,0 +1,626 @@
+#include "pch.h"
+
+#include "ShaderCache.h"
+#include "D3DUtil.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+#include <d3dcompiler.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogCache(const std::wstring& message)
+	{
+		OutputDebugString((L"ShaderCache: " + message + L"\n").c_str());
+	}
+
+	struct FileHeader
+	{
+		UINT32 Magic;
+		UINT32 Version;
+		UINT64 RequestKey;
+		UINT32 DependencyCount;
+		UINT32 BytecodeSize;
+	};
+
+	// Followed by PathLength wide characters.
+	struct DependencyHeader
+	{
+		UINT64 Hash;
+		UINT32 PathLength;
+		UINT32 Reserved;
+	};
+
+	// Far above any real shader or include path; only guards against garbage.
+	const UINT32 MaxBytecodeSize = 64 << 20;
+	const UINT32 MaxPathLength = 32767;
+
+	std::wstring FullPath(const std::wstring& path)
+	{
+		wchar_t buffer[MAX_PATH];
+		const DWORD length = GetFullPathName(path.c_str(), MAX_PATH, buffer, nullptr);
+		if (length == 0 || length >= MAX_PATH)
+			return path;
+		return std::wstring(buffer, length);
+	}
+
+	bool FileExists(const std::wstring& path)
+	{
+		const DWORD attributes = GetFileAttributes(path.c_str());
+		return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+	}
+
+	std::wstring DirectoryOf(const std::wstring& path)
+	{
+		const size_t slash = path.find_last_of(L"\\/");
+		return slash == std::wstring::npos ? std::wstring() : path.substr(0, slash + 1);
+	}
+
+	std::string ToUtf8(const std::wstring& str)
+	{
+		const int size = WideCharToMultiByte(CP_UTF8, 0, str.data(), (int)str.size(), nullptr, 0, nullptr, nullptr);
+		std::string result(size, '\0');
+		if (size > 0)
+			WideCharToMultiByte(CP_UTF8, 0, str.data(), (int)str.size(), &result[0], size, nullptr, nullptr);
+		return result;
+	}
+
+	uint64_t RequestKey(const ShaderCompileDesc& desc)
+	{
+		// Each string is hashed on its own so "ab"+"c" and "a"+"bc" differ.
+		uint64_t key = Fnv1a64(desc.File);
+		key = HashCombine(key, Fnv1a64(desc.EntryPoint));
+		key = HashCombine(key, Fnv1a64(desc.Target));
+		key = HashCombine(key, desc.Flags);
+		for (const ShaderDefine& define : desc.Defines)
+		{
+			key = HashCombine(key, Fnv1a64(define.Name));
+			key = HashCombine(key, Fnv1a64(define.Value));
+		}
+		return key;
+	}
+
+	// Gives D3DCompile the includes through a ShaderSourceLoader. D3DCompile
+	// only tells which buffer an #include is in, so the buffers handed out are
+	// remembered with their paths to resolve nested includes.
+	class IncludeAdapter : public ID3DInclude
+	{
+	public:
+		IncludeAdapter(ShaderSourceLoader& loader, const std::wstring& file, const std::string& source)
+			: m_Loader(loader), m_File(file)
+		{
+			m_Paths[source.data()] = file;
+		}
+
+		HRESULT __stdcall Open(D3D_INCLUDE_TYPE, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* bytes) override
+		{
+			const auto parent = m_Paths.find(parentData);
+			const std::wstring includingFile = parent != m_Paths.end() ? parent->second : m_File;
+
+			std::wstring path;
+			const std::string* text = m_Loader.Load(AnsiToWString(fileName), includingFile, &path);
+			if (text == nullptr)
+				return E_FAIL;
+
+			m_Paths[text->data()] = path;
+			*data = text->data();
+			*bytes = static_cast<UINT>(text->size());
+			return S_OK;
+		}
+
+		HRESULT __stdcall Close(LPCVOID) override
+		{
+			return S_OK; // the loader owns the text
+		}
+
+	private:
+		ShaderSourceLoader& m_Loader;
+		std::wstring m_File;
+		std::unordered_map<LPCVOID, std::wstring> m_Paths;
+	};
+}
+
+// == D3DShaderCompiler ==
+
+bool D3DShaderCompiler::Compile(const ShaderCompileDesc& desc, const std::string& source, ShaderSourceLoader& loader,
+	std::vector<BYTE>& bytecode, std::string& errors)
+{
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const ShaderDefine& define : desc.Defines)
+		macros.push_back({ define.Name.c_str(), define.Value.c_str() });
+	macros.push_back({ nullptr, nullptr });
+
+	IncludeAdapter include(loader, desc.File, source);
+	Microsoft::WRL::ComPtr<ID3DBlob> code;
+	Microsoft::WRL::ComPtr<ID3DBlob> errorBlob;
+	const HRESULT hr = D3DCompile(source.data(), source.size(), ToUtf8(desc.File).c_str(), macros.data(), &include,
+		desc.EntryPoint.c_str(), desc.Target.c_str(), desc.Flags, 0, &code, &errorBlob);
+
+	if (errorBlob != nullptr)
+		errors.assign(static_cast<const char*>(errorBlob->GetBufferPointer()), errorBlob->GetBufferSize());
+	if (FAILED(hr))
+		return false;
+
+	const BYTE* data = static_cast<const BYTE*>(code->GetBufferPointer());
+	bytecode.assign(data, data + code->GetBufferSize());
+	return true;
+}
+
+// == Cache internals ==
+
+// A cache file mapped read-only, for as long as an entry uses its bytecode.
+struct ShaderCache::MappedFile
+{
+	HANDLE File = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = nullptr;
+	const BYTE* Data = nullptr;
+	UINT64 Size = 0;
+
+	MappedFile() = default;
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+
+	~MappedFile()
+	{
+		if (Data != nullptr)
+			UnmapViewOfFile(Data);
+		if (Mapping != nullptr)
+			CloseHandle(Mapping);
+		if (File != INVALID_HANDLE_VALUE)
+			CloseHandle(File);
+	}
+
+	bool Open(const std::wstring& path)
+	{
+		File = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (File == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(File, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(FileHeader))
+			return false;
+		Size = static_cast<UINT64>(fileSize.QuadPart);
+
+		Mapping = CreateFileMapping(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (Mapping == nullptr)
+			return false;
+		Data = static_cast<const BYTE*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+		return Data != nullptr;
+	}
+};
+
+// The ShaderSourceLoader given to the compiler for one shader. Records every
+// file read, keeping the text alive until the compile is done.
+class ShaderCache::Tracker : public ShaderSourceLoader
+{
+public:
+	explicit Tracker(ShaderCache& cache) : m_Cache(cache) {}
+
+	const std::string* Load(const std::wstring& name, const std::wstring& includingFile, std::wstring* resolvedPath) override
+	{
+		const std::wstring path = m_Cache.Resolve(name, includingFile);
+		if (path.empty())
+			return nullptr;
+
+		std::shared_ptr<const SourceFile> source = m_Cache.ReadSource(path);
+		if (!source->Exists)
+			return nullptr;
+
+		const bool known = std::any_of(Dependencies.begin(), Dependencies.end(),
+			[&](const Dependency& dependency) { return dependency.Path == path; });
+		if (!known)
+			Dependencies.push_back({ path, source->Hash });
+		m_Files.push_back(source);
+
+		if (resolvedPath != nullptr)
+			*resolvedPath = path;
+		return &source->Text;
+	}
+
+	std::vector<Dependency> Dependencies;
+
+private:
+	ShaderCache& m_Cache;
+	std::vector<std::shared_ptr<const SourceFile>> m_Files;
+};
+
+// == ShaderCache ==
+
+ShaderCache::ShaderCache()
+	: m_Compiler(std::make_unique<D3DShaderCompiler>())
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+}
+
+ShaderCache::~ShaderCache() = default;
+
+void ShaderCache::Initialize(const std::wstring& directory)
+{
+	if (!CreateDirectory(directory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+	{
+		LogCache(L"could not create " + directory + L", shaders will not be cached on disk");
+		return;
+	}
+	m_Directory = FullPath(directory);
+}
+
+void ShaderCache::AddIncludeDirectory(const std::wstring& directory)
+{
+	std::wstring path = FullPath(directory);
+	if (!path.empty() && path.back() != L'\\' && path.back() != L'/')
+		path += L'\\';
+	m_IncludeDirectories.push_back(path);
+}
+
+ShaderHandle ShaderCache::Add(const ShaderCompileDesc& desc)
+{
+	assert(!desc.File.empty() && !desc.EntryPoint.empty() && !desc.Target.empty());
+
+	// The same shader named by another relative path, or with its defines in
+	// another order, is the same request. Defines with the same name keep
+	// their order, as the last one wins.
+	ShaderCompileDesc request = desc;
+	request.File = FullPath(desc.File);
+	std::stable_sort(request.Defines.begin(), request.Defines.end(),
+		[](const ShaderDefine& a, const ShaderDefine& b) { return a.Name < b.Name; });
+
+	const uint64_t key = RequestKey(request);
+	const auto it = m_ByRequest.find(key);
+	if (it != m_ByRequest.end())
+		return it->second;
+
+	const ShaderHandle handle = static_cast<ShaderHandle>(m_Entries.size());
+	m_Entries.emplace_back();
+	m_Entries.back().Desc = std::move(request);
+	m_Entries.back().RequestKey = key;
+	m_ByRequest.emplace(key, handle);
+	return handle;
+}
+
+bool ShaderCache::Build(ThreadPool* pool)
+{
+	std::vector<Entry*> entries;
+	for (UINT i = m_FirstUnbuilt; i < m_Entries.size(); ++i)
+		entries.push_back(&m_Entries[i]);
+	m_FirstUnbuilt = static_cast<UINT>(m_Entries.size());
+	return BuildEntries(entries, pool, m_Stats);
+}
+
+bool ShaderCache::Rebuild(const std::vector<ShaderHandle>& handles, ThreadPool* pool)
+{
+	std::unique_ptr<ShaderRebuild> rebuild = StageRebuild(handles);
+	const bool succeeded = BuildStaged(*rebuild, pool);
+	CommitRebuild(*rebuild);
+	return succeeded;
+}
+
+std::unique_ptr<ShaderRebuild> ShaderCache::StageRebuild(const std::vector<ShaderHandle>& handles) const
+{
+	auto rebuild = std::make_unique<ShaderRebuild>();
+	rebuild->m_Handles = handles;
+	rebuild->m_Entries.resize(handles.size());
+	for (size_t i = 0; i < handles.size(); ++i)
+	{
+		assert(handles[i] < m_FirstUnbuilt && "Rebuild of a shader that was never built");
+		const Entry& entry = m_Entries[handles[i]];
+		rebuild->m_Entries[i].Desc = entry.Desc;
+		rebuild->m_Entries[i].RequestKey = entry.RequestKey;
+	}
+	return rebuild;
+}
+
+bool ShaderCache::BuildStaged(ShaderRebuild& rebuild, ThreadPool* pool)
+{
+	std::vector<Entry*> entries;
+	for (Entry& entry : rebuild.m_Entries)
+		entries.push_back(&entry);
+	return BuildEntries(entries, pool, rebuild.m_Stats);
+}
+
+std::vector<ShaderHandle> ShaderCache::CommitRebuild(ShaderRebuild& rebuild)
+{
+	m_Stats = rebuild.m_Stats;
+
+	std::vector<ShaderHandle> changed;
+	for (size_t i = 0; i < rebuild.m_Handles.size(); ++i)
+	{
+		Entry& entry = m_Entries[rebuild.m_Handles[i]];
+		Entry& staged = rebuild.m_Entries[i];
+
+		if (staged.Data == nullptr)
+		{
+			// A shader broken by an edit keeps running with its last good
+			// bytecode, but watches the files of both attempts.
+			for (Dependency& dependency : staged.Dependencies)
+			{
+				const bool known = std::any_of(entry.Dependencies.begin(), entry.Dependencies.end(),
+					[&](const Dependency& existing) { return existing.Path == dependency.Path; });
+				if (!known)
+					entry.Dependencies.push_back(std::move(dependency));
+			}
+			continue;
+		}
+
+		// Edits that do not change the code (comments, unused functions) are
+		// not reported.
+		if (entry.Data == nullptr || entry.Size != staged.Size || memcmp(entry.Data, staged.Data, staged.Size) != 0)
+			changed.push_back(rebuild.m_Handles[i]);
+
+		// Moving the vector keeps its buffer, so Data stays valid.
+		entry.OldMapping = std::move(entry.Mapping);
+		entry.OldCompiled = std::move(entry.Compiled);
+		entry.Mapping = std::move(staged.Mapping);
+		entry.Compiled = std::move(staged.Compiled);
+		entry.Data = staged.Data;
+		entry.Size = staged.Size;
+		entry.Dependencies = std::move(staged.Dependencies);
+	}
+	rebuild.m_Handles.clear();
+	rebuild.m_Entries.clear();
+	return changed;
+}
+
+bool ShaderCache::BuildEntries(const std::vector<Entry*>& entries, ThreadPool* pool, Stats& stats)
+{
+	const LARGE_INTEGER start = Now();
+
+	struct Result
+	{
+		bool Succeeded = false;
+		bool CacheHit = false;
+		double CompileMilliseconds = 0.0;
+	};
+	std::vector<Result> results(entries.size());
+
+	// Each task touches only its own entry; the shared source table has its
+	// own lock.
+	ParallelFor(pool, static_cast<UINT>(entries.size()), 1, [&](UINT begin, UINT end)
+	{
+		for (UINT i = begin; i < end; ++i)
+		{
+			Result& result = results[i];
+			result.Succeeded = BuildEntry(*entries[i], result.CompileMilliseconds, result.CacheHit);
+		}
+	});
+
+	stats = Stats();
+	stats.Shaders = static_cast<UINT>(m_Entries.size());
+	for (const Result& result : results)
+	{
+		if (!result.Succeeded)
+			++stats.Failed;
+		else if (result.CacheHit)
+			++stats.CacheHits;
+		else
+			++stats.Compiled;
+		stats.CompileMilliseconds += result.CompileMilliseconds;
+	}
+	stats.BuildMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+
+	if (!entries.empty())
+	{
+		LogCache(std::to_wstring(entries.size()) + L" shaders: " + std::to_wstring(stats.CacheHits) + L" from cache, " +
+			std::to_wstring(stats.Compiled) + L" compiled, " + std::to_wstring(stats.Failed) + L" failed in " +
+			std::to_wstring(stats.BuildMilliseconds) + L" ms");
+	}
+	return stats.Failed == 0;
+}
+
+bool ShaderCache::BuildEntry(Entry& entry, double& compileMilliseconds, bool& cacheHit)
+{
+	entry.Built = true;
+
+	std::shared_ptr<const SourceFile> source = ReadSource(entry.Desc.File);
+	entry.Dependencies.assign(1, { entry.Desc.File, source->Hash });
+	if (!source->Exists)
+	{
+		LogCache(L"cannot read " + entry.Desc.File);
+		return false;
+	}
+
+	// == Cached bytecode ==
+	std::wstring path;
+	if (!m_Directory.empty())
+	{
+		uint64_t fileKey = HashCombine(entry.RequestKey, Fnv1a64(m_Compiler->GetId()));
+		fileKey = HashCombine(fileKey, source->Hash);
+
+		wchar_t name[32];
+		swprintf_s(name, L"%016llX.bin", static_cast<unsigned long long>(fileKey));
+		path = m_Directory + L"\\" + name;
+		if (LoadCached(entry, path))
+		{
+			cacheHit = true;
+			return true;
+		}
+	}
+
+	// == Compile ==
+	Tracker tracker(*this);
+	std::vector<BYTE> bytecode;
+	std::string errors;
+	const LARGE_INTEGER start = Now();
+	const bool compiled = m_Compiler->Compile(entry.Desc, source->Text, tracker, bytecode, errors);
+	compileMilliseconds = (Now().QuadPart - start.QuadPart) * m_SecondsPerCount * 1000.0;
+
+	entry.Dependencies.insert(entry.Dependencies.end(), tracker.Dependencies.begin(), tracker.Dependencies.end());
+	if (!compiled)
+	{
+		// Compiler output can be long; AnsiToWString would cut it off.
+		LogCache(L"failed to compile " + entry.Desc.File + L" (" + AnsiToWString(entry.Desc.EntryPoint) + L", " +
+			AnsiToWString(entry.Desc.Target) + L"):");
+		OutputDebugStringA((errors + "\n").c_str());
+		return false;
+	}
+
+	entry.Compiled.swap(bytecode);
+	entry.Data = entry.Compiled.data();
+	entry.Size = entry.Compiled.size();
+	if (!path.empty())
+		WriteCached(entry, path);
+	return true;
+}
+
+bool ShaderCache::LoadCached(Entry& entry, const std::wstring& path)
+{
+	auto file = std::make_shared<MappedFile>();
+	if (!file->Open(path))
+		return false;
+
+	FileHeader header;
+	memcpy(&header, file->Data, sizeof(header));
+	if (header.Magic != ShaderCacheFormat::Magic || header.Version != ShaderCacheFormat::Version ||
+		header.RequestKey != entry.RequestKey || header.BytecodeSize > MaxBytecodeSize)
+		return false;
+
+	// Every dependency must still have the text the bytecode was built from.
+	std::vector<Dependency> dependencies;
+	UINT64 offset = sizeof(header);
+	for (UINT32 i = 0; i < header.DependencyCount; ++i)
+	{
+		DependencyHeader dependency;
+		if (offset + sizeof(dependency) > file->Size)
+			return false;
+		memcpy(&dependency, file->Data + offset, sizeof(dependency));
+		offset += sizeof(dependency);
+
+		const UINT64 pathBytes = (UINT64)dependency.PathLength * sizeof(wchar_t);
+		if (dependency.PathLength > MaxPathLength || offset + pathBytes > file->Size)
+			return false;
+		std::wstring dependencyPath(dependency.PathLength, L'\0');
+		memcpy(&dependencyPath[0], file->Data + offset, (size_t)pathBytes);
+		offset += pathBytes;
+
+		std::shared_ptr<const SourceFile> source = ReadSource(dependencyPath);
+		if (!source->Exists || source->Hash != dependency.Hash)
+			return false;
+		dependencies.push_back({ std::move(dependencyPath), dependency.Hash });
+	}
+
+	if (offset + header.BytecodeSize != file->Size)
+		return false;
+
+	entry.Dependencies = std::move(dependencies);
+	entry.Data = file->Data + offset;
+	entry.Size = header.BytecodeSize;
+	entry.Mapping = std::move(file);
+	return true;
+}
+
+void ShaderCache::WriteCached(const Entry& entry, const std::wstring& path) const
+{
+	std::vector<BYTE> data(sizeof(FileHeader));
+	FileHeader header = {};
+	header.Magic = ShaderCacheFormat::Magic;
+	header.Version = ShaderCacheFormat::Version;
+	header.RequestKey = entry.RequestKey;
+	header.DependencyCount = static_cast<UINT32>(entry.Dependencies.size());
+	header.BytecodeSize = static_cast<UINT32>(entry.Size);
+	memcpy(data.data(), &header, sizeof(header));
+
+	for (const Dependency& dependency : entry.Dependencies)
+	{
+		DependencyHeader record = {};
+		record.Hash = dependency.Hash;
+		record.PathLength = static_cast<UINT32>(dependency.Path.size());
+		const BYTE* recordBytes = reinterpret_cast<const BYTE*>(&record);
+		const BYTE* pathBytes = reinterpret_cast<const BYTE*>(dependency.Path.data());
+		data.insert(data.end(), recordBytes, recordBytes + sizeof(record));
+		data.insert(data.end(), pathBytes, pathBytes + dependency.Path.size() * sizeof(wchar_t));
+	}
+	data.insert(data.end(), entry.Data, entry.Data + entry.Size);
+
+	// Written aside and moved into place, so a crash never leaves half a
+	// file. The move fails while another shader still maps the old file
+	// (its includes changed during a hot reload); the next run writes it.
+	const std::wstring tempPath = path + L".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return;
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		if (!file)
+			return;
+	}
+	if (!MoveFileEx(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFile(tempPath.c_str());
+		LogCache(L"could not write " + path);
+	}
+}
+
+std::shared_ptr<const ShaderCache::SourceFile> ShaderCache::ReadSource(const std::wstring& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SourceMutex);
+		const auto it = m_Sources.find(path);
+		if (it != m_Sources.end())
+			return it->second;
+	}
+
+	// Read outside the lock; if two threads race, both read the same text.
+	auto source = std::make_shared<SourceFile>();
+	std::ifstream file(path, std::ios::binary);
+	if (file)
+	{
+		source->Text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		source->Exists = !file.bad();
+	}
+	source->Hash = Fnv1a64(source->Text);
+
+	std::lock_guard<std::mutex> lock(m_SourceMutex);
+	return m_Sources.emplace(path, std::move(source)).first->second;
+}
+
+std::wstring ShaderCache::Resolve(const std::wstring& name, const std::wstring& includingFile) const
+{
+	std::wstring candidate = DirectoryOf(includingFile) + name;
+	if (FileExists(candidate))
+		return FullPath(candidate);
+
+	for (const std::wstring& directory : m_IncludeDirectories)
+	{
+		candidate = directory + name;
+		if (FileExists(candidate))
+			return FullPath(candidate);
+	}
+	return std::wstring();
+}
+
+void ShaderCache::InvalidateSource(const std::wstring& file)
+{
+	std::lock_guard<std::mutex> lock(m_SourceMutex);
+	m_Sources.erase(FullPath(file));
+}
+
+D3D12_SHADER_BYTECODE ShaderCache::GetBytecode(ShaderHandle handle) const
+{
+	assert(handle < m_Entries.size());
+	const Entry& entry = m_Entries[handle];
+	assert(entry.Built && "GetBytecode() before Build()");
+	return { entry.Data, entry.Size };
+}
+
+std::vector<std::wstring> ShaderCache::GetDependencies(ShaderHandle handle) const
+{
+	assert(handle < m_Entries.size());
+	std::vector<std::wstring> paths;
+	for (const Dependency& dependency : m_Entries[handle].Dependencies)
+		paths.push_back(dependency.Path);
+	return paths;
+}
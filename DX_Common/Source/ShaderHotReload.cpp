@@ -0,0 +1,410 @@
+#include "pch.h"
+
+#include "ShaderHotReload.h"
+#include "D3DUtil.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cwctype>
+#include <unordered_map>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogReload(const std::wstring& message)
+	{
+		OutputDebugString((L"ShaderHotReload: " + message + L"\n").c_str());
+	}
+
+	// File names are compared as full paths, case-insensitively, whichever
+	// slashes were used.
+	std::wstring NormalizePath(const std::wstring& path)
+	{
+		wchar_t buffer[MAX_PATH];
+		const DWORD length = GetFullPathName(path.c_str(), MAX_PATH, buffer, nullptr);
+		std::wstring result = length > 0 && length < MAX_PATH ? std::wstring(buffer, length) : path;
+		for (wchar_t& c : result)
+			c = c == L'/' ? L'\\' : static_cast<wchar_t>(towlower(c));
+		return result;
+	}
+
+	struct DependencyIndexEntry
+	{
+		std::wstring Path; // as the ShaderCache knows it
+		std::vector<ShaderHandle> Shaders;
+	};
+}
+
+ShaderHotReload::ShaderHotReload(ShaderCache* cache, ThreadPool* pool)
+	: m_Cache(cache)
+	, m_Pool(pool)
+{
+	assert(m_Cache != nullptr);
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+}
+
+ShaderHotReload::~ShaderHotReload()
+{
+	Stop();
+
+	// The background task points at this object.
+	if (m_State != State::Idle)
+	{
+		while (!m_TaskDone.load())
+			std::this_thread::yield();
+	}
+}
+
+// == Pipelines ==
+
+HotPipelineHandle ShaderHotReload::AddPipeline(const std::vector<ShaderHandle>& shaders, CreatePipelineFunc create)
+{
+	Pipeline pipeline;
+	pipeline.Shaders = shaders;
+	pipeline.Create = std::move(create);
+	pipeline.Current = pipeline.Create();
+
+	m_Pipelines.push_back(std::move(pipeline));
+	return static_cast<HotPipelineHandle>(m_Pipelines.size() - 1);
+}
+
+ID3D12PipelineState* ShaderHotReload::GetPipeline(HotPipelineHandle handle) const
+{
+	assert(handle < m_Pipelines.size());
+	return m_Pipelines[handle].Current.Get();
+}
+
+// == Changes ==
+
+void ShaderHotReload::NotifyChanged(const std::wstring& file)
+{
+	std::lock_guard<std::mutex> lock(m_ChangeMutex);
+	m_ChangedFiles.push_back(file);
+	m_LastChange = Now();
+}
+
+bool ShaderHotReload::IsIdle() const
+{
+	std::lock_guard<std::mutex> lock(m_ChangeMutex);
+	return m_State == State::Idle && m_ChangedFiles.empty() && !m_Overflow;
+}
+
+void ShaderHotReload::Update(UINT64 submittedFence, UINT64 completedFence)
+{
+	// == Release what the GPU is done with ==
+	const size_t retiredBefore = m_Retired.size();
+	m_Retired.erase(std::remove_if(m_Retired.begin(), m_Retired.end(),
+		[completedFence](const RetiredPipeline& retired) { return retired.Fence <= completedFence; }), m_Retired.end());
+	m_Stats.PipelinesRetired += static_cast<UINT>(retiredBefore - m_Retired.size());
+
+	// == Advance the reload in flight ==
+	// Each step's background work finishes before the next step starts, so
+	// a step that runs inline (no pool) moves on in the same Update().
+	if (m_State == State::Idle)
+		StartRebuild();
+
+	if (m_State == State::Compiling && m_TaskDone.load())
+		StartPipelines();
+
+	if (m_State == State::CreatingPipelines && m_TaskDone.load())
+		SwapPipelines(submittedFence);
+}
+
+void ShaderHotReload::StartRebuild()
+{
+	std::vector<std::wstring> changedFiles;
+	bool overflow = false;
+	{
+		std::lock_guard<std::mutex> lock(m_ChangeMutex);
+		if (m_ChangedFiles.empty() && !m_Overflow)
+			return;
+
+		// An editor saving a file can produce several notifications in a
+		// row; wait until they stop.
+		const double quietMilliseconds = (Now().QuadPart - m_LastChange.QuadPart) * m_SecondsPerCount * 1000.0;
+		if (quietMilliseconds < m_DebounceMilliseconds)
+			return;
+
+		changedFiles.swap(m_ChangedFiles);
+		overflow = m_Overflow;
+		m_Overflow = false;
+	}
+
+	// == Which shaders depend on what ==
+	// Built from scratch each time: the include graph changes with the
+	// sources, and this only runs when a file was saved.
+	std::unordered_map<std::wstring, DependencyIndexEntry> index;
+	for (ShaderHandle shader = 0; shader < m_Cache->GetShaderCount(); ++shader)
+	{
+		for (const std::wstring& path : m_Cache->GetDependencies(shader))
+		{
+			DependencyIndexEntry& entry = index[NormalizePath(path)];
+			entry.Path = path;
+			entry.Shaders.push_back(shader);
+		}
+	}
+
+	std::vector<bool> affected(m_Cache->GetShaderCount(), false);
+	auto invalidate = [&](const DependencyIndexEntry& entry)
+	{
+		m_Cache->InvalidateSource(entry.Path);
+		for (ShaderHandle shader : entry.Shaders)
+			affected[shader] = true;
+	};
+
+	if (overflow)
+	{
+		LogReload(L"too many changes to track, checking every shader");
+		for (const auto& entry : index)
+			invalidate(entry.second);
+	}
+	for (const std::wstring& file : changedFiles)
+	{
+		const auto it = index.find(NormalizePath(file));
+		if (it != index.end())
+			invalidate(it->second);
+	}
+
+	std::vector<ShaderHandle> shaders;
+	for (ShaderHandle shader = 0; shader < affected.size(); ++shader)
+	{
+		if (affected[shader])
+			shaders.push_back(shader);
+	}
+	if (shaders.empty())
+		return; // not a file any shader uses
+
+	LogReload(L"rebuilding " + std::to_wstring(shaders.size()) + L" shaders");
+	m_ReloadStart = Now();
+	m_Rebuild = m_Cache->StageRebuild(shaders);
+	m_State = State::Compiling;
+	RunInBackground([this]()
+	{
+		m_Cache->BuildStaged(*m_Rebuild, m_Pool);
+	});
+}
+
+void ShaderHotReload::StartPipelines()
+{
+	const ShaderCache::Stats& rebuildStats = m_Rebuild->GetStats();
+	m_Stats.ShadersRebuilt += rebuildStats.CacheHits + rebuildStats.Compiled;
+	m_Stats.ShadersFailed += rebuildStats.Failed;
+
+	// Nothing records with the old bytecode: pipelines copy it when they are
+	// created, so it can be swapped right away.
+	const std::vector<ShaderHandle> changed = m_Cache->CommitRebuild(*m_Rebuild);
+	m_Rebuild.reset();
+
+	m_StagedPipelines.clear();
+	for (HotPipelineHandle handle = 0; handle < m_Pipelines.size(); ++handle)
+	{
+		const Pipeline& pipeline = m_Pipelines[handle];
+		const bool uses = std::any_of(pipeline.Shaders.begin(), pipeline.Shaders.end(),
+			[&](ShaderHandle shader) { return std::find(changed.begin(), changed.end(), shader) != changed.end(); });
+		if (uses)
+			m_StagedPipelines.push_back({ handle, pipeline.Create, nullptr });
+	}
+
+	if (m_StagedPipelines.empty())
+	{
+		FinishReload(0);
+		return;
+	}
+
+	m_State = State::CreatingPipelines;
+	RunInBackground([this]()
+	{
+		ParallelFor(m_Pool, static_cast<UINT>(m_StagedPipelines.size()), 1, [this](UINT begin, UINT end)
+		{
+			for (UINT i = begin; i < end; ++i)
+			{
+				// An edit that compiles but does not match the rest of the
+				// pipeline should not take the application down.
+				try
+				{
+					m_StagedPipelines[i].Result = m_StagedPipelines[i].Create();
+				}
+				catch (const DxException& e)
+				{
+					LogReload(e.ToString());
+				}
+			}
+		});
+	});
+}
+
+void ShaderHotReload::SwapPipelines(UINT64 submittedFence)
+{
+	UINT swapped = 0;
+	for (StagedPipeline& staged : m_StagedPipelines)
+	{
+		if (staged.Result == nullptr)
+		{
+			LogReload(L"could not recreate pipeline " + std::to_wstring(staged.Handle) + L", keeping the old one");
+			continue;
+		}
+
+		// Frames up to 'submittedFence' may still draw with the old one.
+		Pipeline& pipeline = m_Pipelines[staged.Handle];
+		if (pipeline.Current != nullptr)
+			m_Retired.push_back({ std::move(pipeline.Current), submittedFence });
+		pipeline.Current = std::move(staged.Result);
+		++swapped;
+	}
+	m_StagedPipelines.clear();
+	FinishReload(swapped);
+}
+
+void ShaderHotReload::FinishReload(UINT swapped)
+{
+	m_Stats.PipelinesSwapped += swapped;
+	++m_Stats.Reloads;
+	m_Stats.LastReloadMilliseconds = (Now().QuadPart - m_ReloadStart.QuadPart) * m_SecondsPerCount * 1000.0;
+	LogReload(L"reloaded in " + std::to_wstring(m_Stats.LastReloadMilliseconds) + L" ms, swapped " +
+		std::to_wstring(swapped) + L" pipelines");
+	m_State = State::Idle;
+}
+
+void ShaderHotReload::RunInBackground(std::function<void()> task)
+{
+	m_TaskDone.store(false);
+	if (m_Pool == nullptr)
+	{
+		task();
+		m_TaskDone.store(true);
+		return;
+	}
+
+	m_Pool->Submit([this, task]()
+	{
+		task();
+		m_TaskDone.store(true);
+	});
+}
+
+// == File watching ==
+
+void ShaderHotReload::Start(const std::vector<std::wstring>& directories)
+{
+	assert(!m_WatchThread.joinable() && "Start() called twice");
+	assert(directories.size() < MAXIMUM_WAIT_OBJECTS && "One wait handle per directory, plus the stop event");
+
+	m_StopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (m_StopEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	m_WatchThread = std::thread(&ShaderHotReload::WatchThread, this, directories);
+}
+
+void ShaderHotReload::Stop()
+{
+	if (!m_WatchThread.joinable())
+		return;
+
+	SetEvent(m_StopEvent);
+	m_WatchThread.join();
+	CloseHandle(m_StopEvent);
+	m_StopEvent = nullptr;
+}
+
+void ShaderHotReload::WatchThread(std::vector<std::wstring> directories)
+{
+	struct Watch
+	{
+		std::wstring Directory;
+		HANDLE Handle = INVALID_HANDLE_VALUE;
+		OVERLAPPED Overlapped = {};
+		DWORD Buffer[16 * 1024]; // FILE_NOTIFY_INFORMATION needs DWORD alignment
+	};
+
+	const DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME;
+	auto issue = [filter](Watch& watch)
+	{
+		ResetEvent(watch.Overlapped.hEvent);
+		return ReadDirectoryChangesW(watch.Handle, watch.Buffer, sizeof(watch.Buffer), TRUE, filter,
+			nullptr, &watch.Overlapped, nullptr) != FALSE;
+	};
+
+	std::vector<std::unique_ptr<Watch>> watches;
+	std::vector<HANDLE> events = { m_StopEvent };
+	for (const std::wstring& directory : directories)
+	{
+		auto watch = std::make_unique<Watch>();
+		watch->Directory = directory;
+		watch->Handle = CreateFile(directory.c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (watch->Handle == INVALID_HANDLE_VALUE)
+		{
+			LogReload(L"cannot watch " + directory);
+			continue;
+		}
+		watch->Overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		if (!issue(*watch))
+		{
+			LogReload(L"cannot watch " + directory);
+			CloseHandle(watch->Overlapped.hEvent);
+			CloseHandle(watch->Handle);
+			continue;
+		}
+		events.push_back(watch->Overlapped.hEvent);
+		watches.push_back(std::move(watch));
+	}
+
+	for (;;)
+	{
+		const DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, INFINITE);
+		if (signaled == WAIT_OBJECT_0 || signaled >= WAIT_OBJECT_0 + events.size())
+			break;
+
+		Watch& watch = *watches[signaled - WAIT_OBJECT_0 - 1];
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(watch.Handle, &watch.Overlapped, &bytes, FALSE))
+			bytes = 0;
+
+		if (bytes == 0)
+		{
+			// The buffer overflowed; which files changed is lost.
+			std::lock_guard<std::mutex> lock(m_ChangeMutex);
+			m_Overflow = true;
+			m_LastChange = Now();
+		}
+		else
+		{
+			const BYTE* cursor = reinterpret_cast<const BYTE*>(watch.Buffer);
+			for (;;)
+			{
+				const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(cursor);
+				if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+				{
+					const std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+					NotifyChanged(watch.Directory + L"\\" + name);
+				}
+				if (info->NextEntryOffset == 0)
+					break;
+				cursor += info->NextEntryOffset;
+			}
+		}
+
+		if (!issue(watch))
+			LogReload(L"stopped watching " + watch.Directory);
+	}
+
+	for (const std::unique_ptr<Watch>& watch : watches)
+	{
+		CancelIo(watch->Handle);
+		DWORD bytes = 0;
+		GetOverlappedResult(watch->Handle, &watch->Overlapped, &bytes, TRUE);
+		CloseHandle(watch->Overlapped.hEvent);
+		CloseHandle(watch->Handle);
+	}
+}
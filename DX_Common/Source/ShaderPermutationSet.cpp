@@ -0,0 +1,234 @@
+#include "pch.h"
+
+#include "ShaderPermutationSet.h"
+#include "D3DUtil.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+	void LogPermutations(const std::wstring& message)
+	{
+		OutputDebugString((L"ShaderPermutationSet: " + message + L"\n").c_str());
+	}
+
+	struct UsageHeader
+	{
+		UINT32 Magic;
+		UINT32 Version;
+		UINT64 LayoutHash;
+		UINT32 KeyCount;
+		UINT32 Reserved;
+	};
+}
+
+const ShaderPermutation ShaderPermutationSet::s_None;
+
+ShaderPermutationSet::ShaderPermutationSet(const ShaderCompileDesc& base, const std::vector<PermutationFeature>& features)
+	: m_Base(base)
+	, m_Features(features)
+{
+	for (const PermutationFeature& feature : m_Features)
+	{
+		assert(feature.Width > 0 && feature.Shift + feature.Width <= MaxKeyBits && "Too many permutation bits");
+		assert((m_FeatureMask & feature.Mask()) == 0 && "Permutation features overlap");
+		m_FeatureMask |= feature.Mask();
+		m_KeyBits = std::max(m_KeyBits, feature.Shift + feature.Width);
+	}
+	m_Stats.Keys = 1u << m_KeyBits;
+	m_Used.reset(new std::atomic<uint32_t>[(m_Stats.Keys + 31) / 32]());
+}
+
+// == Constraints ==
+
+void ShaderPermutationSet::Require(const PermutationFeature& feature, const PermutationFeature& required)
+{
+	assert(m_Table.empty() && "Constraints must come before AddPermutations()");
+	m_Constraints.push_back({ Constraint::Requires, feature.Mask(), required.Mask() });
+}
+
+void ShaderPermutationSet::Exclude(const PermutationFeature& a, const PermutationFeature& b)
+{
+	assert(m_Table.empty() && "Constraints must come before AddPermutations()");
+	m_Constraints.push_back({ Constraint::Excludes, a.Mask(), b.Mask() });
+}
+
+void ShaderPermutationSet::Limit(const PermutationFeature& feature, UINT maxValue)
+{
+	assert(m_Table.empty() && "Constraints must come before AddPermutations()");
+	assert(maxValue <= feature.Value(feature.Mask()));
+	// Compared in place: the masked key against the limit at the same shift.
+	m_Constraints.push_back({ Constraint::Limits, feature.Mask(), feature(maxValue) });
+}
+
+bool ShaderPermutationSet::IsValid(PermutationKey key) const
+{
+	// Bits of no feature (including gaps between features) are never valid,
+	// so one shader does not end up under several keys.
+	if ((key & ~m_FeatureMask) != 0)
+		return false;
+
+	for (const Constraint& constraint : m_Constraints)
+	{
+		const bool a = (key & constraint.A) != 0;
+		switch (constraint.Type)
+		{
+		case Constraint::Requires:
+			if (a && (key & constraint.B) == 0)
+				return false;
+			break;
+		case Constraint::Excludes:
+			if (a && (key & constraint.B) != 0)
+				return false;
+			break;
+		case Constraint::Limits:
+			if ((key & constraint.A) > constraint.B)
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+ShaderCompileDesc ShaderPermutationSet::GetDesc(PermutationKey key) const
+{
+	ShaderCompileDesc desc = m_Base;
+	for (const PermutationFeature& feature : m_Features)
+		desc.Defines.push_back({ feature.Define, std::to_string(feature.Value(key)) });
+	return desc;
+}
+
+// == Table ==
+
+void ShaderPermutationSet::AddPermutations(ShaderCache& cache)
+{
+	assert(m_Table.empty() && "AddPermutations() called twice");
+	m_Table.assign(m_Stats.Keys, ShaderPermutation());
+	m_Valid.assign(m_Stats.Keys, false);
+
+	for (PermutationKey key = 0; key < m_Stats.Keys; ++key)
+	{
+		if (!IsValid(key))
+			continue;
+		m_Valid[key] = true;
+		++m_Stats.Valid;
+
+		// Without a usage file everything is built; with one, only what was
+		// used in the last PruneAfterRuns runs.
+		if (!m_RunsSinceUse.empty() && m_RunsSinceUse[key] >= m_PruneAfterRuns)
+		{
+			++m_Stats.Pruned;
+			continue;
+		}
+		m_Table[key].Shader = cache.Add(GetDesc(key));
+		++m_Stats.Added;
+	}
+}
+
+UINT ShaderPermutationSet::AddMissing(ShaderCache& cache)
+{
+	if (!m_Missed.exchange(false, std::memory_order_relaxed))
+		return 0;
+
+	UINT added = 0;
+	for (PermutationKey key = 0; key < m_Stats.Keys; ++key)
+	{
+		if (m_Valid[key] && m_Table[key].Shader == InvalidShaderHandle && IsUsed(key))
+		{
+			m_Table[key].Shader = cache.Add(GetDesc(key));
+			++added;
+		}
+	}
+	m_Stats.Added += added;
+	m_Stats.Missed += added;
+	if (added > 0)
+		LogPermutations(std::to_wstring(added) + L" pruned permutations of " + m_Base.File + L" were used after all");
+	return added;
+}
+
+void ShaderPermutationSet::SetPipeline(PermutationKey key, PipelineHandle pipeline)
+{
+	assert(key < m_Table.size() && m_Valid[key]);
+	m_Table[key].Pipeline = pipeline;
+}
+
+// == Usage telemetry ==
+
+uint64_t ShaderPermutationSet::LayoutHash() const
+{
+	// Usage is only meaningful for the same keys of the same shader.
+	uint64_t hash = Fnv1a64(m_Base.File);
+	hash = HashCombine(hash, Fnv1a64(m_Base.EntryPoint));
+	for (const PermutationFeature& feature : m_Features)
+	{
+		hash = HashCombine(hash, Fnv1a64(std::string(feature.Define)));
+		hash = HashCombine(hash, feature.Mask());
+	}
+	return hash;
+}
+
+void ShaderPermutationSet::LoadUsage(const std::wstring& filename)
+{
+	m_UsageFilename = filename;
+	m_RunsSinceUse.clear();
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return;
+
+	UsageHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.Magic != PermutationUsageFormat::Magic || header.Version != PermutationUsageFormat::Version ||
+		header.LayoutHash != LayoutHash() || header.KeyCount != m_Stats.Keys)
+	{
+		LogPermutations(L"ignoring usage file " + filename + L" (written for other permutations)");
+		return;
+	}
+
+	std::vector<BYTE> runs(header.KeyCount);
+	file.read(reinterpret_cast<char*>(runs.data()), runs.size());
+	if (!file)
+	{
+		LogPermutations(L"ignoring truncated usage file " + filename);
+		return;
+	}
+	m_RunsSinceUse.swap(runs);
+}
+
+bool ShaderPermutationSet::SaveUsage() const
+{
+	if (m_UsageFilename.empty())
+		return true;
+
+	UsageHeader header = {};
+	header.Magic = PermutationUsageFormat::Magic;
+	header.Version = PermutationUsageFormat::Version;
+	header.LayoutHash = LayoutHash();
+	header.KeyCount = m_Stats.Keys;
+
+	// A key unused in this run is one run further from its last use. Keys
+	// with no history start counting now, so a first run does not mark
+	// everything it happened not to draw for pruning.
+	std::vector<BYTE> runs(m_Stats.Keys, 0);
+	for (PermutationKey key = 0; key < m_Stats.Keys; ++key)
+	{
+		if (IsUsed(key))
+			continue;
+		const UINT previous = m_RunsSinceUse.empty() ? 0u : m_RunsSinceUse[key];
+		runs[key] = static_cast<BYTE>(std::min<UINT>(previous + 1u, MaxRunsSinceUse));
+	}
+
+	const std::wstring tempFilename = m_UsageFilename + L".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(runs.data()), runs.size());
+		if (!file)
+			return false;
+	}
+	return MoveFileEx(tempFilename.c_str(), m_UsageFilename.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
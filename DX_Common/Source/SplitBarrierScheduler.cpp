@@ -0,0 +1,112 @@
+#include "pch.h"
+
+#include "SplitBarrierScheduler.h"
+#include "BarrierBackend.h"
+#include "ResourceStateTracker.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	D3D12_RESOURCE_BARRIER MakeTransition(ID3D12Resource* resource, UINT subresource,
+		D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after, D3D12_RESOURCE_BARRIER_FLAGS flags)
+	{
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = flags;
+		barrier.Transition.pResource = resource;
+		barrier.Transition.Subresource = subresource;
+		barrier.Transition.StateBefore = before;
+		barrier.Transition.StateAfter = after;
+		return barrier;
+	}
+}
+
+void SplitBarrierScheduler::SetInitialState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state, UINT subresource)
+{
+	m_InitialStates[Key(resource, subresource)] = state;
+}
+
+UINT SplitBarrierScheduler::AddPass(const std::vector<ResourceUse>& uses)
+{
+	m_Passes.push_back(uses);
+	return static_cast<UINT>(m_Passes.size() - 1);
+}
+
+void SplitBarrierScheduler::Compile()
+{
+	m_Tracks.clear();
+	m_Stats = Stats();
+	m_PassBarriers.assign(m_Passes.size(), std::vector<D3D12_RESOURCE_BARRIER>());
+
+	for (const auto& it : m_InitialStates)
+		m_Tracks[it.first].State = it.second;
+
+	for (int pass = 0; pass < static_cast<int>(m_Passes.size()); ++pass)
+	{
+		for (const ResourceUse& use : m_Passes[pass])
+		{
+			assert(use.Resource);
+			Track& track = m_Tracks[Key(use.Resource, use.Subresource)];
+
+			if (ResourceStateTracker::IsStateCompatible(track.State, use.State))
+			{
+				track.LastUse = pass;
+				continue;
+			}
+
+			// The transition may begin once the last pass that used the old
+			// state is done, i.e. right before the pass after it.
+			const int beginPass = track.LastUse + 1;
+			if (beginPass < pass)
+			{
+				m_PassBarriers[beginPass].push_back(MakeTransition(use.Resource, use.Subresource,
+					track.State, use.State, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+				m_PassBarriers[pass].push_back(MakeTransition(use.Resource, use.Subresource,
+					track.State, use.State, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+
+				const UINT distance = static_cast<UINT>(pass - beginPass);
+				m_Stats.SplitBarriers++;
+				m_Stats.TotalDistance += distance;
+				m_Stats.MaxDistance = std::max(m_Stats.MaxDistance, distance);
+			}
+			else
+			{
+				m_PassBarriers[pass].push_back(MakeTransition(use.Resource, use.Subresource,
+					track.State, use.State, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+				m_Stats.ImmediateBarriers++;
+			}
+
+			track.State = use.State;
+			track.LastUse = pass;
+		}
+	}
+}
+
+void SplitBarrierScheduler::RecordBarriers(UINT pass, ID3D12GraphicsCommandList* commandList, BarrierBackend* backend) const
+{
+	const std::vector<D3D12_RESOURCE_BARRIER>& barriers = m_PassBarriers[pass];
+	if (barriers.empty())
+		return;
+
+	if (backend)
+		backend->Record(commandList, static_cast<UINT>(barriers.size()), barriers.data());
+	else
+		commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+}
+
+D3D12_RESOURCE_STATES SplitBarrierScheduler::GetFinalState(ID3D12Resource* resource, UINT subresource) const
+{
+	auto it = m_Tracks.find(Key(resource, subresource));
+	return it != m_Tracks.end() ? it->second.State : D3D12_RESOURCE_STATE_COMMON;
+}
+
+void SplitBarrierScheduler::Reset()
+{
+	m_InitialStates.clear();
+	m_Tracks.clear();
+	m_Passes.clear();
+	m_PassBarriers.clear();
+	m_Stats = Stats();
+}
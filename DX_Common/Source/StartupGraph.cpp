@@ -0,0 +1,244 @@
+#include "pch.h"
+
+#include "StartupGraph.h"
+#include "ThreadPool.h"
+
+#include <cassert>
+
+namespace
+{
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogStartup(const std::wstring& message)
+	{
+		OutputDebugString((L"StartupGraph: " + message + L"\n").c_str());
+	}
+
+	std::wstring Milliseconds(double milliseconds)
+	{
+		wchar_t text[32];
+		swprintf_s(text, L"%.1f ms", milliseconds);
+		return text;
+	}
+}
+
+StartupGraph::StartupGraph(ThreadPool* pool)
+	: m_Pool(pool)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / static_cast<double>(frequency.QuadPart);
+}
+
+StartupTask StartupGraph::Add(const std::wstring& name, std::function<bool()> work,
+	const std::vector<StartupTask>& dependencies, Affinity affinity)
+{
+	const StartupTask handle = static_cast<StartupTask>(m_Tasks.size());
+
+	Task task;
+	task.Work = std::move(work);
+	task.RunOn = affinity;
+	for (StartupTask dependency : dependencies)
+	{
+		// Handles only come from earlier Add() calls, so there are no cycles.
+		assert(dependency < handle && "Unknown startup task");
+		task.Dependencies.push_back(dependency);
+		m_Tasks[dependency].Dependents.push_back(handle);
+	}
+	m_Tasks.push_back(std::move(task));
+
+	TaskTiming timing;
+	timing.Name = name;
+	m_Timings.push_back(timing);
+	return handle;
+}
+
+// == Running ==
+
+bool StartupGraph::Run()
+{
+	m_Start = Now();
+	m_Pending = static_cast<UINT>(m_Tasks.size());
+	m_Failed = false;
+	m_Exception = nullptr;
+
+	std::vector<StartupTask> ready;
+	for (StartupTask i = 0; i < m_Tasks.size(); ++i)
+	{
+		m_Tasks[i].Remaining = static_cast<UINT>(m_Tasks[i].Dependencies.size());
+		m_Tasks[i].Skip = false;
+		if (m_Tasks[i].Remaining == 0)
+			ready.push_back(i);
+	}
+	for (StartupTask task : ready)
+		Dispatch(task);
+
+	// Run the main thread's tasks until every task is done.
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (m_Pending > 0)
+	{
+		if (m_MainQueue.empty())
+		{
+			m_Cv.wait(lock);
+			continue;
+		}
+		const StartupTask task = m_MainQueue.front();
+		m_MainQueue.pop_front();
+		lock.unlock();
+		Execute(task, true);
+		lock.lock();
+	}
+	lock.unlock();
+
+	m_Stats.WallMilliseconds = (Now().QuadPart - m_Start.QuadPart) * m_SecondsPerCount * 1000.0;
+	FindCriticalPath();
+	LogTimings();
+
+	if (m_Exception)
+		std::rethrow_exception(m_Exception);
+	return !m_Failed;
+}
+
+void StartupGraph::Dispatch(StartupTask task)
+{
+	if (m_Tasks[task].Skip)
+	{
+		Complete(task, false);
+		return;
+	}
+
+	if (m_Pool == nullptr || m_Tasks[task].RunOn == Affinity::MainThread)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_MainQueue.push_back(task);
+		}
+		m_Cv.notify_all();
+		return;
+	}
+	m_Pool->Submit([this, task]() { Execute(task, false); });
+}
+
+void StartupGraph::Execute(StartupTask task, bool onMainThread)
+{
+	const LARGE_INTEGER start = Now();
+	bool succeeded = false;
+	try
+	{
+		succeeded = m_Tasks[task].Work();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Exception)
+			m_Exception = std::current_exception();
+	}
+	const LARGE_INTEGER end = Now();
+
+	// Only this thread touches the task's timing until Complete() has run.
+	TaskTiming& timing = m_Timings[task];
+	timing.StartMilliseconds = (start.QuadPart - m_Start.QuadPart) * m_SecondsPerCount * 1000.0;
+	timing.EndMilliseconds = (end.QuadPart - m_Start.QuadPart) * m_SecondsPerCount * 1000.0;
+	timing.OnMainThread = onMainThread;
+	timing.Ran = true;
+	timing.Succeeded = succeeded;
+	if (!succeeded)
+		LogStartup(timing.Name + L" failed; skipping what depends on it.");
+
+	Complete(task, succeeded);
+}
+
+void StartupGraph::Complete(StartupTask task, bool succeeded)
+{
+	std::vector<StartupTask> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!succeeded)
+			m_Failed = true;
+		for (StartupTask dependent : m_Tasks[task].Dependents)
+		{
+			if (!succeeded)
+				m_Tasks[dependent].Skip = true;
+			if (--m_Tasks[dependent].Remaining == 0)
+				ready.push_back(dependent);
+		}
+		--m_Pending;
+
+		// Notified under the lock: once Run() sees the last task done, the
+		// graph may be gone, so nothing may touch it after this block.
+		if (m_Pending == 0)
+		{
+			m_Cv.notify_all();
+			return;
+		}
+	}
+
+	// Each of these is still pending, so Run() cannot return meanwhile.
+	for (StartupTask dependent : ready)
+		Dispatch(dependent);
+}
+
+// == Report ==
+
+void StartupGraph::FindCriticalPath()
+{
+	m_Stats.SerialMilliseconds = 0.0;
+	m_Stats.CriticalPathMilliseconds = 0.0;
+	m_Stats.CriticalPath.clear();
+
+	StartupTask last = InvalidStartupTask;
+	for (StartupTask i = 0; i < m_Timings.size(); ++i)
+	{
+		const TaskTiming& timing = m_Timings[i];
+		if (!timing.Ran)
+			continue;
+		m_Stats.SerialMilliseconds += timing.EndMilliseconds - timing.StartMilliseconds;
+		if (last == InvalidStartupTask || timing.EndMilliseconds > m_Timings[last].EndMilliseconds)
+			last = i;
+	}
+
+	// Walk back through the dependency that finished last: the one the task
+	// was waiting for.
+	while (last != InvalidStartupTask)
+	{
+		const TaskTiming& timing = m_Timings[last];
+		m_Stats.CriticalPath.insert(m_Stats.CriticalPath.begin(), last);
+		m_Stats.CriticalPathMilliseconds += timing.EndMilliseconds - timing.StartMilliseconds;
+
+		StartupTask gate = InvalidStartupTask;
+		for (StartupTask dependency : m_Tasks[last].Dependencies)
+		{
+			if (m_Timings[dependency].Ran &&
+				(gate == InvalidStartupTask || m_Timings[dependency].EndMilliseconds > m_Timings[gate].EndMilliseconds))
+			{
+				gate = dependency;
+			}
+		}
+		last = gate;
+	}
+}
+
+void StartupGraph::LogTimings() const
+{
+	for (const TaskTiming& timing : m_Timings)
+	{
+		if (!timing.Ran)
+		{
+			LogStartup(timing.Name + L": skipped");
+			continue;
+		}
+		LogStartup(timing.Name + L": " + Milliseconds(timing.EndMilliseconds - timing.StartMilliseconds) +
+			L" at " + Milliseconds(timing.StartMilliseconds) + (timing.OnMainThread ? L", main thread" : L", worker"));
+	}
+
+	std::wstring path;
+	for (StartupTask task : m_Stats.CriticalPath)
+		path += (path.empty() ? L"" : L" -> ") + m_Timings[task].Name;
+	LogStartup(L"critical path " + path + L": " + Milliseconds(m_Stats.CriticalPathMilliseconds) +
+		L" of " + Milliseconds(m_Stats.WallMilliseconds) + L" (" + Milliseconds(m_Stats.SerialMilliseconds) + L" if serial)");
+}
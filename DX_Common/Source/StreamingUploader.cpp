@@ -0,0 +1,635 @@
+#include "pch.h"
+
+#include "StreamingUploader.h"
+#include "D3DUtil.h"
+#include "directx/d3dx12.h"
+
+#include <chrono>
+#include <string>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	LARGE_INTEGER Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t;
+	}
+
+	void LogUploader(const std::wstring& message)
+	{
+		OutputDebugString((L"StreamingUploader: " + message + L"\n").c_str());
+	}
+}
+
+D3D12UploadQueue::D3D12UploadQueue(ID3D12Device* device)
+	: m_d3dDevice(device)
+{
+	assert(device);
+
+	// == Copy queue ==
+	// The copy engine runs independently from the graphics queue, so uploads
+	// overlap with rendering instead of being serialized in front of it.
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(m_d3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_CopyQueue)));
+
+	Allocator allocator;
+	ThrowIfFailed(m_d3dDevice->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(allocator.CommandAllocator.GetAddressOf())));
+	ThrowIfFailed(m_d3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_COPY,
+		allocator.CommandAllocator.Get(),
+		nullptr,
+		IID_PPV_ARGS(m_CommandList.GetAddressOf())));
+	m_CommandList->Close();
+	m_Allocators.push_back(allocator);
+
+	ThrowIfFailed(m_d3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_Fence)));
+}
+
+D3D12UploadQueue::~D3D12UploadQueue()
+{
+	// Just like D3DApp's destructor, we must not release the staging buffer
+	// while the GPU may still be reading from it. A removed device reports
+	// every fence value as completed, so this cannot hang.
+	if (m_Fence && m_Fence->GetCompletedValue() < m_CurrentFence)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+		if (eventHandle && SUCCEEDED(m_Fence->SetEventOnCompletion(m_CurrentFence, eventHandle)))
+			WaitForSingleObject(eventHandle, INFINITE);
+		if (eventHandle)
+			CloseHandle(eventHandle);
+	}
+
+	if (m_StagingBuffer)
+		m_StagingBuffer->Unmap(0, nullptr);
+}
+
+BYTE* D3D12UploadQueue::CreateStagingBuffer(UINT64 size)
+{
+	assert(!m_StagingBuffer);
+
+	// == Staging ring ==
+	// One big upload heap buffer that stays mapped for the uploader's lifetime.
+	// Upload heaps are write-combined memory: only ever write to it sequentially
+	// and never read back from it on the CPU.
+	auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+	ThrowIfFailed(m_d3dDevice->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&bufferDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(m_StagingBuffer.GetAddressOf())));
+
+	BYTE* data = nullptr;
+	CD3DX12_RANGE readRange(0, 0); // we do not read from this resource on the CPU
+	ThrowIfFailed(m_StagingBuffer->Map(0, &readRange, reinterpret_cast<void**>(&data)));
+	return data;
+}
+
+void D3D12UploadQueue::GetCopyableFootprints(const D3D12_RESOURCE_DESC& desc, UINT firstSubresource, UINT numSubresources,
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts, UINT* numRows, UINT64* rowSizes, UINT64* totalBytes)
+{
+	m_d3dDevice->GetCopyableFootprints(&desc, firstSubresource, numSubresources, 0, layouts, numRows, rowSizes, totalBytes);
+}
+
+void D3D12UploadQueue::CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 numBytes)
+{
+	BeginRecording();
+	m_CommandList->CopyBufferRegion(dest, destOffset, m_StagingBuffer.Get(), stagingOffset, numBytes);
+}
+
+void D3D12UploadQueue::CopyTexture(ID3D12Resource* dest, UINT subresource, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingLayout)
+{
+	BeginRecording();
+	CD3DX12_TEXTURE_COPY_LOCATION dst(dest, subresource);
+	CD3DX12_TEXTURE_COPY_LOCATION src(m_StagingBuffer.Get(), stagingLayout);
+	m_CommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+}
+
+UINT64 D3D12UploadQueue::Submit()
+{
+	assert(m_IsRecording);
+	m_IsRecording = false;
+
+	ThrowIfFailed(m_CommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { m_CommandList.Get() };
+	m_CopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	m_Recording.FenceValue = ++m_CurrentFence;
+	ThrowIfFailed(m_CopyQueue->Signal(m_Fence.Get(), m_Recording.FenceValue));
+	m_Allocators.push_back(std::move(m_Recording));
+	return m_CurrentFence;
+}
+
+UINT64 D3D12UploadQueue::GetCompletedValue()
+{
+	return m_Fence->GetCompletedValue();
+}
+
+void D3D12UploadQueue::Wait(ID3D12CommandQueue* queue, UINT64 fenceValue)
+{
+	ThrowIfFailed(queue->Wait(m_Fence.Get(), fenceValue));
+}
+
+void D3D12UploadQueue::BeginRecording()
+{
+	if (m_IsRecording)
+		return;
+
+	// The oldest allocator is free once the GPU has passed its last batch;
+	// otherwise another one is created, so there are as many as batches in flight.
+	if (!m_Allocators.empty() && m_Allocators.front().FenceValue <= m_Fence->GetCompletedValue())
+	{
+		m_Recording = std::move(m_Allocators.front());
+		m_Allocators.pop_front();
+		ThrowIfFailed(m_Recording.CommandAllocator->Reset());
+	}
+	else
+	{
+		m_Recording = Allocator();
+		ThrowIfFailed(m_d3dDevice->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_COPY,
+			IID_PPV_ARGS(m_Recording.CommandAllocator.GetAddressOf())));
+	}
+
+	ThrowIfFailed(m_CommandList->Reset(m_Recording.CommandAllocator.Get(), nullptr));
+	m_IsRecording = true;
+}
+
+StreamingUploader::StreamingUploader(ID3D12Device* device, UINT64 stagingRingSize, UINT64 maxBatchSize)
+	: m_OwnedQueue(std::make_unique<D3D12UploadQueue>(device))
+	, m_Queue(m_OwnedQueue.get())
+	, m_RingSize(AlignUp(stagingRingSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT))
+	, m_MaxBatchSize(maxBatchSize)
+{
+	Start();
+}
+
+StreamingUploader::StreamingUploader(UploadQueue* queue, UINT64 stagingRingSize, UINT64 maxBatchSize)
+	: m_Queue(queue)
+	, m_RingSize(AlignUp(stagingRingSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT))
+	, m_MaxBatchSize(maxBatchSize)
+{
+	assert(queue);
+	Start();
+}
+
+void StreamingUploader::Start()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_SecondsPerCount = 1.0 / (double)frequency.QuadPart;
+
+	m_StagingData = m_Queue->CreateStagingBuffer(m_RingSize);
+
+	m_Worker = std::thread(&StreamingUploader::WorkerMain, this);
+}
+
+StreamingUploader::~StreamingUploader()
+{
+	// Drain everything that was requested, then stop the worker. The queue
+	// keeps the staging buffer alive until the GPU is done with it.
+	Flush();
+
+	m_Quit = true;
+	m_QueueCv.notify_all();
+	if (m_Worker.joinable())
+		m_Worker.join();
+}
+
+UploadTicket StreamingUploader::UploadBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* srcData, UINT64 numBytes)
+{
+	assert(dest && srcData);
+	if (numBytes == 0)
+		return UploadTicket();
+
+	PendingRequest request;
+	request.Dest = dest;
+	request.IsTexture = false;
+	request.DestOffset = destOffset;
+	request.StagingSize = numBytes;
+	request.NumBytes = numBytes;
+
+	PendingRequest reserved = ReserveRequest(std::move(request), 16);
+	if (reserved.Sequence == 0)
+		return UploadTicket();
+
+	memcpy(m_StagingData + reserved.StagingOffset, srcData, static_cast<size_t>(numBytes));
+
+	MarkReady(reserved.Sequence);
+	return UploadTicket{ reserved.Sequence };
+}
+
+UploadTicket StreamingUploader::UploadTexture(ID3D12Resource* dest, UINT firstSubresource, UINT numSubresources,
+	const D3D12_SUBRESOURCE_DATA* srcData)
+{
+	assert(dest && srcData);
+	if (numSubresources == 0)
+		return UploadTicket();
+
+	std::vector<UINT> numRows;
+	std::vector<UINT64> rowSizes;
+	PendingRequest reserved = ReserveTextureRequest(dest, firstSubresource, numSubresources, numRows, rowSizes);
+	if (reserved.Sequence == 0)
+		return UploadTicket();
+
+	// Copy the caller's rows into the pitched staging layout.
+	for (UINT i = 0; i < numSubresources; ++i)
+	{
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = reserved.Layouts[i];
+		D3D12_MEMCPY_DEST destData =
+		{
+			m_StagingData + layout.Offset,
+			layout.Footprint.RowPitch,
+			SIZE_T(layout.Footprint.RowPitch) * SIZE_T(numRows[i])
+		};
+		MemcpySubresource(&destData, &srcData[i], static_cast<SIZE_T>(rowSizes[i]), numRows[i], layout.Footprint.Depth);
+	}
+
+	MarkReady(reserved.Sequence);
+	return UploadTicket{ reserved.Sequence };
+}
+
+UploadTicket StreamingUploader::UploadTexture(ID3D12Resource* dest, UINT firstSubresource, UINT numSubresources,
+	const void* srcData, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* srcLayouts)
+{
+	assert(dest && srcData && srcLayouts);
+	if (numSubresources == 0)
+		return UploadTicket();
+
+	std::vector<UINT> numRows;
+	std::vector<UINT64> rowSizes;
+	PendingRequest reserved = ReserveTextureRequest(dest, firstSubresource, numSubresources, numRows, rowSizes, srcLayouts);
+	if (reserved.Sequence == 0)
+		return UploadTicket();
+
+	// If the source was laid out with the same footprints the device wants
+	// (same extents, row pitches and relative placement), the staging copy
+	// is a single memcpy of the whole block instead of one per row. The
+	// reservation checked the format, width and height, which fix the row
+	// count and row size, so those match too.
+	bool sameLayout = true;
+	for (UINT i = 0; i < numSubresources && sameLayout; ++i)
+	{
+		sameLayout =
+			srcLayouts[i].Footprint.Depth == reserved.Layouts[i].Footprint.Depth &&
+			srcLayouts[i].Footprint.RowPitch == reserved.Layouts[i].Footprint.RowPitch &&
+			srcLayouts[i].Offset - srcLayouts[0].Offset == reserved.Layouts[i].Offset - reserved.Layouts[0].Offset;
+	}
+
+	const BYTE* src = static_cast<const BYTE*>(srcData);
+	if (sameLayout)
+	{
+		memcpy(m_StagingData + reserved.StagingOffset, src + srcLayouts[0].Offset, static_cast<size_t>(reserved.StagingSize));
+	}
+	else
+	{
+		for (UINT i = 0; i < numSubresources; ++i)
+		{
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = reserved.Layouts[i];
+			UINT rowCount = numRows[i] * layout.Footprint.Depth;
+			for (UINT row = 0; row < rowCount; ++row)
+			{
+				memcpy(m_StagingData + layout.Offset + UINT64(row) * layout.Footprint.RowPitch,
+					src + srcLayouts[i].Offset + UINT64(row) * srcLayouts[i].Footprint.RowPitch,
+					static_cast<size_t>(rowSizes[i]));
+			}
+		}
+	}
+
+	MarkReady(reserved.Sequence);
+	return UploadTicket{ reserved.Sequence };
+}
+
+StreamingUploader::PendingRequest StreamingUploader::ReserveTextureRequest(ID3D12Resource* dest, UINT firstSubresource,
+	UINT numSubresources, std::vector<UINT>& numRows, std::vector<UINT64>& rowSizes,
+	const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* srcLayouts)
+{
+	// Ask the device how the subresources must be laid out in a buffer so the
+	// copy engine can read them (256-byte row pitch, 512-byte placement).
+	// The offsets are relative to 0 and are rebased onto the ring by ReserveRequest.
+	D3D12_RESOURCE_DESC desc = dest->GetDesc();
+
+	PendingRequest request;
+	request.Dest = dest;
+	request.IsTexture = true;
+	request.FirstSubresource = firstSubresource;
+	request.Layouts.resize(numSubresources);
+
+	numRows.resize(numSubresources);
+	rowSizes.resize(numSubresources);
+	UINT64 totalBytes = 0;
+	m_Queue->GetCopyableFootprints(desc, firstSubresource, numSubresources,
+		request.Layouts.data(), numRows.data(), rowSizes.data(), &totalBytes);
+
+	// Pre-laid-out sources are copied by rows of rowSizes[i], numRows[i] *
+	// Depth of them, so they must describe the same extents as dest or the
+	// copy would read past the source.
+	for (UINT i = 0; srcLayouts && i < numSubresources; ++i)
+	{
+		const D3D12_SUBRESOURCE_FOOTPRINT& src = srcLayouts[i].Footprint;
+		const D3D12_SUBRESOURCE_FOOTPRINT& dst = request.Layouts[i].Footprint;
+		if (src.Format != dst.Format || src.Width != dst.Width || src.Height != dst.Height || src.Depth != dst.Depth ||
+			UINT64(src.RowPitch) < rowSizes[i])
+		{
+			LogUploader(L"rejected a texture upload; source subresource " + std::to_wstring(firstSubresource + i) +
+				L" does not match the destination footprint.");
+			return PendingRequest();
+		}
+	}
+
+	request.StagingSize = totalBytes;
+	for (UINT i = 0; i < numSubresources; ++i)
+		request.NumBytes += rowSizes[i] * numRows[i] * request.Layouts[i].Footprint.Depth;
+
+	return ReserveRequest(std::move(request), D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+}
+
+StreamingUploader::PendingRequest StreamingUploader::ReserveRequest(PendingRequest request, UINT64 alignment)
+{
+	// Waiting for ring space would never end. The ring size is a multiple
+	// of every alignment, so anything up to its size fits at offset 0.
+	if (request.StagingSize > m_RingSize)
+	{
+		LogUploader(L"rejected an upload of " + std::to_wstring(request.StagingSize) +
+			L" bytes; the staging ring holds " + std::to_wstring(m_RingSize) + L".");
+		return PendingRequest();
+	}
+
+	std::unique_lock<std::mutex> lock(m_QueueMutex);
+
+	// Work out where the allocation lands. The ring never splits an
+	// allocation: if it does not fit before the end we skip to the start.
+	UINT64 position = 0;
+	UINT64 padding = 0;
+	auto fits = [&]()
+	{
+		UINT64 ringOffset = m_RingHead % m_RingSize;
+		UINT64 aligned = AlignUp(ringOffset, alignment);
+		if (aligned + request.StagingSize > m_RingSize)
+			aligned = m_RingSize; // wrap to offset 0 of the next lap
+		padding = aligned - ringOffset;
+		position = aligned % m_RingSize;
+		return (m_RingHead + padding + request.StagingSize) - m_RingTail <= m_RingSize;
+	};
+
+	// Out of staging space: wait for the GPU to retire older batches.
+	// The worker is woken so it submits whatever is already queued.
+	while (m_FailedSequence.load() == 0 && !fits())
+	{
+		m_QueueCv.notify_one();
+		m_RingSpaceCv.wait(lock);
+	}
+	if (m_FailedSequence.load() != 0)
+		return PendingRequest();
+
+	m_RingHead += padding + request.StagingSize;
+
+	request.Sequence = m_NextSequence++;
+	request.StagingOffset = position;
+	request.RingEnd = m_RingHead;
+	request.EnqueueTime = Now();
+	for (auto& layout : request.Layouts)
+		layout.Offset += position;
+
+	m_PendingRequests.push_back(request);
+	return request;
+}
+
+void StreamingUploader::MarkReady(UINT64 sequence)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_QueueMutex);
+
+		// Dropped with the rest when the worker failed.
+		if (m_PendingRequests.empty() || sequence < m_PendingRequests.front().Sequence)
+		{
+			assert(m_FailedSequence.load() != 0);
+			return;
+		}
+
+		// Requests stay in sequence order, so the slot is found by index.
+		size_t index = static_cast<size_t>(sequence - m_PendingRequests.front().Sequence);
+		m_PendingRequests[index].Ready = true;
+	}
+	m_QueueCv.notify_one();
+}
+
+bool StreamingUploader::IsComplete(UploadTicket ticket) const
+{
+	if (!ticket.IsValid() || ticket.Sequence <= m_RetiredSequence.load(std::memory_order_acquire) || IsFailed(ticket))
+		return true;
+
+	// The worker retires lazily, so look at the fence itself for an exact answer.
+	std::lock_guard<std::mutex> lock(m_InFlightMutex);
+	UINT64 completedFence = m_Queue->GetCompletedValue();
+	for (const auto& batch : m_InFlight)
+	{
+		if (ticket.Sequence <= batch.LastSequence)
+			return completedFence >= batch.FenceValue;
+	}
+
+	// Still waiting in the request queue.
+	return false;
+}
+
+bool StreamingUploader::IsFailed(UploadTicket ticket) const
+{
+	UINT64 failedSequence = m_FailedSequence.load(std::memory_order_acquire);
+	return ticket.IsValid() && failedSequence != 0 && ticket.Sequence >= failedSequence;
+}
+
+bool StreamingUploader::QueueWait(ID3D12CommandQueue* queue, UploadTicket ticket) const
+{
+	if (!ticket.IsValid() || ticket.Sequence <= m_RetiredSequence.load(std::memory_order_acquire) || IsFailed(ticket))
+		return true;
+
+	std::lock_guard<std::mutex> lock(m_InFlightMutex);
+	for (const auto& batch : m_InFlight)
+	{
+		if (ticket.Sequence >= batch.FirstSequence && ticket.Sequence <= batch.LastSequence)
+		{
+			// GPU-side wait: the graphics queue stalls, the CPU does not.
+			m_Queue->Wait(queue, batch.FenceValue);
+			return true;
+		}
+	}
+	return false;
+}
+
+void StreamingUploader::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_QueueMutex);
+	UINT64 lastIssued = m_NextSequence - 1;
+	m_QueueCv.notify_one();
+	m_RingSpaceCv.wait(lock, [&]() { return m_RetiredSequence.load() >= lastIssued || m_FailedSequence.load() != 0; });
+}
+
+StreamingUploader::Stats StreamingUploader::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_InFlightMutex);
+	return m_Stats;
+}
+
+void StreamingUploader::WorkerMain()
+{
+	// An exception escaping the thread would end in std::terminate, and
+	// stopping quietly would leave Flush() and the producers waiting forever.
+	try
+	{
+		std::vector<PendingRequest> batch;
+
+		while (true)
+		{
+			batch.clear();
+			bool hasInFlight = false;
+			{
+				std::lock_guard<std::mutex> lock(m_InFlightMutex);
+				hasInFlight = !m_InFlight.empty();
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(m_QueueMutex);
+
+				auto hasWork = [&]() { return m_Quit || (!m_PendingRequests.empty() && m_PendingRequests.front().Ready); };
+
+				// While batches are in flight we wake up regularly to retire them
+				// and hand staging memory back to blocked producers.
+				if (hasInFlight)
+					m_QueueCv.wait_for(lock, std::chrono::milliseconds(1), hasWork);
+				else
+					m_QueueCv.wait(lock, hasWork);
+
+				if (m_Quit && m_PendingRequests.empty() && !hasInFlight)
+					return;
+
+				// Take ready requests from the front until the batch is big enough.
+				UINT64 batchBytes = 0;
+				while (!m_PendingRequests.empty() && m_PendingRequests.front().Ready &&
+					(batch.empty() || batchBytes + m_PendingRequests.front().StagingSize <= m_MaxBatchSize))
+				{
+					batchBytes += m_PendingRequests.front().StagingSize;
+					batch.push_back(std::move(m_PendingRequests.front()));
+					m_PendingRequests.pop_front();
+				}
+			}
+
+			if (!batch.empty())
+				SubmitBatch(batch);
+
+			RetireCompletedBatches();
+		}
+	}
+	catch (DxException& e)
+	{
+		LogUploader(L"the copy worker failed: " + e.ToString());
+		FailOutstanding();
+	}
+	catch (...)
+	{
+		LogUploader(L"the copy worker failed.");
+		FailOutstanding();
+	}
+}
+
+void StreamingUploader::SubmitBatch(std::vector<PendingRequest>& requests)
+{
+	InFlightBatch batch;
+	batch.FirstSequence = requests.front().Sequence;
+	batch.LastSequence = requests.back().Sequence;
+	batch.RingEnd = requests.back().RingEnd;
+	batch.NumRequests = static_cast<UINT>(requests.size());
+	batch.EnqueueTimes.reserve(requests.size());
+
+	for (const auto& request : requests)
+	{
+		if (request.IsTexture)
+		{
+			for (UINT i = 0; i < static_cast<UINT>(request.Layouts.size()); ++i)
+				m_Queue->CopyTexture(request.Dest, request.FirstSubresource + i, request.Layouts[i]);
+		}
+		else
+		{
+			m_Queue->CopyBuffer(request.Dest, request.DestOffset, request.StagingOffset, request.NumBytes);
+		}
+
+		batch.NumBytes += request.NumBytes;
+		batch.EnqueueTimes.push_back(request.EnqueueTime);
+	}
+
+	// One fence signal backs every ticket in the batch.
+	batch.FenceValue = m_Queue->Submit();
+
+	std::lock_guard<std::mutex> lock(m_InFlightMutex);
+	m_InFlight.push_back(std::move(batch));
+	m_Stats.BatchesSubmitted++;
+}
+
+void StreamingUploader::RetireCompletedBatches()
+{
+	UINT64 ringTail = 0;
+	UINT64 retiredSequence = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_InFlightMutex);
+
+		UINT64 completedFence = m_Queue->GetCompletedValue();
+		LARGE_INTEGER now = Now();
+		while (!m_InFlight.empty() && m_InFlight.front().FenceValue <= completedFence)
+		{
+			InFlightBatch& batch = m_InFlight.front();
+
+			for (const auto& enqueueTime : batch.EnqueueTimes)
+				m_Stats.TotalLatencySeconds += (now.QuadPart - enqueueTime.QuadPart) * m_SecondsPerCount;
+			m_Stats.RequestsCompleted += batch.NumRequests;
+			m_Stats.BytesCompleted += batch.NumBytes;
+
+			ringTail = batch.RingEnd;
+			retiredSequence = batch.LastSequence;
+			m_InFlight.pop_front();
+		}
+
+		if (retiredSequence == 0)
+			return;
+
+		// Published while m_InFlight is still locked so IsComplete() never sees
+		// a batch that is neither in flight nor retired.
+		m_RetiredSequence.store(retiredSequence, std::memory_order_release);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_QueueMutex);
+		m_RingTail = ringTail;
+	}
+	m_RingSpaceCv.notify_all();
+}
+
+void StreamingUploader::FailOutstanding()
+{
+	// Batches already in flight fail too: with the worker gone nobody would
+	// retire them, and after a device removal they never complete anyway.
+	std::lock(m_QueueMutex, m_InFlightMutex);
+	std::lock_guard<std::mutex> queueLock(m_QueueMutex, std::adopt_lock);
+	std::lock_guard<std::mutex> inFlightLock(m_InFlightMutex, std::adopt_lock);
+
+	UINT64 failedSequence = m_RetiredSequence.load() + 1;
+	m_Stats.RequestsFailed += m_NextSequence - failedSequence;
+	m_FailedSequence.store(failedSequence, std::memory_order_release);
+
+	m_InFlight.clear();
+	m_PendingRequests.clear();
+	m_RingSpaceCv.notify_all();
+}
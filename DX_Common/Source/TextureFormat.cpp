@@ -0,0 +1,208 @@
+#include "pch.h"
+
+#include "TextureFormat.h"
+
+#include <algorithm>
+
+namespace
+{
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+bool GetFormatInfo(DXGI_FORMAT format, FormatInfo& info)
+{
+	info = FormatInfo();
+
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+	case DXGI_FORMAT_R32G32B32A32_SINT:
+		info.BytesPerBlock = 16;
+		return true;
+
+	case DXGI_FORMAT_R32G32B32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:
+	case DXGI_FORMAT_R32G32B32_SINT:
+		info.BytesPerBlock = 12;
+		return true;
+
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+	case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:
+	case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:
+	case DXGI_FORMAT_R32G32_SINT:
+		info.BytesPerBlock = 8;
+		return true;
+
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		info.IsSRGB = true;
+		info.BytesPerBlock = 4;
+		return true;
+
+	case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UINT:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UINT:
+	case DXGI_FORMAT_R8G8B8A8_SNORM:
+	case DXGI_FORMAT_R8G8B8A8_SINT:
+	case DXGI_FORMAT_R16G16_TYPELESS:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R16G16_UINT:
+	case DXGI_FORMAT_R16G16_SNORM:
+	case DXGI_FORMAT_R16G16_SINT:
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_UINT:
+	case DXGI_FORMAT_R32_SINT:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+	case DXGI_FORMAT_D24_UNORM_S8_UINT:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+		info.BytesPerBlock = 4;
+		return true;
+
+	case DXGI_FORMAT_R8G8_TYPELESS:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:
+	case DXGI_FORMAT_R8G8_SINT:
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:
+	case DXGI_FORMAT_R16_SINT:
+		info.BytesPerBlock = 2;
+		return true;
+
+	case DXGI_FORMAT_R8_TYPELESS:
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:
+	case DXGI_FORMAT_R8_SINT:
+	case DXGI_FORMAT_A8_UNORM:
+		info.BytesPerBlock = 1;
+		return true;
+
+	// BC1 and BC4 store a 4x4 block in 8 bytes, the others in 16 bytes.
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		info.IsSRGB = true;
+		// fall through
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		info.BlockWidth = info.BlockHeight = 4;
+		info.BytesPerBlock = 8;
+		info.IsBlockCompressed = true;
+		return true;
+
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		info.IsSRGB = true;
+		// fall through
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+		info.BlockWidth = info.BlockHeight = 4;
+		info.BytesPerBlock = 16;
+		info.IsBlockCompressed = true;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+bool ComputeCopyableFootprints(
+	const D3D12_RESOURCE_DESC& desc,
+	UINT firstSubresource,
+	UINT numSubresources,
+	UINT64 baseOffset,
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts,
+	UINT* numRows,
+	UINT64* rowSizesInBytes,
+	UINT64* totalBytes)
+{
+	FormatInfo info;
+	if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER || !GetFormatInfo(desc.Format, info))
+		return false;
+
+	const UINT mipLevels = desc.MipLevels ? desc.MipLevels : 1;
+	const bool is3D = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+
+	UINT64 offset = AlignUp(baseOffset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	UINT64 end = offset;
+
+	for (UINT i = 0; i < numSubresources; ++i)
+	{
+		// Subresource index = MipSlice + ArraySlice * MipLevels
+		UINT subresource = firstSubresource + i;
+		UINT mip = subresource % mipLevels;
+
+		UINT width = std::max<UINT>(1, static_cast<UINT>(desc.Width >> mip));
+		UINT height = std::max<UINT>(1, desc.Height >> mip);
+		UINT depth = is3D ? std::max<UINT>(1, desc.DepthOrArraySize >> mip) : 1;
+
+		// The footprint of a BC texture is measured in whole blocks.
+		UINT blocksWide = (width + info.BlockWidth - 1) / info.BlockWidth;
+		UINT blocksHigh = (height + info.BlockHeight - 1) / info.BlockHeight;
+
+		UINT64 rowSize = UINT64(blocksWide) * info.BytesPerBlock;
+		UINT rowPitch = static_cast<UINT>(AlignUp(rowSize, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT));
+
+		offset = AlignUp(end, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+		if (layouts)
+		{
+			layouts[i].Offset = offset;
+			layouts[i].Footprint.Format = desc.Format;
+			layouts[i].Footprint.Width = blocksWide * info.BlockWidth;
+			layouts[i].Footprint.Height = blocksHigh * info.BlockHeight;
+			layouts[i].Footprint.Depth = depth;
+			layouts[i].Footprint.RowPitch = rowPitch;
+		}
+		if (numRows)
+			numRows[i] = blocksHigh;
+		if (rowSizesInBytes)
+			rowSizesInBytes[i] = rowSize;
+
+		// Like the runtime, the very last row of a subresource is not padded.
+		end = offset + UINT64(rowPitch) * (UINT64(blocksHigh) * depth - 1) + rowSize;
+	}
+
+	if (totalBytes)
+		*totalBytes = numSubresources ? end - AlignUp(baseOffset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT) : 0;
+
+	return true;
+}
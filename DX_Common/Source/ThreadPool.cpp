@@ -0,0 +1,155 @@
+#include "pch.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(UINT threadCount)
+{
+	if (threadCount == 0)
+	{
+		UINT hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	m_Threads.reserve(threadCount);
+	for (UINT i = 0; i < threadCount; ++i)
+		m_Threads.emplace_back(&ThreadPool::WorkerMain, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	WaitIdle();
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_WorkCv.notify_all();
+
+	for (auto& thread : m_Threads)
+		thread.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Tasks.push_back(std::move(task));
+	}
+	m_WorkCv.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_IdleCv.wait(lock, [this]() { return m_Tasks.empty() && m_ActiveTasks == 0; });
+}
+
+void ThreadPool::ParallelFor(UINT count, UINT grainSize, const std::function<void(UINT begin, UINT end)>& body)
+{
+	if (count == 0)
+		return;
+
+	grainSize = std::max(1u, grainSize);
+	const UINT chunkCount = (count + grainSize - 1) / grainSize;
+
+	// Not worth waking anybody up for.
+	if (chunkCount == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	// Chunks are claimed through a shared counter instead of one task per
+	// chunk: a few "runner" tasks each keep grabbing the next chunk until the
+	// range is exhausted. That keeps the queue short and balances uneven work.
+	//
+	// The counters live on the heap because a runner may only get dequeued
+	// after this call has returned. Such a runner finds no chunk left and
+	// never touches 'body', which by then is gone.
+	struct Shared
+	{
+		std::atomic<UINT> NextChunk{ 0 };
+		std::atomic<UINT> ChunksDone{ 0 };
+	};
+	auto shared = std::make_shared<Shared>();
+	const auto* bodyPtr = &body;
+
+	auto runChunks = [shared, bodyPtr, count, grainSize, chunkCount]()
+	{
+		UINT chunk;
+		while ((chunk = shared->NextChunk.fetch_add(1)) < chunkCount)
+		{
+			UINT begin = chunk * grainSize;
+			UINT end = std::min(count, begin + grainSize);
+			(*bodyPtr)(begin, end);
+			shared->ChunksDone.fetch_add(1);
+		}
+	};
+
+	const UINT runnerCount = std::min(chunkCount - 1, GetThreadCount());
+	for (UINT i = 0; i < runnerCount; ++i)
+		Submit(runChunks);
+
+	// The caller works too, then keeps draining the queue (possibly other
+	// callers' work) until its own chunks are finished.
+	runChunks();
+	while (shared->ChunksDone.load() < chunkCount)
+	{
+		if (!RunOneTask())
+			std::this_thread::yield();
+	}
+}
+
+bool ThreadPool::RunOneTask()
+{
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Tasks.empty())
+			return false;
+		task = std::move(m_Tasks.front());
+		m_Tasks.pop_front();
+		m_ActiveTasks++;
+	}
+
+	task();
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_ActiveTasks--;
+		if (m_Tasks.empty() && m_ActiveTasks == 0)
+			m_IdleCv.notify_all();
+	}
+	return true;
+}
+
+void ThreadPool::WorkerMain()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WorkCv.wait(lock, [this]() { return m_Quit || !m_Tasks.empty(); });
+			if (m_Quit && m_Tasks.empty())
+				return;
+
+			task = std::move(m_Tasks.front());
+			m_Tasks.pop_front();
+			m_ActiveTasks++;
+		}
+
+		task();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_ActiveTasks--;
+			if (m_Tasks.empty() && m_ActiveTasks == 0)
+				m_IdleCv.notify_all();
+		}
+	}
+}
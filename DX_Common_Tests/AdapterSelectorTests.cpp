@@ -0,0 +1,143 @@
+#include "TestFramework.h"
+
+#include "AdapterSelector.h"
+
+namespace
+{
+	AdapterCandidate Adapter(const wchar_t* description, UINT preferenceOrder, UINT64 dedicatedMegabytes,
+		D3D_FEATURE_LEVEL maxFeatureLevel, bool software = false,
+		D3D_SHADER_MODEL highestShaderModel = D3D_SHADER_MODEL_6_6,
+		D3D12_RAYTRACING_TIER raytracingTier = D3D12_RAYTRACING_TIER_1_1,
+		D3D12_MESH_SHADER_TIER meshShaderTier = D3D12_MESH_SHADER_TIER_1)
+	{
+		AdapterCandidate candidate;
+		candidate.Description = description;
+		candidate.PreferenceOrder = preferenceOrder;
+		candidate.DedicatedVideoMemory = dedicatedMegabytes << 20;
+		candidate.Software = software;
+		candidate.MaxFeatureLevel = maxFeatureLevel;
+		candidate.HighestShaderModel = highestShaderModel;
+		candidate.ResourceBindingTier = D3D12_RESOURCE_BINDING_TIER_3;
+		candidate.RaytracingTier = raytracingTier;
+		candidate.MeshShaderTier = meshShaderTier;
+		return candidate;
+	}
+
+	// A dual-GPU laptop, integrated GPU listed first as with nullptr.
+	std::vector<AdapterCandidate> Laptop()
+	{
+		return
+		{
+			Adapter(L"Intel Iris Xe", 0, 128, D3D_FEATURE_LEVEL_12_1, false, D3D_SHADER_MODEL_6_5,
+				D3D12_RAYTRACING_TIER_NOT_SUPPORTED, D3D12_MESH_SHADER_TIER_NOT_SUPPORTED),
+			Adapter(L"NVIDIA RTX 3060 Laptop", 1, 6144, D3D_FEATURE_LEVEL_12_2),
+			Adapter(L"Microsoft Basic Render Driver", 2, 0, D3D_FEATURE_LEVEL_12_1, true),
+		};
+	}
+
+	AdapterPolicy Policy()
+	{
+		AdapterPolicy policy;
+		policy.MinFeatureLevel = D3D_FEATURE_LEVEL_11_0;
+		return policy;
+	}
+
+	// Description of the selected candidate, or "" if none was.
+	std::wstring Select(const AdapterPolicy& policy, const std::vector<AdapterCandidate>& candidates)
+	{
+		AdapterSelector selector(policy);
+		for (const AdapterCandidate& candidate : candidates)
+			selector.AddCandidate(candidate);
+
+		const size_t selected = selector.Select();
+		return selected == AdapterSelector::NoAdapter ? std::wstring() : selector.GetCandidates()[selected].Description;
+	}
+}
+
+TEST_CASE(AdapterSelector_HighPerformancePrefersDiscrete)
+{
+	CHECK(Select(Policy(), Laptop()) == L"NVIDIA RTX 3060 Laptop");
+}
+
+TEST_CASE(AdapterSelector_MinimumPowerKeepsDxgiOrder)
+{
+	AdapterPolicy policy = Policy();
+	policy.Preference = DXGI_GPU_PREFERENCE_MINIMUM_POWER;
+	CHECK(Select(policy, Laptop()) == L"Intel Iris Xe");
+
+	// Requirements come before the preference.
+	policy.MinMeshShaderTier = D3D12_MESH_SHADER_TIER_1;
+	CHECK(Select(policy, Laptop()) == L"NVIDIA RTX 3060 Laptop");
+}
+
+TEST_CASE(AdapterSelector_SameMemoryBucketFallsThrough)
+{
+	// 8000 and 8100 MB are one 256 MB step: feature level decides, then order.
+	std::vector<AdapterCandidate> candidates =
+	{
+		Adapter(L"A", 0, 8000, D3D_FEATURE_LEVEL_12_1),
+		Adapter(L"B", 1, 8100, D3D_FEATURE_LEVEL_12_2),
+	};
+	CHECK(Select(Policy(), candidates) == L"B");
+
+	candidates[1].MaxFeatureLevel = D3D_FEATURE_LEVEL_12_1;
+	CHECK(Select(Policy(), candidates) == L"A");
+}
+
+TEST_CASE(AdapterSelector_SoftwareOnlyAsFallback)
+{
+	// Hardware wins even against more "memory".
+	const std::vector<AdapterCandidate> both =
+	{
+		Adapter(L"WARP", 0, 100000, D3D_FEATURE_LEVEL_12_2, true),
+		Adapter(L"GPU", 1, 512, D3D_FEATURE_LEVEL_12_0),
+	};
+	CHECK(Select(Policy(), both) == L"GPU");
+
+	AdapterPolicy policy = Policy();
+	policy.MinFeatureLevel = D3D_FEATURE_LEVEL_12_2;
+	policy.MinRaytracingTier = D3D12_RAYTRACING_TIER_1_1;
+	const std::vector<AdapterCandidate> oldGpu =
+	{
+		Adapter(L"Old GPU", 0, 4096, D3D_FEATURE_LEVEL_12_1),
+		Adapter(L"WARP", 1, 0, D3D_FEATURE_LEVEL_12_2, true),
+	};
+	CHECK(Select(policy, oldGpu) == L"WARP");
+
+	policy.AllowSoftware = false;
+	CHECK(Select(policy, oldGpu).empty());
+}
+
+TEST_CASE(AdapterSelector_Overrides)
+{
+	AdapterPolicy policy = Policy();
+	policy.Override = L"intel";
+	CHECK(Select(policy, Laptop()) == L"Intel Iris Xe");
+
+	policy.Override = L"#2";
+	CHECK(Select(policy, Laptop()) == L"Microsoft Basic Render Driver");
+
+	policy.Override = L"WARP";
+	CHECK(Select(policy, Laptop()) == L"Microsoft Basic Render Driver");
+
+	// Matching nothing, or nothing usable, is ignored.
+	policy.Override = L"AMD";
+	CHECK(Select(policy, Laptop()) == L"NVIDIA RTX 3060 Laptop");
+
+	policy.Override = L"intel";
+	policy.MinMeshShaderTier = D3D12_MESH_SHADER_TIER_1;
+	CHECK(Select(policy, Laptop()) == L"NVIDIA RTX 3060 Laptop");
+}
+
+TEST_CASE(AdapterSelector_IsUsableNamesTheMissingRequirement)
+{
+	const AdapterPolicy policy = Policy();
+	std::wstring reason;
+
+	// No device could be created: everything reads zero.
+	const AdapterCandidate noDevice = Adapter(L"X", 0, 1, static_cast<D3D_FEATURE_LEVEL>(0));
+	CHECK(!AdapterSelector::IsUsable(noDevice, policy, &reason));
+	CHECK(reason == L"feature level");
+
+	CHECK(AdapterSelector::IsUsable(Laptop()[0], policy, &reason));
+}
@@ -0,0 +1,214 @@
+#include "TestFramework.h"
+
+#include "AssetPack.h"
+#include "TextureFormat.h"
+#include "directx/d3dx12.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const std::filesystem::path s_File = L"AssetPackTests.pack";
+
+	// A texture that is only ever asked for its desc.
+	class FakeTexture : public ID3D12Resource
+	{
+	public:
+		explicit FakeTexture(const D3D12_RESOURCE_DESC& desc) : m_Desc(desc) {}
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** object) override
+		{
+			*object = nullptr;
+			return E_NOINTERFACE;
+		}
+		ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+		ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+		HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetName(LPCWSTR) override { return S_OK; }
+		HRESULT STDMETHODCALLTYPE GetDevice(REFIID, void** device) override
+		{
+			*device = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		HRESULT STDMETHODCALLTYPE Map(UINT, const D3D12_RANGE*, void**) override { return E_NOTIMPL; }
+		void STDMETHODCALLTYPE Unmap(UINT, const D3D12_RANGE*) override {}
+		D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc() override { return m_Desc; }
+		D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress() override { return 0; }
+		HRESULT STDMETHODCALLTYPE WriteToSubresource(UINT, const D3D12_BOX*, const void*, UINT, UINT) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE ReadFromSubresource(void*, UINT, UINT, UINT, const D3D12_BOX*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE GetHeapProperties(D3D12_HEAP_PROPERTIES*, D3D12_HEAP_FLAGS*) override { return E_NOTIMPL; }
+
+	private:
+		D3D12_RESOURCE_DESC m_Desc;
+	};
+
+	// A copy queue that finishes everything at once and copies nothing, so
+	// only the CPU side of a load is timed.
+	class InstantUploadQueue : public UploadQueue
+	{
+	public:
+		BYTE* CreateStagingBuffer(UINT64 size) override
+		{
+			m_Staging.resize(static_cast<size_t>(size));
+			return m_Staging.data();
+		}
+
+		void GetCopyableFootprints(const D3D12_RESOURCE_DESC& desc, UINT firstSubresource, UINT numSubresources,
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts, UINT* numRows, UINT64* rowSizes, UINT64* totalBytes) override
+		{
+			ComputeCopyableFootprints(desc, firstSubresource, numSubresources, 0, layouts, numRows, rowSizes, totalBytes);
+		}
+
+		void CopyBuffer(ID3D12Resource*, UINT64, UINT64, UINT64) override {}
+		void CopyTexture(ID3D12Resource*, UINT, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT&) override {}
+		UINT64 Submit() override { return ++m_Completed; }
+		UINT64 GetCompletedValue() override { return m_Completed; }
+		void Wait(ID3D12CommandQueue*, UINT64) override {}
+
+	private:
+		std::vector<BYTE> m_Staging;
+		std::atomic<UINT64> m_Completed{ 0 };
+	};
+
+	std::string AssetName(int index)
+	{
+		return "textures/asset" + std::to_string(index) + ".dds";
+	}
+
+	// RGBA8, 'size' squared, full mip chain.
+	D3D12_RESOURCE_DESC TextureDesc(UINT size)
+	{
+		UINT16 mipLevels = 1;
+		while ((size >> mipLevels) != 0)
+			++mipLevels;
+		return CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, size, size, 1, mipLevels);
+	}
+
+	bool WritePack(int count, UINT size)
+	{
+		const D3D12_RESOURCE_DESC desc = TextureDesc(size);
+		std::vector<std::vector<BYTE>> mips;
+		std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+		for (UINT16 mip = 0; mip < desc.MipLevels; ++mip)
+		{
+			const UINT width = std::max(size >> mip, 1u);
+			mips.emplace_back(SIZE_T(width) * width * 4);
+		}
+		for (UINT16 mip = 0; mip < desc.MipLevels; ++mip)
+		{
+			const UINT width = std::max(size >> mip, 1u);
+			subresources.push_back({ mips[mip].data(), LONG_PTR(width) * 4, LONG_PTR(width) * width * 4 });
+		}
+
+		AssetPackWriter writer;
+		for (int i = 0; i < count; ++i)
+		{
+			for (std::vector<BYTE>& mip : mips)
+				mip[0] = static_cast<BYTE>(i);
+			if (!writer.AddTexture(AssetName(i), desc, subresources.data()))
+				return false;
+		}
+		return writer.Write(s_File.wstring());
+	}
+
+	// Open, look up and upload every asset straight from the mapped file.
+	void LoadMapped(int count, StreamingUploader& uploader, std::vector<FakeTexture>& textures, UINT64& bytes)
+	{
+		AssetPack pack;
+		if (!pack.Open(s_File.wstring()))
+			return;
+		for (int i = 0; i < count; ++i)
+		{
+			const AssetPackEntry* entry = pack.FindAsset(AssetName(i));
+			if (entry == nullptr || !pack.UploadTexture(uploader, &textures[i], *entry).IsValid())
+				return;
+			bytes += entry->PayloadSize;
+		}
+		uploader.Flush();
+	}
+
+	// The same, but each payload is read into memory first and handed over
+	// as D3D12_SUBRESOURCE_DATA, as loose files would be.
+	void LoadCopied(int count, StreamingUploader& uploader, std::vector<FakeTexture>& textures, UINT64& bytes)
+	{
+		AssetPack pack;
+		if (!pack.Open(s_File.wstring()))
+			return;
+		std::ifstream file(s_File, std::ios::binary);
+		std::vector<BYTE> payload;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts;
+		std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+		for (int i = 0; i < count; ++i)
+		{
+			const AssetPackEntry* entry = pack.FindAsset(AssetName(i));
+			if (entry == nullptr)
+				return;
+			payload.resize(static_cast<size_t>(entry->PayloadSize));
+			file.seekg(static_cast<std::streamoff>(entry->PayloadOffset));
+			file.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+
+			pack.GetTextureLayouts(*entry, layouts);
+			subresources.clear();
+			for (const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout : layouts)
+			{
+				const LONG_PTR rowPitch = layout.Footprint.RowPitch;
+				subresources.push_back({ payload.data() + layout.Offset, rowPitch, rowPitch * layout.Footprint.Height });
+			}
+			if (!uploader.UploadTexture(&textures[i], 0, entry->SubresourceCount, subresources.data()).IsValid())
+				return;
+			bytes += entry->PayloadSize;
+		}
+		uploader.Flush();
+	}
+}
+
+BENCHMARK(AssetPack_LoadTime)
+{
+	// The OS file cache is not emptied in between, so the first run is only
+	// as cold as the cache happens to be; after writing the pack it is warm.
+	// Empty the standby list (RAMMap) and run just this benchmark for a
+	// real cold load.
+	const int count = 1000;
+	const UINT size = 128;
+	REQUIRE(WritePack(count, size));
+
+	std::vector<FakeTexture> textures(count, FakeTexture(TextureDesc(size)));
+
+	typedef void (*LoadFunction)(int, StreamingUploader&, std::vector<FakeTexture>&, UINT64&);
+	const struct
+	{
+		const char* Name;
+		LoadFunction Load;
+	} loads[] =
+	{
+		{ "mapped, first run", &LoadMapped },
+		{ "mapped, warm", &LoadMapped },
+		{ "read + copy, warm", &LoadCopied },
+	};
+	for (const auto& load : loads)
+	{
+		InstantUploadQueue queue;
+		StreamingUploader uploader(&queue);
+		UINT64 bytes = 0;
+
+		Testing::Stopwatch stopwatch;
+		load.Load(count, uploader, textures, bytes);
+		const double seconds = stopwatch.Seconds();
+
+		CHECK(uploader.GetStats().RequestsCompleted == count);
+		printf("  %-18s %d textures, %6.1f MB: %7.2f ms, %6.0f MB/s\n", load.Name, count, bytes / (1024.0 * 1024.0),
+			seconds * 1000.0, bytes / seconds / (1024.0 * 1024.0));
+	}
+
+	std::filesystem::remove(s_File);
+}
@@ -0,0 +1,182 @@
+#include "TestFramework.h"
+
+#include "AsyncFileReader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const std::filesystem::path s_File = L"AsyncFileReaderTests.bin";
+	const UINT64 s_FileSize = 128ull * 1024 * 1024;
+
+	bool WriteTestFile()
+	{
+		std::vector<char> chunk(1024 * 1024);
+		for (size_t i = 0; i < chunk.size(); ++i)
+			chunk[i] = static_cast<char>(i * 131);
+
+		std::ofstream file(s_File, std::ios::binary | std::ios::trunc);
+		for (UINT64 written = 0; written < s_FileSize; written += chunk.size())
+			file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+		return static_cast<bool>(file);
+	}
+
+	struct Result
+	{
+		double Seconds = 0.0;
+		double MeanMilliseconds = 0.0;
+		double P99Milliseconds = 0.0;
+		UINT64 Bytes = 0;
+		UINT Failed = 0;
+	};
+
+	// Keeps exactly 'depth' reads outstanding: each completion issues the
+	// next read into the buffer it just filled. With the reader's queue depth
+	// set to match, nothing waits in its queues, so the latency is the OS's.
+	class QueueDepthRun
+	{
+	public:
+		QueueDepthRun(AsyncFileReader& reader, AsyncFileHandle file, UINT depth, UINT size, bool random)
+			: m_Reader(reader)
+			, m_File(file)
+			, m_Size(size)
+		{
+			const UINT64 blocks = s_FileSize / size;
+			const UINT64 count = random ? std::min<UINT64>(blocks, 16384) : blocks;
+			std::mt19937_64 engine(1);
+			std::uniform_int_distribution<UINT64> block(0, blocks - 1);
+			for (UINT64 i = 0; i < count; ++i)
+				m_Offsets.push_back((random ? block(engine) : i) * size);
+			m_SubmitTimes.resize(m_Offsets.size());
+			m_Latencies.resize(m_Offsets.size());
+
+			const std::align_val_t alignment = static_cast<std::align_val_t>(AsyncFileReader::GetSectorAlignment());
+			for (UINT slot = 0; slot < depth; ++slot)
+				m_Buffers.push_back(static_cast<BYTE*>(::operator new(size, alignment)));
+		}
+
+		~QueueDepthRun()
+		{
+			const std::align_val_t alignment = static_cast<std::align_val_t>(AsyncFileReader::GetSectorAlignment());
+			for (BYTE* buffer : m_Buffers)
+				::operator delete(buffer, alignment);
+		}
+
+		Result Run()
+		{
+			m_Reader.SetQueueDepth(static_cast<UINT>(m_Buffers.size()));
+			Testing::Stopwatch stopwatch;
+			for (UINT slot = 0; slot < m_Buffers.size(); ++slot)
+				Issue(slot);
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_DoneCv.wait(lock, [&]() { return m_Done == m_Offsets.size(); });
+			}
+
+			Result result;
+			result.Seconds = stopwatch.Seconds();
+			result.Bytes = UINT64(m_Offsets.size()) * m_Size;
+			result.Failed = m_Failed;
+			for (double latency : m_Latencies)
+				result.MeanMilliseconds += latency / m_Latencies.size();
+			std::sort(m_Latencies.begin(), m_Latencies.end());
+			result.P99Milliseconds = m_Latencies[m_Latencies.size() * 99 / 100];
+			return result;
+		}
+
+	private:
+		void Issue(UINT slot)
+		{
+			const size_t index = m_Next++;
+			if (index >= m_Offsets.size())
+				return;
+
+			AsyncReadRequest request;
+			request.File = m_File;
+			request.Offset = m_Offsets[index];
+			request.Size = m_Size;
+			request.Buffer = m_Buffers[slot];
+			request.OnComplete = [this, slot, index](AsyncReadId, AsyncReadStatus status, UINT)
+			{
+				const std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - m_SubmitTimes[index];
+				m_Latencies[index] = latency.count();
+				if (status != AsyncReadStatus::Completed)
+					++m_Failed;
+				Issue(slot);
+
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				if (++m_Done == m_Offsets.size())
+					m_DoneCv.notify_one();
+			};
+			m_SubmitTimes[index] = std::chrono::steady_clock::now();
+			m_Reader.Submit(request);
+		}
+
+	private:
+		AsyncFileReader& m_Reader;
+		AsyncFileHandle m_File;
+		UINT m_Size;
+		std::vector<UINT64> m_Offsets;
+		std::vector<BYTE*> m_Buffers;
+		std::vector<std::chrono::steady_clock::time_point> m_SubmitTimes;
+		std::vector<double> m_Latencies;
+		std::atomic<size_t> m_Next{ 0 };
+		std::atomic<UINT> m_Failed{ 0 };
+
+		std::mutex m_Mutex;
+		std::condition_variable m_DoneCv;
+		size_t m_Done = 0;
+	};
+}
+
+BENCHMARK(AsyncFileReader_QueueDepth)
+{
+	// Unbuffered reads skip the file cache, so they measure the drive even
+	// though the file was just written. Buffered ones are shown for contrast.
+	REQUIRE(WriteTestFile());
+	{
+		AsyncFileReader reader;
+		const AsyncFileHandle unbuffered = reader.OpenFile(s_File.wstring(), true);
+		const AsyncFileHandle buffered = reader.OpenFile(s_File.wstring(), false);
+		REQUIRE(unbuffered != 0 && buffered != 0);
+
+		const struct
+		{
+			const char* Name;
+			UINT Size;
+			bool Random;
+		} patterns[] =
+		{
+			{ "1 MB sequential", 1024 * 1024, false },
+			{ "64 KB random", 64 * 1024, true },
+			{ "4 KB random", 4 * 1024, true },
+		};
+		for (const auto& pattern : patterns)
+		{
+			for (int cached = 0; cached < 2; ++cached)
+			{
+				for (UINT depth = 1; depth <= 64; depth *= 2)
+				{
+					QueueDepthRun run(reader, cached ? buffered : unbuffered, depth, pattern.Size, pattern.Random);
+					const Result result = run.Run();
+					CHECK(result.Failed == 0);
+					printf("  %-16s %-10s depth %2u: %7.0f MB/s, %7.0f reads/s, latency %6.3f ms mean, %6.3f ms p99\n",
+						pattern.Name, cached ? "buffered" : "unbuffered", depth,
+						result.Bytes / result.Seconds / (1024.0 * 1024.0), result.Bytes / pattern.Size / result.Seconds,
+						result.MeanMilliseconds, result.P99Milliseconds);
+				}
+			}
+		}
+	}
+	std::filesystem::remove(s_File);
+}
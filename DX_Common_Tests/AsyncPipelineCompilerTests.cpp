@@ -0,0 +1,195 @@
+#include "TestFramework.h"
+
+#include "AsyncPipelineCompiler.h"
+#include "PipelineCache.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Pipelines are only handed back to the caller, never called, so any
+	// distinct addresses will do.
+	int s_PipelineStorage[64];
+
+	ID3D12PipelineState* FakePipeline(int index)
+	{
+		return reinterpret_cast<ID3D12PipelineState*>(&s_PipelineStorage[index]);
+	}
+
+	const BYTE s_ComputeShader[] = { 'D', 'X', 'B', 'C', 1, 2, 3, 4 };
+	int s_RootSignature;
+
+	// Only PipelineCache::HashPipelineStream looks at the contents; the
+	// compile functions below ignore them.
+	D3D12_COMPUTE_PIPELINE_STATE_DESC ComputeDesc()
+	{
+		D3D12_COMPUTE_PIPELINE_STATE_DESC desc = {};
+		desc.pRootSignature = reinterpret_cast<ID3D12RootSignature*>(&s_RootSignature);
+		desc.CS = { s_ComputeShader, sizeof(s_ComputeShader) };
+		return desc;
+	}
+}
+
+TEST_CASE(AsyncPipelineCompiler_ThrowingCompileFails)
+{
+	// Any exception, not only DxException, marks the pipeline failed and
+	// still lets WaitIdle() return.
+	ThreadPool pool(1);
+	AsyncPipelineCompiler compiler(nullptr, &pool);
+	compiler.SetCompileFunc([](const D3D12_PIPELINE_STATE_STREAM_DESC&) -> ID3D12PipelineState*
+	{
+		throw std::runtime_error("compiler crashed");
+	});
+
+	const PipelineHandle handle = compiler.Request(ComputeDesc());
+	compiler.WaitIdle();
+
+	CHECK(compiler.GetStatus(handle) == PipelineStatus::Failed);
+	CHECK(compiler.GetPipeline(handle) == nullptr);
+	CHECK(compiler.GetStats().Failed == 1);
+	CHECK(compiler.GetStats().DrawsSkipped == 1);
+}
+
+TEST_CASE(AsyncPipelineCompiler_FailedRequestIsRetried)
+{
+	// The first compile fails. Requesting the same pipeline again queues it
+	// on the same handle instead of returning the failure; once it is ready,
+	// further requests are deduplicated.
+	PipelineCache cache; // only hashes; never initialized
+	ThreadPool pool(1);
+	AsyncPipelineCompiler compiler(&cache, &pool);
+	std::atomic<int> calls{ 0 };
+	compiler.SetCompileFunc([&](const D3D12_PIPELINE_STATE_STREAM_DESC&) -> ID3D12PipelineState*
+	{
+		return calls.fetch_add(1) == 0 ? nullptr : FakePipeline(0);
+	});
+
+	const PipelineHandle first = compiler.Request(ComputeDesc());
+	compiler.WaitIdle();
+	REQUIRE(compiler.GetStatus(first) == PipelineStatus::Failed);
+
+	const PipelineHandle retried = compiler.Request(ComputeDesc());
+	compiler.WaitIdle();
+	CHECK(retried == first);
+	CHECK(compiler.GetStatus(first) == PipelineStatus::Ready);
+	CHECK(compiler.GetPipeline(first) == FakePipeline(0));
+
+	CHECK(compiler.Request(ComputeDesc()) == first);
+	compiler.WaitIdle();
+	CHECK(calls.load() == 2);
+
+	const AsyncPipelineCompiler::Stats stats = compiler.GetStats();
+	CHECK(stats.Requests == 3);
+	CHECK(stats.Retries == 1);
+	CHECK(stats.Deduplicated == 1);
+	CHECK(stats.Failed == 1);
+	CHECK(stats.Compiled == 1);
+}
+
+TEST_CASE(AsyncPipelineCompiler_FallbackUntilReady)
+{
+	// The fallback compiles at once; the material's compile is held until
+	// the test releases it.
+	ThreadPool pool(1);
+	AsyncPipelineCompiler compiler(nullptr, &pool);
+	std::atomic<int> calls{ 0 };
+	std::atomic<bool> release{ false };
+	compiler.SetCompileFunc([&](const D3D12_PIPELINE_STATE_STREAM_DESC&) -> ID3D12PipelineState*
+	{
+		if (calls.fetch_add(1) == 0)
+			return FakePipeline(1);
+		while (!release.load())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return FakePipeline(2);
+	});
+
+	const PipelineHandle fallback = compiler.Request(ComputeDesc());
+	compiler.WaitIdle();
+	const PipelineHandle material = compiler.Request(ComputeDesc());
+	compiler.SetFallback(material, fallback);
+
+	CHECK(!compiler.IsReady(material));
+	CHECK(compiler.GetPipeline(material) == FakePipeline(1));
+
+	release.store(true);
+	compiler.WaitIdle();
+	CHECK(compiler.GetPipeline(material) == FakePipeline(2));
+
+	const AsyncPipelineCompiler::Stats stats = compiler.GetStats();
+	CHECK(stats.DrawsWithFallback == 1);
+	CHECK(stats.DrawsReady == 1);
+	CHECK(stats.DrawsSkipped == 0);
+}
+
+BENCHMARK(AsyncPipelineCompiler_Hitches)
+{
+	// 120 frames of 4 ms. A new material shows up every 8th frame and is
+	// drawn every frame from then on; 16 background pipelines are prewarmed
+	// at the start. Every compile takes 25 ms. Compiled synchronously each
+	// new material stalls its frame; asynchronously it is drawn with the
+	// fallback until ready.
+	const int frameCount = 120;
+	const int backgroundCount = 16;
+	const auto frameWork = std::chrono::milliseconds(4);
+	const auto compileTime = std::chrono::milliseconds(25);
+	const double longFrameMilliseconds = 1000.0 / 60.0;
+
+	const char* const modes[] = { "synchronous", "async, 2 workers" };
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		ThreadPool pool(2);
+		AsyncPipelineCompiler compiler(nullptr, mode == 0 ? nullptr : &pool);
+		std::atomic<int> compiled{ 0 };
+		compiler.SetCompileFunc([&](const D3D12_PIPELINE_STATE_STREAM_DESC&)
+		{
+			std::this_thread::sleep_for(compileTime);
+			return FakePipeline(compiled.fetch_add(1) % 64);
+		});
+
+		// Loading screen: the fallback is ready before the first frame.
+		const PipelineHandle fallback = compiler.Request(ComputeDesc(), PipelinePriority::Visible);
+		compiler.WaitIdle();
+
+		std::vector<PipelineHandle> visible;
+		double worstFrame = 0.0;
+		int longFrames = 0;
+		Testing::Stopwatch total;
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			Testing::Stopwatch stopwatch;
+			if (frame == 0)
+			{
+				for (int i = 0; i < backgroundCount; ++i)
+					compiler.Request(ComputeDesc(), PipelinePriority::Background);
+			}
+			if (frame % 8 == 0)
+			{
+				visible.push_back(compiler.Request(ComputeDesc()));
+				compiler.SetFallback(visible.back(), fallback);
+			}
+			for (PipelineHandle handle : visible)
+				compiler.GetPipeline(handle);
+			std::this_thread::sleep_for(frameWork);
+
+			const double milliseconds = stopwatch.Seconds() * 1000.0;
+			worstFrame = std::max(worstFrame, milliseconds);
+			longFrames += milliseconds > longFrameMilliseconds ? 1 : 0;
+		}
+		const double totalSeconds = total.Seconds();
+		compiler.WaitIdle();
+
+		const AsyncPipelineCompiler::Stats stats = compiler.GetStats();
+		CHECK(stats.Compiled == 1 + backgroundCount + (frameCount + 7) / 8);
+		printf("  %-16s: %d frames in %6.0f ms, worst %6.1f ms, %3d over %.1f ms;"
+			" draws %u ready, %u fallback, %u skipped; latency %.1f ms max\n",
+			modes[mode], frameCount, totalSeconds * 1000.0, worstFrame, longFrames, longFrameMilliseconds,
+			stats.DrawsReady, stats.DrawsWithFallback, stats.DrawsSkipped, stats.MaxLatencyMilliseconds);
+	}
+}
@@ -0,0 +1,176 @@
+#include "TestFramework.h"
+
+#include "BCEncoder.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const UINT s_Size = 64;
+
+	struct Format
+	{
+		const char* Name;
+		DXGI_FORMAT Format;
+		UINT Channels; // leading RGBA channels the format stores
+	};
+
+	const Format s_Formats[] =
+	{
+		{ "BC1", DXGI_FORMAT_BC1_UNORM, 3 },
+		{ "BC3", DXGI_FORMAT_BC3_UNORM, 4 },
+		{ "BC4", DXGI_FORMAT_BC4_UNORM, 1 },
+		{ "BC5", DXGI_FORMAT_BC5_UNORM, 2 },
+		{ "BC7", DXGI_FORMAT_BC7_UNORM, 4 },
+	};
+
+	// Smooth ramps in every channel, each running in its own direction.
+	std::vector<BYTE> Gradient(bool opaque)
+	{
+		std::vector<BYTE> texels(s_Size * s_Size * 4);
+		for (UINT y = 0; y < s_Size; ++y)
+		{
+			for (UINT x = 0; x < s_Size; ++x)
+			{
+				BYTE* texel = &texels[(y * s_Size + x) * 4];
+				texel[0] = static_cast<BYTE>(x * 255 / (s_Size - 1));
+				texel[1] = static_cast<BYTE>(y * 255 / (s_Size - 1));
+				texel[2] = static_cast<BYTE>((x + y) * 255 / (2 * s_Size - 2));
+				texel[3] = opaque ? 255 : static_cast<BYTE>(255 - (x + s_Size - 1 - y) * 255 / (2 * s_Size - 2));
+			}
+		}
+		return texels;
+	}
+
+	std::vector<BYTE> Noise(bool opaque)
+	{
+		std::vector<BYTE> texels(s_Size * s_Size * 4);
+		std::mt19937 random(5);
+		for (size_t i = 0; i < texels.size(); ++i)
+			texels[i] = (opaque && i % 4 == 3) ? 255 : static_cast<BYTE>(random());
+		return texels;
+	}
+
+	// Encodes, decodes every block and compares the channels the format stores.
+	double RoundTripPsnr(const BCEncoder& encoder, const Format& format, const std::vector<BYTE>& texels, BCQuality quality)
+	{
+		const UINT blocks = s_Size / 4;
+		const UINT blockSize = BCEncoder::GetBlockSize(format.Format);
+		std::vector<BYTE> encoded(blocks * blocks * blockSize);
+		if (!encoder.EncodeSurface(format.Format, texels.data(), s_Size * 4, s_Size, s_Size, encoded.data(),
+			blocks * blockSize, quality))
+		{
+			return 0.0;
+		}
+
+		double squaredError = 0.0;
+		for (UINT by = 0; by < blocks; ++by)
+		{
+			for (UINT bx = 0; bx < blocks; ++bx)
+			{
+				BYTE decoded[16 * 4];
+				if (!BCEncoder::DecodeBlock(format.Format, &encoded[(by * blocks + bx) * blockSize], decoded))
+					return 0.0;
+				for (UINT i = 0; i < 16; ++i)
+				{
+					const BYTE* source = &texels[((by * 4 + i / 4) * s_Size + bx * 4 + i % 4) * 4];
+					for (UINT c = 0; c < format.Channels; ++c)
+					{
+						const double error = double(decoded[i * 4 + c]) - source[c];
+						squaredError += error * error;
+					}
+				}
+			}
+		}
+
+		const double meanSquaredError = squaredError / (double(s_Size) * s_Size * format.Channels);
+		return meanSquaredError == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+	}
+}
+
+TEST_CASE(BCEncoder_GradientRoundTrip)
+{
+	// Smooth content is what BC is built for; anything under these is a
+	// broken endpoint fit rather than the format's limit.
+	const double minimumPsnr[] = { 36.0, 37.0, 48.0, 48.0, 37.0 };
+	BCEncoder encoder;
+	for (size_t f = 0; f < _countof(s_Formats); ++f)
+	{
+		const Format& format = s_Formats[f];
+		const std::vector<BYTE> texels = Gradient(format.Format == DXGI_FORMAT_BC1_UNORM);
+		const double psnr = RoundTripPsnr(encoder, format, texels, BCQuality::Normal);
+		if (psnr < minimumPsnr[f])
+			printf("  %s: %.2f dB\n", format.Name, psnr);
+		CHECK(psnr >= minimumPsnr[f]);
+	}
+}
+
+TEST_CASE(BCEncoder_NoiseRoundTrip)
+{
+	// Noise is the worst case: four or eight palette entries per block
+	// cannot follow it. BC4/BC5 have the most entries per channel and do best.
+	const double minimumPsnr[] = { 12.0, 13.0, 27.0, 27.0, 12.0 };
+	BCEncoder encoder;
+	for (size_t f = 0; f < _countof(s_Formats); ++f)
+	{
+		const Format& format = s_Formats[f];
+		const std::vector<BYTE> texels = Noise(format.Format == DXGI_FORMAT_BC1_UNORM);
+		const double psnr = RoundTripPsnr(encoder, format, texels, BCQuality::Normal);
+		if (psnr < minimumPsnr[f])
+			printf("  %s: %.2f dB\n", format.Name, psnr);
+		CHECK(psnr >= minimumPsnr[f]);
+	}
+}
+
+TEST_CASE(BCEncoder_QualityLevelsDoNotGetWorse)
+{
+	BCEncoder encoder;
+	for (const Format& format : s_Formats)
+	{
+		for (int noise = 0; noise < 2; ++noise)
+		{
+			const bool opaque = format.Format == DXGI_FORMAT_BC1_UNORM;
+			const std::vector<BYTE> texels = noise ? Noise(opaque) : Gradient(opaque);
+			const double fast = RoundTripPsnr(encoder, format, texels, BCQuality::Fast);
+			const double normal = RoundTripPsnr(encoder, format, texels, BCQuality::Normal);
+			const double high = RoundTripPsnr(encoder, format, texels, BCQuality::High);
+			CHECK(normal >= fast - 0.1);
+			CHECK(high >= normal - 0.1);
+		}
+	}
+}
+
+BENCHMARK(BCEncoder_Throughput)
+{
+	// 1024^2 of noise, so no block is an easy one.
+	const UINT size = 1024;
+	std::vector<BYTE> texels(size * size * 4);
+	std::mt19937 random(9);
+	for (BYTE& texel : texels)
+		texel = static_cast<BYTE>(random());
+
+	ThreadPool pool;
+	const char* qualityNames[] = { "Fast", "Normal", "High" };
+	for (const Format& format : s_Formats)
+	{
+		const UINT blockSize = BCEncoder::GetBlockSize(format.Format);
+		std::vector<BYTE> encoded((size / 4) * (size / 4) * blockSize);
+		for (int quality = 0; quality < 3; ++quality)
+		{
+			for (int threaded = 0; threaded < 2; ++threaded)
+			{
+				BCEncoder encoder(threaded ? &pool : nullptr);
+				Testing::Stopwatch stopwatch;
+				CHECK(encoder.EncodeSurface(format.Format, texels.data(), size * 4, size, size, encoded.data(),
+					(size / 4) * blockSize, static_cast<BCQuality>(quality)));
+				const double seconds = stopwatch.Seconds();
+				printf("  %s %-6s %-8s %8.2f ms, %7.1f Mtexel/s\n", format.Name, qualityNames[quality],
+					threaded ? "pool" : "1 thread", seconds * 1000.0, double(size) * size / seconds / 1e6);
+			}
+		}
+	}
+}
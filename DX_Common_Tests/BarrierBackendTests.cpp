@@ -0,0 +1,268 @@
+#include "TestFramework.h"
+
+#include "BarrierBackend.h"
+#include "FakeResource.h"
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+
+namespace
+{
+	bool Matches(const BarrierBackend::EnhancedState& state, D3D12_BARRIER_SYNC sync, D3D12_BARRIER_ACCESS access, D3D12_BARRIER_LAYOUT layout)
+	{
+		return state.Sync == sync && state.Access == access && state.Layout == layout;
+	}
+
+	using Testing::FakeResource;
+
+	D3D12_RESOURCE_BARRIER Transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after,
+		D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE, UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+	{
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = flags;
+		barrier.Transition.pResource = resource;
+		barrier.Transition.Subresource = subresource;
+		barrier.Transition.StateBefore = before;
+		barrier.Transition.StateAfter = after;
+		return barrier;
+	}
+
+	D3D12_RESOURCE_BARRIER UavBarrier(ID3D12Resource* resource)
+	{
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+		barrier.UAV.pResource = resource;
+		return barrier;
+	}
+
+	bool HasCounts(const BarrierBackend::Translation::Call& call, UINT32 global, UINT32 buffer, UINT32 texture)
+	{
+		return call.Legacy == nullptr && call.GlobalCount == global && call.BufferCount == buffer && call.TextureCount == texture;
+	}
+
+	// The enhanced texture barrier says the same as the legacy transition.
+	bool IsEquivalent(const D3D12_TEXTURE_BARRIER& enhanced, const D3D12_RESOURCE_BARRIER& legacy)
+	{
+		BarrierBackend::EnhancedState before = {};
+		BarrierBackend::EnhancedState after = {};
+		if (!BarrierBackend::TranslateState(legacy.Transition.StateBefore, before) ||
+			!BarrierBackend::TranslateState(legacy.Transition.StateAfter, after))
+		{
+			return false;
+		}
+		return enhanced.pResource == legacy.Transition.pResource &&
+			enhanced.Subresources.IndexOrFirstMipLevel == legacy.Transition.Subresource &&
+			enhanced.AccessBefore == before.Access && enhanced.AccessAfter == after.Access &&
+			enhanced.LayoutBefore == before.Layout && enhanced.LayoutAfter == after.Layout;
+	}
+}
+
+TEST_CASE(BarrierBackend_TranslatesSingleStates)
+{
+	struct Row
+	{
+		D3D12_RESOURCE_STATES State;
+		D3D12_BARRIER_SYNC Sync;
+		D3D12_BARRIER_ACCESS Access;
+		D3D12_BARRIER_LAYOUT Layout;
+	};
+	const Row rows[] =
+	{
+		{ D3D12_RESOURCE_STATE_INDEX_BUFFER,              D3D12_BARRIER_SYNC_INDEX_INPUT,       D3D12_BARRIER_ACCESS_INDEX_BUFFER,        D3D12_BARRIER_LAYOUT_GENERIC_READ },
+		{ D3D12_RESOURCE_STATE_RENDER_TARGET,             D3D12_BARRIER_SYNC_RENDER_TARGET,     D3D12_BARRIER_ACCESS_RENDER_TARGET,       D3D12_BARRIER_LAYOUT_RENDER_TARGET },
+		{ D3D12_RESOURCE_STATE_DEPTH_WRITE,               D3D12_BARRIER_SYNC_DEPTH_STENCIL,     D3D12_BARRIER_ACCESS_DEPTH_STENCIL_WRITE, D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_WRITE },
+		{ D3D12_RESOURCE_STATE_DEPTH_READ,                D3D12_BARRIER_SYNC_DEPTH_STENCIL,     D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ,  D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ },
+		{ D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_BARRIER_SYNC_NON_PIXEL_SHADING, D3D12_BARRIER_ACCESS_SHADER_RESOURCE,     D3D12_BARRIER_LAYOUT_SHADER_RESOURCE },
+		{ D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,     D3D12_BARRIER_SYNC_PIXEL_SHADING,     D3D12_BARRIER_ACCESS_SHADER_RESOURCE,     D3D12_BARRIER_LAYOUT_SHADER_RESOURCE },
+		{ D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,         D3D12_BARRIER_SYNC_EXECUTE_INDIRECT,  D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT,   D3D12_BARRIER_LAYOUT_GENERIC_READ },
+		{ D3D12_RESOURCE_STATE_COPY_DEST,                 D3D12_BARRIER_SYNC_COPY,              D3D12_BARRIER_ACCESS_COPY_DEST,           D3D12_BARRIER_LAYOUT_COPY_DEST },
+		{ D3D12_RESOURCE_STATE_COPY_SOURCE,               D3D12_BARRIER_SYNC_COPY,              D3D12_BARRIER_ACCESS_COPY_SOURCE,         D3D12_BARRIER_LAYOUT_COPY_SOURCE },
+		{ D3D12_RESOURCE_STATE_RESOLVE_DEST,              D3D12_BARRIER_SYNC_RESOLVE,           D3D12_BARRIER_ACCESS_RESOLVE_DEST,        D3D12_BARRIER_LAYOUT_RESOLVE_DEST },
+		{ D3D12_RESOURCE_STATE_RESOLVE_SOURCE,            D3D12_BARRIER_SYNC_RESOLVE,           D3D12_BARRIER_ACCESS_RESOLVE_SOURCE,      D3D12_BARRIER_LAYOUT_RESOLVE_SOURCE },
+	};
+
+	for (const Row& row : rows)
+	{
+		BarrierBackend::EnhancedState state = {};
+		CHECK(BarrierBackend::TranslateState(row.State, state));
+		CHECK(Matches(state, row.Sync, row.Access, row.Layout));
+	}
+}
+
+TEST_CASE(BarrierBackend_UnorderedAccessCoversClears)
+{
+	// ClearUnorderedAccessView* is not a shader stage, so a UAV barrier
+	// that only names shading would not wait for it.
+	BarrierBackend::EnhancedState state = {};
+	CHECK(BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_UNORDERED_ACCESS, state));
+	CHECK(state.Sync & D3D12_BARRIER_SYNC_ALL_SHADING);
+	CHECK(state.Sync & D3D12_BARRIER_SYNC_CLEAR_UNORDERED_ACCESS_VIEW);
+	CHECK(state.Access == D3D12_BARRIER_ACCESS_UNORDERED_ACCESS);
+	CHECK(state.Layout == D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS);
+}
+
+TEST_CASE(BarrierBackend_CommonStaysConservative)
+{
+	BarrierBackend::EnhancedState state = {};
+	CHECK(BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_COMMON, state));
+	CHECK(Matches(state, D3D12_BARRIER_SYNC_ALL, D3D12_BARRIER_ACCESS_COMMON, D3D12_BARRIER_LAYOUT_COMMON));
+}
+
+TEST_CASE(BarrierBackend_CombinesReadStates)
+{
+	// Every read state's sync and access, in the one layout all of them allow.
+	BarrierBackend::EnhancedState state = {};
+	CHECK(BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_GENERIC_READ, state));
+	CHECK(state.Sync == (D3D12_BARRIER_SYNC_ALL_SHADING | D3D12_BARRIER_SYNC_INDEX_INPUT | D3D12_BARRIER_SYNC_NON_PIXEL_SHADING |
+		D3D12_BARRIER_SYNC_PIXEL_SHADING | D3D12_BARRIER_SYNC_EXECUTE_INDIRECT | D3D12_BARRIER_SYNC_COPY));
+	CHECK(state.Access == (D3D12_BARRIER_ACCESS_VERTEX_BUFFER | D3D12_BARRIER_ACCESS_CONSTANT_BUFFER | D3D12_BARRIER_ACCESS_INDEX_BUFFER |
+		D3D12_BARRIER_ACCESS_SHADER_RESOURCE | D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT | D3D12_BARRIER_ACCESS_COPY_SOURCE));
+	CHECK(state.Layout == D3D12_BARRIER_LAYOUT_GENERIC_READ);
+
+	// Both shader resource states share a layout, so it is kept.
+	CHECK(BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, state));
+	CHECK(Matches(state, D3D12_BARRIER_SYNC_NON_PIXEL_SHADING | D3D12_BARRIER_SYNC_PIXEL_SHADING,
+		D3D12_BARRIER_ACCESS_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE));
+}
+
+TEST_CASE(BarrierBackend_DepthReadKeepsDepthLayout)
+{
+	// GENERIC_READ would not allow depth testing.
+	BarrierBackend::EnhancedState state = {};
+	CHECK(BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, state));
+	CHECK(Matches(state, D3D12_BARRIER_SYNC_DEPTH_STENCIL | D3D12_BARRIER_SYNC_PIXEL_SHADING,
+		D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ | D3D12_BARRIER_ACCESS_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ));
+}
+
+TEST_CASE(BarrierBackend_RejectsUnmappedStates)
+{
+	// These barriers stay on the legacy path rather than losing a bit.
+	BarrierBackend::EnhancedState state = {};
+	CHECK(!BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, state));
+	CHECK(!BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE, state));
+	CHECK(!BarrierBackend::TranslateState(D3D12_RESOURCE_STATE_COPY_SOURCE | D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE, state));
+}
+
+// == Translation ==
+// What Record() would send to an ID3D12GraphicsCommandList7.
+
+TEST_CASE(BarrierBackend_RenderTargetToShaderResource)
+{
+	FakeResource texture(FakeResource::TextureDesc(1));
+	FakeResource buffer;
+	const D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		Transition(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+		Transition(&buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+	};
+
+	BarrierBackend::Translation translation;
+	BarrierBackend::Translate(_countof(barriers), barriers, translation);
+	REQUIRE(translation.Calls.size() == 1);
+	CHECK(HasCounts(translation.Calls[0], 0, 1, 1));
+	REQUIRE(translation.TextureBarriers.size() == 1 && translation.BufferBarriers.size() == 1);
+
+	// Waits for render target writes only, blocks pixel shading only.
+	const D3D12_TEXTURE_BARRIER& textureBarrier = translation.TextureBarriers[0];
+	CHECK(IsEquivalent(textureBarrier, barriers[0]));
+	CHECK(textureBarrier.SyncBefore == D3D12_BARRIER_SYNC_RENDER_TARGET);
+	CHECK(textureBarrier.SyncAfter == D3D12_BARRIER_SYNC_PIXEL_SHADING);
+	CHECK(textureBarrier.LayoutBefore == D3D12_BARRIER_LAYOUT_RENDER_TARGET);
+	CHECK(textureBarrier.LayoutAfter == D3D12_BARRIER_LAYOUT_SHADER_RESOURCE);
+
+	const D3D12_BUFFER_BARRIER& bufferBarrier = translation.BufferBarriers[0];
+	CHECK(bufferBarrier.pResource == &buffer);
+	CHECK(bufferBarrier.AccessBefore == D3D12_BARRIER_ACCESS_UNORDERED_ACCESS);
+	CHECK(bufferBarrier.AccessAfter == D3D12_BARRIER_ACCESS_SHADER_RESOURCE);
+	CHECK(bufferBarrier.SyncAfter == D3D12_BARRIER_SYNC_NON_PIXEL_SHADING);
+}
+
+TEST_CASE(BarrierBackend_SplitBarrierHalves)
+{
+	// The begin half must not block anything after it and the end half must
+	// not wait for anything before it; both describe the same access and
+	// layout change.
+	FakeResource texture(FakeResource::TextureDesc(4));
+	const D3D12_RESOURCE_BARRIER begin = Transition(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY, 2);
+	const D3D12_RESOURCE_BARRIER end = Transition(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY, 2);
+
+	BarrierBackend::Translation translation;
+	BarrierBackend::Translate(1, &begin, translation);
+	BarrierBackend::Translate(1, &end, translation);
+	REQUIRE(translation.Calls.size() == 2);
+	REQUIRE(translation.TextureBarriers.size() == 2);
+
+	const D3D12_TEXTURE_BARRIER& beginBarrier = translation.TextureBarriers[translation.Calls[0].FirstTexture];
+	const D3D12_TEXTURE_BARRIER& endBarrier = translation.TextureBarriers[translation.Calls[1].FirstTexture];
+	CHECK(IsEquivalent(beginBarrier, begin));
+	CHECK(IsEquivalent(endBarrier, end));
+	CHECK(beginBarrier.SyncBefore == D3D12_BARRIER_SYNC_RENDER_TARGET);
+	CHECK(beginBarrier.SyncAfter == D3D12_BARRIER_SYNC_SPLIT);
+	CHECK(endBarrier.SyncBefore == D3D12_BARRIER_SYNC_SPLIT);
+	CHECK(endBarrier.SyncAfter == D3D12_BARRIER_SYNC_PIXEL_SHADING);
+	CHECK(beginBarrier.Subresources.IndexOrFirstMipLevel == 2 && beginBarrier.Subresources.NumMipLevels == 0);
+}
+
+TEST_CASE(BarrierBackend_RepeatedResourceStartsANewCall)
+{
+	// Barriers in one Barrier() call are unordered, so the second transition
+	// of the texture must not share a call with the first.
+	FakeResource texture(FakeResource::TextureDesc(1));
+	FakeResource buffer;
+	const D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		Transition(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+		Transition(&buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER),
+		Transition(&texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE),
+	};
+
+	BarrierBackend::Translation translation;
+	BarrierBackend::Translate(_countof(barriers), barriers, translation);
+	REQUIRE(translation.Calls.size() == 2);
+	CHECK(HasCounts(translation.Calls[0], 0, 1, 1));
+	CHECK(HasCounts(translation.Calls[1], 0, 0, 1));
+	REQUIRE(translation.TextureBarriers.size() == 2);
+	CHECK(IsEquivalent(translation.TextureBarriers[0], barriers[0]));
+	CHECK(IsEquivalent(translation.TextureBarriers[1], barriers[2]));
+	CHECK(translation.TextureBarriers[0].LayoutAfter == translation.TextureBarriers[1].LayoutBefore);
+}
+
+TEST_CASE(BarrierBackend_UntranslatableBarriersKeepTheirPlace)
+{
+	FakeResource first(FakeResource::TextureDesc(1));
+	FakeResource second(FakeResource::TextureDesc(1));
+	FakeResource buffer;
+	D3D12_RESOURCE_BARRIER aliasing = {};
+	aliasing.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+	aliasing.Aliasing.pResourceBefore = &first;
+	aliasing.Aliasing.pResourceAfter = &second;
+	const D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		Transition(&first, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COMMON),
+		aliasing,
+		Transition(&second, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET),
+		UavBarrier(nullptr),
+		UavBarrier(&buffer),
+	};
+
+	// The aliasing barrier splits the run; the global UAV barrier overlaps
+	// everything, so it and the buffer's UAV barrier each get their own call.
+	BarrierBackend::Translation translation;
+	BarrierBackend::Translate(_countof(barriers), barriers, translation);
+	REQUIRE(translation.Calls.size() == 5);
+	CHECK(HasCounts(translation.Calls[0], 0, 0, 1));
+	CHECK(translation.Calls[1].Legacy == &barriers[1]);
+	CHECK(HasCounts(translation.Calls[2], 0, 0, 1));
+	CHECK(HasCounts(translation.Calls[3], 1, 0, 0));
+	CHECK(HasCounts(translation.Calls[4], 0, 1, 0));
+	CHECK(translation.TextureBarriers[translation.Calls[2].FirstTexture].pResource == &second);
+
+	// A reused translation starts from nothing.
+	translation.Clear();
+	BarrierBackend::Translate(1, barriers, translation);
+	CHECK(translation.Calls.size() == 1 && translation.TextureBarriers.size() == 1);
+}
+
+#endif // ENHANCED_BARRIERS_AVAILABLE
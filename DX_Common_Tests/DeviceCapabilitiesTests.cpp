@@ -0,0 +1,185 @@
+#include "TestFramework.h"
+
+#include "DeviceCapabilities.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const std::filesystem::path s_File = L"DeviceCapabilitiesTests.caps";
+
+	const std::vector<DXGI_FORMAT> s_Formats = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_D24_UNORM_S8_UINT };
+
+	// Answers with values derived from 'Seed', so two answers can be told
+	// apart, and counts how often it was asked.
+	class FakeSource : public DeviceFeatureSource
+	{
+	public:
+		DeviceIdentity Identity = { 0x10DE, 0x2684, 7, 1, 0x001F000000001234ull };
+		UINT Seed = 1;
+		int Queries = 0;
+		bool ArrivedZeroed = true;
+
+		DeviceIdentity GetIdentity() override { return Identity; }
+
+		void Query(const std::vector<DXGI_FORMAT>& msaaFormats, DeviceCapabilities& caps) override
+		{
+			++Queries;
+			const BYTE* bytes = reinterpret_cast<const BYTE*>(&caps);
+			for (size_t i = 0; i < sizeof(caps); ++i)
+				ArrivedZeroed = ArrivedZeroed && bytes[i] == 0;
+
+			UINT* values = reinterpret_cast<UINT*>(&caps);
+			for (size_t i = 0; i < sizeof(caps) / sizeof(UINT); ++i)
+				values[i] = Seed * 2654435761u + static_cast<UINT>(i);
+
+			// 2, 4 and 8 samples are supported, 16 are not.
+			caps.MsaaFormatCount = 0;
+			for (DXGI_FORMAT format : msaaFormats)
+			{
+				MsaaQualityLevels& levels = caps.Msaa[caps.MsaaFormatCount++];
+				levels.Format = format;
+				for (UINT i = 0; i < MsaaQualityLevels::SampleCountCount; ++i)
+					levels.QualityLevels[i] = i == 3 ? 0 : Seed + i;
+			}
+		}
+	};
+
+	std::string ReadAll()
+	{
+		std::ifstream file(s_File, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	void WriteAll(const std::string& data)
+	{
+		std::ofstream(s_File, std::ios::binary | std::ios::trunc).write(data.data(), data.size());
+	}
+}
+
+TEST_CASE(DeviceCapabilities_RoundTrip)
+{
+	std::filesystem::remove(s_File);
+	FakeSource source;
+
+	DeviceCapabilities first;
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+		CHECK(!cache.GetStats().FromDisk);
+		CHECK(source.Queries == 1);
+		CHECK(source.ArrivedZeroed);
+		first = cache.Get();
+
+		CHECK(cache.Get().GetMsaaQualityLevels(DXGI_FORMAT_R8G8B8A8_UNORM, 4) == 2);
+		CHECK(cache.Get().GetMsaaQualityLevels(DXGI_FORMAT_R8G8B8A8_UNORM, 16) == 0);
+		CHECK(cache.Get().GetMsaaQualityLevels(DXGI_FORMAT_BC1_UNORM, 4) == 0);
+	}
+
+	DeviceCapabilityCache cache;
+	cache.Initialize(source, s_File.wstring(), s_Formats);
+	CHECK(cache.GetStats().FromDisk);
+	CHECK(source.Queries == 1);
+	CHECK(memcmp(&first, &cache.Get(), sizeof(first)) == 0);
+
+	std::filesystem::remove(s_File);
+}
+
+TEST_CASE(DeviceCapabilities_DriverUpdateQueriesAgain)
+{
+	std::filesystem::remove(s_File);
+	FakeSource source;
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+	}
+
+	++source.Identity.DriverVersion;
+	source.Seed = 5;
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+		CHECK(!cache.GetStats().FromDisk);
+		CHECK(source.Queries == 2);
+		CHECK(cache.Get().GetMsaaQualityLevels(DXGI_FORMAT_R8G8B8A8_UNORM, 2) == 5);
+	}
+
+	// The new answers were saved in place of the old ones.
+	DeviceCapabilityCache cache;
+	cache.Initialize(source, s_File.wstring(), s_Formats);
+	CHECK(cache.GetStats().FromDisk);
+	CHECK(source.Queries == 2);
+	CHECK(cache.Get().GetMsaaQualityLevels(DXGI_FORMAT_R8G8B8A8_UNORM, 2) == 5);
+
+	std::filesystem::remove(s_File);
+}
+
+TEST_CASE(DeviceCapabilities_OtherFormatsQueryAgain)
+{
+	std::filesystem::remove(s_File);
+	FakeSource source;
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+	}
+
+	DeviceCapabilityCache cache;
+	cache.Initialize(source, s_File.wstring(), { DXGI_FORMAT_R8G8B8A8_UNORM });
+	CHECK(!cache.GetStats().FromDisk);
+	CHECK(source.Queries == 2);
+	CHECK(cache.Get().MsaaFormatCount == 1);
+
+	std::filesystem::remove(s_File);
+}
+
+TEST_CASE(DeviceCapabilities_RejectsDamagedFiles)
+{
+	std::filesystem::remove(s_File);
+	FakeSource source;
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+	}
+	const std::string good = ReadAll();
+	REQUIRE(good.size() > 100);
+
+	// A flipped byte in the snapshot fails the hash.
+	std::string corrupt = good;
+	corrupt[100] ^= 0x7F;
+	WriteAll(corrupt);
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+		CHECK(!cache.GetStats().FromDisk);
+		CHECK(source.Queries == 2);
+	}
+
+	WriteAll(good.substr(0, good.size() - 4));
+	{
+		DeviceCapabilityCache cache;
+		cache.Initialize(source, s_File.wstring(), s_Formats);
+		CHECK(!cache.GetStats().FromDisk);
+		CHECK(source.Queries == 3);
+	}
+
+	// Each miss wrote a good file again.
+	CHECK(ReadAll() == good);
+
+	std::filesystem::remove(s_File);
+}
+
+TEST_CASE(DeviceCapabilities_UnknownDriverIsNotSaved)
+{
+	std::filesystem::remove(s_File);
+	FakeSource source;
+	source.Identity.DriverVersion = 0;
+
+	DeviceCapabilityCache cache;
+	cache.Initialize(source, s_File.wstring(), s_Formats);
+	CHECK(!cache.GetStats().FromDisk);
+	CHECK(source.Queries == 1);
+	CHECK(!std::filesystem::exists(s_File));
+}
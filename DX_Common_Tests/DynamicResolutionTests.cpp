@@ -0,0 +1,203 @@
+#include "TestFramework.h"
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <random>
+
+// Closed-loop runs of DynamicResolutionController against a simulated GPU
+// whose frame time is a fixed cost plus a load that scales with the pixel
+// count, with the times arriving frames late as they do from GpuFrameTimer.
+namespace
+{
+	const double s_FixedMilliseconds = 1.0;
+
+	struct Scenario
+	{
+		const char* Name = "";
+		// Milliseconds at full resolution, less the fixed cost, by frame.
+		std::function<double(int)> Load;
+		double Noise = 0.0; // relative, uniform
+		int Delay = 2;      // frames until a time is known
+		int Frames = 600;
+		int ChangeFrame = 0; // when the load last changes
+	};
+
+	struct Result
+	{
+		int SettleFrames = -1;    // after ChangeFrame, until on target
+		int Reversals = 0;        // of the scale's direction, once settled
+		double MaxOvershoot = 0.0; // noise-free time over target, once settled
+		float FinalScale = 0.0f;
+		float Band = 0.0f;        // of the scale, once settled
+	};
+
+	double FrameTime(double load, float scale)
+	{
+		return s_FixedMilliseconds + load * scale * scale;
+	}
+
+	// The scale that holds the target, or the nearest one allowed.
+	float ExpectedScale(const DynamicResolutionSettings& settings, double load)
+	{
+		const float scale = static_cast<float>(std::sqrt((settings.TargetMilliseconds - s_FixedMilliseconds) / load));
+		return std::clamp(scale, settings.MinScale, settings.MaxScale);
+	}
+
+	Result Simulate(const Scenario& scenario)
+	{
+		DynamicResolutionController controller;
+		const DynamicResolutionSettings& settings = controller.GetSettings();
+		const double target = settings.TargetMilliseconds;
+
+		std::mt19937 random(1);
+		std::uniform_real_distribution<double> noise(-scenario.Noise, scenario.Noise);
+
+		struct Frame
+		{
+			double Milliseconds;
+			float Scale;
+		};
+		std::deque<Frame> inFlight;
+
+		Result result;
+		float scale = controller.GetScale();
+		float low = settings.MaxScale;
+		float high = settings.MinScale;
+		double previousStep = 0.0;
+		for (int frame = 0; frame < scenario.Frames; ++frame)
+		{
+			const double load = scenario.Load(frame);
+			inFlight.push_back({ FrameTime(load, scale) * (1.0 + noise(random)), scale });
+			if (static_cast<int>(inFlight.size()) > scenario.Delay)
+			{
+				const Frame finished = inFlight.front();
+				inFlight.pop_front();
+				const float next = controller.Update(finished.Milliseconds, finished.Scale);
+				const double step = next - scale;
+				if (result.SettleFrames >= 0)
+				{
+					if (step * previousStep < 0.0)
+						++result.Reversals;
+					low = std::min(low, next);
+					high = std::max(high, next);
+				}
+				if (step != 0.0)
+					previousStep = step;
+				scale = next;
+			}
+			if (frame < scenario.ChangeFrame)
+				continue;
+
+			// On target: within the deadband under it, or as sharp as allowed.
+			const double clean = FrameTime(load, scale);
+			const bool onTarget = clean <= target * 1.005 &&
+				(clean >= target * (1.0 - settings.Deadband) || scale == settings.MaxScale);
+			if (result.SettleFrames < 0 && onTarget)
+			{
+				result.SettleFrames = frame - scenario.ChangeFrame;
+				low = high = scale;
+				previousStep = 0.0;
+			}
+			if (result.SettleFrames >= 0)
+				result.MaxOvershoot = std::max(result.MaxOvershoot, clean / target - 1.0);
+		}
+		result.FinalScale = scale;
+		if (result.SettleFrames >= 0)
+			result.Band = high - low;
+
+		printf("  %-18s delay %d: settled in %3d frames, scale %.3f, band %.3f, %d reversals, overshoot %.1f%%\n",
+			scenario.Name, scenario.Delay, result.SettleFrames, result.FinalScale, result.Band, result.Reversals,
+			result.MaxOvershoot * 100.0);
+		return result;
+	}
+
+	// The checks every run must pass; 'expected' is the scale for the final load.
+	void CheckConverges(const Result& result, float expected, int maxSettleFrames)
+	{
+		const DynamicResolutionSettings settings;
+		CHECK(result.SettleFrames >= 0);
+		CHECK(result.SettleFrames <= maxSettleFrames);
+		// Anywhere in the deadband counts; that is at most this much sharper.
+		CHECK(result.FinalScale <= expected + 0.01f);
+		CHECK(result.FinalScale >= expected * static_cast<float>(std::sqrt(1.0 - settings.Deadband)) - 0.01f);
+		CHECK(result.Band < 0.05f);
+		CHECK(result.MaxOvershoot < 0.05);
+	}
+}
+
+TEST_CASE(DynamicResolution_ConvergesUnderHeavyLoad)
+{
+	const DynamicResolutionSettings settings;
+	for (int delay = 1; delay <= 3; ++delay)
+	{
+		// Twice the budget at full resolution.
+		Scenario twice;
+		twice.Name = "2x load";
+		twice.Load = [](int) { return 26.0; };
+		twice.Delay = delay;
+		const Result twiceResult = Simulate(twice);
+		CheckConverges(twiceResult, ExpectedScale(settings, 26.0), 30);
+		CHECK(twiceResult.Reversals == 0);
+
+		Scenario heavier;
+		heavier.Name = "3.5x load";
+		heavier.Load = [](int) { return 45.0; };
+		heavier.Delay = delay;
+		const Result heavierResult = Simulate(heavier);
+		CheckConverges(heavierResult, ExpectedScale(settings, 45.0), 30);
+		CHECK(heavierResult.Reversals == 0);
+	}
+}
+
+TEST_CASE(DynamicResolution_StaysAtFullScaleUnderLightLoad)
+{
+	Scenario light;
+	light.Name = "light load";
+	light.Load = [](int) { return 8.0; };
+	const Result result = Simulate(light);
+	CHECK(result.SettleFrames == 0);
+	CHECK(result.FinalScale == 1.0f);
+	CHECK(result.Band == 0.0f);
+}
+
+TEST_CASE(DynamicResolution_FollowsLoadSteps)
+{
+	const DynamicResolutionSettings settings;
+	for (int delay = 1; delay <= 3; ++delay)
+	{
+		Scenario up;
+		up.Name = "1x to 2x load";
+		up.Load = [](int frame) { return frame < 300 ? 13.0 : 26.0; };
+		up.Delay = delay;
+		up.ChangeFrame = 300;
+		const Result upResult = Simulate(up);
+		CheckConverges(upResult, ExpectedScale(settings, 26.0), 30);
+		CHECK(upResult.Reversals == 0);
+
+		// Falling times are smoothed more, so the way back is slower.
+		Scenario down;
+		down.Name = "2x to 1x load";
+		down.Load = [](int frame) { return frame < 300 ? 26.0 : 13.0; };
+		down.Delay = delay;
+		down.ChangeFrame = 300;
+		const Result downResult = Simulate(down);
+		CheckConverges(downResult, ExpectedScale(settings, 13.0), 60);
+		CHECK(downResult.Reversals == 0);
+	}
+}
+
+TEST_CASE(DynamicResolution_HoldsStillUnderNoise)
+{
+	const DynamicResolutionSettings settings;
+	Scenario noisy;
+	noisy.Name = "2x load, 8% noise";
+	noisy.Load = [](int) { return 26.0; };
+	noisy.Noise = 0.08;
+	const Result result = Simulate(noisy);
+	CheckConverges(result, ExpectedScale(settings, 26.0), 30);
+}
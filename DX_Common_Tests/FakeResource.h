@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d12.h>
+
+namespace Testing
+{
+	// An ID3D12Resource that only answers GetDesc(), for code that uses
+	// resources as keys and asks for their shape (barriers, state tracking).
+	class FakeResource : public ID3D12Resource
+	{
+	public:
+		// A buffer.
+		FakeResource()
+		{
+			m_Desc = {};
+			m_Desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			m_Desc.Width = 256;
+			m_Desc.Height = 1;
+			m_Desc.DepthOrArraySize = 1;
+			m_Desc.MipLevels = 1;
+			m_Desc.Format = DXGI_FORMAT_UNKNOWN;
+			m_Desc.SampleDesc.Count = 1;
+			m_Desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		}
+
+		explicit FakeResource(const D3D12_RESOURCE_DESC& desc) : m_Desc(desc) {}
+
+		// A 2D texture with 'mipLevels' mips.
+		static D3D12_RESOURCE_DESC TextureDesc(UINT16 mipLevels, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM)
+		{
+			D3D12_RESOURCE_DESC desc = {};
+			desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+			desc.Width = UINT64(1) << (mipLevels - 1);
+			desc.Height = 1u << (mipLevels - 1);
+			desc.DepthOrArraySize = 1;
+			desc.MipLevels = mipLevels;
+			desc.Format = format;
+			desc.SampleDesc.Count = 1;
+			return desc;
+		}
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** object) override
+		{
+			*object = nullptr;
+			return E_NOINTERFACE;
+		}
+		ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+		ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+		HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetName(LPCWSTR) override { return S_OK; }
+		HRESULT STDMETHODCALLTYPE GetDevice(REFIID, void** device) override
+		{
+			*device = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		HRESULT STDMETHODCALLTYPE Map(UINT, const D3D12_RANGE*, void**) override { return E_NOTIMPL; }
+		void STDMETHODCALLTYPE Unmap(UINT, const D3D12_RANGE*) override {}
+		D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc() override { return m_Desc; }
+		D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress() override { return 0; }
+		HRESULT STDMETHODCALLTYPE WriteToSubresource(UINT, const D3D12_BOX*, const void*, UINT, UINT) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE ReadFromSubresource(void*, UINT, UINT, UINT, const D3D12_BOX*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE GetHeapProperties(D3D12_HEAP_PROPERTIES*, D3D12_HEAP_FLAGS*) override { return E_NOTIMPL; }
+
+	private:
+		D3D12_RESOURCE_DESC m_Desc;
+	};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Hash.h"
+#include "ShaderCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Testing
+{
+	// A ShaderCompiler without D3DCompile. "Compiles" to a hash of the entry
+	// point, the defines, the source lines and the included files, so the
+	// bytecode changes exactly when the code does: comment lines are
+	// skipped, a line '#include "name"' reads 'name' through the loader, and
+	// a line "#error" fails the compile.
+	class FakeShaderCompiler : public ShaderCompiler
+	{
+	public:
+		std::atomic<int> Calls{ 0 };
+
+		// Added to every compile, to stand in for the real compiler's cost.
+		std::chrono::microseconds Delay{ 0 };
+
+		std::string GetId() const override { return "fake_1"; }
+
+		bool Compile(const ShaderCompileDesc& desc, const std::string& source, ShaderSourceLoader& loader,
+			std::vector<BYTE>& bytecode, std::string& errors) override
+		{
+			++Calls;
+			if (Delay.count() > 0)
+				std::this_thread::sleep_for(Delay);
+
+			uint64_t hash = Fnv1a64(desc.EntryPoint);
+			for (const ShaderDefine& define : desc.Defines)
+				hash = Fnv1a64(define.Name + "=" + define.Value, hash);
+			if (!Scan(source, desc.File, loader, hash))
+			{
+				errors = "fake error";
+				return false;
+			}
+			bytecode.assign(reinterpret_cast<const BYTE*>(&hash), reinterpret_cast<const BYTE*>(&hash) + sizeof(hash));
+			return true;
+		}
+
+	private:
+		bool Scan(const std::string& text, const std::wstring& file, ShaderSourceLoader& loader, uint64_t& hash)
+		{
+			std::istringstream lines(text);
+			std::string line;
+			while (std::getline(lines, line))
+			{
+				if (line.rfind("//", 0) == 0)
+					continue;
+				if (line == "#error")
+					return false;
+				hash = Fnv1a64(line, hash);
+
+				const std::string include = "#include \"";
+				if (line.rfind(include, 0) == 0)
+				{
+					const std::string name = line.substr(include.size(), line.size() - include.size() - 1);
+					std::wstring path;
+					const std::string* included = loader.Load(std::wstring(name.begin(), name.end()), file, &path);
+					if (included == nullptr || !Scan(*included, path, loader, hash))
+						return false;
+				}
+			}
+			return true;
+		}
+	};
+}
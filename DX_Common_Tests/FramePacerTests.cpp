@@ -0,0 +1,260 @@
+#include "TestFramework.h"
+
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Records every call in order: "wait", or "present <sync> <flags>".
+	class FakePresentQueue : public PresentQueue
+	{
+	public:
+		std::vector<std::string> Calls;
+		bool ExclusiveFullscreen = false;
+		bool WaitSucceeds = true;
+		HRESULT PresentResult = S_OK;
+		DWORD LastTimeout = 0;
+
+		bool WaitForFrame(DWORD timeoutMilliseconds) override
+		{
+			Calls.push_back("wait");
+			LastTimeout = timeoutMilliseconds;
+			return WaitSucceeds;
+		}
+
+		HRESULT Present(UINT syncInterval, UINT flags) override
+		{
+			Calls.push_back("present " + std::to_string(syncInterval) + " " + std::to_string(flags));
+			return PresentResult;
+		}
+
+		bool IsExclusiveFullscreen() override { return ExclusiveFullscreen; }
+	};
+
+	// A flip-model swap chain and GPU on a simulated clock, in milliseconds.
+	// Frame i renders into buffer i % BufferCount, which the display gives
+	// back when frame i - BufferCount + 1 replaces it on screen. With vsync
+	// a frame goes on screen at the first vblank after the GPU finishes it,
+	// one frame per vblank.
+	class SimulatedSwapChain : public PresentQueue
+	{
+	public:
+		SimulatedSwapChain(UINT bufferCount, UINT maxLatency, double gpuMilliseconds, double refreshMilliseconds)
+			: m_BufferCount(bufferCount), m_MaxLatency(maxLatency),
+			m_GpuMilliseconds(gpuMilliseconds), m_RefreshMilliseconds(refreshMilliseconds)
+		{
+		}
+
+		// The CPU's time.
+		double Now = 0.0;
+
+		// When each frame finished on the GPU and went on screen.
+		std::vector<double> GpuEnd;
+		std::vector<double> OnScreen;
+
+		// Returns when fewer than MaxLatency presented frames are waiting
+		// for the screen.
+		bool WaitForFrame(DWORD) override
+		{
+			const size_t frames = OnScreen.size();
+			if (frames >= m_MaxLatency)
+				Now = std::max(Now, OnScreen[frames - m_MaxLatency]);
+			return true;
+		}
+
+		HRESULT Present(UINT syncInterval, UINT) override
+		{
+			const size_t frame = OnScreen.size();
+			double gpuStart = std::max(Now, GpuEnd.empty() ? 0.0 : GpuEnd.back());
+			if (frame + 1 >= m_BufferCount)
+				gpuStart = std::max(gpuStart, OnScreen[frame + 1 - m_BufferCount]);
+			GpuEnd.push_back(gpuStart + m_GpuMilliseconds);
+
+			double onScreen = GpuEnd.back();
+			if (syncInterval > 0)
+			{
+				if (!OnScreen.empty())
+					onScreen = std::max(onScreen, OnScreen.back() + m_RefreshMilliseconds);
+				onScreen = std::ceil(onScreen / m_RefreshMilliseconds - 1e-9) * m_RefreshMilliseconds;
+			}
+			OnScreen.push_back(onScreen);
+			return S_OK;
+		}
+
+		bool IsExclusiveFullscreen() override { return false; }
+
+		// D3DApp::Present()'s wait on the fence of the frame that last
+		// rendered into the next back buffer.
+		void WaitForBackBuffer()
+		{
+			const size_t frames = GpuEnd.size();
+			if (frames >= m_BufferCount)
+				Now = std::max(Now, GpuEnd[frames - m_BufferCount]);
+		}
+
+	private:
+		UINT m_BufferCount;
+		UINT m_MaxLatency;
+		double m_GpuMilliseconds;
+		double m_RefreshMilliseconds;
+	};
+
+	const std::string s_VSyncPresent = "present 1 0";
+	const std::string s_TearingPresent = "present 0 " + std::to_string(DXGI_PRESENT_ALLOW_TEARING);
+}
+
+TEST_CASE(FramePacer_WaitsOnceBeforeEachPresent)
+{
+	FakePresentQueue queue;
+	FramePacer pacer;
+	pacer.SetPresentQueue(&queue, false);
+
+	// The usual frame: wait, then present.
+	pacer.WaitForFrame();
+	CHECK(pacer.Present() == S_OK);
+
+	// A second wait in the same frame does not wait again.
+	pacer.WaitForFrame();
+	pacer.WaitForFrame();
+	pacer.Present();
+
+	// A frame that forgot to wait still waits once, before presenting.
+	pacer.Present();
+
+	const std::vector<std::string> expected = { "wait", s_VSyncPresent, "wait", s_VSyncPresent, "wait", s_VSyncPresent };
+	CHECK(queue.Calls == expected);
+	CHECK(queue.LastTimeout == FramePacer::WaitTimeoutMilliseconds);
+	CHECK(pacer.GetStats().Frames == 3);
+
+	// A new queue starts a new frame: the wait is owed again.
+	FakePresentQueue other;
+	pacer.WaitForFrame();
+	pacer.SetPresentQueue(&other, false);
+	pacer.WaitForFrame();
+	CHECK(other.Calls == std::vector<std::string>{ "wait" });
+}
+
+TEST_CASE(FramePacer_TearsOnlyWithoutVSyncInAWindow)
+{
+	FakePresentQueue queue;
+	FramePacer pacer;
+	UINT syncInterval = 0;
+	UINT flags = 0;
+
+	// Tearing supported, vsync on: never tears.
+	pacer.SetPresentQueue(&queue, true);
+	pacer.Present();
+
+	// Vsync off in a window: tears.
+	pacer.SetVSync(false);
+	pacer.GetPresentParameters(syncInterval, flags);
+	CHECK(syncInterval == 0 && flags == DXGI_PRESENT_ALLOW_TEARING);
+	pacer.Present();
+
+	// Exclusive fullscreen does not allow the flag.
+	queue.ExclusiveFullscreen = true;
+	pacer.Present();
+	queue.ExclusiveFullscreen = false;
+
+	// Nor does a display or driver without tearing support.
+	pacer.SetPresentQueue(&queue, false);
+	pacer.Present();
+
+	const std::vector<std::string> expected =
+	{
+		"wait", s_VSyncPresent,
+		"wait", s_TearingPresent,
+		"wait", "present 0 0",
+		"wait", "present 0 0",
+	};
+	CHECK(queue.Calls == expected);
+	CHECK(pacer.GetStats().Frames == 4);
+	CHECK(pacer.GetStats().TearingPresents == 1);
+}
+
+TEST_CASE(FramePacer_CountsTimeoutsAndOcclusion)
+{
+	FakePresentQueue queue;
+	FramePacer pacer;
+	pacer.SetPresentQueue(&queue, false);
+
+	// Minimized: the wait times out and the frame goes ahead anyway.
+	queue.WaitSucceeds = false;
+	pacer.WaitForFrame();
+	CHECK(pacer.Present() == S_OK);
+	CHECK(queue.Calls.back() == s_VSyncPresent);
+
+	// Occluded: the status is passed on and counted.
+	queue.WaitSucceeds = true;
+	queue.PresentResult = DXGI_STATUS_OCCLUDED;
+	CHECK(pacer.Present() == DXGI_STATUS_OCCLUDED);
+	CHECK(pacer.Present() == DXGI_STATUS_OCCLUDED);
+
+	const FramePacer::Stats& stats = pacer.GetStats();
+	CHECK(stats.Frames == 3);
+	CHECK(stats.WaitTimeouts == 1);
+	CHECK(stats.OccludedPresents == 2);
+	CHECK(stats.TearingPresents == 0);
+	CHECK(stats.TotalWaitMilliseconds >= stats.LastWaitMilliseconds);
+}
+
+BENCHMARK(FramePacer_BufferCountSweep)
+{
+	// D3DApp's frame loop for every buffer count (2 to 4) and frame latency
+	// (below the buffer count) it allows, on a simulated 60 Hz display and GPU, so no device is needed:
+	// FramePacer waits and presents, the swap chain decides when each frame
+	// runs on the GPU and goes on screen. Latency is from the start of a
+	// frame's CPU work (input) to the vblank that shows it.
+	struct Load
+	{
+		const char* Name;
+		double CpuMilliseconds;
+		double GpuMilliseconds;
+	};
+	const Load loads[] =
+	{
+		{ "light", 4.0, 8.0 },
+		{ "CPU-bound", 20.0, 8.0 },
+		{ "GPU-bound", 4.0, 20.0 },
+	};
+	const double refreshMilliseconds = 1000.0 / 60.0;
+	const int frameCount = 600;
+
+	for (const Load& load : loads)
+	{
+		printf("  %s: CPU %.0f ms, GPU %.0f ms\n", load.Name, load.CpuMilliseconds, load.GpuMilliseconds);
+		for (UINT bufferCount = 2; bufferCount <= 4; ++bufferCount)
+		{
+			for (UINT maxLatency = 1; maxLatency < bufferCount; ++maxLatency)
+			{
+				SimulatedSwapChain swapChain(bufferCount, maxLatency, load.GpuMilliseconds, refreshMilliseconds);
+				FramePacer pacer;
+				pacer.SetPresentQueue(&swapChain, false);
+
+				double totalLatency = 0.0;
+				double worstLatency = 0.0;
+				for (int frame = 0; frame < frameCount; ++frame)
+				{
+					pacer.WaitForFrame();
+					const double input = swapChain.Now;
+					swapChain.Now += load.CpuMilliseconds;
+					CHECK(pacer.Present() == S_OK);
+					swapChain.WaitForBackBuffer();
+
+					const double latency = swapChain.OnScreen.back() - input;
+					totalLatency += latency;
+					worstLatency = std::max(worstLatency, latency);
+				}
+
+				const double seconds = (swapChain.OnScreen.back() - swapChain.OnScreen.front()) / 1000.0;
+				printf("    %u buffers, latency %u: %5.1f fps, %5.1f ms average latency, %5.1f ms worst\n",
+					bufferCount, maxLatency, (frameCount - 1) / seconds, totalLatency / frameCount, worstLatency);
+			}
+		}
+	}
+}
@@ -0,0 +1,266 @@
+#include "TestFramework.h"
+
+#include "MipGenerator.h"
+#include "TextureFormat.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// A texture laid out as GetCopyableFootprints would, mip 0 filled in.
+	struct Texture
+	{
+		Texture(DXGI_FORMAT format, UINT width, UINT height, UINT16 mipLevels)
+		{
+			Desc = {};
+			Desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+			Desc.Width = width;
+			Desc.Height = height;
+			Desc.DepthOrArraySize = 1;
+			Desc.MipLevels = mipLevels;
+			Desc.Format = format;
+			Desc.SampleDesc.Count = 1;
+
+			Layouts.resize(mipLevels);
+			UINT64 totalBytes = 0;
+			ComputeCopyableFootprints(Desc, 0, mipLevels, 0, Layouts.data(), nullptr, nullptr, &totalBytes);
+			Data.resize(static_cast<size_t>(totalBytes));
+		}
+
+		BYTE* Row(UINT mip, UINT y)
+		{
+			return Data.data() + Layouts[mip].Offset + size_t(y) * Layouts[mip].Footprint.RowPitch;
+		}
+
+		float* FloatRow(UINT mip, UINT y) { return reinterpret_cast<float*>(Row(mip, y)); }
+
+		bool Generate(MipFilter filter, MipSimdLevel simd = MipSimdLevel::Scalar, ThreadPool* pool = nullptr)
+		{
+			MipGenerator generator(pool);
+			generator.SetSimdLevel(simd);
+			return generator.Generate(Desc, Data.data(), Layouts.data(), filter);
+		}
+
+		D3D12_RESOURCE_DESC Desc;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+		std::vector<BYTE> Data;
+	};
+
+	UINT16 FullChain(UINT width, UINT height)
+	{
+		UINT16 levels = 1;
+		while ((std::max(width, height) >> levels) != 0)
+			++levels;
+		return levels;
+	}
+
+	Texture NoiseRgba8(UINT width, UINT height, bool srgb)
+	{
+		Texture texture(srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, width, height,
+			FullChain(width, height));
+		std::mt19937 random(7);
+		for (UINT y = 0; y < height; ++y)
+		{
+			BYTE* row = texture.Row(0, y);
+			for (UINT x = 0; x < width * 4; ++x)
+				row[x] = static_cast<BYTE>(random());
+		}
+		return texture;
+	}
+
+	// A 64-texel R32_FLOAT row and its mip 1.
+	std::vector<float> Downsample(MipFilter filter, const std::function<float(UINT)>& texel)
+	{
+		Texture texture(DXGI_FORMAT_R32_FLOAT, 64, 1, 2);
+		for (UINT x = 0; x < 64; ++x)
+			texture.FloatRow(0, 0)[x] = texel(x);
+		texture.Generate(filter);
+		const float* mip = texture.FloatRow(1, 0);
+		return std::vector<float>(mip, mip + 32);
+	}
+
+	// Largest |value - offset| away from the edges, where clamping changes things.
+	float Amplitude(const std::vector<float>& row, float offset)
+	{
+		float amplitude = 0.0f;
+		for (size_t x = 4; x + 4 < row.size(); ++x)
+			amplitude = std::max(amplitude, std::fabs(row[x] - offset));
+		return amplitude;
+	}
+
+	// Peaks at source position 1, the centre of the first mip texel.
+	float Wave(UINT x, float period)
+	{
+		return 0.5f + 0.5f * std::cos(6.2831853f * (x + 0.5f - 1.0f) / period);
+	}
+}
+
+TEST_CASE(MipGenerator_SimdLevelsMatchScalar)
+{
+	// Odd sizes, so every kernel runs its remainder loop too.
+	for (int filter = 0; filter < 2; ++filter)
+	{
+		const MipFilter mipFilter = filter ? MipFilter::Kaiser : MipFilter::Box;
+
+		Texture reference = NoiseRgba8(67, 45, false);
+		REQUIRE(reference.Generate(mipFilter, MipSimdLevel::Scalar));
+		for (MipSimdLevel simd : { MipSimdLevel::SSE, MipSimdLevel::AVX })
+		{
+			Texture texture = NoiseRgba8(67, 45, false);
+			REQUIRE(texture.Generate(mipFilter, simd));
+			int maxDifference = 0;
+			for (size_t i = 0; i < texture.Data.size(); ++i)
+				maxDifference = std::max(maxDifference, std::abs(texture.Data[i] - reference.Data[i]));
+			CHECK(maxDifference <= 1);
+		}
+
+		// Float formats are written unrounded, so compare the values.
+		Texture floatReference(DXGI_FORMAT_R32G32B32A32_FLOAT, 37, 29, FullChain(37, 29));
+		std::mt19937 random(3);
+		std::uniform_real_distribution<float> value(0.0f, 1.0f);
+		for (UINT y = 0; y < 29; ++y)
+		{
+			for (UINT x = 0; x < 37 * 4; ++x)
+				floatReference.FloatRow(0, y)[x] = value(random);
+		}
+		Texture floatTexture = floatReference;
+		REQUIRE(floatReference.Generate(mipFilter, MipSimdLevel::Scalar));
+		REQUIRE(floatTexture.Generate(mipFilter, MipSimdLevel::AVX));
+		float maxDifference = 0.0f;
+		for (UINT mip = 1; mip < floatTexture.Desc.MipLevels; ++mip)
+		{
+			const D3D12_SUBRESOURCE_FOOTPRINT& footprint = floatTexture.Layouts[mip].Footprint;
+			for (UINT y = 0; y < footprint.Height; ++y)
+			{
+				for (UINT x = 0; x < footprint.Width * 4; ++x)
+				{
+					maxDifference = std::max(maxDifference,
+						std::fabs(floatTexture.FloatRow(mip, y)[x] - floatReference.FloatRow(mip, y)[x]));
+				}
+			}
+		}
+		CHECK(maxDifference < 1e-5f);
+	}
+}
+
+TEST_CASE(MipGenerator_SrgbIsFilteredInLinearSpace)
+{
+	// Black and white average to linear 0.5, which is sRGB code 188, not 128.
+	// Alpha is linear either way.
+	for (int srgb = 0; srgb < 2; ++srgb)
+	{
+		Texture texture(srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, 2, 2, 2);
+		const BYTE black[4] = { 0, 0, 0, 0 };
+		const BYTE white[4] = { 255, 255, 255, 255 };
+		memcpy(texture.Row(0, 0), black, 4);
+		memcpy(texture.Row(0, 0) + 4, white, 4);
+		memcpy(texture.Row(0, 1), white, 4);
+		memcpy(texture.Row(0, 1) + 4, black, 4);
+		REQUIRE(texture.Generate(MipFilter::Box));
+
+		const BYTE* mip = texture.Row(1, 0);
+		const BYTE expected = srgb ? 188 : 128;
+		CHECK(mip[0] == expected && mip[1] == expected && mip[2] == expected);
+		CHECK(mip[3] == 128);
+	}
+
+	// Every code survives a round trip through a constant image.
+	Texture constant(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, 256, 2, 2);
+	for (UINT y = 0; y < 2; ++y)
+	{
+		for (UINT x = 0; x < 256; ++x)
+			memset(constant.Row(0, y) + x * 4, static_cast<int>(x & ~1u), 4);
+	}
+	REQUIRE(constant.Generate(MipFilter::Box));
+	for (UINT x = 0; x < 128; ++x)
+		CHECK(constant.Row(1, 0)[x * 4] == x * 2);
+}
+
+TEST_CASE(MipGenerator_BoxAndKaiserOnKnownSignals)
+{
+	// Both keep a constant exactly.
+	for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser })
+	{
+		const std::vector<float> flat = Downsample(filter, [](UINT) { return 0.25f; });
+		CHECK(Amplitude(flat, 0.25f) < 1e-6f);
+	}
+
+	// Box averages pairs.
+	const std::vector<float> pairs = Downsample(MipFilter::Box, [](UINT x) { return static_cast<float>(x * x); });
+	for (UINT x = 0; x < 32; ++x)
+		CHECK(std::fabs(pairs[x] - (4.0f * x * x + 2.0f * x + 0.5f)) < 1e-3f);
+
+	// An 8-texel period is well below the new Nyquist limit. Averaging two
+	// texels half a period apart scales it by cos(pi / 8) = 0.92; Kaiser keeps
+	// nearly all of it.
+	const float boxPass = Amplitude(Downsample(MipFilter::Box, [](UINT x) { return Wave(x, 8.0f); }), 0.5f) * 2.0f;
+	const float kaiserPass = Amplitude(Downsample(MipFilter::Kaiser, [](UINT x) { return Wave(x, 8.0f); }), 0.5f) * 2.0f;
+	CHECK(std::fabs(boxPass - 0.924f) < 0.005f);
+	CHECK(kaiserPass > 0.99f);
+
+	// A 2.5-texel period cannot be represented after halving: whatever is
+	// left is aliasing. Box lets cos(pi / 2.5) = 0.31 of it through.
+	const float boxAlias = Amplitude(Downsample(MipFilter::Box, [](UINT x) { return Wave(x, 2.5f); }), 0.5f) * 2.0f;
+	const float kaiserAlias = Amplitude(Downsample(MipFilter::Kaiser, [](UINT x) { return Wave(x, 2.5f); }), 0.5f) * 2.0f;
+	CHECK(std::fabs(boxAlias - 0.309f) < 0.005f);
+	CHECK(kaiserAlias < 0.02f);
+}
+
+BENCHMARK(MipGenerator_Throughput)
+{
+	ThreadPool pool;
+	const struct
+	{
+		const char* Name;
+		DXGI_FORMAT Format;
+	} formats[] =
+	{
+		{ "RGBA8", DXGI_FORMAT_R8G8B8A8_UNORM },
+		{ "RGBA8 sRGB", DXGI_FORMAT_R8G8B8A8_UNORM_SRGB },
+		{ "RGBA32F", DXGI_FORMAT_R32G32B32A32_FLOAT },
+	};
+	const char* simdNames[] = { "scalar", "SSE", "AVX" };
+
+	const UINT size = 2048;
+	for (const auto& format : formats)
+	{
+		Texture texture(format.Format, size, size, FullChain(size, size));
+		std::mt19937 random(1);
+		for (UINT y = 0; y < size; ++y)
+		{
+			for (UINT x = 0; x < size * 4; ++x)
+			{
+				if (format.Format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+					texture.FloatRow(0, y)[x] = (random() & 0xFF) / 255.0f;
+				else
+					texture.Row(0, y)[x] = static_cast<BYTE>(random());
+			}
+		}
+
+		for (int filter = 0; filter < 2; ++filter)
+		{
+			for (int simd = 0; simd < 3; ++simd)
+			{
+				if (static_cast<MipSimdLevel>(simd) > MipGenerator::GetSupportedSimdLevel())
+					continue;
+				for (int threaded = 0; threaded < 2; ++threaded)
+				{
+					Testing::Stopwatch stopwatch;
+					CHECK(texture.Generate(filter ? MipFilter::Kaiser : MipFilter::Box, static_cast<MipSimdLevel>(simd),
+						threaded ? &pool : nullptr));
+					const double seconds = stopwatch.Seconds();
+					printf("  %-10s %-6s %-6s %-8s %8.2f ms, %7.1f Mtexel/s of mip 0\n", format.Name,
+						filter ? "Kaiser" : "Box", simdNames[simd], threaded ? "pool" : "1 thread", seconds * 1000.0,
+						double(size) * size / seconds / 1e6);
+				}
+			}
+		}
+	}
+}
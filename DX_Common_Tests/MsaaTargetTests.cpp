@@ -0,0 +1,156 @@
+#include "TestFramework.h"
+
+#include "MsaaTarget.h"
+
+namespace
+{
+	// Records what MsaaTarget asks for instead of creating resources.
+	class FakeAllocator : public MsaaTargetAllocator
+	{
+	public:
+		int Allocations = 0;
+		int Releases = 0;
+		bool Live = false;
+		bool OutOfOrder = false; // allocated over live targets, or released none
+		MsaaTargetDesc Last;
+
+		void Allocate(const MsaaTargetDesc& desc) override
+		{
+			OutOfOrder = OutOfOrder || Live;
+			Live = true;
+			++Allocations;
+			Last = desc;
+		}
+
+		void Release() override
+		{
+			OutOfOrder = OutOfOrder || !Live;
+			Live = false;
+			++Releases;
+		}
+	};
+
+	struct Fixture
+	{
+		Fixture()
+		{
+			Target.SetAllocator(&Allocator);
+			Target.SetFormats(DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_D24_UNORM_S8_UINT);
+			Target.Resize(800, 600);
+		}
+
+		FakeAllocator Allocator;
+		MsaaTarget Target;
+	};
+}
+
+TEST_CASE(MsaaTarget_NothingAllocatedWithoutMsaa)
+{
+	Fixture f;
+	f.Target.SetSampleCount(1, 0);
+	CHECK(!f.Target.IsEnabled());
+	CHECK(!f.Target.Update());
+	CHECK(!f.Target.IsAllocated());
+	CHECK(f.Allocator.Allocations == 0);
+}
+
+TEST_CASE(MsaaTarget_AllocatesOnUpdateOnly)
+{
+	Fixture f;
+	f.Target.SetSampleCount(4, 3);
+	CHECK(f.Target.IsPending());
+	CHECK(f.Allocator.Allocations == 0);
+
+	CHECK(f.Target.Update());
+	CHECK(f.Allocator.Allocations == 1);
+	CHECK(f.Allocator.Last.SampleCount == 4);
+	CHECK(f.Allocator.Last.Quality == 3);
+	CHECK(f.Allocator.Last.Width == 800);
+	CHECK(f.Allocator.Last.Height == 600);
+	CHECK(f.Target.GetDesc() == f.Allocator.Last);
+	CHECK(!f.Target.IsPending());
+	CHECK(!f.Target.Update());
+}
+
+TEST_CASE(MsaaTarget_CoalescesChangesBetweenUpdates)
+{
+	Fixture f;
+	f.Target.SetSampleCount(4, 3);
+	f.Target.Update();
+	const UINT coalesced = f.Target.GetStats().CoalescedChanges;
+
+	// Off and back on again: nothing to do.
+	f.Target.SetSampleCount(1, 0);
+	f.Target.SetSampleCount(4, 3);
+	CHECK(!f.Target.IsPending());
+	CHECK(!f.Target.Update());
+	CHECK(f.Allocator.Allocations == 1);
+	CHECK(f.Allocator.Releases == 0);
+
+	// Two resizes: one reallocation at the last size.
+	f.Target.Resize(1024, 768);
+	f.Target.Resize(1280, 720);
+	CHECK(f.Target.Update());
+	CHECK(f.Allocator.Allocations == 2);
+	CHECK(f.Allocator.Releases == 1);
+	CHECK(f.Allocator.Last.Width == 1280);
+	CHECK(f.Target.GetStats().CoalescedChanges - coalesced == 3);
+	CHECK(!f.Allocator.OutOfOrder);
+}
+
+TEST_CASE(MsaaTarget_ReleasesAtZeroSizeAndWhenTurnedOff)
+{
+	Fixture f;
+	f.Target.SetSampleCount(4, 0);
+	f.Target.Update();
+
+	// Minimized.
+	f.Target.Resize(0, 0);
+	CHECK(f.Target.Update());
+	CHECK(!f.Allocator.Live);
+	CHECK(!f.Target.IsAllocated());
+	CHECK(f.Target.IsEnabled());
+
+	f.Target.Resize(640, 480);
+	CHECK(f.Target.Update());
+	CHECK(f.Allocator.Live);
+	CHECK(f.Allocator.Last.Width == 640);
+
+	f.Target.SetSampleCount(1, 0);
+	CHECK(f.Target.Update());
+	CHECK(!f.Allocator.Live);
+	CHECK(f.Allocator.Allocations == 2);
+	CHECK(f.Allocator.Releases == 2);
+	CHECK(f.Target.GetStats().Allocations == 2);
+	CHECK(f.Target.GetStats().Releases == 2);
+	CHECK(!f.Allocator.OutOfOrder);
+}
+
+TEST_CASE(MsaaTarget_ClearColorReallocates)
+{
+	Fixture f;
+	f.Target.SetSampleCount(4, 0);
+	f.Target.Update();
+
+	const float blue[4] = { 0.0f, 0.2f, 0.4f, 1.0f };
+	f.Target.SetClearColor(blue);
+	CHECK(f.Target.IsPending());
+	CHECK(f.Target.Update());
+	CHECK(f.Allocator.Allocations == 2);
+	CHECK(f.Allocator.Last.ClearColor[2] == 0.4f);
+
+	// The same colour again is no change.
+	f.Target.SetClearColor(blue);
+	CHECK(!f.Target.IsPending());
+
+	// Nor is another colour while MSAA is off, until it is turned on.
+	f.Target.SetSampleCount(1, 0);
+	f.Target.Update();
+	const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	f.Target.SetClearColor(black);
+	CHECK(!f.Target.IsPending());
+	f.Target.SetSampleCount(4, 0);
+	CHECK(f.Target.Update());
+	CHECK(f.Allocator.Last.ClearColor[2] == 0.0f);
+	CHECK(!f.Allocator.OutOfOrder);
+}
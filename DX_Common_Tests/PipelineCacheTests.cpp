@@ -0,0 +1,232 @@
+#include "TestFramework.h"
+
+#include "PipelineCache.h"
+#include "directx/d3dx12.h"
+
+#include <d3dcompiler.h>
+#include <dxgi1_6.h>
+
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const BYTE s_VertexShader[] = { 'D', 'X', 'B', 'C', 1, 2, 3, 4, 5, 6, 7, 8 };
+	const BYTE s_PixelShader[] = { 'D', 'X', 'B', 'C', 8, 7, 6, 5, 4, 3, 2, 1 };
+	const BYTE s_RootSignatureBlob[] = { 'R', 'T', 'S', '0', 1, 0, 0, 0 };
+
+	// Root signatures are only used as keys, never called, so any distinct
+	// addresses will do.
+	int s_RootSignatureA;
+	int s_RootSignatureB;
+	int s_RootSignatureC;
+
+	ID3D12RootSignature* FakeRootSignature(int& storage)
+	{
+		return reinterpret_cast<ID3D12RootSignature*>(&storage);
+	}
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC MakeDesc(ID3D12RootSignature* rootSignature,
+		const std::vector<BYTE>& vertexShader, const std::vector<BYTE>& pixelShader)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+		desc.pRootSignature = rootSignature;
+		desc.VS = { vertexShader.data(), vertexShader.size() };
+		desc.PS = { pixelShader.data(), pixelShader.size() };
+		desc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+		desc.SampleMask = UINT_MAX;
+		desc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+		desc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+		desc.NumRenderTargets = 1;
+		desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		desc.SampleDesc.Count = 1;
+		return desc;
+	}
+
+	uint64_t Hash(const PipelineCache& cache, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, bool* persistent = nullptr)
+	{
+		CD3DX12_PIPELINE_STATE_STREAM stream(desc);
+		const D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+		return cache.HashPipelineStream(streamDesc, persistent);
+	}
+
+	std::vector<BYTE> Bytes(const BYTE* data, size_t size)
+	{
+		return std::vector<BYTE>(data, data + size);
+	}
+
+	const std::filesystem::path s_LibraryFile = L"PipelineCacheTests.bin";
+
+	// A full-screen triangle and a pixel shader whose constant changes with
+	// VARIANT, so every variant is a distinct pipeline for the driver.
+	const char s_BenchmarkShader[] =
+		"float4 VS(uint id : SV_VertexID) : SV_Position\n"
+		"{ return float4((id & 1) * 4.0 - 1.0, (id >> 1) * 4.0 - 1.0, 0, 1); }\n"
+		"float4 PS(float4 position : SV_Position) : SV_Target\n"
+		"{ return frac(position * (VARIANT * 0.001) + sin(position.yxxy * VARIANT)); }\n";
+
+	std::vector<BYTE> CompileShader(const char* entryPoint, const char* target, int variant)
+	{
+		const std::string value = std::to_string(variant);
+		const D3D_SHADER_MACRO defines[] = { { "VARIANT", value.c_str() }, { nullptr, nullptr } };
+		Microsoft::WRL::ComPtr<ID3DBlob> code;
+		Microsoft::WRL::ComPtr<ID3DBlob> errors;
+		if (FAILED(D3DCompile(s_BenchmarkShader, sizeof(s_BenchmarkShader) - 1, nullptr, defines, nullptr,
+			entryPoint, target, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors)))
+			return std::vector<BYTE>();
+		const BYTE* bytes = static_cast<const BYTE*>(code->GetBufferPointer());
+		return std::vector<BYTE>(bytes, bytes + code->GetBufferSize());
+	}
+
+	// WARP is always there and compiles pipelines to CPU code, which is slow
+	// enough to show what the library saves.
+	Microsoft::WRL::ComPtr<ID3D12Device> CreateWarpDevice()
+	{
+		Microsoft::WRL::ComPtr<IDXGIFactory4> factory;
+		Microsoft::WRL::ComPtr<IDXGIAdapter> adapter;
+		Microsoft::WRL::ComPtr<ID3D12Device> device;
+		if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))) ||
+			FAILED(factory->EnumWarpAdapter(IID_PPV_ARGS(&adapter))) ||
+			FAILED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device))))
+			return nullptr;
+		return device;
+	}
+}
+
+TEST_CASE(PipelineCache_HashFollowsShaderBytes)
+{
+	PipelineCache cache;
+	const std::vector<BYTE> vs = Bytes(s_VertexShader, sizeof(s_VertexShader));
+	const std::vector<BYTE> ps = Bytes(s_PixelShader, sizeof(s_PixelShader));
+
+	// Same bytecode at other addresses, as after reloading the shaders.
+	const std::vector<BYTE> vsCopy = vs;
+	const std::vector<BYTE> psCopy = ps;
+
+	bool persistent = false;
+	const uint64_t key = Hash(cache, MakeDesc(nullptr, vs, ps), &persistent);
+	CHECK(key != 0);
+	CHECK(persistent);
+	CHECK(Hash(cache, MakeDesc(nullptr, vsCopy, psCopy)) == key);
+
+	std::vector<BYTE> edited = ps;
+	edited.back() ^= 0xFF;
+	CHECK(Hash(cache, MakeDesc(nullptr, vs, edited)) != key);
+	CHECK(Hash(cache, MakeDesc(nullptr, ps, vs)) != key);
+}
+
+TEST_CASE(PipelineCache_HashFollowsState)
+{
+	PipelineCache cache;
+	const std::vector<BYTE> vs = Bytes(s_VertexShader, sizeof(s_VertexShader));
+	const std::vector<BYTE> ps = Bytes(s_PixelShader, sizeof(s_PixelShader));
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = MakeDesc(nullptr, vs, ps);
+	const uint64_t key = Hash(cache, desc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC other = desc;
+	other.RTVFormats[0] = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	CHECK(Hash(cache, other) != key);
+
+	other = desc;
+	other.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	CHECK(Hash(cache, other) != key);
+}
+
+TEST_CASE(PipelineCache_RegisteredRootSignaturesHashByBlob)
+{
+	const std::vector<BYTE> vs = Bytes(s_VertexShader, sizeof(s_VertexShader));
+	const std::vector<BYTE> ps = Bytes(s_PixelShader, sizeof(s_PixelShader));
+
+	// Two runs: the root signature object differs, its serialized form does not.
+	PipelineCache firstRun;
+	firstRun.RegisterRootSignature(FakeRootSignature(s_RootSignatureA), s_RootSignatureBlob, sizeof(s_RootSignatureBlob));
+	PipelineCache secondRun;
+	secondRun.RegisterRootSignature(FakeRootSignature(s_RootSignatureB), s_RootSignatureBlob, sizeof(s_RootSignatureBlob));
+
+	bool firstPersistent = false;
+	bool secondPersistent = false;
+	const uint64_t firstKey = Hash(firstRun, MakeDesc(FakeRootSignature(s_RootSignatureA), vs, ps), &firstPersistent);
+	const uint64_t secondKey = Hash(secondRun, MakeDesc(FakeRootSignature(s_RootSignatureB), vs, ps), &secondPersistent);
+	CHECK(firstPersistent);
+	CHECK(secondPersistent);
+	CHECK(firstKey == secondKey);
+
+	// Without a root signature the pipeline is a different one.
+	CHECK(Hash(firstRun, MakeDesc(nullptr, vs, ps)) != firstKey);
+}
+
+TEST_CASE(PipelineCache_UnregisteredRootSignatureIsNotPersistent)
+{
+	PipelineCache cache;
+	cache.RegisterRootSignature(FakeRootSignature(s_RootSignatureA), s_RootSignatureBlob, sizeof(s_RootSignatureBlob));
+	const std::vector<BYTE> vs = Bytes(s_VertexShader, sizeof(s_VertexShader));
+	const std::vector<BYTE> ps = Bytes(s_PixelShader, sizeof(s_PixelShader));
+
+	bool persistent = true;
+	const uint64_t key = Hash(cache, MakeDesc(FakeRootSignature(s_RootSignatureC), vs, ps), &persistent);
+	CHECK(key != 0);
+	CHECK(!persistent);
+	CHECK(key != Hash(cache, MakeDesc(FakeRootSignature(s_RootSignatureA), vs, ps)));
+}
+
+BENCHMARK(PipelineCache_ColdVsWarmStartup)
+{
+	// A startup that needs 64 pipelines, twice: first with no library on
+	// disk (every pipeline is compiled and stored), then from the library
+	// the first run saved. Shader compilation is done up front and not timed.
+	const int pipelineCount = 64;
+
+	Microsoft::WRL::ComPtr<ID3D12Device> device = CreateWarpDevice();
+	if (!device)
+	{
+		printf("  no WARP device, skipped\n");
+		return;
+	}
+
+	const std::vector<BYTE> vs = CompileShader("VS", "vs_5_0", 0);
+	std::vector<std::vector<BYTE>> pixelShaders;
+	for (int i = 0; i < pipelineCount; ++i)
+		pixelShaders.push_back(CompileShader("PS", "ps_5_0", i + 1));
+	REQUIRE(!vs.empty() && !pixelShaders.back().empty());
+
+	Microsoft::WRL::ComPtr<ID3DBlob> rootSignatureBlob;
+	const CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc(0, nullptr);
+	REQUIRE(SUCCEEDED(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &rootSignatureBlob, nullptr)));
+
+	std::filesystem::remove(s_LibraryFile);
+	const char* const runNames[] = { "cold", "warm" };
+	for (const char* runName : runNames)
+	{
+		// A new root signature object each run, as after a restart; it is
+		// registered by its serialized form, so the keys stay the same.
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+		REQUIRE(SUCCEEDED(device->CreateRootSignature(0, rootSignatureBlob->GetBufferPointer(),
+			rootSignatureBlob->GetBufferSize(), IID_PPV_ARGS(&rootSignature))));
+
+		Testing::Stopwatch stopwatch;
+		PipelineCache cache;
+		cache.Initialize(device.Get(), s_LibraryFile.wstring());
+		cache.RegisterRootSignature(rootSignature.Get(), rootSignatureBlob->GetBufferPointer(), rootSignatureBlob->GetBufferSize());
+		for (const std::vector<BYTE>& ps : pixelShaders)
+		{
+			D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = MakeDesc(rootSignature.Get(), vs, ps);
+			desc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+			desc.DepthStencilState.DepthEnable = FALSE;
+			CHECK(cache.GetOrCreate(desc) != nullptr);
+		}
+		const double startupSeconds = stopwatch.Seconds();
+		CHECK(cache.Save());
+
+		const PipelineCache::Stats& stats = cache.GetStats();
+		printf("  %s: %d pipelines in %7.1f ms (Initialize %.1f ms); %u compiled in %.1f ms, %u from the library in %.1f ms%s\n",
+			runName, pipelineCount, startupSeconds * 1000.0, stats.InitializeMilliseconds,
+			stats.Compiles, stats.CompileMilliseconds, stats.LibraryHits, stats.LibraryMilliseconds,
+			stats.LibraryFromDisk ? "" : ", no library on disk");
+	}
+	std::filesystem::remove(s_LibraryFile);
+}
@@ -0,0 +1,356 @@
+#include "TestFramework.h"
+
+#include "PipelineCanonicalizer.h"
+#include "directx/d3dx12.h"
+
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+	const BYTE s_VertexShader[] = { 'D', 'X', 'B', 'C', 1, 2, 3, 4, 5, 6, 7, 8 };
+	const BYTE s_PixelShader[] = { 'D', 'X', 'B', 'C', 8, 7, 6, 5, 4, 3, 2, 1 };
+
+	// Only used as a key, never called.
+	int s_RootSignature;
+
+	ID3D12RootSignature* FakeRootSignature()
+	{
+		return reinterpret_cast<ID3D12RootSignature*>(&s_RootSignature);
+	}
+
+	D3D12_RT_FORMAT_ARRAY OneTarget(DXGI_FORMAT format)
+	{
+		D3D12_RT_FORMAT_ARRAY formats = {};
+		formats.NumRenderTargets = 1;
+		formats.RTFormats[0] = format;
+		return formats;
+	}
+
+	// Only what a pipeline cannot do without; everything else is left to
+	// the runtime defaults.
+	struct MinimalStream
+	{
+		CD3DX12_PIPELINE_STATE_STREAM_ROOT_SIGNATURE RootSignature;
+		CD3DX12_PIPELINE_STATE_STREAM_VS VS;
+		CD3DX12_PIPELINE_STATE_STREAM_PS PS;
+		CD3DX12_PIPELINE_STATE_STREAM_RENDER_TARGET_FORMATS RTVFormats;
+		CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL_FORMAT DSVFormat;
+	};
+
+	// The same pipeline with every default spelled out, in another order.
+	struct ExplicitStream
+	{
+		CD3DX12_PIPELINE_STATE_STREAM_FLAGS Flags;
+		CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL_FORMAT DSVFormat;
+		CD3DX12_PIPELINE_STATE_STREAM_PS PS;
+		CD3DX12_PIPELINE_STATE_STREAM_BLEND_DESC Blend;
+		CD3DX12_PIPELINE_STATE_STREAM_SAMPLE_MASK SampleMask;
+		CD3DX12_PIPELINE_STATE_STREAM_RASTERIZER Rasterizer;
+		CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL DepthStencil;
+		CD3DX12_PIPELINE_STATE_STREAM_PRIMITIVE_TOPOLOGY Topology;
+		CD3DX12_PIPELINE_STATE_STREAM_RENDER_TARGET_FORMATS RTVFormats;
+		CD3DX12_PIPELINE_STATE_STREAM_SAMPLE_DESC SampleDesc;
+		CD3DX12_PIPELINE_STATE_STREAM_NODE_MASK NodeMask;
+		CD3DX12_PIPELINE_STATE_STREAM_VS VS;
+		CD3DX12_PIPELINE_STATE_STREAM_ROOT_SIGNATURE RootSignature;
+	};
+
+	template <typename Stream>
+	void FillShaders(Stream& stream)
+	{
+		stream.RootSignature = FakeRootSignature();
+		stream.VS = CD3DX12_SHADER_BYTECODE(s_VertexShader, sizeof(s_VertexShader));
+		stream.PS = CD3DX12_SHADER_BYTECODE(s_PixelShader, sizeof(s_PixelShader));
+		stream.RTVFormats = OneTarget(DXGI_FORMAT_R8G8B8A8_UNORM);
+		stream.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	}
+
+	template <typename Stream>
+	bool Canonicalize(Stream& stream, CanonicalPipelineDesc& desc)
+	{
+		const D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+		return PipelineCanonicalizer::Canonicalize(streamDesc, desc);
+	}
+
+	// Only the depth-stencil subobject differs between the versions below.
+	template <typename DepthStencil>
+	struct DepthStencilStream
+	{
+		CD3DX12_PIPELINE_STATE_STREAM_ROOT_SIGNATURE RootSignature;
+		CD3DX12_PIPELINE_STATE_STREAM_VS VS;
+		CD3DX12_PIPELINE_STATE_STREAM_PS PS;
+		CD3DX12_PIPELINE_STATE_STREAM_RENDER_TARGET_FORMATS RTVFormats;
+		CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL_FORMAT DSVFormat;
+		DepthStencil DepthStencilState;
+	};
+
+	// Depth test on, stencil marking with masks that differ from the
+	// defaults, the same for both faces as DESC and DESC1 require.
+	template <typename Desc>
+	void SetStencil(Desc& desc)
+	{
+		desc.DepthEnable = TRUE;
+		desc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+		desc.DepthFunc = D3D12_COMPARISON_FUNC_GREATER_EQUAL;
+		desc.StencilEnable = TRUE;
+		desc.FrontFace.StencilPassOp = D3D12_STENCIL_OP_REPLACE;
+		desc.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+		desc.BackFace = desc.FrontFace;
+	}
+
+	uint64_t Hash(const CanonicalPipelineDesc& desc)
+	{
+		return PipelineCanonicalizer::Hash(desc, 1);
+	}
+
+	bool Reports(const std::vector<PipelineFieldDiff>& diffs, const char* field)
+	{
+		for (const PipelineFieldDiff& diff : diffs)
+		{
+			if (diff.Field == field)
+				return true;
+		}
+		return false;
+	}
+}
+
+TEST_CASE(PipelineCanonicalizer_AbsentSubobjectsMatchDefaults)
+{
+	MinimalStream minimal;
+	FillShaders(minimal);
+
+	ExplicitStream spelledOut;
+	FillShaders(spelledOut);
+	spelledOut.Blend = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	spelledOut.SampleMask = UINT_MAX;
+	spelledOut.Rasterizer = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	spelledOut.DepthStencil = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	spelledOut.Topology = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	spelledOut.SampleDesc = DXGI_SAMPLE_DESC{ 1, 0 };
+	spelledOut.NodeMask = 0u;
+	spelledOut.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+
+	CanonicalPipelineDesc a, b;
+	REQUIRE(Canonicalize(minimal, a));
+	REQUIRE(Canonicalize(spelledOut, b));
+	CHECK(PipelineCanonicalizer::Diff(a, b).empty());
+	CHECK(Hash(a) == Hash(b));
+
+	// Without a DSV format an absent depth-stencil subobject means no depth
+	// test, which the default CD3DX12_DEPTH_STENCIL_DESC does not.
+	minimal.DSVFormat = DXGI_FORMAT_UNKNOWN;
+	spelledOut.DSVFormat = DXGI_FORMAT_UNKNOWN;
+	REQUIRE(Canonicalize(minimal, a));
+	REQUIRE(Canonicalize(spelledOut, b));
+	CHECK(!a.DepthEnable);
+	CHECK(b.DepthEnable);
+	CHECK(Hash(a) != Hash(b));
+}
+
+TEST_CASE(PipelineCanonicalizer_DepthStencilVersionsHashAlike)
+{
+	CD3DX12_DEPTH_STENCIL_DESC desc(D3D12_DEFAULT);
+	SetStencil(desc);
+	desc.StencilReadMask = 0x0F;
+	desc.StencilWriteMask = 0xF0;
+
+	CD3DX12_DEPTH_STENCIL_DESC1 desc1(D3D12_DEFAULT);
+	SetStencil(desc1);
+	desc1.StencilReadMask = 0x0F;
+	desc1.StencilWriteMask = 0xF0;
+	desc1.DepthBoundsTestEnable = FALSE;
+
+	DepthStencilStream<CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL> stream;
+	FillShaders(stream);
+	stream.DepthStencilState = desc;
+	DepthStencilStream<CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL1> stream1;
+	FillShaders(stream1);
+	stream1.DepthStencilState = desc1;
+
+	CanonicalPipelineDesc a, b;
+	REQUIRE(Canonicalize(stream, a));
+	REQUIRE(Canonicalize(stream1, b));
+	CHECK(PipelineCanonicalizer::Diff(a, b).empty());
+	CHECK(Hash(a) == Hash(b));
+	CHECK(a.FrontFace.ReadMask == 0x0F && a.BackFace.WriteMask == 0xF0);
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 606)
+	// DESC2 carries the masks per face.
+	CD3DX12_DEPTH_STENCIL_DESC2 desc2(D3D12_DEFAULT);
+	desc2.DepthEnable = TRUE;
+	desc2.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	desc2.DepthFunc = D3D12_COMPARISON_FUNC_GREATER_EQUAL;
+	desc2.StencilEnable = TRUE;
+	desc2.FrontFace.StencilPassOp = D3D12_STENCIL_OP_REPLACE;
+	desc2.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+	desc2.FrontFace.StencilReadMask = 0x0F;
+	desc2.FrontFace.StencilWriteMask = 0xF0;
+	desc2.BackFace = desc2.FrontFace;
+
+	DepthStencilStream<CD3DX12_PIPELINE_STATE_STREAM_DEPTH_STENCIL2> stream2;
+	FillShaders(stream2);
+	stream2.DepthStencilState = desc2;
+
+	CanonicalPipelineDesc c;
+	REQUIRE(Canonicalize(stream2, c));
+	CHECK(PipelineCanonicalizer::Diff(a, c).empty());
+	CHECK(Hash(a) == Hash(c));
+#endif
+
+	// Stencil off: the faces no longer matter.
+	desc.StencilEnable = FALSE;
+	desc1.StencilEnable = FALSE;
+	desc1.FrontFace.StencilFailOp = D3D12_STENCIL_OP_INVERT;
+	desc1.StencilWriteMask = 0x01;
+	stream.DepthStencilState = desc;
+	stream1.DepthStencilState = desc1;
+	REQUIRE(Canonicalize(stream, a));
+	REQUIRE(Canonicalize(stream1, b));
+	CHECK(Hash(a) == Hash(b));
+}
+
+TEST_CASE(PipelineCanonicalizer_BlendFactorsIgnoredWithoutBlending)
+{
+	ExplicitStream opaque;
+	FillShaders(opaque);
+	opaque.Blend = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+
+	ExplicitStream leftovers = opaque;
+	CD3DX12_BLEND_DESC blend(D3D12_DEFAULT);
+	blend.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+	blend.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+	blend.RenderTarget[0].BlendOpAlpha = D3D12_BLEND_OP_MAX;
+	// Render target 1 does not exist, so whatever it says is ignored too.
+	blend.RenderTarget[1].BlendEnable = TRUE;
+	leftovers.Blend = blend;
+
+	CanonicalPipelineDesc a, b;
+	REQUIRE(Canonicalize(opaque, a));
+	REQUIRE(Canonicalize(leftovers, b));
+	CHECK(PipelineCanonicalizer::Diff(a, b).empty());
+	CHECK(Hash(a) == Hash(b));
+
+	// Once blending is on, the factors are part of the pipeline.
+	blend.RenderTarget[0].BlendEnable = TRUE;
+	leftovers.Blend = blend;
+	REQUIRE(Canonicalize(leftovers, b));
+	CHECK(Hash(a) != Hash(b));
+}
+
+TEST_CASE(PipelineCanonicalizer_DiffNamesFields)
+{
+	ExplicitStream first;
+	FillShaders(first);
+	first.Blend = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	first.Rasterizer = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	first.DepthStencil = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+
+	ExplicitStream second = first;
+	CD3DX12_BLEND_DESC blend(D3D12_DEFAULT);
+	blend.RenderTarget[0].BlendEnable = TRUE;
+	blend.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+	second.Blend = blend;
+	CD3DX12_RASTERIZER_DESC rasterizer(D3D12_DEFAULT);
+	rasterizer.CullMode = D3D12_CULL_MODE_NONE;
+	second.Rasterizer = rasterizer;
+	CD3DX12_DEPTH_STENCIL_DESC depthStencil(D3D12_DEFAULT);
+	depthStencil.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+	second.DepthStencil = depthStencil;
+	second.SampleMask = 0u;
+	second.PS = CD3DX12_SHADER_BYTECODE(s_VertexShader, sizeof(s_VertexShader));
+
+	CanonicalPipelineDesc a, b;
+	REQUIRE(Canonicalize(first, a));
+	REQUIRE(Canonicalize(second, b));
+	const std::vector<PipelineFieldDiff> diffs = PipelineCanonicalizer::Diff(a, b);
+
+	CHECK(diffs.size() == 6);
+	CHECK(Reports(diffs, "Blend.RenderTarget[0].BlendEnable"));
+	CHECK(Reports(diffs, "Blend.RenderTarget[0].SrcBlend"));
+	CHECK(Reports(diffs, "Rasterizer.CullMode"));
+	CHECK(Reports(diffs, "DepthStencil.DepthFunc"));
+	CHECK(Reports(diffs, "SampleMask"));
+	CHECK(Reports(diffs, "PS"));
+
+	for (const PipelineFieldDiff& diff : diffs)
+	{
+		if (diff.Field == "Rasterizer.CullMode")
+		{
+			CHECK(diff.A == std::to_string(D3D12_CULL_MODE_BACK));
+			CHECK(diff.B == std::to_string(D3D12_CULL_MODE_NONE));
+		}
+	}
+}
+
+BENCHMARK(PipelineCanonicalizer_Throughput)
+{
+	// 3 cull modes x 2 formats x 4 sets of leftover blend factors on a
+	// target without blending: 24 distinct streams, 6 distinct pipelines.
+	const D3D12_CULL_MODE cullModes[] = { D3D12_CULL_MODE_BACK, D3D12_CULL_MODE_FRONT, D3D12_CULL_MODE_NONE };
+	const DXGI_FORMAT formats[] = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R16G16B16A16_FLOAT };
+	const D3D12_BLEND factors[] = { D3D12_BLEND_ONE, D3D12_BLEND_SRC_ALPHA, D3D12_BLEND_DEST_COLOR, D3D12_BLEND_INV_SRC_ALPHA };
+
+	const D3D12_INPUT_ELEMENT_DESC inputLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
+	std::vector<CD3DX12_PIPELINE_STATE_STREAM> streams;
+	for (D3D12_CULL_MODE cullMode : cullModes)
+	{
+		for (DXGI_FORMAT format : formats)
+		{
+			for (D3D12_BLEND factor : factors)
+			{
+				D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+				desc.pRootSignature = FakeRootSignature();
+				desc.VS = { s_VertexShader, sizeof(s_VertexShader) };
+				desc.PS = { s_PixelShader, sizeof(s_PixelShader) };
+				desc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+				desc.BlendState.RenderTarget[0].SrcBlend = factor;
+				desc.SampleMask = UINT_MAX;
+				desc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+				desc.RasterizerState.CullMode = cullMode;
+				desc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+				desc.InputLayout = { inputLayout, _countof(inputLayout) };
+				desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+				desc.NumRenderTargets = 1;
+				desc.RTVFormats[0] = format;
+				desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+				desc.SampleDesc.Count = 1;
+				streams.emplace_back(desc);
+			}
+		}
+	}
+
+	const int rounds = 20000;
+	std::unordered_set<uint64_t> keys;
+	CanonicalPipelineDesc canonical;
+	uint64_t checksum = 0;
+
+	Testing::Stopwatch stopwatch;
+	for (int round = 0; round < rounds; ++round)
+	{
+		for (CD3DX12_PIPELINE_STATE_STREAM& stream : streams)
+		{
+			const D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+			PipelineCanonicalizer::Canonicalize(streamDesc, canonical);
+			checksum += PipelineCanonicalizer::Hash(canonical, 1);
+			if (round == 0)
+				keys.insert(PipelineCanonicalizer::Hash(canonical, 1));
+		}
+	}
+	const double seconds = stopwatch.Seconds();
+
+	const double count = double(rounds) * double(streams.size());
+	CHECK(keys.size() == _countof(cullModes) * _countof(formats));
+	printf("  %zu streams -> %zu pipelines; %.0f canonicalize+hash in %.1f ms: %.2f us each, %.0f per second (checksum %llx)\n",
+		streams.size(), keys.size(), count, seconds * 1000.0, seconds * 1e6 / count, count / seconds,
+		static_cast<unsigned long long>(checksum));
+}
@@ -0,0 +1,462 @@
+#include "TestFramework.h"
+
+#include "FakeResource.h"
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	using Testing::FakeResource;
+
+	const UINT64 s_PlacementAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+	D3D12_RESOURCE_DESC TargetDesc(UINT64 width, UINT height)
+	{
+		D3D12_RESOURCE_DESC desc = FakeResource::TextureDesc(1);
+		desc.Width = width;
+		desc.Height = height;
+		desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+		return desc;
+	}
+
+	// 4 bytes per texel, rounded up to the placement alignment, like an
+	// uncompressed RGBA8 texture on real hardware.
+	D3D12_RESOURCE_ALLOCATION_INFO AllocationInfo(const D3D12_RESOURCE_DESC& desc)
+	{
+		D3D12_RESOURCE_ALLOCATION_INFO info;
+		const UINT64 bytes = desc.Width * desc.Height * 4;
+		info.SizeInBytes = (bytes + s_PlacementAlignment - 1) / s_PlacementAlignment * s_PlacementAlignment;
+		info.Alignment = s_PlacementAlignment;
+		return info;
+	}
+
+	void NoExecute(RenderGraphContext&) {}
+
+	std::vector<UINT> ExecutionOrder(const RenderGraph& graph)
+	{
+		std::vector<UINT> order;
+		for (UINT step = 0; step < graph.GetStepCount(); ++step)
+			order.push_back(graph.GetStepPass(step));
+		return order;
+	}
+
+	bool Waits(const RenderGraph& graph, UINT consumerBatch, UINT producerBatch)
+	{
+		const std::vector<UINT>& waits = graph.GetBatchWaits(consumerBatch);
+		return std::find(waits.begin(), waits.end(), producerBatch) != waits.end();
+	}
+}
+
+TEST_CASE(RenderGraph_CullsPassesNobodyReads)
+{
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+
+	RenderGraphHandle scene = InvalidRenderGraphHandle;
+	RenderGraphHandle unused = InvalidRenderGraphHandle;
+	RenderGraphHandle unusedChain = InvalidRenderGraphHandle;
+	const UINT scenePass = graph.AddPass("Scene", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		scene = builder.Create("Scene", TargetDesc(64, 64));
+		builder.Write(scene, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT unusedPass = graph.AddPass("Unused", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		unused = builder.Create("Unused", TargetDesc(64, 64));
+		builder.Write(unused, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT unusedReaderPass = graph.AddPass("UnusedReader", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(unused, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		unusedChain = builder.Create("UnusedChain", TargetDesc(64, 64));
+		builder.Write(unusedChain, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT compositePass = graph.AddPass("Composite", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(scene, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT readbackPass = graph.AddPass("Readback", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.SetSideEffect();
+	}, NoExecute);
+	graph.Compile(nullptr, false);
+
+	CHECK(!graph.IsPassCulled(scenePass));
+	CHECK(graph.IsPassCulled(unusedPass));
+	CHECK(graph.IsPassCulled(unusedReaderPass));
+	CHECK(!graph.IsPassCulled(compositePass));
+	CHECK(!graph.IsPassCulled(readbackPass));
+	CHECK(graph.GetStats().PassesDeclared == 5);
+	CHECK(graph.GetStats().PassesCulled == 2);
+	CHECK(graph.GetStepCount() == 3);
+	CHECK(graph.GetStats().TransientResources == 1);
+}
+
+TEST_CASE(RenderGraph_OrdersByDependencies)
+{
+	// Declared as two graphics passes, an independent async compute pass and
+	// a graphics pass reading its output. The compute pass is hoisted to the
+	// front only when there is a compute queue to run it on.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	auto declare = [&](RenderGraph& graph)
+	{
+		const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+			D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+		RenderGraphHandle scene = InvalidRenderGraphHandle;
+		RenderGraphHandle particles = InvalidRenderGraphHandle;
+		graph.AddPass("Scene", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+		{
+			scene = builder.Create("Scene", TargetDesc(64, 64));
+			builder.Write(scene, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		}, NoExecute);
+		graph.AddPass("Tonemap", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+		{
+			builder.Read(scene, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+			builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		}, NoExecute);
+		graph.AddPass("Particles", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+		{
+			particles = builder.Create("Particles", TargetDesc(64, 64));
+			builder.Write(particles, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		}, NoExecute);
+		graph.AddPass("Overlay", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+		{
+			builder.Read(particles, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+			builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		}, NoExecute);
+	};
+
+	RenderGraph graphicsOnly;
+	declare(graphicsOnly);
+	graphicsOnly.Compile(nullptr, false);
+	CHECK(ExecutionOrder(graphicsOnly) == std::vector<UINT>({ 0, 1, 2, 3 }));
+	CHECK(graphicsOnly.GetPassQueue(2) == RenderGraphQueue::Graphics);
+	CHECK(graphicsOnly.GetBatchCount() == 1);
+
+	RenderGraph withCompute;
+	declare(withCompute);
+	withCompute.Compile(nullptr, true);
+	CHECK(ExecutionOrder(withCompute) == std::vector<UINT>({ 2, 0, 1, 3 }));
+	CHECK(withCompute.GetPassQueue(2) == RenderGraphQueue::AsyncCompute);
+	CHECK(withCompute.GetStats().AsyncComputePasses == 1);
+}
+
+TEST_CASE(RenderGraph_WriteWaitsForEarlierReaders)
+{
+	// Write-after-read: the pass that overwrites History must come after the
+	// pass that samples it, even though it is declared to run on compute and
+	// nothing it reads is produced by the sampling pass.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+	RenderGraphHandle history = InvalidRenderGraphHandle;
+	graph.AddPass("WriteHistory", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		history = builder.Create("History", TargetDesc(64, 64));
+		builder.Write(history, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("Resolve", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(history, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("Overwrite", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+	{
+		builder.Write(history, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		builder.SetSideEffect();
+	}, NoExecute);
+	graph.Compile(nullptr, true);
+
+	CHECK(ExecutionOrder(graph) == std::vector<UINT>({ 0, 1, 2 }));
+}
+
+TEST_CASE(RenderGraph_AliasesTransientsWithDisjointLifetimes)
+{
+	// A chain of full-screen passes: A and C are never alive at the same
+	// time, and neither are B and Bloom, so each pair can share memory.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	graph.SetAllocationInfoFunc(AllocationInfo);
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+
+	RenderGraphHandle a = InvalidRenderGraphHandle;
+	RenderGraphHandle b = InvalidRenderGraphHandle;
+	RenderGraphHandle c = InvalidRenderGraphHandle;
+	RenderGraphHandle bloom = InvalidRenderGraphHandle;
+	graph.AddPass("A", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		a = builder.Create("A", TargetDesc(256, 256));
+		builder.Write(a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("B", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		b = builder.Create("B", TargetDesc(256, 256));
+		builder.Write(b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("C", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(b, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		c = builder.Create("C", TargetDesc(256, 256));
+		builder.Write(c, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("Bloom", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(c, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		bloom = builder.Create("Bloom", TargetDesc(64, 64));
+		builder.Write(bloom, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("Composite", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(c, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Read(bloom, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.Compile(nullptr, false);
+
+	// 256x256x4 = 256 KB each. Bloom rounds up to one 64 KB block and goes
+	// where B was.
+	const UINT64 size = 256 * 256 * 4;
+	CHECK(graph.GetTransientOffset(a) == 0);
+	CHECK(graph.GetTransientOffset(b) == size);
+	CHECK(graph.GetTransientOffset(c) == 0);
+	CHECK(graph.GetTransientOffset(bloom) == size);
+	CHECK(graph.IsTransientAliased(a));
+	CHECK(graph.IsTransientAliased(b));
+	CHECK(graph.IsTransientAliased(c));
+	CHECK(graph.IsTransientAliased(bloom));
+
+	const RenderGraph::Stats& stats = graph.GetStats();
+	CHECK(stats.TransientResources == 4);
+	CHECK(stats.TransientResourceBytes == 3 * size + s_PlacementAlignment);
+	CHECK(stats.TransientHeapBytes == 2 * size);
+	CHECK(stats.AliasingBarriers == 4);
+}
+
+TEST_CASE(RenderGraph_ComputeTransientsAreNotAliased)
+{
+	// Simulation is last used in step 1 and Late first used in step 2, so
+	// on one queue they could share memory. Simulation is used on async
+	// compute, which overlaps the graphics work, so it is kept apart.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	graph.SetAllocationInfoFunc(AllocationInfo);
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+
+	RenderGraphHandle simulation = InvalidRenderGraphHandle;
+	RenderGraphHandle late = InvalidRenderGraphHandle;
+	const UINT simulatePass = graph.AddPass("Simulate", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+	{
+		simulation = builder.Create("Simulation", TargetDesc(256, 256));
+		builder.Write(simulation, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}, NoExecute);
+	graph.AddPass("UseSimulation", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(simulation, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("Late", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		late = builder.Create("Late", TargetDesc(256, 256));
+		builder.Write(late, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("UseLate", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(late, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+
+	graph.Compile(nullptr, false);
+	CHECK(ExecutionOrder(graph) == std::vector<UINT>({ 0, 1, 2, 3 }));
+	CHECK(graph.GetTransientOffset(simulation) == graph.GetTransientOffset(late));
+	CHECK(graph.GetStats().AliasingBarriers == 2);
+
+	graph.Compile(nullptr, true);
+	REQUIRE(graph.GetPassQueue(simulatePass) == RenderGraphQueue::AsyncCompute);
+	CHECK(ExecutionOrder(graph) == std::vector<UINT>({ 0, 1, 2, 3 }));
+	CHECK(graph.GetTransientOffset(simulation) != graph.GetTransientOffset(late));
+	CHECK(!graph.IsTransientAliased(simulation));
+	CHECK(!graph.IsTransientAliased(late));
+	CHECK(graph.GetStats().AliasingBarriers == 0);
+}
+
+TEST_CASE(RenderGraph_WaitsOnlyWhereDependenciesCrossQueues)
+{
+	// Compute produces a buffer that graphics samples: one compute batch,
+	// then one graphics batch that waits for it. The compute batch waits for
+	// nothing.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+	RenderGraphHandle lighting = InvalidRenderGraphHandle;
+	const UINT computePass = graph.AddPass("Lighting", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+	{
+		lighting = builder.Create("Lighting", TargetDesc(64, 64));
+		builder.Write(lighting, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}, NoExecute);
+	const UINT firstGraphicsPass = graph.AddPass("Sky", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT secondGraphicsPass = graph.AddPass("Composite", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(lighting, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.Compile(nullptr, true);
+
+	REQUIRE(graph.GetBatchCount() == 2);
+	CHECK(graph.GetBatchQueue(0) == RenderGraphQueue::AsyncCompute);
+	CHECK(graph.GetBatchQueue(1) == RenderGraphQueue::Graphics);
+	CHECK(graph.GetPassBatch(computePass) == 0);
+	CHECK(graph.GetPassBatch(firstGraphicsPass) == 1);
+	CHECK(graph.GetPassBatch(secondGraphicsPass) == 1);
+	CHECK(graph.GetBatchWaits(0).empty());
+	CHECK(graph.GetBatchWaits(1) == std::vector<UINT>({ 0 }));
+
+	// UAV -> PIXEL_SHADER_RESOURCE on graphics, RENDER_TARGET -> PRESENT at the end.
+	CHECK(graph.GetStats().Transitions == 4);
+}
+
+TEST_CASE(RenderGraph_GraphicsOnlyTransitionsFollowAGraphicsUse)
+{
+	// Compute cannot transition out of RENDER_TARGET, so the graph records
+	// that transition on graphics right after the render target pass and
+	// makes the compute batch wait for it.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+	RenderGraphHandle target = InvalidRenderGraphHandle;
+	const UINT drawPass = graph.AddPass("Draw", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		target = builder.Create("Target", TargetDesc(64, 64));
+		builder.Write(target, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT blurPass = graph.AddPass("Blur", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(target, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		builder.Write(target, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}, NoExecute);
+	graph.AddPass("Composite", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.Compile(nullptr, true);
+
+	CHECK(graph.GetPassQueue(blurPass) == RenderGraphQueue::AsyncCompute);
+	REQUIRE(graph.GetBatchCount() == 3);
+	CHECK(Waits(graph, graph.GetPassBatch(blurPass), graph.GetPassBatch(drawPass)));
+	CHECK(Waits(graph, 2, graph.GetPassBatch(blurPass)));
+}
+
+TEST_CASE(RenderGraph_ComputeAfterComputeReadOfGraphicsStateIsDemoted)
+{
+	// Target ends up in PIXEL | NON_PIXEL_SHADER_RESOURCE on graphics. A
+	// compute pass may read it as NON_PIXEL without a transition, but then
+	// the last use before the UAV write is on compute, which cannot leave
+	// PIXEL_SHADER_RESOURCE. The writer has to run on graphics.
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+	RenderGraph graph;
+	const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+	RenderGraphHandle target = InvalidRenderGraphHandle;
+	RenderGraphHandle mask = InvalidRenderGraphHandle;
+	graph.AddPass("Draw", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		target = builder.Create("Target", TargetDesc(64, 64));
+		builder.Write(target, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	graph.AddPass("SampleBoth", RenderGraphQueue::Graphics, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		mask = builder.Create("Mask", TargetDesc(64, 64));
+		builder.Write(mask, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}, NoExecute);
+	const UINT computeReadPass = graph.AddPass("ComputeRead", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+	{
+		builder.Read(target, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		builder.Read(mask, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		builder.SetSideEffect();
+	}, NoExecute);
+	const UINT computeWritePass = graph.AddPass("ComputeWrite", RenderGraphQueue::AsyncCompute, [&](RenderGraphBuilder& builder)
+	{
+		builder.Write(target, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		builder.SetSideEffect();
+	}, NoExecute);
+	graph.Compile(nullptr, true);
+
+	CHECK(ExecutionOrder(graph) == std::vector<UINT>({ 0, 1, 2, 3 }));
+	CHECK(graph.GetPassQueue(computeReadPass) == RenderGraphQueue::AsyncCompute);
+	CHECK(graph.GetPassQueue(computeWritePass) == RenderGraphQueue::Graphics);
+	CHECK(Waits(graph, graph.GetPassBatch(computeWritePass), graph.GetPassBatch(computeReadPass)));
+}
+
+BENCHMARK(RenderGraph_CompileThousandsOfPasses)
+{
+	// A synthetic frame: each pass creates one transient, samples up to
+	// three recent ones and every eighth runs on async compute. One pass in
+	// sixteen writes the back buffer, so the chains feeding it are kept and
+	// the rest are culled. Compiled headless, with transients packed.
+	const UINT passCounts[] = { 1000, 4000, 10000 };
+	FakeResource backBuffer(FakeResource::TextureDesc(1));
+
+	for (UINT passCount : passCounts)
+	{
+		std::mt19937 random(passCount);
+		RenderGraph graph;
+		graph.SetAllocationInfoFunc(AllocationInfo);
+
+		Testing::Stopwatch declareStopwatch;
+		const RenderGraphHandle output = graph.ImportResource("BackBuffer", &backBuffer,
+			D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+		std::vector<RenderGraphHandle> transients;
+		for (UINT pass = 0; pass < passCount; ++pass)
+		{
+			const bool compute = pass % 8 == 7;
+			graph.AddPass("Pass", compute ? RenderGraphQueue::AsyncCompute : RenderGraphQueue::Graphics,
+				[&](RenderGraphBuilder& builder)
+			{
+				const UINT reads = random() % 4;
+				for (UINT i = 0; i < reads && !transients.empty(); ++i)
+				{
+					const size_t window = std::min<size_t>(transients.size(), 32);
+					const RenderGraphHandle input = transients[transients.size() - 1 - random() % window];
+					builder.Read(input, compute ? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE : D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+				}
+
+				const UINT size = 64u << (random() % 5);
+				const RenderGraphHandle target = builder.Create("Target", TargetDesc(size, size));
+				builder.Write(target, compute ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS : D3D12_RESOURCE_STATE_RENDER_TARGET);
+				transients.push_back(target);
+
+				if (!compute && pass % 16 == 0)
+					builder.Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			}, NoExecute);
+		}
+		const double declareSeconds = declareStopwatch.Seconds();
+
+		graph.Compile(nullptr, true);
+		const RenderGraph::Stats& stats = graph.GetStats();
+		CHECK(stats.PassesDeclared == passCount);
+		CHECK(stats.TransientHeapBytes <= stats.TransientResourceBytes);
+		printf("  %5u passes: declare %7.2f ms, compile %8.2f ms; %u culled, %u on compute, %u batches,"
+			" %u transitions (%u split), %u aliasing; transients %.1f MB -> %.1f MB\n",
+			passCount, declareSeconds * 1000.0, stats.CompileMilliseconds, stats.PassesCulled, stats.AsyncComputePasses,
+			stats.Batches, stats.Transitions, stats.SplitTransitions, stats.AliasingBarriers,
+			stats.TransientResourceBytes / (1024.0 * 1024.0), stats.TransientHeapBytes / (1024.0 * 1024.0));
+	}
+}
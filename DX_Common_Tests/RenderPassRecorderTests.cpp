@@ -0,0 +1,148 @@
+#include "TestFramework.h"
+
+#include "RenderPassRecorder.h"
+
+namespace
+{
+	// One render target at descriptor 'view', with the given ops.
+	RenderPassDesc ColorPass(RenderPassLoadOp load, RenderPassStoreOp store, SIZE_T view = 1)
+	{
+		RenderPassDesc desc;
+		desc.NumRenderTargets = 1;
+		desc.RenderTargets[0].View.ptr = view;
+		desc.RenderTargets[0].Load = load;
+		desc.RenderTargets[0].Store = store;
+		return desc;
+	}
+
+	// A render target that is preserved throughout, plus depth and stencil
+	// with the given ops.
+	RenderPassDesc DepthPass(RenderPassLoadOp depthLoad, RenderPassStoreOp depthStore,
+		RenderPassLoadOp stencilLoad = RenderPassLoadOp::NoAccess, RenderPassStoreOp stencilStore = RenderPassStoreOp::NoAccess)
+	{
+		RenderPassDesc desc = ColorPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve);
+		desc.HasDepthStencil = true;
+		desc.DepthStencil.View.ptr = 100;
+		desc.DepthStencil.Load = depthLoad;
+		desc.DepthStencil.Store = depthStore;
+		desc.StencilLoad = stencilLoad;
+		desc.StencilStore = stencilStore;
+		return desc;
+	}
+
+	bool Continues(RenderPassStoreOp store, RenderPassLoadOp load)
+	{
+		return RenderPassRecorder::CanMerge(
+			ColorPass(RenderPassLoadOp::Preserve, store),
+			ColorPass(load, RenderPassStoreOp::Preserve));
+	}
+}
+
+TEST_CASE(RenderPassRecorder_PreservedContentsContinue)
+{
+	// The second pass loads what the first stored, or does not care.
+	CHECK(Continues(RenderPassStoreOp::Preserve, RenderPassLoadOp::Preserve));
+	CHECK(Continues(RenderPassStoreOp::Preserve, RenderPassLoadOp::Discard));
+}
+
+TEST_CASE(RenderPassRecorder_ClearAndResolveDoNotContinue)
+{
+	// A clear has to happen where the second pass begins, a resolve where
+	// the first one ends.
+	CHECK(!Continues(RenderPassStoreOp::Preserve, RenderPassLoadOp::Clear));
+	CHECK(!Continues(RenderPassStoreOp::Discard, RenderPassLoadOp::Clear));
+	CHECK(!Continues(RenderPassStoreOp::Resolve, RenderPassLoadOp::Preserve));
+	CHECK(!Continues(RenderPassStoreOp::Resolve, RenderPassLoadOp::Discard));
+}
+
+TEST_CASE(RenderPassRecorder_DiscardedContentsAreNotPreserved)
+{
+	// Contents the first pass discards are undefined afterwards. A second
+	// pass that discards them too may continue; one that preserves them
+	// would be handed data it must not rely on.
+	CHECK(Continues(RenderPassStoreOp::Discard, RenderPassLoadOp::Discard));
+	CHECK(!Continues(RenderPassStoreOp::Discard, RenderPassLoadOp::Preserve));
+}
+
+TEST_CASE(RenderPassRecorder_NoAccessOnlyContinuesNoAccess)
+{
+	CHECK(Continues(RenderPassStoreOp::NoAccess, RenderPassLoadOp::NoAccess));
+	CHECK(!Continues(RenderPassStoreOp::NoAccess, RenderPassLoadOp::Preserve));
+	CHECK(!Continues(RenderPassStoreOp::NoAccess, RenderPassLoadOp::Discard));
+	CHECK(!Continues(RenderPassStoreOp::Preserve, RenderPassLoadOp::NoAccess));
+	CHECK(!Continues(RenderPassStoreOp::Discard, RenderPassLoadOp::NoAccess));
+
+	// Stencil follows the same rule as depth.
+	CHECK(RenderPassRecorder::CanMerge(
+		DepthPass(RenderPassLoadOp::Clear, RenderPassStoreOp::Preserve),
+		DepthPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Discard)));
+	CHECK(!RenderPassRecorder::CanMerge(
+		DepthPass(RenderPassLoadOp::Clear, RenderPassStoreOp::Preserve),
+		DepthPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Discard, RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve)));
+}
+
+TEST_CASE(RenderPassRecorder_DifferentAttachmentsDoNotMerge)
+{
+	const RenderPassDesc first = ColorPass(RenderPassLoadOp::Clear, RenderPassStoreOp::Preserve);
+	CHECK(RenderPassRecorder::CanMerge(first, ColorPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve)));
+
+	// Another render target
+	CHECK(!RenderPassRecorder::CanMerge(first, ColorPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve, 2)));
+
+	// Another number of render targets
+	RenderPassDesc twoTargets = ColorPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve);
+	twoTargets.NumRenderTargets = 2;
+	twoTargets.RenderTargets[1].View.ptr = 2;
+	CHECK(!RenderPassRecorder::CanMerge(first, twoTargets));
+
+	// A depth buffer appears
+	CHECK(!RenderPassRecorder::CanMerge(first, DepthPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve)));
+
+	// Other flags
+	RenderPassDesc uavWrites = ColorPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Preserve);
+	uavWrites.Flags = D3D12_RENDER_PASS_FLAG_ALLOW_UAV_WRITES;
+	CHECK(!RenderPassRecorder::CanMerge(first, uavWrites));
+}
+
+TEST_CASE(RenderPassRecorder_MergeBeginsLikeFirstAndEndsLikeSecond)
+{
+	// Scene: clear colour and depth. Transparent: continue both, then
+	// resolve colour and discard depth. The merged pass clears with the
+	// first pass's values and resolves into the second pass's target.
+	RenderPassDesc scene = DepthPass(RenderPassLoadOp::Clear, RenderPassStoreOp::Preserve,
+		RenderPassLoadOp::Clear, RenderPassStoreOp::Preserve);
+	scene.RenderTargets[0].Load = RenderPassLoadOp::Clear;
+	scene.RenderTargets[0].ClearValue.Color[0] = 0.25f;
+	scene.DepthStencil.ClearValue.DepthStencil.Depth = 1.0f;
+
+	ID3D12Resource* const resolveTarget = reinterpret_cast<ID3D12Resource*>(0x1000);
+	RenderPassDesc transparent = DepthPass(RenderPassLoadOp::Preserve, RenderPassStoreOp::Discard,
+		RenderPassLoadOp::Preserve, RenderPassStoreOp::Discard);
+	transparent.RenderTargets[0].Store = RenderPassStoreOp::Resolve;
+	transparent.RenderTargets[0].ResolveTarget = resolveTarget;
+	transparent.RenderTargets[0].ResolveFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	REQUIRE(RenderPassRecorder::CanMerge(scene, transparent));
+	const RenderPassDesc merged = RenderPassRecorder::Merge(scene, transparent);
+
+	const RenderPassAttachment& color = merged.RenderTargets[0];
+	CHECK(merged.NumRenderTargets == 1);
+	CHECK(color.View.ptr == 1);
+	CHECK(color.Load == RenderPassLoadOp::Clear);
+	CHECK(color.ClearValue.Color[0] == 0.25f);
+	CHECK(color.Store == RenderPassStoreOp::Resolve);
+	CHECK(color.ResolveTarget == resolveTarget);
+	CHECK(color.ResolveFormat == DXGI_FORMAT_R8G8B8A8_UNORM);
+
+	CHECK(merged.HasDepthStencil);
+	CHECK(merged.DepthStencil.Load == RenderPassLoadOp::Clear);
+	CHECK(merged.DepthStencil.ClearValue.DepthStencil.Depth == 1.0f);
+	CHECK(merged.DepthStencil.Store == RenderPassStoreOp::Discard);
+	CHECK(merged.StencilLoad == RenderPassLoadOp::Clear);
+	CHECK(merged.StencilStore == RenderPassStoreOp::Discard);
+
+	// Depth could continue, but the merged pass resolves colour, so nothing
+	// more can be folded into it.
+	CHECK(!RenderPassRecorder::CanMerge(merged, DepthPass(RenderPassLoadOp::Discard, RenderPassStoreOp::Discard,
+		RenderPassLoadOp::Discard, RenderPassStoreOp::Discard)));
+}
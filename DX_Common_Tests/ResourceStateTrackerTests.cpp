@@ -0,0 +1,240 @@
+#include "TestFramework.h"
+
+#include "FakeResource.h"
+#include "ResourceStateTracker.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	using Testing::FakeResource;
+
+	// Registers for the length of a test, so the global states of one test
+	// never leak into the next.
+	struct Registration
+	{
+		Registration(FakeResource& resource, D3D12_RESOURCE_STATES state) : Resource(&resource)
+		{
+			ResourceStateTracker::RegisterResource(Resource, state);
+		}
+		~Registration() { ResourceStateTracker::UnregisterResource(Resource); }
+
+		ID3D12Resource* Resource;
+	};
+
+	// The submission sequence from the class comment; returns the fixups.
+	std::vector<D3D12_RESOURCE_BARRIER> Submit(ResourceStateTracker& tracker)
+	{
+		std::vector<D3D12_RESOURCE_BARRIER> fixups;
+		ResourceStateTracker::Lock();
+		tracker.FlushPendingBarriers(fixups);
+		tracker.CommitFinalStates();
+		ResourceStateTracker::Unlock();
+		tracker.Reset();
+		return fixups;
+	}
+
+	std::vector<D3D12_RESOURCE_BARRIER> Flush(ResourceStateTracker& tracker)
+	{
+		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+		tracker.FlushBarriers(barriers);
+		return barriers;
+	}
+
+	bool IsTransition(const D3D12_RESOURCE_BARRIER& barrier, ID3D12Resource* resource, UINT subresource,
+		D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+	{
+		return barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && barrier.Transition.pResource == resource &&
+			barrier.Transition.Subresource == subresource && barrier.Transition.StateBefore == before &&
+			barrier.Transition.StateAfter == after;
+	}
+
+	const UINT s_All = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+}
+
+TEST_CASE(ResourceStateTracker_CompatibleFirstUseNeedsNoFixup)
+{
+	FakeResource buffer;
+	Registration registration(buffer, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	// GENERIC_READ already covers the read: no fixup, and the buffer stays
+	// in GENERIC_READ rather than being narrowed to PIXEL_SHADER_RESOURCE.
+	ResourceStateTracker tracker;
+	tracker.TransitionResource(&buffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	CHECK(Flush(tracker).empty());
+	CHECK(Submit(tracker).empty());
+
+	tracker.TransitionResource(&buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+	const std::vector<D3D12_RESOURCE_BARRIER> fixups = Submit(tracker);
+	REQUIRE(fixups.size() == 1);
+	CHECK(IsTransition(fixups[0], &buffer, s_All, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST));
+}
+
+TEST_CASE(ResourceStateTracker_CompatibleFirstUseIsFixedUpWhenTransitionedLater)
+{
+	// The list transitions out of PIXEL_SHADER_RESOURCE, so the barrier it
+	// recorded names that state as its before-state and the fixup has to
+	// put the buffer there first.
+	FakeResource buffer;
+	Registration registration(buffer, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	ResourceStateTracker tracker;
+	tracker.TransitionResource(&buffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.TransitionResource(&buffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	const std::vector<D3D12_RESOURCE_BARRIER> barriers = Flush(tracker);
+	REQUIRE(barriers.size() == 1);
+	CHECK(IsTransition(barriers[0], &buffer, s_All, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+	const std::vector<D3D12_RESOURCE_BARRIER> fixups = Submit(tracker);
+	REQUIRE(fixups.size() == 1);
+	CHECK(IsTransition(fixups[0], &buffer, s_All, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+TEST_CASE(ResourceStateTracker_WholeToSubresourceAndBack)
+{
+	FakeResource texture(FakeResource::TextureDesc(4));
+	Registration registration(texture, D3D12_RESOURCE_STATE_COMMON);
+
+	ResourceStateTracker tracker;
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	CHECK(Flush(tracker).empty()); // first use: pending
+
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, 2);
+	std::vector<D3D12_RESOURCE_BARRIER> barriers = Flush(tracker);
+	REQUIRE(barriers.size() == 1);
+	CHECK(IsTransition(barriers[0], &texture, 2, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	// Back to the whole resource: only mip 2 differs, so only it moves.
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	barriers = Flush(tracker);
+	REQUIRE(barriers.size() == 1);
+	CHECK(IsTransition(barriers[0], &texture, 2, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+	// Uniform again, so the next whole-resource transition is one barrier.
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	barriers = Flush(tracker);
+	REQUIRE(barriers.size() == 1);
+	CHECK(IsTransition(barriers[0], &texture, s_All, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE));
+
+	const std::vector<D3D12_RESOURCE_BARRIER> fixups = Submit(tracker);
+	REQUIRE(fixups.size() == 1);
+	CHECK(IsTransition(fixups[0], &texture, s_All, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_RENDER_TARGET));
+}
+
+TEST_CASE(ResourceStateTracker_SubresourceTransitionsMergeWhileQueued)
+{
+	FakeResource texture(FakeResource::TextureDesc(4));
+	Registration registration(texture, D3D12_RESOURCE_STATE_COPY_DEST);
+
+	// Each mip's first use is pending; they all want the same state, so the
+	// fixup is one whole-resource barrier.
+	ResourceStateTracker tracker;
+	for (UINT mip = 0; mip < 4; ++mip)
+		tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, mip);
+
+	// A->B->A on one mip cancels out before it is flushed.
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 1);
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, 1);
+	CHECK(Flush(tracker).empty());
+	CHECK(tracker.GetStats().TransitionsMerged == 1);
+
+	std::vector<D3D12_RESOURCE_BARRIER> fixups = Submit(tracker);
+	REQUIRE(fixups.size() == 1);
+	CHECK(IsTransition(fixups[0], &texture, s_All, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	// The next list finds mip 3 in PIXEL_SHADER_RESOURCE and wants the
+	// whole texture there plus NON_PIXEL: every mip moves the same way.
+	const D3D12_RESOURCE_STATES allShaderResource =
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	tracker.TransitionResource(&texture, allShaderResource);
+	fixups = Submit(tracker);
+	REQUIRE(fixups.size() == 1);
+	CHECK(IsTransition(fixups[0], &texture, s_All, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, allShaderResource));
+}
+
+TEST_CASE(ResourceStateTracker_FixupsPerSubresourceWhenGlobalStatesDiffer)
+{
+	FakeResource texture(FakeResource::TextureDesc(4));
+	Registration registration(texture, D3D12_RESOURCE_STATE_COPY_DEST);
+
+	// Leave mip 1 in UNORDERED_ACCESS and mip 2 in GENERIC_READ.
+	ResourceStateTracker tracker;
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, 1);
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_GENERIC_READ, 2);
+	CHECK(Submit(tracker).size() == 2);
+
+	// Mips 0 and 3 come from COPY_DEST, mip 1 from UNORDERED_ACCESS, and
+	// mip 2 is already readable.
+	tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	const std::vector<D3D12_RESOURCE_BARRIER> fixups = Submit(tracker);
+	REQUIRE(fixups.size() == 3);
+	CHECK(IsTransition(fixups[0], &texture, 0, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	CHECK(IsTransition(fixups[1], &texture, 1, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	CHECK(IsTransition(fixups[2], &texture, 3, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+BENCHMARK(ResourceStateTracker_BarriersPerFrame)
+{
+	// A synthetic frame: 32 render targets written and then sampled in
+	// groups of four, a G-buffer read by two later passes, and 8 textures
+	// that get a mip chain generated per subresource. Compares the barriers
+	// the tracker records with one barrier per requested transition.
+	const int renderTargetCount = 32;
+	const int mipTextureCount = 8;
+	const UINT16 mipLevels = 10;
+	std::vector<FakeResource> renderTargets(renderTargetCount);
+	std::vector<FakeResource> mipTextures(mipTextureCount, FakeResource(FakeResource::TextureDesc(mipLevels)));
+	std::vector<Registration> registrations;
+	registrations.reserve(renderTargetCount + mipTextureCount);
+	for (FakeResource& target : renderTargets)
+		registrations.emplace_back(target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	for (FakeResource& texture : mipTextures)
+		registrations.emplace_back(texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	const int frames = 1000;
+	ResourceStateTracker tracker;
+	std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	UINT64 fixups = 0;
+	Testing::Stopwatch stopwatch;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		for (int group = 0; group < renderTargetCount / 4; ++group)
+		{
+			for (int i = 0; i < 4; ++i)
+				tracker.TransitionResource(&renderTargets[group * 4 + i], D3D12_RESOURCE_STATE_RENDER_TARGET);
+			if (group > 0)
+			{
+				for (int i = 0; i < 4; ++i)
+					tracker.TransitionResource(&renderTargets[group * 4 - 4 + i], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+			}
+			// The G-buffer (group 0) is read by every later pass.
+			for (int i = 0; i < 4; ++i)
+				tracker.TransitionResource(&renderTargets[i], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+			tracker.FlushBarriers(barriers);
+		}
+
+		for (FakeResource& texture : mipTextures)
+		{
+			for (UINT mip = 1; mip < mipLevels; ++mip)
+			{
+				tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mip - 1);
+				tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, mip);
+				tracker.FlushBarriers(barriers);
+			}
+			tracker.TransitionResource(&texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		}
+		tracker.FlushBarriers(barriers);
+
+		fixups += Submit(tracker).size();
+		barriers.clear();
+	}
+	const double seconds = stopwatch.Seconds();
+
+	const ResourceStateTracker::Stats& stats = tracker.GetStats();
+	printf("  per frame: %.1f transitions requested, %.1f barriers in %.1f batches (%.1f fixups),"
+		" %.1f skipped, %.1f merged; %.2f us\n",
+		double(stats.TransitionsRequested) / frames, double(stats.BarriersRecorded) / frames,
+		double(stats.BarrierBatches) / frames, double(fixups) / frames, double(stats.TransitionsSkipped) / frames,
+		double(stats.TransitionsMerged) / frames, seconds * 1e6 / frames);
+}
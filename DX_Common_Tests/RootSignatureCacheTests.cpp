@@ -0,0 +1,135 @@
+#include "TestFramework.h"
+
+#include "RootSignatureCache.h"
+#include "directx/d3dx12.h"
+
+#include <cstring>
+
+// One root signature written against each version: a pixel shader table of
+// four SRVs and a CBV, a root CBV at b1, four root constants at b2 and an
+// anisotropic static sampler.
+namespace
+{
+	const D3D12_ROOT_SIGNATURE_FLAGS s_Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+
+	const D3D12_STATIC_SAMPLER_DESC s_Sampler =
+	{
+		D3D12_FILTER_ANISOTROPIC,
+		D3D12_TEXTURE_ADDRESS_MODE_WRAP, D3D12_TEXTURE_ADDRESS_MODE_WRAP, D3D12_TEXTURE_ADDRESS_MODE_WRAP,
+		0.0f, 16, D3D12_COMPARISON_FUNC_LESS, D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE,
+		0.0f, 1000.0f, 0, 0, D3D12_SHADER_VISIBILITY_PIXEL
+	};
+
+	// Version 1.0 leaves the range offsets to the runtime.
+	struct Layout_1_0
+	{
+		D3D12_DESCRIPTOR_RANGE Ranges[2];
+		D3D12_ROOT_PARAMETER Parameters[3];
+		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC Desc;
+
+		Layout_1_0()
+		{
+			Ranges[0] = { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+			Ranges[1] = { D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND };
+
+			Parameters[0] = {};
+			Parameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			Parameters[0].DescriptorTable = { 2, Ranges };
+			Parameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+			Parameters[1] = {};
+			Parameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+			Parameters[1].Descriptor = { 1, 0 };
+			Parameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+			Parameters[2] = {};
+			Parameters[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+			Parameters[2].Constants = { 2, 0, 4 };
+			Parameters[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+			Desc.Init_1_0(3, Parameters, 1, &s_Sampler, s_Flags);
+		}
+	};
+
+	// Version 1.1 with the given range and root descriptor flags, and the
+	// offsets written out.
+	struct Layout_1_1
+	{
+		CD3DX12_DESCRIPTOR_RANGE1 Ranges[2];
+		CD3DX12_ROOT_PARAMETER1 Parameters[3];
+		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC Desc;
+
+		Layout_1_1(D3D12_DESCRIPTOR_RANGE_FLAGS rangeFlags, D3D12_ROOT_DESCRIPTOR_FLAGS descriptorFlags)
+		{
+			Ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0, 0, rangeFlags, 0);
+			Ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, rangeFlags, 4);
+			Parameters[0].InitAsDescriptorTable(2, Ranges, D3D12_SHADER_VISIBILITY_PIXEL);
+			Parameters[1].InitAsConstantBufferView(1, 0, descriptorFlags);
+			Parameters[2].InitAsConstants(4, 2);
+
+			Desc.Init_1_1(3, Parameters, 1, &s_Sampler, s_Flags);
+		}
+	};
+
+	const D3D12_DESCRIPTOR_RANGE_FLAGS s_VolatileRange =
+		D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+}
+
+TEST_CASE(RootSignatureCache_Version_1_0_MatchesEquivalent_1_1)
+{
+	// 1.0 means volatile descriptors and data.
+	const Layout_1_0 layout10;
+	const Layout_1_1 layout11(s_VolatileRange, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+	CHECK(RootSignatureCache::Hash(layout10.Desc) == RootSignatureCache::Hash(layout11.Desc));
+
+	// The 1.1 defaults promise more, so they are another root signature.
+	const Layout_1_1 defaults(D3D12_DESCRIPTOR_RANGE_FLAG_NONE, D3D12_ROOT_DESCRIPTOR_FLAG_NONE);
+	CHECK(RootSignatureCache::Hash(layout10.Desc) != RootSignatureCache::Hash(defaults.Desc));
+}
+
+TEST_CASE(RootSignatureCache_Version_1_1_DefaultsMatchExplicitFlags)
+{
+	const Layout_1_1 defaults(D3D12_DESCRIPTOR_RANGE_FLAG_NONE, D3D12_ROOT_DESCRIPTOR_FLAG_NONE);
+	const Layout_1_1 spelledOut(D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+	CHECK(RootSignatureCache::Hash(defaults.Desc) == RootSignatureCache::Hash(spelledOut.Desc));
+
+	const Layout_1_1 staticData(D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC);
+	CHECK(RootSignatureCache::Hash(defaults.Desc) != RootSignatureCache::Hash(staticData.Desc));
+}
+
+TEST_CASE(RootSignatureCache_HashFollowsContent)
+{
+	const Layout_1_1 layout(D3D12_DESCRIPTOR_RANGE_FLAG_NONE, D3D12_ROOT_DESCRIPTOR_FLAG_NONE);
+	const uint64_t hash = RootSignatureCache::Hash(layout.Desc);
+
+	Layout_1_1 moved(D3D12_DESCRIPTOR_RANGE_FLAG_NONE, D3D12_ROOT_DESCRIPTOR_FLAG_NONE);
+	moved.Parameters[2].InitAsConstants(4, 3);
+	CHECK(RootSignatureCache::Hash(moved.Desc) != hash);
+
+	Layout_1_1 wider(D3D12_DESCRIPTOR_RANGE_FLAG_NONE, D3D12_ROOT_DESCRIPTOR_FLAG_NONE);
+	wider.Ranges[0].NumDescriptors = 5;
+	wider.Ranges[1].OffsetInDescriptorsFromTableStart = 5;
+	CHECK(RootSignatureCache::Hash(wider.Desc) != hash);
+}
+
+#if defined(D3D12_SDK_VERSION) && (D3D12_SDK_VERSION >= 609)
+
+TEST_CASE(RootSignatureCache_Version_1_2_MatchesEarlierVersions)
+{
+	D3D12_STATIC_SAMPLER_DESC1 sampler = {};
+	memcpy(&sampler, &s_Sampler, sizeof(s_Sampler));
+	sampler.Flags = D3D12_SAMPLER_FLAG_NONE;
+
+	const Layout_1_0 layout10;
+	Layout_1_1 layout12(s_VolatileRange, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+	layout12.Desc.Init_1_2(3, layout12.Parameters, 1, &sampler, s_Flags);
+	CHECK(RootSignatureCache::Hash(layout10.Desc) == RootSignatureCache::Hash(layout12.Desc));
+
+	// A 1.2-only sampler flag makes it another root signature.
+	D3D12_STATIC_SAMPLER_DESC1 uintBorder = sampler;
+	uintBorder.Flags = D3D12_SAMPLER_FLAG_UINT_BORDER_COLOR;
+	Layout_1_1 layout12Uint(s_VolatileRange, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+	layout12Uint.Desc.Init_1_2(3, layout12Uint.Parameters, 1, &uintBorder, s_Flags);
+	CHECK(RootSignatureCache::Hash(layout12Uint.Desc) != RootSignatureCache::Hash(layout12.Desc));
+}
+
+#endif
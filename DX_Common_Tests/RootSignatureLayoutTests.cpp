@@ -0,0 +1,146 @@
+#include "TestFramework.h"
+
+#include "RootSignatureLayout.h"
+
+namespace
+{
+	RootBinding Binding(const char* name, BindingType type, BindingFrequency frequency, UINT shaderRegister,
+		UINT num32BitValues = 0, UINT numDescriptors = 1, D3D12_SHADER_VISIBILITY visibility = D3D12_SHADER_VISIBILITY_ALL)
+	{
+		RootBinding binding;
+		binding.Name = name;
+		binding.Type = type;
+		binding.Frequency = frequency;
+		binding.ShaderRegister = shaderRegister;
+		binding.Num32BitValues = num32BitValues;
+		binding.NumDescriptors = numDescriptors;
+		binding.Visibility = visibility;
+		return binding;
+	}
+
+	// What the parameters really cost, independent of GetCost().
+	UINT ParameterCost(const RootSignatureLayout& layout)
+	{
+		UINT cost = 0;
+		for (const D3D12_ROOT_PARAMETER1& parameter : layout.GetParameters())
+		{
+			switch (parameter.ParameterType)
+			{
+			case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS: cost += parameter.Constants.Num32BitValues; break;
+			case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE: cost += 1; break;
+			default: cost += 2; break;
+			}
+		}
+		return cost;
+	}
+
+	// Per-draw parameters first, then per-pass, then per-frame.
+	bool OrderedByFrequency(const RootSignatureLayout& layout, const std::vector<RootBinding>& bindings)
+	{
+		std::vector<int> frequencies(layout.GetParameters().size(), -1);
+		for (size_t i = 0; i < bindings.size(); ++i)
+			frequencies[layout.GetLocation(i).RootParameter] = static_cast<int>(bindings[i].Frequency);
+
+		int previous = static_cast<int>(BindingFrequency::PerDraw);
+		for (int frequency : frequencies)
+		{
+			if (frequency < 0 || frequency > previous)
+				return false;
+			previous = frequency;
+		}
+		return true;
+	}
+}
+
+TEST_CASE(RootSignatureLayout_PlacesBindingsByType)
+{
+	const std::vector<RootBinding> bindings =
+	{
+		Binding("FrameConstants", BindingType::Constants, BindingFrequency::PerFrame, 0, 16),
+		Binding("PassConstants", BindingType::Constants, BindingFrequency::PerPass, 1, 16),
+		Binding("Lights", BindingType::BufferSRV, BindingFrequency::PerFrame, 0),
+		Binding("ShadowMaps", BindingType::TextureSRV, BindingFrequency::PerPass, 1, 0, 4, D3D12_SHADER_VISIBILITY_PIXEL),
+		Binding("Samplers", BindingType::Sampler, BindingFrequency::PerFrame, 0, 0, 4, D3D12_SHADER_VISIBILITY_PIXEL),
+		Binding("DrawConstants", BindingType::Constants, BindingFrequency::PerDraw, 2, 12),
+		Binding("Material", BindingType::ConstantBuffer, BindingFrequency::PerDraw, 3),
+		Binding("MaterialTextures", BindingType::TextureSRV, BindingFrequency::PerDraw, 5, 0, 3, D3D12_SHADER_VISIBILITY_PIXEL),
+		Binding("Bones", BindingType::BufferSRV, BindingFrequency::PerDraw, 8),
+		Binding("BigConstants", BindingType::Constants, BindingFrequency::PerPass, 4, 40),
+		Binding("Output", BindingType::BufferUAV, BindingFrequency::PerPass, 0),
+	};
+
+	RootSignatureLayout layout;
+	REQUIRE(layout.Build(bindings));
+	CHECK(layout.GetCost() <= RootSignatureLayout::MaxCost);
+	CHECK(layout.GetCost() == ParameterCost(layout));
+	CHECK(OrderedByFrequency(layout, bindings));
+
+	CHECK(layout.GetLocation(0).Placement == RootPlacement::Constants);
+	CHECK(layout.GetLocation(2).Placement == RootPlacement::Descriptor);
+	CHECK(layout.GetLocation(3).Placement == RootPlacement::Table);
+	CHECK(layout.GetLocation(5).Placement == RootPlacement::Constants);
+	CHECK(layout.GetLocation(6).Placement == RootPlacement::Descriptor);
+	CHECK(layout.GetLocation(7).Placement == RootPlacement::Table);
+	// Over MaxInlineConstants, so bound through a CBV.
+	CHECK(layout.GetLocation(9).Placement != RootPlacement::Constants);
+
+	// Samplers never share a table with views.
+	CHECK(layout.GetLocation(4).Placement == RootPlacement::Table);
+	CHECK(layout.GetLocation(4).RootParameter != layout.GetLocation(3).RootParameter);
+	CHECK(layout.GetLocation(4).RootParameter != layout.GetLocation(7).RootParameter);
+}
+
+TEST_CASE(RootSignatureLayout_DemotesLeastFrequentFirst)
+{
+	// 80 DWORDs as root constants; two demotions to root CBVs bring it under 64.
+	const std::vector<RootBinding> bindings =
+	{
+		Binding("Frame0", BindingType::Constants, BindingFrequency::PerFrame, 0, 16),
+		Binding("Frame1", BindingType::Constants, BindingFrequency::PerFrame, 1, 16),
+		Binding("Frame2", BindingType::Constants, BindingFrequency::PerFrame, 2, 16),
+		Binding("Draw0", BindingType::Constants, BindingFrequency::PerDraw, 3, 16),
+		Binding("Draw1", BindingType::Constants, BindingFrequency::PerDraw, 4, 16),
+	};
+
+	RootSignatureLayout layout;
+	REQUIRE(layout.Build(bindings));
+	CHECK(layout.GetCost() <= RootSignatureLayout::MaxCost);
+	CHECK(layout.GetCost() == ParameterCost(layout));
+	CHECK(OrderedByFrequency(layout, bindings));
+
+	CHECK(layout.GetLocation(3).Placement == RootPlacement::Constants);
+	CHECK(layout.GetLocation(4).Placement == RootPlacement::Constants);
+	UINT inlineFrameConstants = 0;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		if (layout.GetLocation(i).Placement == RootPlacement::Constants)
+			++inlineFrameConstants;
+	}
+	CHECK(inlineFrameConstants == 1);
+}
+
+TEST_CASE(RootSignatureLayout_FitsManyBindings)
+{
+	std::vector<RootBinding> bindings;
+	for (UINT i = 0; i < 100; ++i)
+		bindings.push_back(Binding("", BindingType::Constants, static_cast<BindingFrequency>(i % 3), i, 16));
+
+	RootSignatureLayout layout;
+	REQUIRE(layout.Build(bindings));
+	CHECK(layout.GetCost() <= RootSignatureLayout::MaxCost);
+	CHECK(layout.GetCost() == ParameterCost(layout));
+	CHECK(OrderedByFrequency(layout, bindings));
+
+	// Bindings sharing a table get their own descriptor slots.
+	for (size_t i = 0; i < bindings.size(); ++i)
+	{
+		const RootBindingLocation& a = layout.GetLocation(i);
+		if (a.Placement != RootPlacement::Table)
+			continue;
+		for (size_t j = i + 1; j < bindings.size(); ++j)
+		{
+			const RootBindingLocation& b = layout.GetLocation(j);
+			CHECK(b.Placement != RootPlacement::Table || b.RootParameter != a.RootParameter || b.Offset != a.Offset);
+		}
+	}
+}
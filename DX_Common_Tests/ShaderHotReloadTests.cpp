@@ -0,0 +1,285 @@
+#include "TestFramework.h"
+
+#include "FakeShaderCompiler.h"
+#include "ShaderHotReload.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const std::filesystem::path s_Root = L"ShaderHotReloadTests";
+
+	// Stands in for a real pipeline: only counted, never used.
+	class FakePipelineState : public ID3D12PipelineState
+	{
+	public:
+		static std::atomic<int> s_Alive;
+
+		FakePipelineState() { ++s_Alive; }
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** object) override
+		{
+			*object = nullptr;
+			return E_NOINTERFACE;
+		}
+		ULONG STDMETHODCALLTYPE AddRef() override { return ++m_References; }
+		ULONG STDMETHODCALLTYPE Release() override
+		{
+			const ULONG references = --m_References;
+			if (references == 0)
+			{
+				--s_Alive;
+				delete this;
+			}
+			return references;
+		}
+
+		HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override { return E_NOTIMPL; }
+		HRESULT STDMETHODCALLTYPE SetName(LPCWSTR) override { return S_OK; }
+		HRESULT STDMETHODCALLTYPE GetDevice(REFIID, void** device) override
+		{
+			*device = nullptr;
+			return E_NOINTERFACE;
+		}
+		HRESULT STDMETHODCALLTYPE GetCachedBlob(ID3DBlob** blob) override
+		{
+			*blob = nullptr;
+			return E_NOTIMPL;
+		}
+
+	private:
+		std::atomic<ULONG> m_References{ 1 };
+	};
+
+	std::atomic<int> FakePipelineState::s_Alive{ 0 };
+
+	void WriteFile(const char* name, const std::string& text)
+	{
+		std::ofstream(s_Root / "src" / name, std::ios::trunc) << text;
+	}
+
+	std::wstring SourcePath(const char* name)
+	{
+		return (s_Root / "src" / name).wstring();
+	}
+
+	// Three shaders, a.hlsl (twice) and b.hlsl including common.h and c.hlsl
+	// including other.h, and three pipelines over them:
+	//   P1 = { a0, c }, P2 = { b, a1 }, P3 = { c }
+	struct Fixture
+	{
+		explicit Fixture(bool usePool)
+		{
+			std::filesystem::remove_all(s_Root);
+			std::filesystem::create_directories(s_Root / "src");
+			WriteFile("common.h", "float common;\n");
+			WriteFile("other.h", "float other;\n");
+			WriteFile("a.hlsl", "#include \"common.h\"\nvoid a() {}\n");
+			WriteFile("b.hlsl", "#include \"common.h\"\nvoid b() {}\n");
+			WriteFile("c.hlsl", "#include \"other.h\"\nvoid c() {}\n");
+
+			std::unique_ptr<Testing::FakeShaderCompiler> compiler = std::make_unique<Testing::FakeShaderCompiler>();
+			Compiler = compiler.get();
+			Cache.SetCompiler(std::move(compiler));
+			Cache.Initialize((s_Root / "cache").wstring());
+			A0 = AddShader("a.hlsl", "0");
+			A1 = AddShader("a.hlsl", "1");
+			B = AddShader("b.hlsl", "0");
+			C = AddShader("c.hlsl", "0");
+			Built = Cache.Build(&Pool);
+
+			Reload = std::make_unique<ShaderHotReload>(&Cache, usePool ? &Pool : nullptr);
+			Reload->SetDebounceMilliseconds(0);
+			P1 = Reload->AddPipeline({ A0, C }, CreatePipeline({ A0, C }));
+			P2 = Reload->AddPipeline({ B, A1 }, CreatePipeline({ B, A1 }));
+			P3 = Reload->AddPipeline({ C }, CreatePipeline({ C }));
+		}
+
+		~Fixture()
+		{
+			Reload.reset();
+			std::error_code error;
+			std::filesystem::remove_all(s_Root, error);
+		}
+
+		ShaderHandle AddShader(const char* file, const char* permutation)
+		{
+			ShaderCompileDesc desc;
+			desc.File = SourcePath(file);
+			desc.EntryPoint = "main";
+			desc.Target = "ps_5_1";
+			desc.Defines = { { "P", permutation } };
+			return Cache.Add(desc);
+		}
+
+		ShaderHotReload::CreatePipelineFunc CreatePipeline(std::vector<ShaderHandle> shaders)
+		{
+			return [this, shaders]()
+			{
+				for (ShaderHandle shader : shaders)
+				{
+					if (Cache.GetBytecode(shader).BytecodeLength != sizeof(uint64_t))
+						return ComPtr<ID3D12PipelineState>();
+				}
+				ComPtr<ID3D12PipelineState> pipeline;
+				pipeline.Attach(new FakePipelineState());
+				return pipeline;
+			};
+		}
+
+		void Edit(const char* file, const std::string& text)
+		{
+			WriteFile(file, text);
+			Reload->NotifyChanged(SourcePath(file));
+		}
+
+		// Runs frames until the reload is done; the GPU is two frames behind.
+		void Settle()
+		{
+			for (int frame = 0; frame < 1000 && !Reload->IsIdle(); ++frame)
+			{
+				Reload->Update(Fence, Fence - 2);
+				++Fence;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		ThreadPool Pool;
+		ShaderCache Cache;
+		Testing::FakeShaderCompiler* Compiler = nullptr;
+		std::unique_ptr<ShaderHotReload> Reload;
+		bool Built = false;
+		ShaderHandle A0, A1, B, C;
+		HotPipelineHandle P1, P2, P3;
+		UINT64 Fence = 10;
+	};
+}
+
+TEST_CASE(ShaderHotReload_HeaderEditSwapsDependentPipelines)
+{
+	for (int usePool = 0; usePool < 2; ++usePool)
+	{
+		Fixture f(usePool != 0);
+		REQUIRE(f.Built);
+		ID3D12PipelineState* p1 = f.Reload->GetPipeline(f.P1);
+		ID3D12PipelineState* p2 = f.Reload->GetPipeline(f.P2);
+		ID3D12PipelineState* p3 = f.Reload->GetPipeline(f.P3);
+		const int calls = f.Compiler->Calls;
+
+		// Paths compare as the file system does.
+		WriteFile("common.h", "float common2;\n");
+		f.Reload->NotifyChanged(SourcePath("COMMON.h"));
+		f.Settle();
+
+		const ShaderHotReload::Stats& stats = f.Reload->GetStats();
+		CHECK(f.Compiler->Calls - calls == 3);
+		CHECK(stats.ShadersRebuilt == 3);
+		CHECK(stats.PipelinesSwapped == 2);
+		CHECK(f.Reload->GetPipeline(f.P1) != p1);
+		CHECK(f.Reload->GetPipeline(f.P2) != p2);
+		CHECK(f.Reload->GetPipeline(f.P3) == p3);
+	}
+}
+
+TEST_CASE(ShaderHotReload_RetiresPipelinesAfterTheirFence)
+{
+	const int aliveBefore = FakePipelineState::s_Alive;
+	{
+		Fixture f(true);
+		REQUIRE(f.Built);
+		CHECK(FakePipelineState::s_Alive - aliveBefore == 3);
+
+		// Frames up to 100 were submitted, the GPU finished up to 50.
+		f.Edit("other.h", "float other2;\n");
+		for (int frame = 0; frame < 1000 && !f.Reload->IsIdle(); ++frame)
+		{
+			f.Reload->Update(100, 50);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		const ShaderHotReload::Stats& stats = f.Reload->GetStats();
+		CHECK(stats.PipelinesSwapped == 2);
+
+		// The old P1 and P3 may still be in flight until 100 completes.
+		f.Reload->Update(200, 99);
+		CHECK(stats.PipelinesRetired == 0);
+		CHECK(FakePipelineState::s_Alive - aliveBefore == 5);
+		f.Reload->Update(200, 100);
+		CHECK(stats.PipelinesRetired == 2);
+		CHECK(FakePipelineState::s_Alive - aliveBefore == 3);
+	}
+	CHECK(FakePipelineState::s_Alive == aliveBefore);
+}
+
+TEST_CASE(ShaderHotReload_UnchangedCodeKeepsPipelines)
+{
+	Fixture f(true);
+	REQUIRE(f.Built);
+	ID3D12PipelineState* p1 = f.Reload->GetPipeline(f.P1);
+	const int calls = f.Compiler->Calls;
+
+	// Recompiled, but to the same bytecode.
+	f.Edit("common.h", "// note\nfloat common;\n");
+	f.Settle();
+	CHECK(f.Compiler->Calls - calls == 3);
+	CHECK(f.Reload->GetStats().PipelinesSwapped == 0);
+	CHECK(f.Reload->GetPipeline(f.P1) == p1);
+}
+
+TEST_CASE(ShaderHotReload_BrokenEditKeepsLastGoodPipelines)
+{
+	Fixture f(true);
+	REQUIRE(f.Built);
+	ID3D12PipelineState* p1 = f.Reload->GetPipeline(f.P1);
+	ID3D12PipelineState* p3 = f.Reload->GetPipeline(f.P3);
+
+	f.Edit("other.h", "#error\n");
+	f.Settle();
+	CHECK(f.Reload->GetStats().ShadersFailed == 1);
+	CHECK(f.Reload->GetPipeline(f.P1) == p1);
+	CHECK(f.Reload->GetPipeline(f.P3) == p3);
+	CHECK(f.Cache.GetBytecode(f.C).BytecodeLength == sizeof(uint64_t));
+
+	// Fixing it reloads as usual.
+	f.Edit("other.h", "float other3;\n");
+	f.Settle();
+	CHECK(f.Reload->GetPipeline(f.P1) != p1);
+	CHECK(f.Reload->GetPipeline(f.P3) != p3);
+}
+
+TEST_CASE(ShaderHotReload_IgnoresUnrelatedFiles)
+{
+	Fixture f(true);
+	REQUIRE(f.Built);
+	const int calls = f.Compiler->Calls;
+
+	f.Edit("readme.txt", "notes");
+	f.Settle();
+	CHECK(f.Compiler->Calls == calls);
+	CHECK(f.Reload->GetStats().Reloads == 0);
+}
+
+TEST_CASE(ShaderHotReload_FollowsNewIncludes)
+{
+	Fixture f(true);
+	REQUIRE(f.Built);
+
+	// c.hlsl starts including extra.h; from then on edits to it reload P3.
+	WriteFile("extra.h", "float extra;\n");
+	f.Edit("c.hlsl", "#include \"other.h\"\n#include \"extra.h\"\nvoid c() {}\n");
+	f.Settle();
+	ID3D12PipelineState* p3 = f.Reload->GetPipeline(f.P3);
+
+	f.Edit("extra.h", "float extra2;\n");
+	f.Settle();
+	CHECK(f.Reload->GetPipeline(f.P3) != p3);
+}
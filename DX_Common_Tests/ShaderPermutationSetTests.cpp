@@ -0,0 +1,191 @@
+#include "TestFramework.h"
+
+#include "ShaderPermutationSet.h"
+
+namespace Lit
+{
+	constexpr PermutationFeature NormalMap = { "NORMAL_MAP", 0 };
+	constexpr PermutationFeature AlphaTest = { "ALPHA_TEST", 1 };
+	constexpr PermutationFeature Skinning  = { "SKINNING", 2 };
+	constexpr PermutationFeature Parallax  = { "PARALLAX", 3 };
+	constexpr PermutationFeature Lights    = { "NUM_LIGHTS", 4, 2 };
+	constexpr PermutationFeature Shadows   = { "SHADOWS", 6 };
+	constexpr PermutationFeature Fog       = { "FOG", 8 }; // bit 7 belongs to no feature
+}
+static_assert((Lit::NormalMap() | Lit::Lights(3)) == 0x31, "keys are built at compile time");
+
+namespace
+{
+	const wchar_t* s_UsageFile = L"ShaderPermutationSetTests.usage";
+
+	ShaderCompileDesc Base()
+	{
+		ShaderCompileDesc desc;
+		desc.File = L"Lit.hlsl";
+		desc.EntryPoint = "PS";
+		desc.Target = "ps_5_1";
+		return desc;
+	}
+
+	std::vector<PermutationFeature> Features()
+	{
+		using namespace Lit;
+		return { NormalMap, AlphaTest, Skinning, Parallax, Lights, Shadows, Fog };
+	}
+
+	void Constrain(ShaderPermutationSet& set)
+	{
+		using namespace Lit;
+		set.Require(Parallax, NormalMap);
+		set.Exclude(Skinning, AlphaTest);
+		set.Limit(Lights, 2);
+	}
+
+	// One run of the application: load the usage, add the permutations,
+	// ask for 'used' and save the usage again. Returns the stats.
+	ShaderPermutationSet::Stats Run(const std::vector<PermutationKey>& used)
+	{
+		ShaderCache cache;
+		ShaderPermutationSet set(Base(), Features());
+		Constrain(set);
+		set.SetPruneAfterRuns(2);
+		set.LoadUsage(s_UsageFile);
+		set.AddPermutations(cache);
+		for (PermutationKey key : used)
+			set.Get(key);
+		set.SaveUsage();
+		return set.GetStats();
+	}
+}
+
+TEST_CASE(ShaderPermutationSet_Constraints)
+{
+	using namespace Lit;
+	ShaderPermutationSet set(Base(), Features());
+	Constrain(set);
+
+	CHECK(set.IsValid(0));
+	CHECK(set.IsValid(Parallax() | NormalMap()));
+	CHECK(!set.IsValid(Parallax()));
+	CHECK(set.IsValid(Skinning()));
+	CHECK(!set.IsValid(Skinning() | AlphaTest()));
+	CHECK(set.IsValid(Lights(2)));
+	CHECK(!set.IsValid(Lights(3)));
+	CHECK(!set.IsValid(1u << 7));
+
+	// Count the combinations the rules allow by hand.
+	UINT expected = 0;
+	for (UINT normalMap = 0; normalMap < 2; ++normalMap)
+		for (UINT alphaTest = 0; alphaTest < 2; ++alphaTest)
+			for (UINT skinning = 0; skinning < 2; ++skinning)
+				for (UINT parallax = 0; parallax < 2; ++parallax)
+					for (UINT lights = 0; lights < 4; ++lights)
+						if (!(parallax && !normalMap) && !(skinning && alphaTest) && lights <= 2)
+							expected += 4; // shadows and fog are free
+	UINT valid = 0;
+	for (PermutationKey key = 0; key < 512; ++key)
+	{
+		if (set.IsValid(key))
+			++valid;
+	}
+	CHECK(valid == expected);
+
+	ShaderCache cache;
+	set.AddPermutations(cache);
+	CHECK(set.GetStats().Keys == 512);
+	CHECK(set.GetStats().Valid == expected);
+	CHECK(set.GetStats().Added == expected);
+}
+
+TEST_CASE(ShaderPermutationSet_DefinesEveryFeature)
+{
+	using namespace Lit;
+	ShaderPermutationSet set(Base(), Features());
+	const ShaderCompileDesc desc = set.GetDesc(NormalMap() | Lights(2));
+
+	REQUIRE(desc.Defines.size() == Features().size());
+	for (const ShaderDefine& define : desc.Defines)
+	{
+		if (define.Name == "NORMAL_MAP")
+			CHECK(define.Value == "1");
+		else if (define.Name == "NUM_LIGHTS")
+			CHECK(define.Value == "2");
+		else
+			CHECK(define.Value == "0");
+	}
+}
+
+TEST_CASE(ShaderPermutationSet_PrunesKeysUnusedForRuns)
+{
+	using namespace Lit;
+	DeleteFile(s_UsageFile);
+	const std::vector<PermutationKey> used = { 0, NormalMap(), NormalMap() | Lights(2) | Shadows() };
+
+	// No history: everything is built, and the first run's unused keys
+	// count one run from now.
+	ShaderPermutationSet::Stats stats = Run(used);
+	CHECK(stats.Pruned == 0);
+	CHECK(stats.Added == stats.Valid);
+
+	// One run unused is under the limit of two.
+	stats = Run(used);
+	CHECK(stats.Pruned == 0);
+
+	// Two runs unused: only the used keys are built.
+	stats = Run(used);
+	CHECK(stats.Added == used.size());
+	CHECK(stats.Pruned == stats.Valid - used.size());
+
+	DeleteFile(s_UsageFile);
+}
+
+TEST_CASE(ShaderPermutationSet_AddsPrunedKeysOnDemand)
+{
+	using namespace Lit;
+	DeleteFile(s_UsageFile);
+	const std::vector<PermutationKey> used = { 0, NormalMap() };
+	Run(used);
+	Run(used);
+
+	ShaderCache cache;
+	ShaderPermutationSet set(Base(), Features());
+	Constrain(set);
+	set.SetPruneAfterRuns(2);
+	set.LoadUsage(s_UsageFile);
+	set.AddPermutations(cache);
+	CHECK(set.Get(0).Shader != InvalidShaderHandle);
+
+	const PermutationKey late = AlphaTest() | Fog();
+	CHECK(set.Get(late).Shader == InvalidShaderHandle);
+	CHECK(set.AddMissing(cache) == 1);
+	CHECK(set.Get(late).Shader != InvalidShaderHandle);
+	CHECK(set.AddMissing(cache) == 0);
+	CHECK(set.GetStats().Missed == 1);
+	CHECK(set.SaveUsage());
+
+	// Used this run, so built in the next.
+	const ShaderPermutationSet::Stats stats = Run(used);
+	CHECK(stats.Added == used.size() + 1);
+
+	DeleteFile(s_UsageFile);
+}
+
+TEST_CASE(ShaderPermutationSet_IgnoresUsageOfOtherFeatures)
+{
+	DeleteFile(s_UsageFile);
+	const std::vector<PermutationKey> used = { 0 };
+	Run(used);
+	Run(used);
+
+	// The same file for a set without fog says nothing about its keys.
+	std::vector<PermutationFeature> features = Features();
+	features.pop_back();
+	ShaderCache cache;
+	ShaderPermutationSet set(Base(), features);
+	set.SetPruneAfterRuns(2);
+	set.LoadUsage(s_UsageFile);
+	set.AddPermutations(cache);
+	CHECK(set.GetStats().Pruned == 0);
+
+	DeleteFile(s_UsageFile);
+}
@@ -0,0 +1,195 @@
+#include "TestFramework.h"
+
+#include "BarrierBackend.h"
+#include "FakeResource.h"
+#include "SplitBarrierScheduler.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	using Testing::FakeResource;
+
+	bool IsTransition(const D3D12_RESOURCE_BARRIER& barrier, ID3D12Resource* resource, D3D12_RESOURCE_STATES before,
+		D3D12_RESOURCE_STATES after, D3D12_RESOURCE_BARRIER_FLAGS flags, UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+	{
+		return barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && barrier.Flags == flags &&
+			barrier.Transition.pResource == resource && barrier.Transition.Subresource == subresource &&
+			barrier.Transition.StateBefore == before && barrier.Transition.StateAfter == after;
+	}
+}
+
+TEST_CASE(SplitBarrierScheduler_SplitsAcrossUnrelatedPasses)
+{
+	// The example from the header: A is written in pass 0 and sampled in
+	// pass 3, so the transition spans passes 1 and 2.
+	FakeResource a(FakeResource::TextureDesc(1));
+	FakeResource b(FakeResource::TextureDesc(1));
+	SplitBarrierScheduler scheduler;
+	scheduler.SetInitialState(&a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	scheduler.SetInitialState(&b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_RENDER_TARGET } });
+	scheduler.AddPass({ { &b, D3D12_RESOURCE_STATE_RENDER_TARGET } });
+	scheduler.AddPass({ { &b, D3D12_RESOURCE_STATE_RENDER_TARGET } });
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE } });
+	scheduler.Compile();
+
+	CHECK(scheduler.GetBarriers(0).empty());
+	REQUIRE(scheduler.GetBarriers(1).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(1)[0], &a, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+	CHECK(scheduler.GetBarriers(2).empty());
+	REQUIRE(scheduler.GetBarriers(3).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(3)[0], &a, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+
+	CHECK(scheduler.GetStats().SplitBarriers == 1);
+	CHECK(scheduler.GetStats().ImmediateBarriers == 0);
+	CHECK(scheduler.GetStats().MaxDistance == 2);
+	CHECK(scheduler.GetFinalState(&a) == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+#ifdef ENHANCED_BARRIERS_AVAILABLE
+	// On the Enhanced Barriers path the halves become SYNC_SPLIT.
+	BarrierBackend::Translation translation;
+	BarrierBackend::Translate(1, scheduler.GetBarriers(1).data(), translation);
+	BarrierBackend::Translate(1, scheduler.GetBarriers(3).data(), translation);
+	REQUIRE(translation.TextureBarriers.size() == 2);
+	CHECK(translation.TextureBarriers[0].SyncAfter == D3D12_BARRIER_SYNC_SPLIT);
+	CHECK(translation.TextureBarriers[1].SyncBefore == D3D12_BARRIER_SYNC_SPLIT);
+#endif
+}
+
+TEST_CASE(SplitBarrierScheduler_ImmediateWhenLastUseIsThePreviousPass)
+{
+	FakeResource a(FakeResource::TextureDesc(1));
+	SplitBarrierScheduler scheduler;
+	scheduler.SetInitialState(&a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_RENDER_TARGET } });
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE } });
+	scheduler.Compile();
+
+	CHECK(scheduler.GetBarriers(0).empty());
+	REQUIRE(scheduler.GetBarriers(1).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(1)[0], &a, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_NONE));
+	CHECK(scheduler.GetStats().SplitBarriers == 0);
+	CHECK(scheduler.GetStats().ImmediateBarriers == 1);
+}
+
+TEST_CASE(SplitBarrierScheduler_CompatibleReadNeedsNoBarrier)
+{
+	FakeResource a;
+	FakeResource other;
+	SplitBarrierScheduler scheduler;
+	scheduler.SetInitialState(&a, D3D12_RESOURCE_STATE_GENERIC_READ);
+	scheduler.SetInitialState(&other, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE } });
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE } });
+	scheduler.AddPass({ { &other, D3D12_RESOURCE_STATE_UNORDERED_ACCESS } });
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_COPY_DEST } });
+	scheduler.Compile();
+
+	// Both reads are covered by GENERIC_READ, but they still count as uses:
+	// the transition to COPY_DEST can only begin after pass 1.
+	CHECK(scheduler.GetBarriers(0).empty());
+	CHECK(scheduler.GetBarriers(1).empty());
+	REQUIRE(scheduler.GetBarriers(2).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(2)[0], &a, D3D12_RESOURCE_STATE_GENERIC_READ,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+	REQUIRE(scheduler.GetBarriers(3).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(3)[0], &a, D3D12_RESOURCE_STATE_GENERIC_READ,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+	CHECK(scheduler.GetStats().SplitBarriers == 1);
+}
+
+TEST_CASE(SplitBarrierScheduler_FirstUseCanBeginBeforeTheFrame)
+{
+	// Without an initial state the resource is in COMMON and unused before
+	// the frame, so the barrier begins ahead of pass 0.
+	FakeResource a;
+	SplitBarrierScheduler scheduler;
+	scheduler.AddPass({});
+	scheduler.AddPass({});
+	scheduler.AddPass({ { &a, D3D12_RESOURCE_STATE_UNORDERED_ACCESS } });
+	scheduler.Compile();
+
+	REQUIRE(scheduler.GetBarriers(0).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(0)[0], &a, D3D12_RESOURCE_STATE_COMMON,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+	REQUIRE(scheduler.GetBarriers(2).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(2)[0], &a, D3D12_RESOURCE_STATE_COMMON,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+}
+
+TEST_CASE(SplitBarrierScheduler_SubresourcesAreScheduledIndependently)
+{
+	// Mip 0 is written in pass 0 and read in pass 1 (immediate), mip 1 is
+	// read in pass 3 (split over passes 1 and 2).
+	FakeResource texture(FakeResource::TextureDesc(2));
+	SplitBarrierScheduler scheduler;
+	scheduler.SetInitialState(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET, 0);
+	scheduler.SetInitialState(&texture, D3D12_RESOURCE_STATE_RENDER_TARGET, 1);
+	scheduler.AddPass({ { &texture, D3D12_RESOURCE_STATE_RENDER_TARGET, 0 }, { &texture, D3D12_RESOURCE_STATE_RENDER_TARGET, 1 } });
+	scheduler.AddPass({ { &texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, 0 } });
+	scheduler.AddPass({});
+	scheduler.AddPass({ { &texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, 1 } });
+	scheduler.Compile();
+
+	REQUIRE(scheduler.GetBarriers(1).size() == 2);
+	CHECK(IsTransition(scheduler.GetBarriers(1)[0], &texture, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_NONE, 0));
+	CHECK(IsTransition(scheduler.GetBarriers(1)[1], &texture, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY, 1));
+	REQUIRE(scheduler.GetBarriers(3).size() == 1);
+	CHECK(IsTransition(scheduler.GetBarriers(3)[0], &texture, D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY, 1));
+	CHECK(scheduler.GetFinalState(&texture, 0) == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	CHECK(scheduler.GetFinalState(&texture, 1) == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
+
+BENCHMARK(SplitBarrierScheduler_SyntheticFrame)
+{
+	// 200 passes over 64 resources. Each pass renders to one or two of them
+	// and samples up to four others, like a frame with many post-processing
+	// passes. Reports how far the split barriers get to stretch.
+	const int passCount = 200;
+	const int resourceCount = 64;
+	std::vector<FakeResource> resources(resourceCount, FakeResource(FakeResource::TextureDesc(1)));
+	std::mt19937 random(11);
+
+	SplitBarrierScheduler scheduler;
+	for (FakeResource& resource : resources)
+		scheduler.SetInitialState(&resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	for (int pass = 0; pass < passCount; ++pass)
+	{
+		std::vector<SplitBarrierScheduler::ResourceUse> uses;
+		const int writes = 1 + random() % 2;
+		for (int i = 0; i < writes; ++i)
+			uses.push_back({ &resources[random() % resourceCount], D3D12_RESOURCE_STATE_RENDER_TARGET });
+		const int reads = random() % 5;
+		for (int i = 0; i < reads; ++i)
+		{
+			ID3D12Resource* resource = &resources[random() % resourceCount];
+			bool written = false;
+			for (const SplitBarrierScheduler::ResourceUse& use : uses)
+				written |= use.Resource == resource;
+			if (!written)
+				uses.push_back({ resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE });
+		}
+		scheduler.AddPass(uses);
+	}
+
+	const int runs = 100;
+	Testing::Stopwatch stopwatch;
+	for (int run = 0; run < runs; ++run)
+		scheduler.Compile();
+	const double seconds = stopwatch.Seconds();
+
+	const SplitBarrierScheduler::Stats& stats = scheduler.GetStats();
+	CHECK(stats.SplitBarriers + stats.ImmediateBarriers > 0);
+	printf("  %d passes, %d resources: %u split, %u immediate barriers; split distance %.2f passes average, %u max;"
+		" Compile %.1f us\n", passCount, resourceCount, stats.SplitBarriers, stats.ImmediateBarriers,
+		stats.AverageDistance(), stats.MaxDistance, seconds * 1e6 / runs);
+}
@@ -0,0 +1,154 @@
+#include "TestFramework.h"
+
+#include "StartupGraph.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace
+{
+	std::function<bool()> Succeed(std::atomic<int>& runs)
+	{
+		return [&runs]() { ++runs; return true; };
+	}
+
+	bool Ran(const StartupGraph& graph, StartupTask task)
+	{
+		return graph.GetTimings()[task].Ran;
+	}
+
+	// Sleeps for 'milliseconds', standing in for a startup stage.
+	std::function<bool()> Work(int milliseconds)
+	{
+		return [milliseconds]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+			return true;
+		};
+	}
+}
+
+TEST_CASE(StartupGraph_FailureSkipsDependents)
+{
+	// Device fails: Command objects and Swap chain, which need it, are
+	// skipped; Window and Assets, which do not, still run.
+	for (int usePool = 0; usePool < 2; ++usePool)
+	{
+		ThreadPool pool(2);
+		StartupGraph graph(usePool ? &pool : nullptr);
+		std::atomic<int> runs{ 0 };
+
+		const StartupTask window = graph.Add(L"Window", Succeed(runs), {}, StartupGraph::Affinity::MainThread);
+		const StartupTask device = graph.Add(L"Device", []() { return false; });
+		const StartupTask commandObjects = graph.Add(L"Command objects", Succeed(runs), { device });
+		const StartupTask swapChain = graph.Add(L"Swap chain", Succeed(runs), { window, commandObjects },
+			StartupGraph::Affinity::MainThread);
+		const StartupTask assets = graph.Add(L"Assets", Succeed(runs));
+
+		CHECK(!graph.Run());
+		CHECK(runs.load() == 2);
+		CHECK(Ran(graph, window) && graph.GetTimings()[window].Succeeded);
+		CHECK(Ran(graph, device) && !graph.GetTimings()[device].Succeeded);
+		CHECK(!Ran(graph, commandObjects));
+		CHECK(!Ran(graph, swapChain));
+		CHECK(Ran(graph, assets));
+	}
+}
+
+TEST_CASE(StartupGraph_ExceptionIsRethrownAfterTheRest)
+{
+	// The throwing task's dependents are skipped like a failure's; the rest
+	// finishes before Run() rethrows on the calling thread.
+	ThreadPool pool(2);
+	StartupGraph graph(&pool);
+	std::atomic<int> runs{ 0 };
+
+	const StartupTask device = graph.Add(L"Device", []() -> bool { throw std::runtime_error("no device"); });
+	const StartupTask dependent = graph.Add(L"Command objects", Succeed(runs), { device });
+	const StartupTask slow = graph.Add(L"Assets", [&runs]()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		++runs;
+		return true;
+	});
+
+	bool caught = false;
+	try
+	{
+		graph.Run();
+	}
+	catch (const std::runtime_error& e)
+	{
+		caught = std::string(e.what()) == "no device";
+	}
+	CHECK(caught);
+	CHECK(runs.load() == 1);
+	CHECK(!Ran(graph, dependent));
+	CHECK(Ran(graph, slow));
+}
+
+TEST_CASE(StartupGraph_MainThreadTasksRunOnCaller)
+{
+	ThreadPool pool(2);
+	StartupGraph graph(&pool);
+	const std::thread::id caller = std::this_thread::get_id();
+	std::atomic<bool> onCaller{ false };
+
+	const StartupTask device = graph.Add(L"Device", Work(5));
+	const StartupTask swapChain = graph.Add(L"Swap chain", [&]()
+	{
+		onCaller = std::this_thread::get_id() == caller;
+		return true;
+	}, { device }, StartupGraph::Affinity::MainThread);
+
+	REQUIRE(graph.Run());
+	CHECK(onCaller.load());
+	CHECK(graph.GetTimings()[swapChain].OnMainThread);
+	CHECK(!graph.GetTimings()[device].OnMainThread);
+}
+
+BENCHMARK(StartupGraph_HeadlessStartup)
+{
+	// D3DApp::Initialize()'s stages and a sample's own tasks, with sleeps
+	// of typical lengths instead of the work, so no window or device is
+	// needed. Run serially (no pool) and as a graph; the critical path is
+	// what the graph cannot shorten.
+	const char* const modes[] = { "serial", "graph, 4 workers" };
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		ThreadPool pool(4);
+		StartupGraph graph(mode == 0 ? nullptr : &pool);
+
+		const StartupTask window = graph.Add(L"Window", Work(30), {}, StartupGraph::Affinity::MainThread);
+		const StartupTask device = graph.Add(L"Device", Work(80));
+		const StartupTask shaderCache = graph.Add(L"Shader cache", Work(2));
+		const StartupTask commandObjects = graph.Add(L"Command objects", Work(10), { device });
+		const StartupTask swapChain = graph.Add(L"Swap chain", Work(15), { window, commandObjects },
+			StartupGraph::Affinity::MainThread);
+		const StartupTask shaders = graph.Add(L"Shaders", Work(60), { shaderCache });
+		const StartupTask pipelines = graph.Add(L"Pipelines", Work(40), { device, shaders });
+		const StartupTask assets = graph.Add(L"Assets", Work(70));
+		graph.Add(L"Upload", Work(20), { assets, commandObjects });
+		graph.Add(L"First frame", Work(5), { swapChain, pipelines });
+
+		CHECK(graph.Run());
+
+		const StartupGraph::Stats& stats = graph.GetStats();
+		printf("  %-16s: %6.1f ms wall, %6.1f ms of tasks\n", modes[mode], stats.WallMilliseconds, stats.SerialMilliseconds);
+
+		// Run serially, tasks also wait for unrelated ones, so there the
+		// path means nothing.
+		if (mode == 1)
+		{
+			std::wstring path;
+			for (StartupTask task : stats.CriticalPath)
+				path += (path.empty() ? L"" : L" -> ") + graph.GetTimings()[task].Name;
+			printf("  critical path %6.1f ms: %ls\n", stats.CriticalPathMilliseconds, path.c_str());
+		}
+	}
+}
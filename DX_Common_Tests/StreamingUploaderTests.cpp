@@ -0,0 +1,344 @@
+#include "TestFramework.h"
+
+#include "D3DUtil.h"
+#include "StreamingUploader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const UINT64 s_RingSize = 64 * 1024;
+
+	// Fake destinations are byte vectors; the uploader never touches a
+	// buffer destination itself.
+	typedef std::vector<BYTE> FakeBuffer;
+
+	ID3D12Resource* AsResource(FakeBuffer& buffer)
+	{
+		return reinterpret_cast<ID3D12Resource*>(&buffer);
+	}
+
+	// A copy queue whose GPU is the test: submitted batches complete when
+	// Complete() says so, or right away with AutoComplete. Copies read the
+	// staging memory when they complete, as the copy engine would, and
+	// notice if it changed since they were submitted.
+	class FakeUploadQueue : public UploadQueue
+	{
+	public:
+		bool AutoComplete = false;
+		bool FailSubmit = false;
+		// Off for benchmarks: copies are only counted.
+		bool Execute = true;
+
+		BYTE* CreateStagingBuffer(UINT64 size) override
+		{
+			m_Staging.resize(static_cast<size_t>(size));
+			return m_Staging.data();
+		}
+
+		// Buffers only; no test uploads a texture.
+		void GetCopyableFootprints(const D3D12_RESOURCE_DESC&, UINT, UINT, D3D12_PLACED_SUBRESOURCE_FOOTPRINT*, UINT*,
+			UINT64*, UINT64* totalBytes) override
+		{
+			*totalBytes = 0;
+		}
+
+		void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 numBytes) override
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			Copy copy = { reinterpret_cast<FakeBuffer*>(dest), destOffset, stagingOffset, numBytes };
+			if (Execute)
+			{
+				const BYTE* staged = m_Staging.data() + stagingOffset;
+				copy.Snapshot.assign(staged, staged + numBytes);
+			}
+			StagingOffsets.push_back(stagingOffset);
+			MaxStagingEnd = std::max(MaxStagingEnd, stagingOffset + numBytes);
+			m_Recording.push_back(std::move(copy));
+		}
+
+		void CopyTexture(ID3D12Resource*, UINT, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT&) override
+		{
+			CHECK(false);
+		}
+
+		UINT64 Submit() override
+		{
+			if (FailSubmit)
+				ThrowIfFailed(DXGI_ERROR_DEVICE_REMOVED);
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Submitted.push_back({ ++m_Signaled, std::move(m_Recording) });
+			m_Recording.clear();
+			if (AutoComplete)
+				CompleteLocked(m_Signaled);
+			return m_Signaled;
+		}
+
+		UINT64 GetCompletedValue() override { return m_Completed; }
+
+		void Wait(ID3D12CommandQueue*, UINT64 fenceValue) override
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			Waits.push_back(fenceValue);
+		}
+
+		// The GPU finishes every batch up to 'fenceValue'.
+		void Complete(UINT64 fenceValue)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			CompleteLocked(fenceValue);
+		}
+
+		void CompleteAll()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			CompleteLocked(m_Signaled);
+		}
+
+		UINT64 Signaled()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_Signaled;
+		}
+
+		// Read after the uploader has gone quiet.
+		std::vector<UINT64> Waits;
+		std::vector<UINT64> StagingOffsets;
+		UINT64 MaxStagingEnd = 0;
+		int Overwritten = 0; // copies whose staging bytes changed before they ran
+
+	private:
+		struct Copy
+		{
+			FakeBuffer* Dest;
+			UINT64 DestOffset;
+			UINT64 StagingOffset;
+			UINT64 NumBytes;
+			std::vector<BYTE> Snapshot;
+		};
+
+		struct Batch
+		{
+			UINT64 FenceValue;
+			std::vector<Copy> Copies;
+		};
+
+		void CompleteLocked(UINT64 fenceValue)
+		{
+			while (!m_Submitted.empty() && m_Submitted.front().FenceValue <= fenceValue)
+			{
+				for (const Copy& copy : m_Submitted.front().Copies)
+				{
+					if (!Execute)
+						continue;
+					const BYTE* staged = m_Staging.data() + copy.StagingOffset;
+					if (memcmp(staged, copy.Snapshot.data(), static_cast<size_t>(copy.NumBytes)) != 0)
+						++Overwritten;
+					memcpy(copy.Dest->data() + copy.DestOffset, staged, static_cast<size_t>(copy.NumBytes));
+				}
+				m_Completed = m_Submitted.front().FenceValue;
+				m_Submitted.erase(m_Submitted.begin());
+			}
+		}
+
+		std::mutex m_Mutex;
+		std::vector<BYTE> m_Staging;
+		std::vector<Copy> m_Recording;
+		std::vector<Batch> m_Submitted;
+		UINT64 m_Signaled = 0;
+		std::atomic<UINT64> m_Completed{ 0 };
+	};
+
+	std::vector<BYTE> Pattern(size_t size, int seed)
+	{
+		std::vector<BYTE> bytes(size);
+		for (size_t i = 0; i < size; ++i)
+			bytes[i] = static_cast<BYTE>(i * 31 + seed * 7 + (i >> 8));
+		return bytes;
+	}
+
+	// Polls 'done' for up to a second.
+	template<typename Predicate>
+	bool WaitUntil(Predicate done)
+	{
+		for (int i = 0; i < 1000 && !done(); ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return done();
+	}
+}
+
+TEST_CASE(StreamingUploader_WrapsAroundTheRing)
+{
+	// Ten 20 KB uploads through a 64 KB ring: producers have to wait for the
+	// GPU, and allocations that do not fit before the end start over at 0.
+	const size_t size = 20000;
+	const int count = 10;
+	std::vector<FakeBuffer> dests(count, FakeBuffer(size));
+	std::vector<std::vector<BYTE>> sources;
+	for (int i = 0; i < count; ++i)
+		sources.push_back(Pattern(size, i));
+
+	FakeUploadQueue queue;
+	{
+		StreamingUploader uploader(&queue, s_RingSize, s_RingSize);
+
+		std::atomic<bool> producing{ true };
+		std::vector<UploadTicket> tickets(count);
+		std::thread producer([&]()
+		{
+			for (int i = 0; i < count; ++i)
+				tickets[i] = uploader.UploadBuffer(AsResource(dests[i]), 0, sources[i].data(), size);
+			producing = false;
+		});
+
+		// The GPU falls behind a little at a time.
+		while (producing)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			queue.CompleteAll();
+		}
+		producer.join();
+		CHECK(WaitUntil([&]() { queue.CompleteAll(); return uploader.IsComplete(tickets[count - 1]); }));
+
+		for (const UploadTicket& ticket : tickets)
+		{
+			CHECK(ticket.IsValid());
+			CHECK(!uploader.IsFailed(ticket));
+		}
+		CHECK(WaitUntil([&]() { return uploader.GetStats().RequestsCompleted == count; }));
+		CHECK(uploader.GetStats().BytesCompleted == size * count);
+	}
+
+	CHECK(queue.Overwritten == 0);
+	CHECK(queue.MaxStagingEnd <= s_RingSize);
+	bool wrapped = false;
+	for (size_t i = 1; i < queue.StagingOffsets.size(); ++i)
+		wrapped = wrapped || queue.StagingOffsets[i] < queue.StagingOffsets[i - 1];
+	CHECK(wrapped);
+	for (int i = 0; i < count; ++i)
+		CHECK(dests[i] == sources[i]);
+}
+
+TEST_CASE(StreamingUploader_RejectsRequestsLargerThanTheRing)
+{
+	// These used to wait for ring space that could never come.
+	FakeUploadQueue queue;
+	queue.AutoComplete = true;
+	StreamingUploader uploader(&queue, s_RingSize);
+
+	FakeBuffer big(s_RingSize + 1);
+	const std::vector<BYTE> source = Pattern(big.size(), 1);
+	const UploadTicket rejected = uploader.UploadBuffer(AsResource(big), 0, source.data(), big.size());
+	CHECK(!rejected.IsValid());
+	CHECK(uploader.IsComplete(rejected));
+
+	// The whole ring still fits, and the uploader carries on afterwards.
+	const UploadTicket whole = uploader.UploadBuffer(AsResource(big), 0, source.data(), s_RingSize);
+	CHECK(whole.IsValid());
+	const UploadTicket small = uploader.UploadBuffer(AsResource(big), 0, source.data(), 100);
+	uploader.Flush();
+	CHECK(uploader.IsComplete(whole));
+	CHECK(uploader.IsComplete(small));
+	CHECK(uploader.GetStats().RequestsCompleted == 2);
+	CHECK(memcmp(big.data(), source.data(), s_RingSize) == 0);
+}
+
+TEST_CASE(StreamingUploader_TicketsRetireWithTheirBatch)
+{
+	FakeUploadQueue queue;
+	StreamingUploader uploader(&queue, s_RingSize);
+	CHECK(uploader.IsComplete(UploadTicket()));
+
+	FakeBuffer dest(256);
+	const std::vector<BYTE> source = Pattern(dest.size(), 2);
+	const UploadTicket ticket = uploader.UploadBuffer(AsResource(dest), 0, source.data(), dest.size());
+	REQUIRE(WaitUntil([&]() { return queue.Signaled() == 1; }));
+
+	// Submitted, not finished: the GPU can be made to wait on it.
+	CHECK(!uploader.IsComplete(ticket));
+	CHECK(uploader.QueueWait(nullptr, ticket));
+	REQUIRE(queue.Waits.size() == 1);
+	CHECK(queue.Waits[0] == 1);
+
+	// Complete as soon as the fence is, before the worker gets round to it.
+	queue.Complete(1);
+	CHECK(uploader.IsComplete(ticket));
+	CHECK(WaitUntil([&]() { return uploader.GetStats().RequestsCompleted == 1; }));
+	CHECK(uploader.GetStats().BatchesSubmitted == 1);
+	CHECK(uploader.GetStats().BytesCompleted == dest.size());
+
+	// Retired: nothing left to wait for.
+	CHECK(uploader.QueueWait(nullptr, ticket));
+	CHECK(queue.Waits.size() == 1);
+	CHECK(dest == source);
+}
+
+TEST_CASE(StreamingUploader_WorkerErrorFailsTickets)
+{
+	FakeUploadQueue queue;
+	queue.FailSubmit = true;
+	StreamingUploader uploader(&queue, s_RingSize);
+
+	FakeBuffer dest(256);
+	const std::vector<BYTE> source = Pattern(dest.size(), 3);
+	const UploadTicket ticket = uploader.UploadBuffer(AsResource(dest), 0, source.data(), dest.size());
+	CHECK(WaitUntil([&]() { return uploader.IsComplete(ticket); }));
+	CHECK(uploader.IsFailed(ticket));
+	CHECK(uploader.QueueWait(nullptr, ticket));
+	CHECK(queue.Waits.empty());
+	CHECK(uploader.GetStats().RequestsFailed == 1);
+	CHECK(uploader.GetStats().RequestsCompleted == 0);
+
+	// Returns instead of waiting for the worker that is gone.
+	uploader.Flush();
+	const UploadTicket later = uploader.UploadBuffer(AsResource(dest), 0, source.data(), dest.size());
+	CHECK(!later.IsValid());
+}
+
+BENCHMARK(StreamingUploader_Throughput)
+{
+	// CPU side only: staging memcpy, ring bookkeeping and batching, against
+	// a GPU that finishes instantly. Real copy engine bandwidth is not in it.
+	const UINT64 total = 256ull * 1024 * 1024;
+	const UINT64 sizes[] = { 4 * 1024, 64 * 1024, 1024 * 1024 };
+	for (UINT64 size : sizes)
+	{
+		for (int threads = 1; threads <= 4; threads *= 4)
+		{
+			FakeUploadQueue queue;
+			queue.AutoComplete = true;
+			queue.Execute = false;
+			StreamingUploader uploader(&queue);
+			const std::vector<BYTE> source = Pattern(static_cast<size_t>(size), 4);
+
+			Testing::Stopwatch stopwatch;
+			std::vector<std::thread> producers;
+			for (int t = 0; t < threads; ++t)
+			{
+				producers.emplace_back([&]()
+				{
+					for (UINT64 sent = 0; sent < total / threads; sent += size)
+						uploader.UploadBuffer(reinterpret_cast<ID3D12Resource*>(1), 0, source.data(), size);
+				});
+			}
+			for (std::thread& producer : producers)
+				producer.join();
+			uploader.Flush();
+			const double seconds = stopwatch.Seconds();
+
+			const StreamingUploader::Stats stats = uploader.GetStats();
+			CHECK(stats.BytesCompleted == total);
+			printf("  %7llu KB requests, %d thread%s: %7.0f MB/s, %5llu batches, %.3f ms mean latency\n",
+				size / 1024, threads, threads > 1 ? "s" : " ", total / seconds / (1024.0 * 1024.0),
+				stats.BatchesSubmitted, stats.TotalLatencySeconds * 1000.0 / stats.RequestsCompleted);
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+// == Test framework ==
+//
+// Just enough to run DX_Common's device-free logic from the command line.
+// TEST_CASE registers a function before main() runs; CHECK records a
+// failure and carries on, REQUIRE records it and leaves the test, for
+// checks later lines depend on.
+//
+// Test names start with the module they cover, so "DX_Common_Tests
+// RootSignature" runs the root signature tests only.
+//
+// BENCHMARK registers the same way but only runs with --benchmark
+// ("DX_Common_Tests --benchmark StreamingUploader"), which runs no tests.
+// Benchmarks print their own numbers; build Release to take them seriously.
+namespace Testing
+{
+	typedef void (*TestFunction)();
+
+	struct TestCase
+	{
+		const char* Name;
+		TestFunction Function;
+		bool IsBenchmark;
+	};
+
+	std::vector<TestCase>& Registry();
+
+	struct Registrar
+	{
+		Registrar(const char* name, TestFunction function, bool isBenchmark = false)
+		{
+			Registry().push_back({ name, function, isBenchmark });
+		}
+	};
+
+	// 'macro' is the check that failed: CHECK or REQUIRE.
+	void ReportFailure(const char* file, int line, const char* macro, const char* expression);
+
+	// Wall-clock time since construction, for benchmarks.
+	class Stopwatch
+	{
+	public:
+		Stopwatch() : m_Start(std::chrono::steady_clock::now()) {}
+
+		double Seconds() const
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_Start;
+	};
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static const Testing::Registrar name##Registrar(#name, &name); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static const Testing::Registrar name##Registrar(#name, &name, true); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) Testing::ReportFailure(__FILE__, __LINE__, "CHECK", #expression); } while (false)
+
+#define REQUIRE(expression) \
+	do { if (!(expression)) { Testing::ReportFailure(__FILE__, __LINE__, "REQUIRE", #expression); return; } } while (false)
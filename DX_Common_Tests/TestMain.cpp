@@ -0,0 +1,68 @@
+#include "TestFramework.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	int s_Failures = 0;
+}
+
+std::vector<Testing::TestCase>& Testing::Registry()
+{
+	// Function-local so registration from other files' static
+	// initializers never sees it unconstructed.
+	static std::vector<TestCase> s_Registry;
+	return s_Registry;
+}
+
+void Testing::ReportFailure(const char* file, int line, const char* macro, const char* expression)
+{
+	std::printf("  %s(%d): %s(%s) failed\n", file, line, macro, expression);
+	++s_Failures;
+}
+
+// Runs every test, or those whose name contains the filter argument; with
+// --benchmark first, the benchmarks instead. The exit code is the number of
+// failed tests.
+int main(int argc, char* argv[])
+{
+	int arg = 1;
+	const bool benchmarks = arg < argc && std::strcmp(argv[arg], "--benchmark") == 0;
+	if (benchmarks)
+		++arg;
+	const char* filter = arg < argc ? argv[arg] : nullptr;
+
+	int run = 0;
+	int failed = 0;
+	for (const Testing::TestCase& test : Testing::Registry())
+	{
+		if (test.IsBenchmark != benchmarks)
+			continue;
+		if (filter != nullptr && std::strstr(test.Name, filter) == nullptr)
+			continue;
+
+		std::printf("[ RUN  ] %s\n", test.Name);
+		const int failuresBefore = s_Failures;
+		try
+		{
+			test.Function();
+		}
+		catch (...)
+		{
+			// DxException is not a std::exception; the message is not needed to
+			// tell that the test failed.
+			std::printf("  unexpected exception\n");
+			++s_Failures;
+		}
+
+		const bool passed = s_Failures == failuresBefore;
+		std::printf("[ %s ] %s\n", passed ? " OK " : "FAIL", test.Name);
+		++run;
+		if (!passed)
+			++failed;
+	}
+
+	std::printf("%d %s, %d failed\n", run, benchmarks ? "benchmarks" : "tests", failed);
+	return failed;
+}